@@ -33,6 +33,22 @@ private:
     bool getDefaultOpenDb(QSqlDatabase& outDb) const;
     void createUsersTable(QSqlDatabase& db);
     void createTreeNodesTable(QSqlDatabase& db);
+    // Индекс предков для tree_nodes: материализованный путь "/1/5/9/" + триггеры синхронизации
+    void createTreePathIndex(QSqlDatabase& db);
+    // Счётчик версий узла tree_nodes для инкрементального обновления дерева
+    void createTreeVersionTracking(QSqlDatabase& db);
+    // Число потомков узла tree_nodes, поддерживаемое триггерами по материализованному пути
+    void createTreeDescendantCounts(QSqlDatabase& db);
+    // Полнотекстовый (триграммный) индекс FTS5 по tree_nodes.name
+    void createTreeSearchIndex(QSqlDatabase& db);
+    // Постоянный счетчик изменений tree_nodes (для проверки актуальности снимка дерева)
+    void createTreeChangeCounter(QSqlDatabase& db);
+    // Ключ порядка братьев tree_nodes.order_key (дробный индекс, см. OrderKey)
+    void createTreeSiblingOrder(QSqlDatabase& db);
+    // Таблицы листов TableDataModel: sheets, sheet_columns, sheet_rows, sheet_cells
+    void createSheetTables(QSqlDatabase& db);
+    bool columnExists(QSqlDatabase& db, const QString& tableName, const QString& columnName) const;
+    bool execStatements(QSqlDatabase& db, const QStringList& statements, const QString& context);
     //QSqlDatabase db;
     //QList<QString> connectionNames;
 };
@@ -243,6 +243,20 @@ public:
     int batchDelete(const QString& tableName, const QVariantList& ids,
                    const QString& idColumn = "id");
 
+    /**
+     * @brief Выполнить один prepared statement для набора параметров
+     *
+     * Запрос подготавливается один раз. Вне транзакции строки фиксируются
+     * пакетами по batchSize в локальных транзакциях; внутри уже открытой
+     * транзакции (executeInTransaction) пакеты не создаются.
+     *
+     * @param query SQL-запрос с плейсхолдерами (?)
+     * @param rows Списки значений для каждого выполнения
+     * @param batchSize Размер пакета (0 = без локальных транзакций)
+     * @return Количество успешных выполнений (-1 при ошибке; выполнение прекращается на первой ошибке)
+     */
+    int batchExecute(const QString& query, const QList<QVariantList>& rows, int batchSize = 500);
+
     // ========================================
     // === СПЕЦИАЛИЗИРОВАННЫЕ ОПЕРАЦИИ ===
     // ========================================
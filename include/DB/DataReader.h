@@ -12,6 +12,7 @@
 #include <QSqlField>
 #include <QSqlDriver>
 #include <QSqlIndex>
+#include <functional>
 
 
 /**
@@ -39,6 +40,8 @@ public:
 
     void setConnectionName(const QString& connectionName);
 
+    QString getConnectionName() const;
+
     // === БАЗОВЫЕ ОПЕРАЦИИ ЧТЕНИЯ ===
 
     /**
@@ -310,6 +313,23 @@ public:
     QList<QSqlRecord> selectWithPagination(const QString& tableName, int page, int pageSize,
                                           const QString& orderBy = QString()) const;
 
+    /**
+     * @brief Выбрать страницу по ключу (keyset-пагинация)
+     *
+     * В отличие от LIMIT/OFFSET стоимость не зависит от номера страницы:
+     * чтение начинается сразу с позиции afterKey по индексу ключевой колонки.
+     *
+     * @param tableName Имя таблицы
+     * @param keyColumn Уникальная индексированная колонка, задающая порядок
+     * @param afterKey Ключ последней строки предыдущей страницы (невалидный = с начала)
+     * @param limit Размер страницы
+     * @param columns Колонки для выборки (пустой список = все колонки)
+     * @return Записи страницы, упорядоченные по keyColumn
+     */
+    QList<QSqlRecord> selectKeysetPage(const QString& tableName, const QString& keyColumn,
+                                       const QVariant& afterKey, int limit,
+                                       const QStringList& columns = QStringList()) const;
+
     /**
      * @brief Выбрать уникальные значения колонок
      * @param tableName Имя таблицы
@@ -318,6 +338,20 @@ public:
      */
     QList<QSqlRecord> selectDistinct(const QString& tableName, const QStringList& columns) const;
 
+    /**
+     * @brief Потоково обойти результат запроса без накопления в памяти
+     *
+     * Курсор работает в режиме forward-only, поэтому память не зависит от числа строк.
+     * Обход прекращается, если callback вернул false.
+     *
+     * @param query SQL-запрос с плейсхолдерами (?)
+     * @param bindValues Значения для подстановки
+     * @param callback Обработчик очередной строки
+     * @return Количество обработанных строк (-1 при ошибке)
+     */
+    int forEachRecord(const QString& query, const QVariantList& bindValues,
+                      const std::function<bool(const QSqlRecord&)>& callback) const;
+
     // === АНАЛИЗ И СТАТИСТИКА ДАННЫХ ===
 
     // === СТАТИСТИКА ПО ТАБЛИЦАМ ===
@@ -390,6 +424,69 @@ public:
     QList<QSqlRecord> selectByPattern(const QString& tableName, const QString& columnName,
                                      const QString& pattern) const;
 
+    /**
+     * @brief Постраничный полнотекстовый поиск подстроки через FTS5-индекс
+     *
+     * Страницы выбираются по ключу (id > afterId), поэтому каждая следующая
+     * страница стоит столько же, сколько первая. Для терминов короче трех
+     * символов (триграммы не применимы) или без FTS-таблицы используется LIKE.
+     *
+     * @param tableName Имя таблицы с данными
+     * @param ftsTableName Имя FTS5-таблицы (content_rowid = id)
+     * @param columnName Имя текстовой колонки
+     * @param searchTerm Искомая подстрока
+     * @param afterId Вернуть только записи с id больше этого значения
+     * @param limit Максимальный размер страницы
+     * @return Полные записи найденных строк, отсортированные по id
+     */
+    QList<QSqlRecord> searchFullText(const QString& tableName, const QString& ftsTableName,
+                                     const QString& columnName, const QString& searchTerm,
+                                     qint64 afterId, int limit) const;
+
+    // === ИЕРАРХИЯ (МАТЕРИАЛИЗОВАННЫЙ ПУТЬ) ===
+    // Методы рассчитаны на таблицы вида tree_nodes с колонками id, parent_id и path,
+    // где path = "/<id корня>/.../<id узла>/" поддерживается триггерами (см. DBConnection)
+
+    /**
+     * @brief Разобрать материализованный путь в список ID
+     * @param path Путь вида "/1/5/9/"
+     * @return ID от корня до узла включительно
+     */
+    static QList<qint64> parsePath(const QString& path);
+
+    /**
+     * @brief Получить ID всех предков узла (без обращения к родителям по одному)
+     * @param tableName Имя таблицы дерева
+     * @param nodeId ID узла
+     * @return ID предков от корня до непосредственного родителя
+     */
+    QList<qint64> getAncestorIds(const QString& tableName, const QVariant& nodeId) const;
+
+    /**
+     * @brief Выбрать записи предков узла (хлебные крошки)
+     * @param tableName Имя таблицы дерева
+     * @param nodeId ID узла
+     * @return Записи предков от корня до непосредственного родителя
+     */
+    QList<QSqlRecord> selectAncestors(const QString& tableName, const QVariant& nodeId) const;
+
+    /**
+     * @brief Выбрать всех потомков узла одним range scan по индексу path
+     * @param tableName Имя таблицы дерева
+     * @param nodeId ID узла
+     * @return Записи потомков в порядке обхода в глубину (узел не включается)
+     */
+    QList<QSqlRecord> selectDescendants(const QString& tableName, const QVariant& nodeId) const;
+
+    /**
+     * @brief Проверить, лежит ли узел в поддереве другого узла
+     * @param tableName Имя таблицы дерева
+     * @param nodeId ID проверяемого узла
+     * @param ancestorId ID предполагаемого предка
+     * @return true если ancestorId - строгий предок nodeId
+     */
+    bool isDescendantOf(const QString& tableName, const QVariant& nodeId, const QVariant& ancestorId) const;
+
     // === УТИЛИТЫ ===
 
     /**
@@ -0,0 +1,45 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+
+/**
+ * @brief Дробные лексикографические ключи порядка
+ *
+ * Ключ - строка из цифр base-62 ("0-9A-Za-z"), которая интерпретируется как дробь
+ * 0.k1k2k3... Между любыми двумя ключами всегда можно построить новый, поэтому
+ * вставка или перемещение элемента меняет ровно одну строку и не требует
+ * перенумерации соседей. Порядок ключей совпадает с побайтовым сравнением строк
+ * (BINARY-коллация SQLite и QString::operator<).
+ *
+ * Генерируемые ключи никогда не заканчиваются на '0' - иначе между "x" и "x0"
+ * не нашлось бы места.
+ */
+class OrderKey {
+public:
+    /**
+     * @brief Построить ключ строго между двумя ключами
+     * @param before Ключ предыдущего элемента (пустой = начало списка)
+     * @param after Ключ следующего элемента (пустой = конец списка)
+     * @return Новый ключ; пустая строка, если before >= after
+     */
+    static QString between(const QString& before, const QString& after);
+
+    /**
+     * @brief Построить count ключей между двумя ключами, равномерно
+     *
+     * Используется для массовой вставки: длина ключей растет как log(count),
+     * а не линейно, как при последовательных вызовах between(last, "").
+     *
+     * @param before Нижняя граница (пустой = начало списка)
+     * @param after Верхняя граница (пустой = конец списка)
+     * @param count Количество ключей
+     * @return Отсортированный по возрастанию список ключей
+     */
+    static QStringList sequence(const QString& before, const QString& after, int count);
+
+private:
+    static QString midpoint(const QString& before, const QString& after);
+    static QString increment(const QString& key);
+    static void fillSequence(const QString& before, const QString& after, int count, QStringList& out);
+    static int digitIndex(QChar digit);
+};
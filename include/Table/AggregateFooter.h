@@ -0,0 +1,38 @@
+#pragma once
+#include <QWidget>
+#include <QPointer>
+#include <QString>
+
+class QHeaderView;
+class TableDataModel;
+
+// Строка итогов под таблицей: по ячейке на столбец, выровненной по секциям
+// горизонтального заголовка. Итоги берутся из кеша TableDataModel::columnAggregates
+// и запрашиваются только для видимых столбцов; для разреженного и плиточного
+// хранилища они считаются в пуле потоков, ячейка пуста до сигнала готовности.
+// Итоги относятся ко всему столбцу, а не только к отфильтрованным строкам
+class AggregateFooter : public QWidget
+{
+    Q_OBJECT
+public:
+    enum class Function { Sum, Mean, Min, Max, Count, NullCount };
+
+    AggregateFooter(QHeaderView *header, QWidget *parent = nullptr);
+
+    void setSourceModel(TableDataModel *model);
+    void setFunction(Function function);
+    Function function() const { return m_function; }
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void contextMenuEvent(QContextMenuEvent *event) override;
+
+private:
+    QHeaderView *m_header;
+    QPointer<TableDataModel> m_model;
+    Function m_function = Function::Sum;
+
+    QString cellText(int column) const;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <QStyledItemDelegate>
+#include <QStaticText>
+#include <QCache>
+#include <QFont>
+#include <QPointer>
+#include <QString>
+#include <QtGlobal>
+
+class QAbstractItemModel;
+
+// Делегат ячеек MainTable с кешем отрисовки.
+//
+// Стандартный делегат на каждой перерисовке заново запрашивает у модели все роли,
+// форматирует QVariant и раскладывает текст. Здесь для ячейки кешируется
+// отформатированная строка и QStaticText, обрезанный под ширину ячейки: при смене
+// ширины заново раскладывается только текст, при правке (dataChanged) запись
+// удаляется. Перестановка/вставка строк и столбцов и смена шрифта очищают кеш.
+// Ключ - (строка, столбец), а не версия ячейки: модель меняет значения только с
+// dataChanged, а позиции - только с сигналами структуры, и запись удаляется в тот же
+// момент, когда версия бы сменилась. Ширина хранится в записи.
+// Модель листа отдает только DisplayRole, поэтому остальные роли не запрашиваются
+class CachedCellDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+public:
+    static constexpr int MaxCachedCells = 16384;  // несколько экранов ячеек
+
+    explicit CachedCellDelegate(QObject *parent = nullptr);
+
+    // Модель представления: ее сигналы сбрасывают кеш
+    void setModel(QAbstractItemModel *model);
+    void clear();
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const override;
+
+    qint64 cacheHits() const { return m_hits; }
+    qint64 cacheMisses() const { return m_misses; }
+
+private:
+    struct Entry
+    {
+        QString text;        // отформатированное значение
+        QStaticText layout;  // text, обрезанный под width
+        int width = -1;
+    };
+
+    QPointer<QAbstractItemModel> m_model;
+    mutable QCache<quint64, Entry> m_cache;
+    mutable QFont m_font;
+    mutable qint64 m_hits = 0;
+    mutable qint64 m_misses = 0;
+
+    static quint64 key(int row, int column) { return (quint64(quint32(row)) << 32) | quint32(column); }
+    void onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight);
+};
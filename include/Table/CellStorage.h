@@ -0,0 +1,46 @@
+#pragma once
+#include <QVariant>
+#include <QtGlobal>
+#include <functional>
+#include <memory>
+
+// Интерфейс хранилища ячеек TableDataModel.
+// Реализации: ColumnStorage (плотные типизированные колонки), SparseStorage
+// (только заполненные ячейки) и TiledStorage (плитки с выгрузкой на диск);
+// модель переключается между ними по заполненности и объему памяти
+class CellStorage
+{
+public:
+    enum class Kind { Columnar, Sparse, Tiled };
+
+    virtual ~CellStorage() = default;
+
+    virtual Kind kind() const = 0;
+
+    virtual int rowCount() const = 0;
+    virtual int columnCount() const = 0;
+
+    virtual QVariant value(int row, int column) const = 0;
+    // Невалидный QVariant очищает ячейку
+    virtual void setValue(int row, int column, const QVariant &value) = 0;
+
+    virtual void insertRows(int row, int count) = 0;
+    virtual void removeRows(int row, int count) = 0;
+    virtual void insertColumns(int column, int count) = 0;
+    virtual void removeColumns(int column, int count) = 0;
+
+    // Число непустых ячеек
+    virtual qint64 filledCellCount() const = 0;
+    // Обход непустых ячеек: внутри колонки строки идут по возрастанию
+    // (колонки - по порядку, у TiledStorage - полосами)
+    virtual void forEachValue(const std::function<void(int row, int column, const QVariant &value)> &visitor) const = 0;
+
+    // Приблизительный объем памяти в байтах
+    virtual qint64 memoryUsage() const = 0;
+
+    // Неизменяемая копия содержимого (копирование при записи): колонки общие с хранилищем,
+    // первая запись в колонку после снимка копирует только эту колонку (у ColumnStorage -
+    // только затронутые блоки колонки). Снимок читается
+    // из любого потока без storage lock. nullptr - хранилище снимки не поддерживает
+    virtual std::shared_ptr<const CellStorage> snapshot() const { return nullptr; }
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <QVector>
+#include <QVariant>
+#include <QtGlobal>
+#include <limits>
+
+class CellStorage;
+
+// Итоги по столбцу для строки итогов таблицы.
+// sum/min/max/mean считаются по числовым ячейкам, count/nullCount - по всем
+struct ColumnAggregates
+{
+    qint64 count = 0;         // непустые ячейки
+    qint64 nullCount = 0;
+    qint64 numericCount = 0;
+    double sum = 0.0;
+    double min = std::numeric_limits<double>::quiet_NaN();
+    double max = std::numeric_limits<double>::quiet_NaN();
+
+    double mean() const { return numericCount > 0 ? sum / double(numericCount) : std::numeric_limits<double>::quiet_NaN(); }
+
+    static ColumnAggregates compute(const CellStorage &storage, int column);
+};
+
+// Ядра для типизированных буферов TableColumn: полностью заполненные блоки по 64 строки
+// (слово битовой карты = ~0) считаются векторно (SSE2), остальные ячейки - скалярно.
+// Без SSE2 используется только скалярный путь
+namespace AggregateKernels {
+    void accumulate(const double *data, const quint64 *valid, int rowCount, ColumnAggregates &out);
+    void accumulate(const qint64 *data, const quint64 *valid, int rowCount, ColumnAggregates &out);
+}
+
+// Кеш итогов модели. Правка одной ячейки обновляет count/sum без пересчета;
+// столбец пересчитывается целиком, только если ушло крайнее значение min/max.
+// Версия столбца меняется при любой правке и сдвиге: итог, посчитанный в фоне
+// по старой версии, не сохраняется
+class AggregateCache
+{
+public:
+    void clear();
+    void invalidate(int column);
+    void insertColumns(int column, int count);
+    void removeColumns(int column, int count);
+    void insertRows(int count);
+    void cellChanged(int column, const QVariant &oldValue, const QVariant &newValue);
+
+    const ColumnAggregates &get(const CellStorage &storage, int column);
+    // Готовый итог или nullptr
+    const ColumnAggregates *find(int column) const;
+    quint64 version(int column, int columnCount);
+    void store(int column, quint64 version, const ColumnAggregates &value);
+
+private:
+    struct Entry
+    {
+        ColumnAggregates value;
+        bool valid = false;
+        quint64 version = 0;
+    };
+
+    QVector<Entry> m_entries;
+    quint64 m_version = 0;
+
+    Entry freshEntry() { Entry entry; entry.version = ++m_version; return entry; }
+    void touch(Entry &entry) { entry.valid = false; entry.version = ++m_version; }
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <QString>
+#include <QVector>
+#include <QVariant>
+#include <QHash>
+#include <QPair>
+#include <QtGlobal>
+#include <functional>
+
+// Формула вычисляемого столбца листа.
+//
+// Выражение над значениями той же строки: числа, ссылки на столбцы [Имя],
+// + - * / и скобки, cumsum(выражение) - нарастающий итог выражения сверху вниз.
+// Ссылки хранятся по стабильным id столбцов (SheetTracker), поэтому вставка и
+// переименование других столбцов формулу не ломают; в БД пишется текст со
+// ссылками вида [#id]. Текст компилируется в обратную польскую запись, строка
+// вычисляется без выделения памяти. Пустое или нечисловое значение, деление
+// на ноль дают NaN - пустую ячейку (в cumsum такие строки пропускаются)
+class ColumnFormula
+{
+public:
+    // resolveName: имя столбца -> id (-1, если столбца нет); ссылки [#id] не разрешаются
+    bool compile(const QString &text, const std::function<qint64(const QString &name)> &resolveName = {});
+    QString getLastError() const { return m_lastError; }
+
+    // Текст для пользователя (columnName: id -> текущее имя) и для хранения
+    QString displayText(const std::function<QString(qint64 id)> &columnName) const;
+    QString storedText() const;
+
+    // id столбцов-аргументов без повторов; evaluate получает значения в этом порядке
+    const QVector<qint64> &inputs() const { return m_inputs; }
+    // Число нарастающих итогов: их состояние переходит от строки к строке
+    int cumulativeCount() const { return m_cumulativeCount; }
+    bool isCumulative() const { return m_cumulativeCount > 0; }
+
+    // sums - состояние cumulativeCount() итогов, обновляется на месте
+    double evaluate(const double *inputs, double *sums) const;
+
+    // Столбцы пересоздались с новыми id (отмена удаления)
+    void remapInputs(const QHash<qint64, qint64> &ids);
+
+    // Число из значения ячейки; NaN - пусто или не число
+    static double toNumber(const QVariant &value);
+
+private:
+    enum class Op : quint8 { Number, Input, Add, Sub, Mul, Div, Neg, CumSum };
+    struct Instruction
+    {
+        Op op;
+        int slot;  // Input - индекс в m_inputs, CumSum - индекс итога
+        double number;
+    };
+
+    QVector<Instruction> m_program;
+    QVector<qint64> m_inputs;
+    int m_cumulativeCount = 0;
+    int m_stackDepth = 0;
+    // Исходный текст: литеральные куски и ссылки (id >= 0) по порядку
+    QVector<QPair<QString, qint64>> m_parts;
+    QString m_lastError;
+
+    class Parser;
+};
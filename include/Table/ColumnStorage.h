@@ -0,0 +1,130 @@
+#pragma once
+#include <QVariant>
+#include <QString>
+#include <QStringView>
+#include <QtGlobal>
+#include <vector>
+#include <memory>
+#include "CellStorage.h"
+
+// Одна колонка таблицы в колоночном формате.
+//
+// Значения хранятся в типизированном буфере: Int64 и Double - 8 байт на ячейку,
+// String - ссылка (смещение, длина) в UTF-16 пул, Variant - QVariant
+// как запасной вариант для смешанных данных. Пустые ячейки отмечаются в битовой карте.
+// Пока в колонке нет ни одного значения, буферы не выделяются.
+// Буферы разбиты на блоки по ChunkRows строк со своим пулом строк. Копия колонки
+// разделяет блоки: запись копирует один блок, вставка/удаление строк - блоки от
+// правленой строки до конца, блоки выше остаются общими
+class TableColumn
+{
+public:
+    enum class Type { Int64, Double, String, Variant };
+
+    // Кратно 64: слова битовой карты не пересекают границу блока
+    static constexpr int ChunkRows = 4096;
+
+    explicit TableColumn(int rowCount = 0);
+
+    Type type() const { return m_type; }
+    int rowCount() const { return m_rowCount; }
+    int nonNullCount() const { return m_nonNullCount; }
+
+    bool isNull(int row) const;
+    QVariant value(int row) const;
+    // Значение другого типа переводит колонку в Variant (или меняет тип пустой колонки)
+    void setValue(int row, const QVariant &value);
+
+    void insertRows(int row, int count);
+    void removeRows(int row, int count);
+
+    // Непустая ячейка колонки Int64/Double без обертки в QVariant
+    qint64 int64At(int row) const { return chunkAt(row).ints[row % ChunkRows]; }
+    double doubleAt(int row) const { return chunkAt(row).doubles[row % ChunkRows]; }
+    QStringView stringAt(int row) const;
+
+    // Прямой доступ к буферам блока для вычислений по колонке (nullptr, если буфер не выделен).
+    // Пока буферы не выделены, блоков нет
+    int chunkCount() const { return static_cast<int>(m_chunks.size()); }
+    int chunkRowCount(int chunk) const { return qMin(ChunkRows, m_rowCount - chunk * ChunkRows); }
+    const qint64 *int64Data(int chunk) const;
+    const double *doubleData(int chunk) const;
+    const quint64 *validityBits(int chunk) const;
+
+    qint64 memoryUsage() const;
+
+    static Type typeForValue(const QVariant &value);
+
+private:
+    struct StringRef
+    {
+        quint32 offset;
+        quint32 length;
+    };
+
+    struct Chunk
+    {
+        std::vector<quint64> valid;  // бит на ячейку: 1 - есть значение
+        std::vector<qint64> ints;
+        std::vector<double> doubles;
+        std::vector<StringRef> strings;
+        QString stringPool;
+        qsizetype stringGarbage = 0;  // символы пула, на которые больше никто не ссылается
+        std::vector<QVariant> variants;
+    };
+
+    Type m_type = Type::Int64;
+    int m_rowCount = 0;
+    int m_nonNullCount = 0;
+    bool m_allocated = false;
+    std::vector<std::shared_ptr<Chunk>> m_chunks;
+
+    const Chunk &chunkAt(int row) const { return *m_chunks[row / ChunkRows]; }
+    // Блок для записи: общий с другой копией колонки копируется
+    Chunk &detachChunk(int chunk);
+    std::shared_ptr<Chunk> makeChunk(int rows) const;
+
+    void allocate();
+    void reset(Type type);
+    void convertToVariant();
+    void rebuildTail(int row, int inserted, int removed);
+    void copyCell(int row, Chunk &target, int index) const;
+    static void releaseString(Chunk &chunk, int index);
+    static void compactStrings(Chunk &chunk);
+};
+
+// Колоночное хранилище ячеек TableDataModel.
+// Вставка/удаление столбца не трогает данные остальных столбцов.
+// Колонки разделяются со снимками и копируются при первой записи; копия колонки
+// дешевая - блоки данных остаются общими, пока их не тронет правка
+class ColumnStorage : public CellStorage
+{
+public:
+    Kind kind() const override { return Kind::Columnar; }
+
+    int rowCount() const override { return m_rowCount; }
+    int columnCount() const override { return static_cast<int>(m_columns.size()); }
+
+    QVariant value(int row, int column) const override;
+    void setValue(int row, int column, const QVariant &value) override;
+
+    void insertRows(int row, int count) override;
+    void removeRows(int row, int count) override;
+    void insertColumns(int column, int count) override;
+    void removeColumns(int column, int count) override;
+
+    qint64 filledCellCount() const override;
+    void forEachValue(const std::function<void(int row, int column, const QVariant &value)> &visitor) const override;
+
+    const TableColumn &column(int column) const { return *m_columns[column]; }
+
+    qint64 memoryUsage() const override;
+    std::shared_ptr<const CellStorage> snapshot() const override;
+
+private:
+    std::vector<std::shared_ptr<TableColumn>> m_columns;
+    int m_rowCount = 0;
+
+    // Колонка для записи: общая со снимком копируется
+    TableColumn &detach(int column);
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <QVariant>
+#include <QVector>
+#include <QStringView>
+#include <QFuture>
+#include <QtGlobal>
+
+class TableDataModel;
+class CellStorage;
+
+// Объявленный тип столбца листа. Auto - без схемы: значения хранятся как введены.
+// Значения перечисления сохраняются в sheet_columns.value_type - не переставлять
+enum class ColumnType { Auto = 0, Int = 1, Double = 2, Date = 3, Bool = 4, Text = 5 };
+
+struct ColumnTypeGuess
+{
+    ColumnType type = ColumnType::Auto;  // Auto - в выборке только пустые ячейки
+    int sampled = 0;                     // непустых ячеек в выборке
+    int matched = 0;                     // из них подходят под type
+};
+
+// Определение типов столбцов по выборке ячеек.
+//
+// Из столбца берется до SampleSize непустых ячеек равномерно по строкам; столбцы
+// с числовым буфером TableColumn определяются сразу. Тип выбирается, если под него
+// подходит не меньше 95% выборки (Int, затем Double, Bool, Date), иначе Text.
+// Большие листы обрабатываются по столбцам в пуле потоков по снимку листа
+// (TableDataModel::snapshot), правка во время разбора не ждет его окончания
+namespace ColumnTypeInference {
+    constexpr int SampleSize = 1000;
+
+    ColumnType classify(const QVariant &value);
+    ColumnType classifyText(QStringView text);
+
+    ColumnTypeGuess inferColumn(const CellStorage &storage, int column);
+    QFuture<QVector<ColumnTypeGuess>> inferColumnsAsync(const TableDataModel *model);
+
+    // Значение в представлении типа; при неудаче ok = false и возвращается исходное
+    QVariant coerce(const QVariant &value, ColumnType type, bool *ok = nullptr);
+}
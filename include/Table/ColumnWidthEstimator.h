@@ -0,0 +1,73 @@
+#pragma once
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QList>
+#include <QVector>
+#include <QFont>
+#include <QPointer>
+#include <QtGlobal>
+#include <optional>
+
+class TableDataModel;
+template <typename T> class QFutureWatcher;
+
+// Ширина столбцов по содержимому без просмотра всех ячеек.
+//
+// Измеряется текст заголовка и стратифицированная выборка строк: первые и последние
+// EdgeRows строк и по одной строке из каждой из SampleStrata равных полос листа
+// (строка внутри полосы выбирается детерминированно). Измерение идет в пуле потоков:
+// значения выборки копируются под storageLock() на чтение по одному столбцу, текст
+// измеряется уже без блокировки. Результат кешируется по столбцу до правки его ячеек,
+// заголовка или смены шрифта; столбцы, измененные во время измерения, не кешируются
+class ColumnWidthEstimator : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int SampleStrata = 512;
+    static constexpr int EdgeRows = 16;
+    static constexpr int MaxWidth = 600;  // длинный текст не растягивает столбец на весь экран
+
+    explicit ColumnWidthEstimator(TableDataModel *model, QObject *parent = nullptr);
+    ~ColumnWidthEstimator();
+
+    // -1 - ширина не измерена или устарела
+    int cachedWidth(int column) const { return m_cache.value(column, -1); }
+
+    // Ширины столбцов приходят сигналом widthsReady (известные из кеша - без фоновой задачи).
+    // padding добавляется к тексту ячеек, headerPadding - к тексту заголовка
+    void estimate(const QList<int> &columns, const QFont &font, const QFont &headerFont,
+                  int padding, int headerPadding);
+    bool isBusy() const;
+
+signals:
+    void widthsReady(const QHash<int, int> &widths);
+
+private:
+    QPointer<TableDataModel> m_model;
+    QHash<int, int> m_cache;
+    QFont m_font;
+    QFont m_headerFont;
+    int m_padding = 0;
+    int m_headerPadding = 0;
+
+    struct Request
+    {
+        QList<int> columns;
+        QFont font;
+        QFont headerFont;
+        int padding = 0;
+        int headerPadding = 0;
+    };
+
+    QFutureWatcher<QHash<int, int>> *m_watcher = nullptr;
+    QHash<int, int> m_pendingCached;   // часть ответа, взятая из кеша
+    std::optional<Request> m_queued;   // запрос, пришедший во время измерения
+    QSet<int> m_changedWhileRunning;
+    bool m_structureChanged = false;   // столбцы сдвинулись - результат по индексам неверен
+
+    void start(const QList<int> &columns);
+    void onFinished();
+    void invalidateColumns(int first, int last);
+    void invalidateAll();
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+#include <QHash>
+#include <QList>
+#include <QtGlobal>
+
+class DataReader;
+
+// Окно строк таблицы БД для TableDataModel.
+//
+// Строки читаются блоками по ключевой колонке (keyset-пагинация), в памяти держится
+// не больше maxBlocks блоков (LRU). Для каждого прочитанного блока запоминается ключ,
+// после которого он начинается, поэтому вытесненный блок перечитывается одним запросом
+// по индексу, без OFFSET. Память ограничена maxBlocks * blockSize строк.
+class DbTableWindow
+{
+public:
+    DbTableWindow(DataReader *reader, const QString &tableName, const QString &keyColumn,
+                  int blockSize = 256, int maxBlocks = 64);
+
+    // Читает список колонок и кэширует COUNT(*); false при ошибке (см. getLastError)
+    bool open();
+
+    QStringList columnNames() const { return m_columns; }
+    int columnCount() const { return m_columns.size(); }
+    int totalRows() const { return m_totalRows; }
+    int loadedRows() const { return m_loadedRows; }
+    bool atEnd() const { return m_atEnd; }
+
+    // Следующий по порядку блок; возвращает число новых строк (0 - данных больше нет,
+    // -1 - ошибка запроса, см. getLastError)
+    int loadNextBlock();
+
+    QVariant value(int row, int column);
+
+    int cachedBlockCount() const { return m_blocks.size(); }
+    QString getLastError() const { return m_lastError; }
+
+private:
+    struct Block
+    {
+        QVector<QVariant> cells;  // построчно, rows * columnCount
+        int rows = 0;
+        quint64 lastUse = 0;
+    };
+
+    DataReader *m_reader;
+    QString m_tableName;
+    QString m_keyColumn;
+    int m_blockSize;
+    int m_maxBlocks;
+    int m_keyIndex = -1;
+
+    QStringList m_columns;
+    int m_totalRows = 0;
+    int m_loadedRows = 0;
+    bool m_atEnd = false;
+
+    QVector<QVariant> m_blockAfterKeys;  // ключ, после которого начинается блок (невалидный для 0-го)
+    QHash<int, Block> m_blocks;
+    quint64 m_useCounter = 0;
+    QString m_lastError;
+
+    Block *fetchBlock(int blockIndex);
+    void evictIfNeeded();
+};
@@ -4,6 +4,8 @@
 #include <QContextMenuEvent>
 #include <QMenu>
 #include <QInputDialog>
+#include <QList>
+#include "ColumnTypeInference.h"
 
 class CustomHeaderView : public QHeaderView
 {
@@ -12,6 +14,12 @@ public:
     CustomHeaderView(Qt::Orientation orientation, QWidget *parent = nullptr);
     ~CustomHeaderView();
 
+    // Режим широкой таблицы (десятки тысяч столбцов): последняя секция не растягивается -
+    // растяжение перекладывает все секции при каждом изменении ширины окна, - и размер
+    // секций не подбирается по содержимому
+    void setWideMode(bool enabled);
+    bool isWideMode() const { return m_wideMode; }
+
 protected:
     void mousePressEvent(QMouseEvent *event) override;
     void contextMenuEvent(QContextMenuEvent *event) override;
@@ -22,11 +30,25 @@ signals:
     void headerAddRequested(int logicalIndex, bool addToRight);  // индекс и направление (false=слева, true=справа)
     void headerDeleteRequested(int logicalIndex);  // индекс столбца
     void headerRenameRequested(int logicalIndex, const QString &newName);  // индекс и новое имя
+    // Меню вызвано на одном из нескольких выделенных столбцов
+    void headersAddRequested(const QList<int> &logicalIndexes, bool addToRight);
+    void headersDeleteRequested(const QList<int> &logicalIndexes);
+    // Сортировка/фильтр по столбцу (addKey - дополнительный ключ к текущей сортировке)
+    void sortRequested(int logicalIndex, Qt::SortOrder order, bool addKey);
+    void sortResetRequested();
+    void filterRequested(int logicalIndex, const QString &text);
+    // Тип данных столбца: явный выбор или определение по содержимому
+    void columnTypeRequested(int logicalIndex, ColumnType type);
+    void columnTypeInferenceRequested(int logicalIndex);  // -1 - все столбцы без типа
+    void formulaEditRequested(int logicalIndex);
+    // Ширина по содержимому; пустой список - все столбцы
+    void fitWidthRequested(const QList<int> &logicalIndexes);
 
 private slots:
     void onAdd();
     void onDelete();
     void onRename();
+    void onFilter();
 
 private:
     int m_contextMenuIndex;  // индекс столбца, по которому вызвали меню
@@ -35,6 +57,10 @@ private:
     QAction *m_addAction;
     QAction *m_deleteAction;
     QAction *m_renameAction;
+    QMenu *m_sortMenu;
+    QAction *m_filterAction;
+    QMenu *m_typeMenu;
+    bool m_wideMode = false;
 };
 
 class RowHeaderView : public QHeaderView
@@ -52,6 +78,9 @@ signals:
     void rowAddRequested(int logicalIndex);                  // запрос на добавление строки по индексу
     void rowDeleteRequested(int logicalIndex);              // индекс строки
     void rowHeaderClicked(int logicalIndex);                // клик по заголовку строки
+    // Меню вызвано на одной из нескольких выделенных строк
+    void rowsAddRequested(const QList<int> &logicalIndexes);
+    void rowsDeleteRequested(const QList<int> &logicalIndexes);
 
 private slots:
     void onAdd();
@@ -9,7 +9,11 @@
 #include <algorithm>
 #include <QMap>
 #include <memory>
+#include <QPointer>
 #include "HeaderTable.h"
+#include "AggregateFooter.h"
+#include "ColumnWidthEstimator.h"
+#include "CachedCellDelegate.h"
 
 
 class MainTable : public QTableView
@@ -21,14 +25,58 @@ public:
 
     CustomHeaderView* getCustomHeader() const { return m_customHeader; }
     RowHeaderView* getRowHeader() const { return m_rowHeader; }
+    AggregateFooter* getFooter() const { return m_footer; }
+
+    void setModel(QAbstractItemModel *model) override;
+
+    // Широкий режим (см. CustomHeaderView::setWideMode) включается сам, когда
+    // столбцов не меньше WideTableColumns, и выключается, когда их меньше
+    static constexpr int WideTableColumns = 1000;
+    bool isWideTableMode() const { return m_customHeader->isWideMode(); }
+
+    // Ширина по содержимому по выборке строк (см. ColumnWidthEstimator); пустой список - все столбцы.
+    // Без оценщика ширина считается стандартно по видимым строкам
+    void setWidthEstimator(ColumnWidthEstimator *estimator);
+    void fitColumnsToContents(const QList<int> &columns = {});
+
+#ifdef QT_DEBUG
+    // Замер времени отрисовки видимой области (repaint() рисует синхронно):
+    // стандартный делегат, кеширующий с пустым кешем и с заполненным. Результат - в лог.
+    // Только в отладочной сборке
+    struct PaintTiming
+    {
+        double averageMs = 0;
+        double maxMs = 0;
+    };
+    struct PaintBenchmark
+    {
+        int frames = 0;
+        int visibleCells = 0;
+        PaintTiming standardDelegate;
+        PaintTiming coldCache;
+        PaintTiming warmCache;
+    };
+    PaintBenchmark benchmarkPaint(int frames = 50);
+#endif
 
 signals:
     void editCellRequested(QModelIndex index);
 
 protected:
     void contextMenuEvent(QContextMenuEvent *event) override;
+    void updateGeometries() override;
+    // Двойной клик по границе секции: ширина из кеша оценщика, если она уже измерена
+    int sizeHintForColumn(int column) const override;
 
 private:
     CustomHeaderView *m_customHeader;
     RowHeaderView *m_rowHeader;
+    AggregateFooter *m_footer = nullptr;
+    CachedCellDelegate *m_delegate;
+    QList<QMetaObject::Connection> m_modelConnections;  // только свои: связи QTableView с моделью не трогаем
+    QPointer<ColumnWidthEstimator> m_widthEstimator;
+    bool m_updatingGeometries = false;
+    int m_narrowSingleStep = 0;  // шаг прокрутки до включения широкого режима
+
+    void updateWideTableMode();
 };
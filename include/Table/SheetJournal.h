@@ -0,0 +1,84 @@
+#pragma once
+#include <QObject>
+#include <QFile>
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+#include <QtGlobal>
+#include <functional>
+#include "SheetStore.h"
+
+class QTimer;
+class QDataStream;
+template <typename T> class QFutureWatcher;
+
+// Журнал несохраненных правок листа (только дозапись) для восстановления после сбоя.
+//
+// Каждая правка - короткая двоичная запись в терминах id строк/столбцов, как в
+// SheetChanges: значение ячейки, новая строка, описание столбца, удаление. Запись
+// копится в памяти и раз в syncInterval мс пакетом пишется в файл с fsync в пуле
+// потоков - правка стоит одной сериализации, медленный диск не задерживает UI.
+// При загрузке листа журнал проигрывается
+// поверх состояния из БД; после сохранения попавшие в БД записи вырезаются из файла.
+// Запись: длина, CRC-16 и данные; оборванная при сбое запись в конце отбрасывается
+class SheetJournal : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int DefaultSyncIntervalMs = 100;
+
+    SheetJournal(const QString &filePath, qint64 sheetId, QObject *parent = nullptr);
+    ~SheetJournal();
+
+    // Открыть или создать журнал. Журнал другого листа или с поврежденным
+    // заголовком начинается заново
+    bool open();
+    bool isOpen() const { return m_file.isOpen(); }
+    QString filePath() const { return m_file.fileName(); }
+
+    void setSyncInterval(int ms) { m_syncIntervalMs = qMax(ms, 0); }
+    int syncInterval() const { return m_syncIntervalMs; }
+
+    void appendCell(qint64 rowId, qint64 columnId, const QVariant &value);
+    void appendRow(const SheetChanges::Line &row);
+    void appendColumn(const SheetChanges::Line &column);
+    void appendRemovedRow(qint64 id);
+    void appendRemovedColumn(qint64 id);
+
+    // Записать накопленное и дождаться записи на диск (в том числе фоновой)
+    bool sync();
+
+    // Изменения из журнала, слитые по id (последнее значение ячейки побеждает)
+    bool replay(SheetChanges &outChanges);
+    // Наложить изменения на лист, загруженный из БД (порядок строк/столбцов - по ключу)
+    static void apply(SheetData &data, const SheetChanges &changes);
+
+    // Позиция конца журнала: записи до нее входят в сохранение, начатое сейчас
+    qint64 checkpoint() const { return m_base + (m_fileSize - HeaderSize) + m_buffer.size(); }
+    // Записи до checkpoint сохранены в БД - файл переписывается без них
+    bool discardBefore(qint64 checkpoint);
+
+    QString getLastError() const { return m_lastError; }
+
+private:
+    static constexpr qint64 HeaderSize = 16;  // сигнатура, версия, id листа
+    enum RecordKind : quint8 { CellRecord = 1, RowRecord, ColumnRecord, RemovedRowRecord, RemovedColumnRecord };
+
+    QFile m_file;
+    qint64 m_sheetId;
+    QByteArray m_buffer;     // записи, еще не переданные в файл
+    QByteArray m_flushing;   // пакет, который сейчас пишет фоновый поток (уже учтен в m_fileSize)
+    qint64 m_fileSize = 0;   // m_file трогает только фоновый поток, пока m_flushing не пуст
+    qint64 m_base = 0;       // позиция первой записи файла (растет при вырезании)
+    QTimer *m_syncTimer;
+    QFutureWatcher<QString> *m_flushWatcher;  // результат - текст ошибки
+    int m_syncIntervalMs = DefaultSyncIntervalMs;
+    QString m_lastError;
+
+    void append(RecordKind kind, const std::function<void(QDataStream &out)> &writeFields);
+    bool writeBuffer();
+    void startFlush();
+    void finishFlush();
+    void waitForFlush();
+    bool writeHeader(QIODevice &device) const;
+};
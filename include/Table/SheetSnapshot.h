@@ -0,0 +1,34 @@
+#pragma once
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+#include <memory>
+#include "CellStorage.h"
+#include "ColumnTypeInference.h"
+
+class QIODevice;
+
+// Согласованный снимок листа для фоновой обработки (экспорт, статистика).
+// Ячейки - CellStorage::snapshot(): не меняются при дальнейшей правке листа и
+// читаются из любого потока без storageLock()
+struct SheetSnapshot
+{
+    std::shared_ptr<const CellStorage> cells;
+    QVector<QString> headers;
+    QVector<ColumnType> columnTypes;
+
+    bool isValid() const { return cells != nullptr; }
+};
+
+// Выгрузка снимка в CSV (UTF-8, разделитель - запятая, первая строка - заголовки).
+// Поля с разделителем, кавычками, переводом строки или пробелами по краям
+// заключаются в кавычки; даты пишутся в ISO 8601, числа - без локали
+class SheetCsvWriter
+{
+public:
+    bool write(const SheetSnapshot &snapshot, QIODevice &device);
+    QString getLastError() const { return m_lastError; }
+
+private:
+    QString m_lastError;
+};
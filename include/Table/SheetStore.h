@@ -0,0 +1,80 @@
+#pragma once
+#include <QString>
+#include <QList>
+#include <QVariant>
+#include <QFuture>
+#include <QtGlobal>
+#include <functional>
+
+class DataModifier;
+
+// Изменения листа с момента последнего сохранения.
+// Значения ячеек скопированы в момент формирования, поэтому набор можно
+// сохранять в фоновом потоке, пока пользователь продолжает редактирование
+struct SheetChanges
+{
+    struct Line
+    {
+        qint64 id = 0;
+        QString orderKey;
+        QString name;       // только для столбцов
+        int valueType = 0;  // только для столбцов: ColumnType
+        QString formula;    // только для столбцов: ColumnFormula::storedText()
+        bool added = false; // создана после прошлого сохранения (в БД ее нет)
+    };
+    struct Cell
+    {
+        qint64 rowId = 0;
+        qint64 columnId = 0;
+        QVariant value;  // невалидный - ячейка очищена
+    };
+
+    QList<Line> rows;
+    QList<Line> columns;
+    QList<qint64> removedRows;
+    QList<qint64> removedColumns;
+    QList<Cell> cells;
+
+    bool isEmpty() const
+    {
+        return rows.isEmpty() && columns.isEmpty() && removedRows.isEmpty()
+               && removedColumns.isEmpty() && cells.isEmpty();
+    }
+};
+
+// Полное содержимое листа при загрузке; строки и столбцы упорядочены по ключу
+struct SheetData
+{
+    QList<SheetChanges::Line> rows;
+    QList<SheetChanges::Line> columns;
+    QList<SheetChanges::Cell> cells;
+};
+
+// Сохранение листа в таблицы sheet_rows/sheet_columns/sheet_cells (см. DBConnection::createSheetTables).
+// Все изменения пишутся одной транзакцией подготовленными запросами DataModifier::batchExecute
+class SheetStore
+{
+public:
+    SheetStore(const QString &connectionName, qint64 sheetId);
+
+    bool save(const SheetChanges &changes);
+    // Сохранение на отдельном соединении (клон connectionName) в пуле потоков
+    QFuture<bool> saveAsync(const SheetChanges &changes) const;
+
+    bool load(SheetData &outData);
+    // Строки и столбцы листа без ячеек; cellCount - число ячеек (оценка памяти до загрузки)
+    bool loadLayout(SheetData &outData, qint64 *cellCount = nullptr);
+    // Ячейки по одной, без накопления: лист может не помещаться в память.
+    // visitor возвращает false, чтобы остановить чтение
+    bool forEachCell(const std::function<bool(const SheetChanges::Cell &cell)> &visitor);
+
+    qint64 sheetId() const { return m_sheetId; }
+    QString getLastError() const { return m_lastError; }
+
+private:
+    QString m_connectionName;
+    qint64 m_sheetId;
+    QString m_lastError;
+
+    static bool writeChanges(DataModifier &modifier, qint64 sheetId, const SheetChanges &changes);
+};
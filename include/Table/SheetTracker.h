@@ -0,0 +1,71 @@
+#pragma once
+#include <QVector>
+#include <QString>
+#include <QSet>
+#include <QHash>
+#include <QPair>
+#include <QtGlobal>
+#include <functional>
+#include "SheetStore.h"
+
+class CellStorage;
+
+// Стабильные id и ключи порядка строк/столбцов листа и учет несохраненных изменений.
+//
+// Позиция строки меняется при вставках выше нее, поэтому изменения запоминаются
+// по id: сохранение после правки 20 ячеек пишет 20 строк sheet_cells, а вставка
+// строки - одну строку sheet_rows с ключом между соседями.
+class SheetTracker
+{
+public:
+    void clear();
+    // Загруженный лист: id и ключи из БД, изменений нет
+    void load(const SheetData &data);
+
+    void insertRows(int row, int count);
+    void removeRows(int row, int count);
+    void insertColumns(int column, int count);
+    void removeColumns(int column, int count);
+
+    void markCell(int row, int column);
+    void markColumn(int column);  // переименование, смена типа или формулы
+
+    bool isModified() const;
+
+    qint64 rowId(int row) const { return m_rows.ids.at(row); }
+    qint64 columnId(int column) const { return m_columns.ids.at(column); }
+    QString rowKey(int row) const { return m_rows.keys.at(row); }
+    QString columnKey(int column) const { return m_columns.keys.at(column); }
+    int columnIndex(qint64 id) const { return m_columns.ids.indexOf(id); }  // -1 - столбца нет
+
+    // Забрать изменения (значения копируются из storage) и начать учет заново.
+    // describeColumn заполняет имя, тип и формулу измененного столбца
+    SheetChanges takeChanges(const CellStorage &storage,
+                             const std::function<void(int column, SheetChanges::Line &line)> &describeColumn);
+    // Вернуть изменения, которые не удалось сохранить
+    void requeue(const SheetChanges &changes);
+    // Изменения из журнала, уже наложенные на загруженный лист, снова несохраненные.
+    // savedRows/savedColumns - id из БД: только их удаление нужно записать
+    void restoreChanges(const SheetChanges &changes, const QSet<qint64> &savedRows, const QSet<qint64> &savedColumns);
+
+private:
+    struct Axis
+    {
+        QVector<qint64> ids;
+        QVector<QString> keys;
+        qint64 nextId = 1;
+        QSet<qint64> dirty;    // новые/измененные, еще не записанные
+        QSet<qint64> added;    // созданные после последнего сохранения
+        QSet<qint64> removed;  // удаленные, которые есть в БД
+
+        void insert(int position, int count);
+        QVector<qint64> remove(int position, int count);
+        QHash<qint64, int> positionsOf(const QSet<qint64> &wanted) const;
+    };
+
+    Axis m_rows;
+    Axis m_columns;
+    QSet<QPair<qint64, qint64>> m_dirtyCells;  // (row id, column id)
+
+    void dropCells(const QVector<qint64> &ids, bool byRow);
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <QVariant>
+#include <QtGlobal>
+#include <vector>
+#include <memory>
+#include "CellStorage.h"
+
+// Разреженное хранилище: в каждой колонке только непустые ячейки,
+// отсортированные по номеру строки. Память пропорциональна числу заполненных
+// ячеек, а вставка/удаление строк сдвигает номера только у ячеек ниже позиции.
+// Колонки разделяются со снимками и копируются при первой записи
+class SparseStorage : public CellStorage
+{
+public:
+    Kind kind() const override { return Kind::Sparse; }
+
+    int rowCount() const override { return m_rowCount; }
+    int columnCount() const override { return static_cast<int>(m_columns.size()); }
+
+    QVariant value(int row, int column) const override;
+    void setValue(int row, int column, const QVariant &value) override;
+
+    void insertRows(int row, int count) override;
+    void removeRows(int row, int count) override;
+    void insertColumns(int column, int count) override;
+    void removeColumns(int column, int count) override;
+
+    qint64 filledCellCount() const override { return m_filledCells; }
+    void forEachValue(const std::function<void(int row, int column, const QVariant &value)> &visitor) const override;
+
+    qint64 memoryUsage() const override;
+    std::shared_ptr<const CellStorage> snapshot() const override;
+
+private:
+    struct Cell
+    {
+        int row;
+        QVariant value;
+    };
+    using Column = std::vector<Cell>;
+
+    std::vector<std::shared_ptr<Column>> m_columns;
+    int m_rowCount = 0;
+    qint64 m_filledCells = 0;
+
+    Column &detach(int column);
+
+    static Column::iterator lowerBound(Column &cells, int row);
+    static Column::const_iterator lowerBound(const Column &cells, int row);
+};
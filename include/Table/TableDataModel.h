@@ -9,6 +9,28 @@
 #include <QHash>
 #include <QSet>
 #include <QStack>
+#include <memory>
+#include <vector>
+#include "CellStorage.h"
+#include "ColumnStorage.h"
+#include "TiledStorage.h"
+#include "DbTableWindow.h"
+#include "SheetTracker.h"
+#include "TableUndoLog.h"
+#include "ColumnAggregates.h"
+#include "ColumnTypeInference.h"
+#include "ColumnFormula.h"
+#include "SheetSnapshot.h"
+#include <QElapsedTimer>
+#include <QRect>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+#include <QFuture>
+#include <functional>
+
+class SheetStore;
+class SheetJournal;
+template <typename T> class QFutureWatcher;
 
 class TableDataModel : public QAbstractTableModel
 {
@@ -27,6 +49,122 @@ public:
     QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
     bool setHeaderData(int section, Qt::Orientation orientation, const QVariant &value, int role = Qt::EditRole);
 
+    // Запись прямоугольника напрямую в хранилище: один шаг отмены и один dataChanged.
+    // values - строки диапазона; недостающие в коротких строках ячейки очищаются
+    bool setRange(int row, int column, const QVector<QVector<QVariant>> &values);
+    // generator(row, column) вызывается для каждой ячейки (порядок обхода не гарантируется)
+    bool fillRange(int row, int column, int rowCount, int columnCount,
+                   const std::function<QVariant(int row, int column)> &generator);
+
+    // Запись разрозненных ячеек (например, замена найденного): один шаг отмены
+    struct CellUpdate
+    {
+        int row;
+        int column;
+        QVariant value;
+    };
+    bool setCells(const QVector<CellUpdate> &updates);
+
+    // Пакет изменений: dataChanged от setData/fillRange внутри пакета объединяются в один
+    // сигнал при закрытии внешнего пакета, весь пакет - один шаг отмены
+    void beginBatchUpdate();
+    void endBatchUpdate();
+
+    class BatchUpdate
+    {
+    public:
+        explicit BatchUpdate(TableDataModel *model) : m_model(model) { m_model->beginBatchUpdate(); }
+        ~BatchUpdate() { m_model->endBatchUpdate(); }
+        BatchUpdate(const BatchUpdate &) = delete;
+        BatchUpdate &operator=(const BatchUpdate &) = delete;
+
+    private:
+        TableDataModel *m_model;
+    };
+
+    // Режим просмотра таблицы БД: строки подгружаются блоками через fetchMore(),
+    // в памяти держится ограниченное окно (см. DbTableWindow). Модель в этом режиме только для чтения
+    bool bindToTable(DataReader *reader, const QString &tableName, const QString &keyColumn = "id");
+    void unbindTable();
+    bool isTableBound() const { return m_dbWindow != nullptr; }
+
+    // Хранилище ячеек: Auto выбирает разреженное для почти пустых листов и
+    // плиточное с выгрузкой на диск, когда ячейки не помещаются в бюджет памяти
+    enum class StorageMode { Auto, Columnar, Sparse, Tiled };
+    void setStorageMode(StorageMode mode);
+    StorageMode storageMode() const { return m_storageMode; }
+    CellStorage::Kind storageKind() const { return m_storage->kind(); }
+    // Приблизительный объем памяти ячеек и заголовков в байтах
+    qint64 memoryUsage() const;
+    // Бюджет памяти плиточного хранилища (и порог перехода на него в режиме Auto)
+    void setTiledMemoryBudget(qint64 bytes);
+    qint64 tiledMemoryBudget() const { return m_tiledMemoryBudget; }
+    // Счетчики кеша плиток; нули, если хранилище не плиточное
+    TiledStorage::Metrics tiledStorageMetrics() const;
+    // Подгрузка с диска плиток следующего экрана в направлении прокрутки (rowDirection,
+    // columnDirection: -1, 0, 1) в пуле потоков. visible - видимые ячейки (x - столбец, y - строка).
+    // Для неплиточного хранилища ничего не делает
+    void prefetchCells(const QRect &visible, int rowDirection, int columnDirection);
+    // Прямой доступ к ячейкам для построчных вычислений (сортировка, агрегаты).
+    // Из других потоков - только под storageLock() на чтение: модель пишет в хранилище под записью
+    const CellStorage &cellStorage() const { return *m_storage; }
+    QReadWriteLock &storageLock() const { return m_storageLock; }
+    // Итоги по столбцу (кешируются, правка ячейки обновляет их инкрементально).
+    // Колоночное хранилище считается сразу, разреженное и плиточное - в пуле потоков:
+    // пока итог не готов, возвращается false, готовность - сигнал columnAggregatesReady
+    bool columnAggregates(int column, ColumnAggregates &out);
+
+    // Схема столбцов: значения столбца с типом приводятся к нему при записи
+    // (не приводимые сохраняются как введены). Смена типа конвертирует уже
+    // записанные ячейки одним шагом отмены и сохраняется вместе с листом
+    ColumnType columnType(int column) const { return m_columnTypes.value(column, ColumnType::Auto); }
+    bool setColumnType(int column, ColumnType type);
+
+    // Вычисляемые столбцы (см. ColumnFormula). Правка ячейки пересчитывает только
+    // зависящие от нее ячейки (для cumsum - строки ниже), в пакете изменений пересчет
+    // выполняется один раз при закрытии пакета. Большой диапазон без cumsum считается в
+    // пуле потоков, значения появляются по окончании. Пустая формула делает столбец обычным,
+    // значения остаются. Ячейки вычисляемого столбца не редактируются
+    bool setColumnFormula(int column, const QString &formula);
+    QString columnFormula(int column) const;
+    bool isComputedColumn(int column) const;
+
+    // Сохранение листа в БД: пишутся только изменения с прошлого сохранения/загрузки.
+    // Пока идет фоновое сохранение, возвращает false
+    bool saveSheet(SheetStore &store);
+    // То же в пуле потоков; результат приходит сигналом sheetSaved.
+    // store должен жить до сигнала
+    bool saveSheetInBackground(SheetStore *store);
+    bool loadSheet(SheetStore &store);
+    bool isModified() const { return m_tracker.isModified(); }
+    // Журнал несохраненных правок (не владеет, открытый). Задается до loadSheet:
+    // загрузка накладывает правки из журнала, сохранение вырезает записанное в БД
+    void setJournal(SheetJournal *journal) { m_journal = journal; }
+    SheetJournal *journal() const { return m_journal; }
+
+    // Снимок листа для фоновых задач: ячейки не копируются, правка после снимка копирует
+    // только изменяемую колонку. Невалиден в режиме таблицы БД и для плиточного хранилища
+    SheetSnapshot snapshot() const;
+    // Выгрузка в CSV в пуле потоков по снимку: правки во время записи в файл не попадают.
+    // Результат приходит сигналом csvExported
+    bool exportCsvInBackground(const QString &filePath);
+
+    // Отмена/повтор правок листа. Подряд идущие правки соседних ячеек
+    // в пределах UndoMergeIntervalMs сливаются в один шаг
+    bool undo();
+    bool redo();
+    bool canUndo() const { return m_undoLog.canUndo(); }
+    bool canRedo() const { return m_undoLog.canRedo(); }
+    void clearUndo();
+    void setUndoMemoryLimit(qint64 bytes) { m_undoLog.setMemoryLimit(bytes); }
+    qint64 undoMemoryUsage() const { return m_undoLog.memoryUsage(); }
+    // Все изменения между begin и end отменяются одним шагом (вложенные вызовы допускаются)
+    void beginUndoMacro();
+    void endUndoMacro();
+
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
 
 
 public slots:
@@ -36,6 +174,12 @@ public slots:
     bool onHeaderRenameRequested(int logicalIndex, const QString &newName);
     bool onRowAddRequested(int logicalIndex);
     bool onRowDeleteRequested(int logicalIndex);
+    // Групповые команды для выделения в заголовках: индексы разбиваются на непрерывные
+    // блоки, каждый блок - одна вставка/удаление (один begin/end для представления)
+    bool onRowsAddRequested(const QList<int> &logicalIndexes);
+    bool onRowsDeleteRequested(const QList<int> &logicalIndexes);
+    bool onHeadersAddRequested(const QList<int> &logicalIndexes, bool addToRight);
+    bool onHeadersDeleteRequested(const QList<int> &logicalIndexes);
 
     bool removeRows(int row, int count, const QModelIndex &parent = QModelIndex());
     bool insertRows(int row, int count, const QModelIndex &parent = QModelIndex());
@@ -47,12 +191,108 @@ private:
     bool removeColumns(int column, int count, const QModelIndex &parent = QModelIndex());
 
 
-    QVector<QVector<QVariant>> m_data;
+    std::unique_ptr<CellStorage> m_storage;
+    mutable QReadWriteLock m_storageLock;
+    StorageMode m_storageMode = StorageMode::Auto;
+    qint64 m_tiledMemoryBudget = TiledStorage::DefaultMemoryBudget;
+    QFuture<void> m_prefetch;
+    int m_writesSinceStorageCheck = 0;
+
+    void updateStorageKind();
+    bool assignNewColumnName(int column);
+    void switchStorage(CellStorage::Kind kind);
     QVector<QString> m_columnHeaders;
+    QVector<ColumnType> m_columnTypes;
+    QVariant coerceToColumn(int column, const QVariant &value) const;
+    void describeColumn(int column, SheetChanges::Line &line) const;
+    // setCells; coerce = false - значения уже приведены к типам столбцов
+    bool writeCells(const QVector<CellUpdate> &updates, bool coerce);
+    // Учет изменения в трекере и запись в журнал
+    void markCell(int row, int column);
+    void markColumn(int column);
+
+    std::unique_ptr<DbTableWindow> m_dbWindow;
+    int m_fetchedRows = 0;  // строки окна БД, уже показанные представлению
+
+    SheetTracker m_tracker;
+    SheetJournal *m_journal = nullptr;
+    QFutureWatcher<bool> *m_saveWatcher = nullptr;
+    QFutureWatcher<QString> *m_exportWatcher = nullptr;  // результат - текст ошибки
+
+    AggregateCache m_aggregates;
+    struct AggregateResult
+    {
+        int column;
+        quint64 version;
+        ColumnAggregates value;
+    };
+    QList<int> m_aggregateRequests;  // столбцы к фоновому подсчету
+    bool m_aggregatesRunning = false;
+    QFutureWatcher<QVector<AggregateResult>> *m_aggregateWatcher = nullptr;
+    void startAggregates();
+    void finishAggregates();
+
+    struct ComputedColumn
+    {
+        std::shared_ptr<ColumnFormula> formula;
+        std::vector<double> sums;  // состояние cumsum после каждой строки (cumulativeCount() на строку)
+    };
+    QHash<qint64, ComputedColumn> m_computed;        // по id столбца (SheetTracker)
+    QVector<qint64> m_formulaOrder;                  // вычисляемые столбцы после своих аргументов
+    QHash<qint64, QPair<int, int>> m_formulaDirty;  // строки к пересчету (первая, последняя)
+
+    bool updateFormulaOrder();
+    qint64 resolveColumnName(const QString &name) const;
+    void markFormulaInputs(int column, int firstRow, int lastRow);
+    void markFormulaDirty(qint64 columnId, int firstRow, int lastRow);
+    void recalculateFormulas();
+    // false - пересчет ушел в пул потоков (см. startRecalculation)
+    bool recalculateColumn(int column, ComputedColumn &computed, int firstRow, int lastRow);
+    void startRecalculation(int column, const std::shared_ptr<ColumnFormula> &formula,
+                            const QVector<int> &inputColumns, int firstRow, int lastRow);
+    void finishRecalculation();
+    void storeRecalculated(int column, int firstRow, const std::vector<QVariant> &results);
+
+    // Фоновый пересчет большого диапазона столбца без cumsum; results пуст - пересчета нет
+    struct RecalcJob
+    {
+        qint64 columnId = 0;
+        std::shared_ptr<ColumnFormula> formula;
+        int firstRow = 0;
+        int lastRow = -1;
+        int generation = 0;
+        QVector<int> blocks;  // первые строки блоков (последовательность для QtConcurrent::map)
+        std::shared_ptr<std::vector<QVariant>> results;
+    };
+    RecalcJob m_recalcJob;
+    QFutureWatcher<void> *m_recalcWatcher = nullptr;
+    QAtomicInt m_recalcGeneration;  // меняется при вставке/удалении строк и столбцов
+    void captureColumnFormulas(TableUndoOperation &operation) const;
+    void restoreColumnFormulas(const TableUndoOperation &operation);
+
+    int m_batchDepth = 0;
+    QRect m_pendingChange;  // x - столбцы, y - строки
+    void flushPendingChange();
+
+    TableUndoLog m_undoLog;
+    int m_undoMacroDepth = 0;
+    bool m_undoMacroRecorded = false;  // у текущего макроса уже есть шаг в журнале
+    bool m_applyingUndo = false;
+    bool m_canMergeCellEdit = false;
+    QElapsedTimer m_lastCellEdit;
 
-    int m_rowCount = 0;
-    int m_columnCount = 0;
+    void recordUndo(const TableUndoOperation &operation, bool cellEdit = false);
+    void applyUndoStep(TableUndoStep &step);
+    void applyUndoOperation(TableUndoOperation &operation);
+    QVector<QPair<int, QVariant>> captureCells(int row, int column, int rowCount, int columnCount) const;
+    void restoreCells(int row, int column, int rowCount, int columnCount, const QVector<QPair<int, QVariant>> &values);
+    QVector<QPair<int, QVariant>> captureCellList(const QVector<QPoint> &cells) const;
+    void restoreCellList(const QVector<QPoint> &cells, const QVector<QPair<int, QVariant>> &values);
+    void notifyCellsChanged(const QRect &changed);
 
 signals:
     //void rowsInserted(int start, int end);
+    void sheetSaved(bool success);
+    void columnAggregatesReady();
+    void csvExported(bool success, const QString &filePath);
 };
@@ -0,0 +1,69 @@
+#pragma once
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QVector>
+#include <QRegularExpression>
+
+class TableDataModel;
+template <typename T> class QFutureWatcher;
+
+struct FindOptions
+{
+    QString pattern;
+    bool regularExpression = false;
+    bool wholeCell = false;  // совпадение со всем текстом ячейки
+    Qt::CaseSensitivity caseSensitivity = Qt::CaseInsensitive;
+};
+
+struct FindMatch
+{
+    int row = 0;
+    int column = 0;
+};
+
+// Поиск и замена по ячейкам TableDataModel.
+//
+// Строки делятся на блоки, блоки обрабатываются в пуле потоков под storageLock()
+// на чтение. Текстовые колонки сравниваются прямо по UTF-16 пулу (QStringView),
+// числа форматируются в буфер на стеке - на ячейку ничего не выделяется
+// (кроме Variant-колонок и разреженного хранилища). Совпадения приходят порциями
+// по мере готовности блоков. Любое изменение модели прерывает поиск: позиции устарели
+class TableFindEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit TableFindEngine(TableDataModel *model, QObject *parent = nullptr);
+    ~TableFindEngine();
+
+    bool find(const FindOptions &options);
+    void cancel();
+    bool isRunning() const;
+
+    // Совпадения последнего поиска (упорядочены по строкам после finished)
+    const QVector<FindMatch> &matches() const { return m_matches; }
+
+    // Замена во всех найденных ячейках одним шагом отмены.
+    // Возвращает число измененных ячеек или -1 при ошибке
+    int replaceAll(const QString &replacement);
+
+    QString getLastError() const { return m_lastError; }
+
+signals:
+    void matchesFound(const QVector<FindMatch> &matches);
+    void finished(int total);
+    // Модель изменилась во время или после поиска - найденные позиции недействительны
+    void invalidated();
+
+private:
+    QPointer<TableDataModel> m_model;
+    QFutureWatcher<QVector<FindMatch>> *m_watcher;
+    FindOptions m_options;
+    QRegularExpression m_regex;
+    QVector<FindMatch> m_matches;
+    bool m_valid = false;  // m_matches соответствуют текущему содержимому
+    bool m_replacing = false;
+    QString m_lastError;
+
+    void onModelChanged();
+};
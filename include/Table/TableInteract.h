@@ -12,7 +12,15 @@
 #include <QStack>
 #include <QModelIndex>
 #include "TableDataModel.h"
+#include "TableSortFilterModel.h"
+#include "TableFindEngine.h"
 #include "MainTable.h"
+#include "SheetStore.h"
+#include "SheetJournal.h"
+#include <QFutureWatcher>
+#include <memory>
+
+class DatabaseManager;
 
 class TableInteract : public QObject
 {
@@ -25,11 +33,45 @@ public:
 
     void ForTestCommand();
 
+    // Просмотр таблицы БД в MainTable (строки подгружаются по мере прокрутки)
+    bool showDatabaseTable(DataReader *reader, const QString &tableName, const QString &keyColumn = "id");
+
+    // Листы таблицы sheets: createSheet возвращает id нового листа (-1 при ошибке),
+    // openSheet загружает лист в модель, новый пустой лист заполняется тестовыми данными.
+    // Несохраненные правки пишутся в журнал sheet_<id>.journal рядом с файлом БД и
+    // проигрываются при следующем открытии листа
+    static qint64 createSheet(DatabaseManager *db, const QString &name);
+    bool openSheet(DatabaseManager *db, qint64 sheetId);
+    qint64 sheetId() const { return sheetStore ? sheetStore->sheetId() : -1; }
+
+public slots:
+    // Изменения открытого листа пишутся в БД в фоне (Ctrl+S), результат - сигнал sheetSaved
+    bool saveSheet();
+
+signals:
+    void sheetSaved(bool success);
+
 private slots:
     void determineCellType(const QModelIndex &index);
+    void findInTable();
+    void replaceInTable();
+    void inferColumnTypes(int column);
+    void editColumnFormula(int column);
+    void exportToCsv();
 
 private:
     TableDataModel *tableModel;
+    TableSortFilterModel *sortModel;  // между моделью и представлением
+    TableFindEngine *findEngine;
+    ColumnWidthEstimator *widthEstimator;
+    bool replaceAfterFind = false;  // замена ждет окончания поиска
+    QString pendingReplacement;
+    QFutureWatcher<QVector<ColumnTypeGuess>> *typeWatcher = nullptr;
+    std::unique_ptr<SheetStore> sheetStore;  // открытый лист
+    std::unique_ptr<SheetJournal> sheetJournal;  // удаляется после модели, которая в него пишет
+
+    QList<int> sourceRows(const QList<int> &viewRows) const;
+    void prefetchAhead(int rowDirection, int columnDirection);
     MainTable *tableView;
 
 
@@ -0,0 +1,146 @@
+#pragma once
+#include <QAbstractProxyModel>
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+#include <memory>
+#include <vector>
+
+class TableDataModel;
+template <typename T> class QFutureWatcher;
+
+// Сортировка и фильтрация поверх TableDataModel без копирования ячеек.
+//
+// Для столбцов-ключей один раз строятся нормализованные ключи (число или текст
+// в нижнем регистре), затем сортируется только перестановка номеров строк: куски
+// сортируются параллельно и сливаются попарно. Все это идет в пуле потоков, ключи
+// строятся под TableDataModel::storageLock() на чтение. Фильтры считаются
+// битовыми картами по строкам источника и объединяются через AND; карты и ключи
+// кешируются по столбцам до изменения данных столбца, вставка и удаление строк
+// только сдвигают закешированные ключи.
+// Без сортировки и фильтров строки отображаются 1:1 без массивов перестановки.
+// Правки не пересортировывают таблицу - как в табличных редакторах, порядок
+// обновляется по следующему запросу сортировки
+class TableSortFilterModel : public QAbstractProxyModel
+{
+    Q_OBJECT
+public:
+    struct SortKey
+    {
+        int column = 0;
+        Qt::SortOrder order = Qt::AscendingOrder;
+    };
+
+    explicit TableSortFilterModel(QObject *parent = nullptr);
+    ~TableSortFilterModel();
+
+    // Источник должен быть TableDataModel
+    void setSourceModel(QAbstractItemModel *sourceModel) override;
+
+    // Первый ключ главный; пустой список возвращает исходный порядок
+    void setSortKeys(const QVector<SortKey> &keys);
+    // Дополнительный ключ (или смена направления уже выбранного столбца)
+    void addSortKey(int column, Qt::SortOrder order);
+    QVector<SortKey> sortKeys() const { return m_sortKeys; }
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    // Показывать строки, где текст столбца содержит text (без учета регистра); пустой text снимает фильтр
+    void setFilter(int column, const QString &text);
+    QString filter(int column) const { return m_filters.value(column); }
+    void clearSortAndFilters();
+
+    bool isBusy() const;
+    int mapRowToSource(int row) const;
+
+    QModelIndex mapToSource(const QModelIndex &proxyIndex) const override;
+    QModelIndex mapFromSource(const QModelIndex &sourceIndex) const override;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+signals:
+    // Новый порядок/фильтр применен
+    void sortFilterFinished();
+
+public:
+    // Нормализованные ключи одного столбца (неизменяемы после построения - читаются из пула потоков)
+    struct ColumnKeys
+    {
+        enum Kind : quint8 { Number, Text, Null };
+
+        std::vector<quint8> kinds;
+        std::vector<double> numbers;  // выделяется при первом числе
+        QVector<QString> texts;       // выделяется при первом тексте
+    };
+    using Bitmap = std::vector<quint64>;
+
+    // Вставка (count > 0) или удаление (count < 0) строк с first после построения ключей
+    struct RowEdit
+    {
+        int first;
+        int count;
+    };
+
+    struct Result
+    {
+        quint64 generation = 0;
+        quint64 keyVersion = 0;
+        QHash<int, std::shared_ptr<const ColumnKeys>> keys;  // ключи столбцов задачи
+        bool identity = true;
+        QVector<int> rows;  // видимые строки источника в порядке показа
+        QHash<int, std::shared_ptr<const Bitmap>> bitmaps;
+        QHash<int, std::shared_ptr<const ColumnKeys>> bitmapKeys;  // ключи, по которым построены карты
+    };
+
+private:
+    TableDataModel *m_source = nullptr;
+
+    bool m_identity = true;
+    QVector<int> m_proxyToSource;
+    QVector<int> m_sourceToProxy;  // -1 - строка скрыта фильтром
+
+    QVector<SortKey> m_sortKeys;
+    QHash<int, QString> m_filters;
+    struct CachedKeys
+    {
+        std::shared_ptr<const ColumnKeys> keys;
+        QVector<RowEdit> rowEdits;  // еще не примененные к keys (применяет задача)
+    };
+    static constexpr int MaxRowEdits = 256;  // дальше ключи дешевле построить заново
+    QHash<int, CachedKeys> m_keyCache;
+    QHash<int, std::shared_ptr<const Bitmap>> m_bitmapCache;
+    quint64 m_keyVersion = 0;  // растет при любом изменении m_keyCache
+
+    QFutureWatcher<Result> *m_watcher = nullptr;
+    quint64 m_generation = 0;
+    bool m_pending = false;       // запрос пришел во время работы фоновой задачи
+    bool m_removingRows = false;   // начато удаление одного блока показа
+    bool m_resetOnRemove = false;  // удаление затрагивает несколько блоков показа
+
+    void requestUpdate();
+    void updateAfterStructureChange();
+    void startJob();
+    void applyResult(const Result &result);
+    void setIdentity();
+    void rebuildSourceToProxy();
+    void invalidateCaches();
+    void shiftRows(int first, int count);
+    void shiftColumns(int first, int count);
+
+    void onSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles);
+    void onSourceHeaderDataChanged(Qt::Orientation orientation, int first, int last);
+    void onSourceRowsAboutToBeInserted(const QModelIndex &parent, int first, int last);
+    void onSourceRowsInserted(const QModelIndex &parent, int first, int last);
+    void onSourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void onSourceRowsRemoved(const QModelIndex &parent, int first, int last);
+    void onSourceColumnsAboutToBeInserted(const QModelIndex &parent, int first, int last);
+    void onSourceColumnsInserted(const QModelIndex &parent, int first, int last);
+    void onSourceColumnsAboutToBeRemoved(const QModelIndex &parent, int first, int last);
+    void onSourceColumnsRemoved(const QModelIndex &parent, int first, int last);
+    void onSourceAboutToBeReset();
+    void onSourceReset();
+};
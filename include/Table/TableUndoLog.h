@@ -0,0 +1,79 @@
+#pragma once
+#include <QVector>
+#include <QPair>
+#include <QVariant>
+#include <QString>
+#include <QPoint>
+#include <QStack>
+#include <QtGlobal>
+
+// Операция журнала отмены TableDataModel - компактная дельта, а не снимок листа.
+//
+// Ячейки: прямоугольник и только непустые значения в нем, вставка строк/столбцов -
+// только диапазон индексов. Применение операции выполняет обратное действие и
+// превращает ее в обратную: значения меняются местами с текущими, вставка становится
+// удалением с сохраненным содержимым. Поэтому одна и та же запись служит и для undo, и для redo
+struct TableUndoOperation
+{
+    enum class Kind { Cells, CellList, InsertRows, RemoveRows, InsertColumns, RemoveColumns, RenameColumn,
+                      SetColumnType, SetColumnFormula };
+
+    Kind kind = Kind::Cells;
+    int row = 0;  // левый верхний угол прямоугольника / позиция вставки
+    int column = 0;
+    int rowCount = 0;
+    int columnCount = 0;
+    // Непустые значения прямоугольника по возрастанию смещения (row-major); остальные ячейки пустые
+    QVector<QPair<int, QVariant>> values;
+    QVector<QString> headers;  // заголовки удаленных столбцов / прежнее имя столбца
+    QVector<int> columnTypes;  // типы (ColumnType) удаленных столбцов / прежний тип столбца
+    QVector<QString> formulas;  // формулы (storedText) удаленных столбцов / прежняя формула столбца
+    QVector<qint64> columnIds;  // id удаленных столбцов: по ним восстанавливаются ссылки формул
+    // CellList: разрозненные ячейки (x - столбец, y - строка); смещение в values - индекс в cells
+    QVector<QPoint> cells;
+
+    qint64 memoryUsage() const;
+};
+
+// Шаг отмены - все операции одного действия пользователя
+struct TableUndoStep
+{
+    QVector<TableUndoOperation> operations;
+
+    qint64 memoryUsage() const;
+};
+
+// Стеки undo/redo с ограничением памяти: при превышении лимита отбрасываются
+// самые старые шаги; ближайший шаг отмены/повтора сохраняется всегда
+class TableUndoLog
+{
+public:
+    static constexpr qint64 DefaultMemoryLimit = 64 * 1024 * 1024;
+
+    void setMemoryLimit(qint64 bytes);
+    qint64 memoryLimit() const { return m_memoryLimit; }
+    qint64 memoryUsage() const { return m_memoryUsage; }
+
+    bool canUndo() const { return !m_undo.isEmpty(); }
+    bool canRedo() const { return !m_redo.isEmpty(); }
+    void clear();
+
+    // Новое действие: стек повтора очищается
+    void record(const TableUndoOperation &operation);
+    // Дописать операцию в последний шаг; соседние правки ячеек сливаются
+    void appendToLast(const TableUndoOperation &operation);
+
+    TableUndoStep takeUndo();
+    void pushUndo(TableUndoStep step);
+    TableUndoStep takeRedo();
+    void pushRedo(TableUndoStep step);
+
+private:
+    QStack<TableUndoStep> m_undo;
+    QStack<TableUndoStep> m_redo;
+    qint64 m_memoryLimit = DefaultMemoryLimit;
+    qint64 m_memoryUsage = 0;
+
+    void trim();
+    static bool mergeCells(TableUndoOperation &target, const TableUndoOperation &operation);
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include <QVariant>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "CellStorage.h"
+
+class QTemporaryFile;
+
+// Хранилище для листов больше доступной памяти.
+//
+// Ячейки лежат плитками TileRows x TileColumns. В памяти держатся только недавно
+// использованные плитки в пределах бюджета, остальные (LRU) выгружаются во временный
+// файл и читаются обратно при обращении. Плитка, не измененная после загрузки,
+// вытесняется без записи. Пустые плитки не хранятся.
+// Логические строки/столбцы отображаются на физические слоты плиток, поэтому
+// вставка и удаление строк не переписывают плитки - удаленные слоты очищаются и
+// переиспользуются. value() и prefetch() безопасны из нескольких потоков
+// (кеш плиток под внутренним мьютексом)
+class TiledStorage : public CellStorage
+{
+public:
+    static constexpr int TileRows = 256;
+    static constexpr int TileColumns = 32;
+    static constexpr qint64 DefaultMemoryBudget = 512ll * 1024 * 1024;
+
+    struct Metrics
+    {
+        qint64 hits = 0;          // плитка была в памяти
+        qint64 misses = 0;        // плитка прочитана с диска по запросу
+        qint64 prefetched = 0;    // плитка прочитана с диска заранее
+        qint64 evictions = 0;
+        qint64 spills = 0;        // вытеснения с записью на диск
+        qint64 residentTiles = 0;
+        qint64 spilledTiles = 0;
+        qint64 residentBytes = 0;
+        qint64 spillFileBytes = 0;
+    };
+
+    explicit TiledStorage(qint64 memoryBudget = DefaultMemoryBudget);
+    ~TiledStorage() override;
+
+    Kind kind() const override { return Kind::Tiled; }
+
+    int rowCount() const override { return static_cast<int>(m_rowSlots.size()); }
+    int columnCount() const override { return static_cast<int>(m_columnSlots.size()); }
+
+    QVariant value(int row, int column) const override;
+    void setValue(int row, int column, const QVariant &value) override;
+
+    void insertRows(int row, int count) override;
+    void removeRows(int row, int count) override;
+    void insertColumns(int column, int count) override;
+    void removeColumns(int column, int count) override;
+
+    qint64 filledCellCount() const override { return m_filledCells; }
+    // Порядок - полосами по TileColumns столбцов, внутри полосы по строкам
+    void forEachValue(const std::function<void(int row, int column, const QVariant &value)> &visitor) const override;
+
+    qint64 memoryUsage() const override;
+
+    // Бюджет памяти плиток в байтах; уменьшение сразу вытесняет лишнее
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const { return m_memoryBudget; }
+
+    // Загрузка выгруженных плиток диапазона (логические номера) без учета в промахах
+    void prefetch(int firstRow, int lastRow, int firstColumn, int lastColumn) const;
+
+    Metrics metrics() const;
+
+private:
+    struct Tile
+    {
+        std::vector<QVariant> cells;  // TileRows * TileColumns, по строкам
+        int filled = 0;
+        qint64 bytes = 0;
+        bool dirty = true;            // отличается от копии в файле (или копии нет)
+        std::list<quint64>::iterator lru;
+    };
+    struct SpillRecord
+    {
+        qint64 offset = 0;
+        qint64 size = 0;
+    };
+
+    std::vector<int> m_rowSlots;     // логическая строка -> физический слот
+    std::vector<int> m_columnSlots;
+    std::vector<int> m_freeRowSlots;
+    std::vector<int> m_freeColumnSlots;
+    int m_physicalRows = 0;
+    int m_physicalColumns = 0;
+    qint64 m_filledCells = 0;
+    qint64 m_memoryBudget;
+
+    mutable QMutex m_mutex;
+    mutable std::unordered_map<quint64, std::unique_ptr<Tile>> m_tiles;
+    mutable std::list<quint64> m_lru;  // начало - последняя использованная
+    mutable std::unordered_map<quint64, SpillRecord> m_spilled;
+    mutable std::unique_ptr<QTemporaryFile> m_file;
+    mutable qint64 m_fileGarbage = 0;
+    mutable qint64 m_residentBytes = 0;
+    mutable bool m_spillFailed = false;
+    mutable Metrics m_metrics;
+
+    static quint64 tileKey(int rowSlot, int columnSlot)
+    {
+        return (quint64(quint32(rowSlot / TileRows)) << 32) | quint32(columnSlot / TileColumns);
+    }
+    static int cellIndex(int rowSlot, int columnSlot)
+    {
+        return (rowSlot % TileRows) * TileColumns + columnSlot % TileColumns;
+    }
+    static qint64 valueBytes(const QVariant &value);
+
+    // Вызываются под m_mutex
+    Tile *findTile(quint64 key, bool prefetching = false) const;
+    Tile *createTile(quint64 key);
+    void dropTile(quint64 key);
+    void touch(Tile *tile) const;
+    void evictOverBudget(const Tile *keep) const;
+    bool spill(quint64 key, Tile &tile) const;
+    bool readTile(const SpillRecord &record, Tile &tile) const;
+    void compactFile() const;
+    void clearSlots(std::vector<int> slots, bool rows);
+    int takeSlot(bool rows);
+};
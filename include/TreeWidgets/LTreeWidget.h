@@ -8,6 +8,10 @@
 #include <vector>
 #include <algorithm>
 #include <QMap>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QDropEvent>
 #include <memory>
 
 
@@ -28,9 +32,47 @@ public:
     void deleteNode(const QString &nodeId);
     void renameNode(const QString &nodeId);
 
+    // Подтянуть изменения tree_nodes, сделанные извне, без пересборки дерева:
+    // применяются только вставки/удаления/переносы/переименования, раскрытие и выделение сохраняются
+    void refreshTree();
+
+    // Порядок братьев задается дробным ключом order_key, поэтому вставка и перенос
+    // пишут одну строку. previousId/nextId - соседние братья внутри parentId
+    // (пустой previousId - в начало, оба пустые - в конец). Возвращает id нового узла
+    QString insertNodeBetween(const QString &parentId, const QString &previousId,
+                              const QString &nextId, const QString &name);
+    bool moveNode(const QString &nodeId, const QString &newParentId,
+                  const QString &previousId, const QString &nextId);
+
+    // Массовый импорт/экспорт в JSON Lines (см. TreeTransfer); дерево обновляется один раз в конце.
+    // Пустой id - корень / всё дерево. Возвращают число узлов или -1
+    int importTree(const QString &filePath, const QString &parentId);
+    int exportTree(const QString &filePath, const QString &nodeId);
+
+    // Число потомков узла поддерживается инкрементально (O(глубина) на изменение)
+    // и показывается во второй колонке; отрисовка стоит O(видимых узлов)
+    static constexpr int DescendantCountRole = Qt::UserRole + 1;
+    static constexpr int NodeIdRole = Qt::UserRole + 2;
+    static constexpr int OrderKeyRole = Qt::UserRole + 3;  // tree_nodes.order_key
+    int descendantCount(const QString &nodeId) const;
+    void setShowDescendantCounts(bool show);
+
+public slots:
+    // Поиск по именам узлов через FTS-индекс tree_nodes_fts; результаты приходят
+    // страницами между итерациями цикла событий, поэтому ввод не блокируется
+    void setSearchText(const QString &text);
+    // Режим фильтра: видны только совпадения и их предки
+    void setFilterMode(bool enabled);
+
+protected:
+    // Перетаскивание внутри дерева выполняется через moveNode()
+    void dropEvent(QDropEvent *event) override;
+
 signals:
     void itemClicked(const QString &nodeId, const QString &nodeName);
     void itemDoubleClicked(const QString &nodeId, const QString &nodeName);
+    void searchMatchesFound(const QStringList &nodeIds);  // очередная страница совпадений
+    void searchFinished(int matchCount);
 
 private slots:
     void onItemClicked(QTreeWidgetItem *item, int column);
@@ -39,6 +81,11 @@ private slots:
     void onAddChild();
     void onDeleteNode();
     void onRenameNode();
+    void onImportTree();
+    void onExportTree();
+    void startSearch();
+    void fetchSearchPage();
+    void saveSnapshot();
 
 private:
     void iniTree(QString tableName);
@@ -48,16 +95,52 @@ private:
 
     //std::vector<TreeStruct> treeNodes;
     QMap<QString, std::shared_ptr<QTreeWidgetItem>> itemMap;
+    QHash<QString, qint64> nodeVersions; // id -> tree_nodes.version на момент последней синхронизации
     QMenu *contextMenu;
     QAction *addChildAction;
     QAction *deleteAction;
     QAction *renameAction;
     QAction *addRootAction;
+    QAction *importAction;
+    QAction *exportAction;
     QString currentSelectedNodeId;
 
+    // Состояние поиска
+    static constexpr int SearchPageSize = 256;
+    static constexpr int SearchDebounceMs = 150;
+    QTimer *searchTimer = nullptr;
+    QString searchText;
+    quint64 searchGeneration = 0;  // номер текущего поиска; устаревшие страницы отбрасываются
+    qint64 searchCursor = 0;       // id последнего полученного совпадения (keyset-пагинация)
+    QStringList searchMatchIds;
+    QSet<QString> revealedIds;     // узлы, открытые фильтром поверх скрытого дерева
+    bool filterMode = false;
+    bool filterHidesAll = false;
+
+    // Бинарный снимок дерева (см. TreeSnapshot)
+    static constexpr int SnapshotDelayMs = 2000;
+    QTimer *snapshotTimer = nullptr;
+    qint64 syncedChangeCounter = -1;  // счетчик изменений БД, которому соответствует дерево (-1 - неизвестно)
+
     // Helper methods
     bool isRoot(const QString &nodeId);
     void attachToParent(const QString &childId, const QString &parentId);
+    int orderedInsertIndex(QTreeWidgetItem *parent, QTreeWidgetItem *child) const;
+    QString orderKeyBetween(const QString &parentId, const QString &previousId, const QString &nextId) const;
+    void detachItem(QTreeWidgetItem *item);
+    void adjustAncestorCounts(QTreeWidgetItem *item, int delta);
+    void setItemDescendantCount(QTreeWidgetItem *item, int count);
+    int recountSubtree(QTreeWidgetItem *item);
+    void setupSearch();
+    qint64 readChangeCounter() const;
+    void noteLocalChange(qint64 counterBefore);
+    QString snapshotPath() const;
+    void clearSearchResults();
+    void setAllItemsHidden(bool hidden);
+    void revealWithAncestors(QTreeWidgetItem *item);
+    void setItemHighlighted(QTreeWidgetItem *item, bool highlighted);
+    void collectViewState(QTreeWidgetItem *item, QList<QTreeWidgetItem*> &expanded,
+                          QList<QTreeWidgetItem*> &selected) const;
 
 
 };
@@ -0,0 +1,59 @@
+#pragma once
+#include <QString>
+#include <QList>
+#include <QtGlobal>
+
+// Бинарный снимок дерева для быстрого старта без чтения всей таблицы tree_nodes.
+//
+// Формат файла (порядок байт платформы, файл читается через QFile::map):
+//   Header                        - сигнатура, версия формата, счетчик изменений БД
+//   NodeEntry[nodeCount]          - узлы с целочисленными id и ссылками в таблицу строк
+//   char16_t[stringUnits]         - таблица строк (имена и ключи порядка узлов в UTF-16 подряд)
+//
+// Снимок считается актуальным, только если сохраненный счетчик изменений совпадает
+// с tree_nodes_state.change_counter в БД; иначе дерево загружается из БД.
+class TreeSnapshot
+{
+public:
+    struct Node
+    {
+        qint64 id = 0;
+        qint64 parentId = 0;
+        qint64 version = 0;
+        QString name;
+        QString orderKey;
+    };
+
+    // Записать снимок атомарно (через временный файл)
+    static bool write(const QString &filePath, qint64 changeCounter, const QList<Node> &nodes);
+
+    // Прочитать снимок; false если файла нет, он поврежден или счетчик не совпадает
+    static bool read(const QString &filePath, qint64 expectedChangeCounter, QList<Node> &outNodes);
+
+private:
+    static constexpr quint32 Magic = 0x4E53544C; // "LTSN"
+    static constexpr quint32 FormatVersion = 2; // 2: добавлен ключ порядка узла
+
+    struct Header
+    {
+        quint32 magic;
+        quint32 formatVersion;
+        qint64 changeCounter;
+        quint32 nodeCount;
+        quint32 stringUnits;
+    };
+
+    struct NodeEntry
+    {
+        qint64 id;
+        qint64 parentId;
+        qint64 version;
+        quint32 nameOffset;  // смещение в таблице строк, в символах UTF-16
+        quint32 nameLength;
+        quint32 orderKeyOffset;
+        quint32 orderKeyLength;
+    };
+
+    static_assert(sizeof(Header) == 24, "snapshot header layout changed");
+    static_assert(sizeof(NodeEntry) == 40, "snapshot node layout changed");
+};
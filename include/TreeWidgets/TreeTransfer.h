@@ -0,0 +1,37 @@
+#pragma once
+#include <QString>
+#include <QIODevice>
+#include <QtGlobal>
+
+// Потоковый импорт/экспорт иерархии tree_nodes в формате JSON Lines.
+//
+// Одна строка - один узел: {"id": 12, "parent": 5, "name": "..."}
+// Родитель должен встречаться в файле раньше своих потомков; экспорт пишет узлы
+// обходом в глубину с учетом order_key, поэтому порядок братьев сохраняется.
+// id из файла - идентификаторы клиента: при импорте они заменяются на id БД.
+// Узлы с parent = 0/null или с родителем вне файла прикрепляются к целевому узлу.
+class TreeTransfer
+{
+public:
+    TreeTransfer(const QString &connectionName, const QString &tableName);
+
+    // Импорт под узел targetParentId (0 - в корень). Файл читается дважды:
+    // первый проход проверяет строки и считает детей у каждого родителя (для ключей порядка),
+    // второй вставляет узлы пакетами по ChunkSize строк в отдельных транзакциях.
+    // При ошибке уже зафиксированные пакеты остаются в БД. Возвращает число узлов или -1
+    int importJsonLines(QIODevice &device, qint64 targetParentId);
+
+    // Экспорт поддерева rootId (0 - всё дерево). Возвращает число узлов или -1
+    int exportJsonLines(QIODevice &device, qint64 rootId);
+
+    QString getLastError() const;
+
+private:
+    static constexpr int ChunkSize = 500;
+
+    QString m_connectionName;
+    QString m_tableName;
+    QString m_lastError;
+
+    QString lastChildOrderKey(qint64 parentId);
+};
@@ -1,4 +1,6 @@
 #include "DBConnection.h"
+#include "OrderKey.h"
+#include <QVector>
 #include <QCoreApplication>
 
 DBConnection::DBConnection()
@@ -95,6 +97,13 @@ void DBConnection::createTable()
     }
     createUsersTable(db);
     createTreeNodesTable(db);
+    createTreePathIndex(db);
+    createTreeVersionTracking(db);
+    createTreeDescendantCounts(db);
+    createTreeSearchIndex(db);
+    createTreeChangeCounter(db);
+    createTreeSiblingOrder(db);
+    createSheetTables(db);
 }
 
 bool DBConnection::getDefaultOpenDb(QSqlDatabase& outDb) const
@@ -170,7 +179,11 @@ void DBConnection::createTreeNodesTable(QSqlDatabase& db)
             "CREATE TABLE tree_nodes ("
             "id INTEGER PRIMARY KEY AUTOINCREMENT,"
             "name TEXT NOT NULL,"
-            "parent_id INTEGER DEFAULT 0"
+            "parent_id INTEGER DEFAULT 0,"
+            "path TEXT,"
+            "version INTEGER NOT NULL DEFAULT 0,"
+            "descendant_count INTEGER NOT NULL DEFAULT 0,"
+            "order_key TEXT"
             ")";
 
         if (!query.exec(createTreeQuery)) {
@@ -182,3 +195,390 @@ void DBConnection::createTreeNodesTable(QSqlDatabase& db)
         qDebug() << "table tree_nodes already exists";
     }
 }
+
+bool DBConnection::columnExists(QSqlDatabase& db, const QString& tableName, const QString& columnName) const
+{
+    QSqlQuery query(db);
+    if (!query.exec(QString("PRAGMA table_info(%1)").arg(tableName))) {
+        qWarning() << "error reading structure of" << tableName << ":" << query.lastError().text();
+        return false;
+    }
+    while (query.next()) {
+        // В PRAGMA table_info имя колонки находится под индексом 1
+        if (query.value(1).toString() == columnName) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DBConnection::execStatements(QSqlDatabase& db, const QStringList& statements, const QString& context)
+{
+    QSqlQuery query(db);
+    for (const QString& statement : statements) {
+        if (!query.exec(statement)) {
+            qWarning() << "error" << context << ":" << query.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+void DBConnection::createTreePathIndex(QSqlDatabase& db)
+{
+    // Материализованный путь: path = "/<id корня>/.../<id родителя>/<id узла>/".
+    // Все потомки узла с путём P лежат в диапазоне [P, P без последнего '/' + '0'),
+    // так как после префикса идут только цифры и '/', а '/' < '0'. Поэтому выборка
+    // поддерева - один range scan по индексу idx_tree_nodes_path, а предки узла
+    // читаются прямо из его пути без рекурсивных запросов.
+    QSqlQuery query(db);
+
+    if (!columnExists(db, "tree_nodes", "path")) {
+        if (!query.exec("ALTER TABLE tree_nodes ADD COLUMN path TEXT")) {
+            qWarning() << "error adding column tree_nodes.path:" << query.lastError().text();
+            return;
+        }
+        qDebug() << "column tree_nodes.path added";
+    }
+
+    const QStringList statements = {
+        "CREATE INDEX IF NOT EXISTS idx_tree_nodes_path ON tree_nodes(path)",
+
+        // Новый узел получает путь родителя + собственный id
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_path_insert AFTER INSERT ON tree_nodes "
+        "BEGIN "
+        "UPDATE tree_nodes SET path = "
+        "COALESCE((SELECT p.path FROM tree_nodes p WHERE p.id = NEW.parent_id), '/') || NEW.id || '/' "
+        "WHERE id = NEW.id; "
+        "END",
+
+        // Запрещаем перенос узла внутрь собственного поддерева (иначе образуется цикл)
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_path_guard BEFORE UPDATE OF parent_id ON tree_nodes "
+        "WHEN NEW.parent_id = NEW.id OR EXISTS (SELECT 1 FROM tree_nodes p WHERE p.id = NEW.parent_id "
+        "AND substr(p.path, 1, length(OLD.path)) = OLD.path) "
+        "BEGIN "
+        "SELECT RAISE(ABORT, 'tree_nodes: node cannot be moved into its own subtree'); "
+        "END",
+
+        // Перенос узла переписывает префикс пути у всего поддерева одним range-обновлением
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_path_move AFTER UPDATE OF parent_id ON tree_nodes "
+        "WHEN NEW.parent_id IS NOT OLD.parent_id "
+        "BEGIN "
+        "UPDATE tree_nodes SET path = "
+        "COALESCE((SELECT p.path FROM tree_nodes p WHERE p.id = NEW.parent_id), '/') || NEW.id || '/' "
+        "|| substr(path, length(OLD.path) + 1) "
+        "WHERE path >= OLD.path AND path < substr(OLD.path, 1, length(OLD.path) - 1) || '0'; "
+        "END"
+    };
+    if (!execStatements(db, statements, "creating tree_nodes path index")) {
+        return;
+    }
+
+    // Заполняем пути для строк, созданных до появления индекса
+    const QString backfillQuery =
+        "WITH RECURSIVE node_paths(id, path) AS ("
+        "SELECT id, '/' || id || '/' FROM tree_nodes "
+        "WHERE parent_id IS NULL OR parent_id = 0 "
+        "OR parent_id NOT IN (SELECT id FROM tree_nodes) "
+        "UNION ALL "
+        "SELECT t.id, np.path || t.id || '/' FROM tree_nodes t JOIN node_paths np ON t.parent_id = np.id"
+        ") "
+        "UPDATE tree_nodes SET path = (SELECT np.path FROM node_paths np WHERE np.id = tree_nodes.id) "
+        "WHERE path IS NULL";
+    if (!query.exec(backfillQuery)) {
+        qWarning() << "error filling tree_nodes.path:" << query.lastError().text();
+    } else if (query.numRowsAffected() > 0) {
+        qDebug() << "tree_nodes.path filled for" << query.numRowsAffected() << "rows";
+    }
+}
+
+void DBConnection::createTreeVersionTracking(QSqlDatabase& db)
+{
+    // version увеличивается при каждом переименовании или переносе узла, чтобы
+    // виджет мог сравнить компактный снимок (id, parent_id, name, version)
+    // со своим состоянием и применить только реально изменившиеся узлы
+    if (!columnExists(db, "tree_nodes", "version")) {
+        QSqlQuery query(db);
+        if (!query.exec("ALTER TABLE tree_nodes ADD COLUMN version INTEGER NOT NULL DEFAULT 0")) {
+            qWarning() << "error adding column tree_nodes.version:" << query.lastError().text();
+            return;
+        }
+        qDebug() << "column tree_nodes.version added";
+    }
+
+    const QStringList statements = {
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_version AFTER UPDATE OF name, parent_id ON tree_nodes "
+        "WHEN NEW.name IS NOT OLD.name OR NEW.parent_id IS NOT OLD.parent_id "
+        "BEGIN "
+        "UPDATE tree_nodes SET version = OLD.version + 1 WHERE id = NEW.id; "
+        "END"
+    };
+    execStatements(db, statements, "creating tree_nodes version trigger");
+}
+
+void DBConnection::createTreeDescendantCounts(QSqlDatabase& db)
+{
+    // Предки узла - это ID из пути его родителя, поэтому при вставке, переносе и
+    // удалении обновляются только O(глубина) строк по первичному ключу.
+    // Путь разворачивается в список ID через json_each: CTE внутри триггеров недоступны.
+    QSqlQuery query(db);
+    bool needsBackfill = false;
+
+    if (!columnExists(db, "tree_nodes", "descendant_count")) {
+        if (!query.exec("ALTER TABLE tree_nodes ADD COLUMN descendant_count INTEGER NOT NULL DEFAULT 0")) {
+            qWarning() << "error adding column tree_nodes.descendant_count:" << query.lastError().text();
+            return;
+        }
+        qDebug() << "column tree_nodes.descendant_count added";
+        needsBackfill = true;
+    }
+
+    const QString parentAncestors =
+        "SELECT value FROM json_each('[' || replace(trim("
+        "(SELECT p.path FROM tree_nodes p WHERE p.id = %1.parent_id), '/'), '/', ',') || ']')";
+
+    const QStringList statements = {
+        QString("CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_count_insert AFTER INSERT ON tree_nodes "
+                "BEGIN "
+                "UPDATE tree_nodes SET descendant_count = descendant_count + 1 + NEW.descendant_count "
+                "WHERE id IN (%1); "
+                "END").arg(parentAncestors.arg("NEW")),
+
+        QString("CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_count_move AFTER UPDATE OF parent_id ON tree_nodes "
+                "WHEN NEW.parent_id IS NOT OLD.parent_id "
+                "BEGIN "
+                "UPDATE tree_nodes SET descendant_count = descendant_count - 1 - NEW.descendant_count "
+                "WHERE id IN (%1); "
+                "UPDATE tree_nodes SET descendant_count = descendant_count + 1 + NEW.descendant_count "
+                "WHERE id IN (%2); "
+                "END").arg(parentAncestors.arg("OLD"), parentAncestors.arg("NEW")),
+
+        QString("CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_count_delete AFTER DELETE ON tree_nodes "
+                "BEGIN "
+                "UPDATE tree_nodes SET descendant_count = descendant_count - 1 - OLD.descendant_count "
+                "WHERE id IN (%1); "
+                "END").arg(parentAncestors.arg("OLD"))
+    };
+    if (!execStatements(db, statements, "creating tree_nodes descendant count triggers")) {
+        return;
+    }
+
+    if (needsBackfill) {
+        // Разовый пересчёт для существующих строк: по одному range scan на узел
+        const QString backfillQuery =
+            "UPDATE tree_nodes SET descendant_count = ("
+            "SELECT COUNT(*) FROM tree_nodes d WHERE d.path > tree_nodes.path "
+            "AND d.path < substr(tree_nodes.path, 1, length(tree_nodes.path) - 1) || '0')";
+        if (!query.exec(backfillQuery)) {
+            qWarning() << "error filling tree_nodes.descendant_count:" << query.lastError().text();
+        }
+    }
+}
+
+void DBConnection::createTreeSearchIndex(QSqlDatabase& db)
+{
+    // External-content FTS5 таблица: тексты не дублируются, индекс хранит только
+    // триграммы, поэтому поиск подстроки в любом месте имени не сканирует tree_nodes.
+    // Если SQLite собран без FTS5/trigram, поиск в DataReader откатится на LIKE.
+    QSqlQuery query(db);
+    query.prepare("SELECT name FROM sqlite_master WHERE type='table' AND name='tree_nodes_fts'");
+    if (!query.exec()) {
+        qWarning() << "error checking existence of table tree_nodes_fts:" << query.lastError().text();
+        return;
+    }
+    const bool existed = query.next();
+
+    const QStringList statements = {
+        "CREATE VIRTUAL TABLE IF NOT EXISTS tree_nodes_fts USING fts5("
+        "name, content='tree_nodes', content_rowid='id', tokenize='trigram')",
+
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_fts_insert AFTER INSERT ON tree_nodes "
+        "BEGIN "
+        "INSERT INTO tree_nodes_fts(rowid, name) VALUES (NEW.id, NEW.name); "
+        "END",
+
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_fts_delete AFTER DELETE ON tree_nodes "
+        "BEGIN "
+        "INSERT INTO tree_nodes_fts(tree_nodes_fts, rowid, name) VALUES ('delete', OLD.id, OLD.name); "
+        "END",
+
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_fts_update AFTER UPDATE OF name ON tree_nodes "
+        "BEGIN "
+        "INSERT INTO tree_nodes_fts(tree_nodes_fts, rowid, name) VALUES ('delete', OLD.id, OLD.name); "
+        "INSERT INTO tree_nodes_fts(rowid, name) VALUES (NEW.id, NEW.name); "
+        "END"
+    };
+    if (!execStatements(db, statements, "creating tree_nodes search index")) {
+        return;
+    }
+
+    if (!existed) {
+        // Индексируем строки, созданные до появления FTS-таблицы
+        if (!query.exec("INSERT INTO tree_nodes_fts(tree_nodes_fts) VALUES ('rebuild')")) {
+            qWarning() << "error building tree_nodes_fts:" << query.lastError().text();
+        } else {
+            qDebug() << "table tree_nodes_fts successfully created";
+        }
+    }
+}
+
+void DBConnection::createTreeChangeCounter(QSqlDatabase& db)
+{
+    // PRAGMA data_version живет только в пределах соединения, поэтому счетчик
+    // хранится в отдельной однострочной таблице и переживает перезапуск приложения
+    const QStringList statements = {
+        "CREATE TABLE IF NOT EXISTS tree_nodes_state ("
+        "id INTEGER PRIMARY KEY CHECK (id = 1),"
+        "change_counter INTEGER NOT NULL DEFAULT 0"
+        ")",
+
+        "INSERT OR IGNORE INTO tree_nodes_state (id, change_counter) VALUES (1, 0)",
+
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_state_insert AFTER INSERT ON tree_nodes "
+        "BEGIN "
+        "UPDATE tree_nodes_state SET change_counter = change_counter + 1 WHERE id = 1; "
+        "END",
+
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_state_update AFTER UPDATE OF name, parent_id ON tree_nodes "
+        "BEGIN "
+        "UPDATE tree_nodes_state SET change_counter = change_counter + 1 WHERE id = 1; "
+        "END",
+
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_state_delete AFTER DELETE ON tree_nodes "
+        "BEGIN "
+        "UPDATE tree_nodes_state SET change_counter = change_counter + 1 WHERE id = 1; "
+        "END"
+    };
+    execStatements(db, statements, "creating tree_nodes change counter");
+}
+
+void DBConnection::createTreeSiblingOrder(QSqlDatabase& db)
+{
+    // order_key - дробный ключ порядка среди братьев (см. OrderKey): вставка между
+    // соседями и перестановка меняют одну строку без перенумерации остальных.
+    // Порядок читается индексом (parent_id, order_key) без отдельной сортировки.
+    QSqlQuery query(db);
+
+    if (!columnExists(db, "tree_nodes", "order_key")) {
+        if (!query.exec("ALTER TABLE tree_nodes ADD COLUMN order_key TEXT")) {
+            qWarning() << "error adding column tree_nodes.order_key:" << query.lastError().text();
+            return;
+        }
+        qDebug() << "column tree_nodes.order_key added";
+    }
+
+    const QStringList statements = {
+        "CREATE INDEX IF NOT EXISTS idx_tree_nodes_parent_order ON tree_nodes(parent_id, order_key)",
+
+        // Перестановка без смены имени и родителя тоже должна быть видна refreshTree
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_order_version AFTER UPDATE OF order_key ON tree_nodes "
+        "WHEN NEW.order_key IS NOT OLD.order_key "
+        "AND NEW.name IS OLD.name AND NEW.parent_id IS OLD.parent_id "
+        "BEGIN "
+        "UPDATE tree_nodes SET version = OLD.version + 1 WHERE id = NEW.id; "
+        "END",
+
+        "CREATE TRIGGER IF NOT EXISTS trg_tree_nodes_state_order AFTER UPDATE OF order_key ON tree_nodes "
+        "WHEN NEW.order_key IS NOT OLD.order_key "
+        "BEGIN "
+        "UPDATE tree_nodes_state SET change_counter = change_counter + 1 WHERE id = 1; "
+        "END"
+    };
+    if (!execStatements(db, statements, "creating tree_nodes sibling order")) {
+        return;
+    }
+
+    // Строкам без ключа сохраняем прежний порядок (по id): ключи OrderKey идут после
+    // всех существующих. Ключ из id с ведущими нулями сломал бы порядок на длинных id
+    QVector<qint64> ids;
+    if (!query.exec("SELECT id FROM tree_nodes WHERE order_key IS NULL ORDER BY id")) {
+        qWarning() << "error reading tree_nodes without order_key:" << query.lastError().text();
+        return;
+    }
+    while (query.next()) ids.append(query.value(0).toLongLong());
+    if (ids.isEmpty()) return;
+
+    QString lastKey;
+    if (query.exec("SELECT MAX(order_key) FROM tree_nodes") && query.next()) {
+        lastKey = query.value(0).toString();
+    }
+    const QStringList keys = OrderKey::sequence(lastKey, QString(), ids.size());
+
+    db.transaction();
+    query.prepare("UPDATE tree_nodes SET order_key = ? WHERE id = ?");
+    for (int i = 0; i < ids.size(); ++i) {
+        query.addBindValue(keys[i]);
+        query.addBindValue(ids[i]);
+        if (!query.exec()) {
+            qWarning() << "error filling tree_nodes.order_key:" << query.lastError().text();
+            db.rollback();
+            return;
+        }
+    }
+    if (!db.commit()) {
+        qWarning() << "error filling tree_nodes.order_key:" << db.lastError().text();
+        return;
+    }
+    qDebug() << "tree_nodes.order_key filled for" << ids.size() << "rows";
+}
+
+void DBConnection::createSheetTables(QSqlDatabase& db)
+{
+    // Лист таблицы хранится по ячейкам: сохранение пишет только измененные ячейки,
+    // строки и столбцы. Порядок строк/столбцов - дробные ключи (см. OrderKey),
+    // поэтому вставка строки в середину не перенумеровывает остальные
+    const QStringList statements = {
+        "CREATE TABLE IF NOT EXISTS sheets ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "name TEXT NOT NULL"
+        ")",
+
+        "CREATE TABLE IF NOT EXISTS sheet_columns ("
+        "sheet_id INTEGER NOT NULL,"
+        "column_id INTEGER NOT NULL,"
+        "order_key TEXT NOT NULL,"
+        "name TEXT,"
+        "value_type INTEGER NOT NULL DEFAULT 0,"  // ColumnType, 0 - без схемы
+        "formula TEXT,"                           // вычисляемый столбец (ссылки [#column_id])
+        "PRIMARY KEY (sheet_id, column_id)"
+        ") WITHOUT ROWID",
+
+        "CREATE TABLE IF NOT EXISTS sheet_rows ("
+        "sheet_id INTEGER NOT NULL,"
+        "row_id INTEGER NOT NULL,"
+        "order_key TEXT NOT NULL,"
+        "PRIMARY KEY (sheet_id, row_id)"
+        ") WITHOUT ROWID",
+
+        // value без объявленного типа: SQLite хранит INTEGER/REAL/TEXT как есть
+        "CREATE TABLE IF NOT EXISTS sheet_cells ("
+        "sheet_id INTEGER NOT NULL,"
+        "row_id INTEGER NOT NULL,"
+        "column_id INTEGER NOT NULL,"
+        "value,"
+        "PRIMARY KEY (sheet_id, row_id, column_id)"
+        ") WITHOUT ROWID",
+
+        // Удаление столбца чистит его ячейки без полного сканирования
+        "CREATE INDEX IF NOT EXISTS idx_sheet_cells_column ON sheet_cells(sheet_id, column_id)"
+    };
+    execStatements(db, statements, "creating sheet tables");
+
+    // Базы, созданные до появления типов столбцов
+    if (!columnExists(db, "sheet_columns", "value_type")) {
+        QSqlQuery query(db);
+        if (!query.exec("ALTER TABLE sheet_columns ADD COLUMN value_type INTEGER NOT NULL DEFAULT 0")) {
+            qWarning() << "error adding column sheet_columns.value_type:" << query.lastError().text();
+            return;
+        }
+        qDebug() << "column sheet_columns.value_type added";
+    }
+    if (!columnExists(db, "sheet_columns", "formula")) {
+        QSqlQuery query(db);
+        if (!query.exec("ALTER TABLE sheet_columns ADD COLUMN formula TEXT")) {
+            qWarning() << "error adding column sheet_columns.formula:" << query.lastError().text();
+            return;
+        }
+        qDebug() << "column sheet_columns.formula added";
+    }
+}
@@ -534,6 +534,56 @@ int DataModifier::batchDelete(const QString& tableName, const QVariantList& ids,
     return deleteRecords(tableName, whereClause);
 }
 
+int DataModifier::batchExecute(const QString& queryStr, const QList<QVariantList>& rows, int batchSize)
+{
+    if (queryStr.isEmpty()) {
+        m_lastError = "Query string is empty";
+        return -1;
+    }
+    if (rows.isEmpty()) {
+        return 0;
+    }
+
+    QSqlQuery query(getDatabase());
+    if (!query.prepare(queryStr)) {
+        setError(query.lastError());
+        return -1;
+    }
+
+    const bool inLocalTransaction = !m_inTransaction && batchSize > 0;
+    if (inLocalTransaction && !beginTransaction()) {
+        return -1;
+    }
+
+    int successCount = 0;
+    int currentBatch = 0;
+    for (const QVariantList& bindValues : rows) {
+        for (const QVariant& value : bindValues) {
+            query.addBindValue(value);
+        }
+        if (!query.exec()) {
+            // rollbackTransaction() очищает текст ошибки - восстанавливаем его
+            const QSqlError error = query.lastError();
+            if (inLocalTransaction) rollbackTransaction();
+            setError(error);
+            return -1;
+        }
+        ++successCount;
+
+        if (inLocalTransaction && ++currentBatch >= batchSize) {
+            if (!commitTransaction() || !beginTransaction()) {
+                return -1;
+            }
+            currentBatch = 0;
+        }
+    }
+
+    if (inLocalTransaction && !commitTransaction()) {
+        return -1;
+    }
+    return successCount;
+}
+
 // ========================================
 // === СПЕЦИАЛИЗИРОВАННЫЕ ОПЕРАЦИИ ===
 // ========================================
@@ -1,5 +1,6 @@
 #pragma once
 #include "DataReader.h"
+#include <QDebug>
 
 
 namespace {
@@ -45,6 +46,10 @@ void DataReader::setConnectionName(const QString& connectionName) {
     m_connectionName = connectionName;
 }
 
+QString DataReader::getConnectionName() const {
+    return m_connectionName;
+}
+
 /**
  * @brief Внутренний метод для выполнения SELECT-запросов
  *
@@ -643,12 +648,79 @@ QList<QSqlRecord> DataReader::selectWithPagination(const QString& tableName, int
     return executeSelectQuery(q);
 }
 
+QList<QSqlRecord> DataReader::selectKeysetPage(const QString& tableName, const QString& keyColumn,
+                                             const QVariant& afterKey, int limit,
+                                             const QStringList& columns) const {
+    QList<QSqlRecord> results;
+    m_lastError.clear();
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isValid() || !db.isOpen()) {
+        m_lastError = QString("Database is not open for connection '%1'").arg(m_connectionName);
+        return results;
+    }
+
+    QString cols = columns.isEmpty() ? "*" : joinIdentifiers(columns);
+    QString q = QString("SELECT %1 FROM %2").arg(cols, tableName);
+    if (afterKey.isValid()) q += QString(" WHERE %1 > ?").arg(keyColumn);
+    q += QString(" ORDER BY %1 LIMIT %2").arg(keyColumn).arg(limit);
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!query.prepare(q)) {
+        m_lastError = query.lastError().text();
+        return results;
+    }
+    if (afterKey.isValid()) query.addBindValue(afterKey);
+    if (!query.exec()) {
+        m_lastError = query.lastError().text();
+        return results;
+    }
+    while (query.next()) {
+        results.append(makeRowRecord(query));
+    }
+    return results;
+}
+
 QList<QSqlRecord> DataReader::selectDistinct(const QString& tableName, const QStringList& columns) const {
     QString cols = columns.isEmpty() ? "*" : joinIdentifiers(columns);
     QString q = QString("SELECT DISTINCT %1 FROM %2").arg(cols, tableName);
     return executeSelectQuery(q);
 }
 
+int DataReader::forEachRecord(const QString& queryStr, const QVariantList& bindValues,
+                              const std::function<bool(const QSqlRecord&)>& callback) const {
+    m_lastError.clear();
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isValid() || !db.isOpen()) {
+        m_lastError = QString("Database is not open for connection '%1'").arg(m_connectionName);
+        return -1;
+    }
+
+    QSqlQuery query(db);
+    // Без forward-only QSqlQuery кэширует все прочитанные строки
+    query.setForwardOnly(true);
+    if (!query.prepare(queryStr)) {
+        m_lastError = query.lastError().text();
+        return -1;
+    }
+    for (const QVariant& value : bindValues) {
+        query.addBindValue(value);
+    }
+    if (!query.exec()) {
+        m_lastError = query.lastError().text();
+        return -1;
+    }
+
+    int processed = 0;
+    while (query.next()) {
+        ++processed;
+        if (!callback(makeRowRecord(query))) {
+            break;
+        }
+    }
+    return processed;
+}
+
 QMap<QString, int> DataReader::getTableRowCounts() const {
     QMap<QString, int> counts;
     for (const QString& t : getTableNames()) {
@@ -841,6 +913,188 @@ QList<QSqlRecord> DataReader::selectByPattern(const QString& tableName, const QS
     return results;
 }
 
+/**
+ * @brief Постраничный полнотекстовый поиск
+ *
+ * Термин передается в MATCH как строка в двойных кавычках, чтобы символы
+ * синтаксиса FTS5 внутри пользовательского ввода трактовались буквально.
+ *
+ * @return Записи найденных строк, отсортированные по id
+ */
+QList<QSqlRecord> DataReader::searchFullText(const QString& tableName, const QString& ftsTableName,
+                                             const QString& columnName, const QString& searchTerm,
+                                             qint64 afterId, int limit) const {
+    QList<QSqlRecord> results;
+    m_lastError.clear();
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isValid() || !db.isOpen()) {
+        m_lastError = QString("Database is not open for connection '%1'").arg(m_connectionName);
+        return results;
+    }
+    if (searchTerm.isEmpty() || limit <= 0) return results;
+
+    QSqlQuery query(db);
+    if (searchTerm.size() >= 3) {
+        const QString q = QString(
+            "SELECT t.* FROM %1 f JOIN %2 t ON t.id = f.rowid "
+            "WHERE %1 MATCH ? AND f.rowid > ? ORDER BY f.rowid LIMIT ?").arg(ftsTableName, tableName);
+        QString phrase = searchTerm;
+        phrase.replace("\"", "\"\"");
+        if (query.prepare(q)) {
+            query.addBindValue(QString("\"%1\"").arg(phrase));
+            query.addBindValue(afterId);
+            query.addBindValue(limit);
+            if (query.exec()) {
+                while (query.next()) results.append(makeRowRecord(query));
+                return results;
+            }
+        }
+        qWarning() << "full-text search unavailable, falling back to LIKE:" << query.lastError().text();
+    }
+
+    // Экранируем символы подстановки LIKE во введенном тексте
+    QString pattern = searchTerm;
+    pattern.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_");
+    const QString q = QString(
+        "SELECT * FROM %1 WHERE %2 LIKE ? ESCAPE '\\' AND id > ? ORDER BY id LIMIT ?").arg(tableName, columnName);
+    if (!query.prepare(q)) {
+        m_lastError = query.lastError().text();
+        return results;
+    }
+    query.addBindValue(QString("%" + pattern + "%"));
+    query.addBindValue(afterId);
+    query.addBindValue(limit);
+    if (!query.exec()) {
+        m_lastError = query.lastError().text();
+        return results;
+    }
+    while (query.next()) results.append(makeRowRecord(query));
+    return results;
+}
+
+/**
+ * @brief Разобрать материализованный путь
+ *
+ * Путь хранится как "/1/5/9/": ID корня идёт первым, ID самого узла - последним.
+ *
+ * @param path Материализованный путь
+ * @return Список ID от корня до узла
+ */
+QList<qint64> DataReader::parsePath(const QString& path) {
+    QList<qint64> ids;
+    const QStringList parts = path.split('/', Qt::SkipEmptyParts);
+    ids.reserve(parts.size());
+    for (const QString& part : parts) {
+        bool ok = false;
+        const qint64 id = part.toLongLong(&ok);
+        if (ok) ids.append(id);
+    }
+    return ids;
+}
+
+QList<qint64> DataReader::getAncestorIds(const QString& tableName, const QVariant& nodeId) const {
+    const QSqlRecord node = findById(tableName, "id", nodeId);
+    if (node.isEmpty()) return {};
+
+    QList<qint64> ids = parsePath(node.value("path").toString());
+    if (!ids.isEmpty()) ids.removeLast(); // последний элемент пути - сам узел
+    return ids;
+}
+
+/**
+ * @brief Выбрать записи предков узла
+ *
+ * Предки берутся из пути узла и читаются одним запросом по первичному ключу,
+ * затем упорядочиваются от корня к родителю в соответствии с путём.
+ *
+ * @param tableName Имя таблицы дерева
+ * @param nodeId ID узла
+ * @return Записи предков от корня до родителя
+ */
+QList<QSqlRecord> DataReader::selectAncestors(const QString& tableName, const QVariant& nodeId) const {
+    const QList<qint64> ancestorIds = getAncestorIds(tableName, nodeId);
+    if (ancestorIds.isEmpty()) return {};
+
+    QStringList idStrings;
+    for (qint64 id : ancestorIds) idStrings << QString::number(id);
+    const QList<QSqlRecord> records = executeSelectQuery(
+        QString("SELECT * FROM %1 WHERE id IN (%2)").arg(tableName, joinIdentifiers(idStrings)));
+
+    QMap<qint64, QSqlRecord> byId;
+    for (const QSqlRecord& record : records) byId.insert(record.value("id").toLongLong(), record);
+
+    QList<QSqlRecord> ordered;
+    for (qint64 id : ancestorIds) {
+        if (byId.contains(id)) ordered.append(byId.value(id));
+    }
+    return ordered;
+}
+
+/**
+ * @brief Выбрать всех потомков узла
+ *
+ * Пути потомков начинаются с пути узла P, а все такие строки лежат в диапазоне
+ * [P, P без завершающего '/' + '0'), поэтому запрос выполняется как один
+ * range scan по индексу на колонке path.
+ *
+ * @param tableName Имя таблицы дерева
+ * @param nodeId ID узла
+ * @return Записи потомков, отсортированные по пути
+ */
+QList<QSqlRecord> DataReader::selectDescendants(const QString& tableName, const QVariant& nodeId) const {
+    QList<QSqlRecord> results;
+    m_lastError.clear();
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isValid() || !db.isOpen()) {
+        m_lastError = QString("Database is not open for connection '%1'").arg(m_connectionName);
+        return results;
+    }
+
+    QSqlQuery query(db);
+    const QString q = QString(
+        "SELECT d.* FROM %1 a JOIN %1 d "
+        "ON d.path > a.path AND d.path < substr(a.path, 1, length(a.path) - 1) || '0' "
+        "WHERE a.id = ? ORDER BY d.path").arg(tableName);
+    if (!query.prepare(q)) {
+        m_lastError = query.lastError().text();
+        return results;
+    }
+    query.addBindValue(nodeId);
+    if (!query.exec()) {
+        m_lastError = query.lastError().text();
+        return results;
+    }
+
+    while (query.next()) results.append(makeRowRecord(query));
+    return results;
+}
+
+bool DataReader::isDescendantOf(const QString& tableName, const QVariant& nodeId, const QVariant& ancestorId) const {
+    m_lastError.clear();
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isValid() || !db.isOpen()) {
+        m_lastError = QString("Database is not open for connection '%1'").arg(m_connectionName);
+        return false;
+    }
+
+    // Узел лежит в поддереве, если путь предка является строгим префиксом его пути
+    QSqlQuery query(db);
+    const QString q = QString(
+        "SELECT 1 FROM %1 n JOIN %1 a ON a.id = ? "
+        "WHERE n.id = ? AND n.id <> a.id AND substr(n.path, 1, length(a.path)) = a.path LIMIT 1").arg(tableName);
+    if (!query.prepare(q)) {
+        m_lastError = query.lastError().text();
+        return false;
+    }
+    query.addBindValue(ancestorId);
+    query.addBindValue(nodeId);
+    if (!query.exec()) {
+        m_lastError = query.lastError().text();
+        return false;
+    }
+    return query.next();
+}
+
 QString DataReader::getLastError() const {
     return m_lastError;
 }
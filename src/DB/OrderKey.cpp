@@ -0,0 +1,90 @@
+#include "OrderKey.h"
+
+namespace {
+    const char Digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    constexpr int Base = 62;
+}
+
+int OrderKey::digitIndex(QChar digit)
+{
+    const char16_t c = digit.unicode();
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'z') return c - 'a' + 36;
+    return 0;
+}
+
+QString OrderKey::between(const QString& before, const QString& after)
+{
+    if (!after.isEmpty() && !(before < after)) {
+        return QString();
+    }
+    // В конец списка: увеличиваем первую не максимальную цифру - ключ остается коротким
+    if (after.isEmpty()) {
+        return increment(before);
+    }
+    return midpoint(before, after);
+}
+
+QString OrderKey::increment(const QString& key)
+{
+    for (int i = 0; i < key.size(); ++i) {
+        const int digit = digitIndex(key.at(i));
+        if (digit < Base - 1) {
+            return key.left(i) + QChar(Digits[digit + 1]);
+        }
+    }
+    // Ключ состоит только из 'z' (или пуст) - уходим на разряд глубже
+    return key + QChar(Digits[Base / 2]);
+}
+
+QString OrderKey::midpoint(const QString& before, const QString& after)
+{
+    // Общий префикс (before дополняется нулями справа) переносится в результат как есть
+    if (!after.isEmpty()) {
+        int n = 0;
+        while (n < after.size() && (n < before.size() ? before.at(n) : QChar('0')) == after.at(n)) {
+            ++n;
+        }
+        if (n > 0) {
+            return after.left(n) + midpoint(before.mid(n), after.mid(n));
+        }
+    }
+
+    const int digitBefore = before.isEmpty() ? 0 : digitIndex(before.at(0));
+    const int digitAfter = after.isEmpty() ? Base : digitIndex(after.at(0));
+
+    // Между первыми цифрами есть свободная цифра
+    if (digitAfter - digitBefore > 1) {
+        return QString(QChar(Digits[(digitBefore + digitAfter + 1) / 2]));
+    }
+    // Цифры соседние: если after длиннее одной цифры, его первая цифра уже подходит
+    if (after.size() > 1) {
+        return after.left(1);
+    }
+    // Иначе берем цифру before и ищем место после остатка before
+    return QChar(Digits[digitBefore]) + midpoint(before.mid(1), QString());
+}
+
+QStringList OrderKey::sequence(const QString& before, const QString& after, int count)
+{
+    QStringList keys;
+    if (count <= 0 || (!after.isEmpty() && !(before < after))) {
+        return keys;
+    }
+    keys.reserve(count);
+    fillSequence(before, after, count, keys);
+    return keys;
+}
+
+void OrderKey::fillSequence(const QString& before, const QString& after, int count, QStringList& out)
+{
+    if (count <= 0) return;
+
+    // Делим интервал пополам: глубина рекурсии и длина ключей растут логарифмически
+    const QString middle = between(before, after);
+    const int leftCount = (count - 1) / 2;
+    fillSequence(before, middle, leftCount, out);
+    out.append(middle);
+    fillSequence(middle, after, count - 1 - leftCount, out);
+}
@@ -1,4 +1,5 @@
 #include "MainWind.h"
+#include <QSqlRecord>
 
 
 MainWindow::MainWindow(DatabaseManager *dbInit, QMainWindow *parent)
@@ -10,8 +11,23 @@ MainWindow::MainWindow(DatabaseManager *dbInit, QMainWindow *parent)
 
     Ltree = std::make_unique<LTreeWidget>("tree_nodes",treeWidget, dbMan);
 
+    connect(lineEdit_treeSearch, &QLineEdit::textChanged, Ltree.get(), &LTreeWidget::setSearchText);
+    connect(checkBox_treeFilter, &QCheckBox::toggled, Ltree.get(), &LTreeWidget::setFilterMode);
+
     tableInteract = std::make_unique<TableInteract>(tableView, this);
 
+    // Таблица показывает первый лист из БД; при первом запуске он создается
+    qint64 sheetId = -1;
+    const int found = dbMan->getReader()->forEachRecord("SELECT id FROM sheets ORDER BY id LIMIT 1", {},
+                                                        [&sheetId](const QSqlRecord &record) {
+        sheetId = record.value(0).toLongLong();
+        return false;
+    });
+    if (found < 0) qWarning() << "sheets not read:" << dbMan->getReader()->getLastError();
+    if (found == 0) sheetId = TableInteract::createSheet(dbMan, "Лист 1");
+    if (!tableInteract->openSheet(dbMan, sheetId)) {
+        qWarning() << "sheet" << sheetId << "not opened";
+    }
 }
 
 MainWindow::~MainWindow()
@@ -0,0 +1,129 @@
+#include "AggregateFooter.h"
+#include "TableDataModel.h"
+#include <QHeaderView>
+#include <QPainter>
+#include <QStyleOptionHeader>
+#include <QContextMenuEvent>
+#include <QMenu>
+#include <QActionGroup>
+#include <cmath>
+
+namespace {
+    QString formatNumber(double value)
+    {
+        if (std::isnan(value)) return QString();
+        // Целые без дробной части, остальные - до 10 значащих цифр
+        if (std::floor(value) == value && std::fabs(value) < 1e15) {
+            return QString::number(static_cast<qint64>(value));
+        }
+        return QString::number(value, 'g', 10);
+    }
+}
+
+AggregateFooter::AggregateFooter(QHeaderView *header, QWidget *parent)
+    : QWidget(parent), m_header(header)
+{
+    connect(m_header, &QHeaderView::sectionResized, this, qOverload<>(&QWidget::update));
+    connect(m_header, &QHeaderView::sectionMoved, this, qOverload<>(&QWidget::update));
+    connect(m_header, &QHeaderView::geometriesChanged, this, qOverload<>(&QWidget::update));
+}
+
+void AggregateFooter::setSourceModel(TableDataModel *model)
+{
+    if (m_model) disconnect(m_model, nullptr, this, nullptr);
+    m_model = model;
+    if (m_model) {
+        // Итоги берутся из кеша модели, поэтому достаточно перерисовки
+        connect(m_model, &TableDataModel::columnAggregatesReady, this, qOverload<>(&QWidget::update));
+        connect(m_model, &QAbstractItemModel::dataChanged, this, qOverload<>(&QWidget::update));
+        connect(m_model, &QAbstractItemModel::rowsInserted, this, qOverload<>(&QWidget::update));
+        connect(m_model, &QAbstractItemModel::rowsRemoved, this, qOverload<>(&QWidget::update));
+        connect(m_model, &QAbstractItemModel::columnsInserted, this, qOverload<>(&QWidget::update));
+        connect(m_model, &QAbstractItemModel::columnsRemoved, this, qOverload<>(&QWidget::update));
+        connect(m_model, &QAbstractItemModel::modelReset, this, qOverload<>(&QWidget::update));
+    }
+    update();
+}
+
+void AggregateFooter::setFunction(Function function)
+{
+    m_function = function;
+    update();
+}
+
+QSize AggregateFooter::sizeHint() const
+{
+    return QSize(0, m_header->sizeHint().height());
+}
+
+QString AggregateFooter::cellText(int column) const
+{
+    if (!m_model) return QString();
+
+    // Итог еще считается в пуле потоков - ячейка пока пустая
+    ColumnAggregates aggregates;
+    if (!m_model->columnAggregates(column, aggregates)) return QString();
+    switch (m_function) {
+    case Function::Sum:
+        return aggregates.numericCount > 0 ? formatNumber(aggregates.sum) : QString();
+    case Function::Mean:
+        return formatNumber(aggregates.mean());
+    case Function::Min:
+        return formatNumber(aggregates.min);
+    case Function::Max:
+        return formatNumber(aggregates.max);
+    case Function::Count:
+        return QString::number(aggregates.count);
+    case Function::NullCount:
+        return QString::number(aggregates.nullCount);
+    }
+    return QString();
+}
+
+void AggregateFooter::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+
+    // Только видимые секции: итоги невидимых столбцов не считаются
+    const int first = m_header->visualIndexAt(0);
+    int last = m_header->visualIndexAt(width() - 1);
+    if (first < 0) return;
+    if (last < 0) last = m_header->count() - 1;
+
+    for (int visual = first; visual <= last; ++visual) {
+        const int logical = m_header->logicalIndex(visual);
+        if (logical < 0 || m_header->isSectionHidden(logical)) continue;
+
+        QStyleOptionHeader option;
+        option.initFrom(this);
+        option.rect = QRect(m_header->sectionViewportPosition(logical), 0, m_header->sectionSize(logical), height());
+        option.section = logical;
+        option.textAlignment = Qt::AlignRight | Qt::AlignVCenter;
+        option.text = cellText(logical);
+        style()->drawControl(QStyle::CE_Header, &option, &painter, this);
+    }
+}
+
+void AggregateFooter::contextMenuEvent(QContextMenuEvent *event)
+{
+    QMenu menu(this);
+    auto *group = new QActionGroup(&menu);
+    const QList<QPair<QString, Function>> items = {
+        {"Сумма", Function::Sum},
+        {"Среднее", Function::Mean},
+        {"Минимум", Function::Min},
+        {"Максимум", Function::Max},
+        {"Количество", Function::Count},
+        {"Пустых", Function::NullCount},
+    };
+    for (const auto &item : items) {
+        QAction *action = menu.addAction(item.first);
+        action->setCheckable(true);
+        action->setChecked(item.second == m_function);
+        group->addAction(action);
+        const Function function = item.second;
+        connect(action, &QAction::triggered, this, [this, function]() { setFunction(function); });
+    }
+    menu.exec(event->globalPos());
+}
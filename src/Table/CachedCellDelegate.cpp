@@ -0,0 +1,119 @@
+#include "CachedCellDelegate.h"
+#include <QAbstractItemModel>
+#include <QApplication>
+#include <QPainter>
+#include <QStyle>
+
+CachedCellDelegate::CachedCellDelegate(QObject *parent)
+    : QStyledItemDelegate(parent), m_cache(MaxCachedCells)
+{
+}
+
+void CachedCellDelegate::setModel(QAbstractItemModel *model)
+{
+    if (m_model) m_model->disconnect(this);
+    m_model = model;
+    clear();
+    if (!model) return;
+
+    connect(model, &QAbstractItemModel::dataChanged, this, &CachedCellDelegate::onDataChanged);
+    // Ключ кеша - позиция ячейки: любое смещение строк/столбцов делает его неверным
+    connect(model, &QAbstractItemModel::layoutChanged, this, &CachedCellDelegate::clear);
+    connect(model, &QAbstractItemModel::modelReset, this, &CachedCellDelegate::clear);
+    connect(model, &QAbstractItemModel::rowsInserted, this, &CachedCellDelegate::clear);
+    connect(model, &QAbstractItemModel::rowsRemoved, this, &CachedCellDelegate::clear);
+    connect(model, &QAbstractItemModel::rowsMoved, this, &CachedCellDelegate::clear);
+    connect(model, &QAbstractItemModel::columnsInserted, this, &CachedCellDelegate::clear);
+    connect(model, &QAbstractItemModel::columnsRemoved, this, &CachedCellDelegate::clear);
+    connect(model, &QAbstractItemModel::columnsMoved, this, &CachedCellDelegate::clear);
+}
+
+void CachedCellDelegate::clear()
+{
+    m_cache.clear();
+}
+
+void CachedCellDelegate::onDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight)
+{
+    // Большой диапазон (заполнение, замена) дешевле сбросить целиком
+    const qint64 cells = qint64(bottomRight.row() - topLeft.row() + 1) * (bottomRight.column() - topLeft.column() + 1);
+    if (cells > m_cache.maxCost()) {
+        clear();
+        return;
+    }
+    for (int row = topLeft.row(); row <= bottomRight.row(); ++row) {
+        for (int column = topLeft.column(); column <= bottomRight.column(); ++column) {
+            m_cache.remove(key(row, column));
+        }
+    }
+}
+
+void CachedCellDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    if (option.font != m_font) {
+        m_cache.clear();
+        m_font = option.font;
+    }
+
+    const QWidget *widget = option.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+
+    // Фон и выделение рисует стиль, как у стандартного делегата
+    QStyleOptionViewItem background(option);
+    background.index = index;
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &background, painter, widget);
+
+    const int margin = style->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, widget) + 1;
+    const QRect textRect = option.rect.adjusted(margin, 0, -margin, 0);
+
+    const quint64 cellKey = key(index.row(), index.column());
+    Entry *entry = m_cache.object(cellKey);
+    if (!entry) {
+        ++m_misses;
+        entry = new Entry;
+        const QVariant value = index.data(Qt::DisplayRole);
+        if (value.isValid()) entry->text = displayText(value, option.locale);
+        m_cache.insert(cellKey, entry);
+    } else {
+        ++m_hits;
+    }
+    if (entry->text.isEmpty()) {
+        if (option.state & QStyle::State_HasFocus) {
+            style->drawPrimitive(QStyle::PE_FrameFocusRect, &background, painter, widget);
+        }
+        return;
+    }
+
+    // Раскладка текста зависит только от ширины ячейки
+    if (entry->width != textRect.width()) {
+        const QString elided = option.fontMetrics.elidedText(entry->text, option.textElideMode, textRect.width());
+        entry->layout.setText(elided);
+        entry->layout.setTextFormat(Qt::PlainText);
+        entry->layout.prepare(QTransform(), option.font);
+        entry->width = textRect.width();
+    }
+
+    const QSizeF size = entry->layout.size();
+    qreal x = textRect.left();
+    if (option.displayAlignment & Qt::AlignRight) {
+        x = textRect.right() + 1 - size.width();
+    } else if (option.displayAlignment & Qt::AlignHCenter) {
+        x = textRect.left() + (textRect.width() - size.width()) / 2;
+    }
+    const qreal y = textRect.top() + (textRect.height() - size.height()) / 2;
+
+    const bool selected = option.state & QStyle::State_Selected;
+    const QPalette::ColorGroup group = !(option.state & QStyle::State_Enabled) ? QPalette::Disabled
+                                       : (option.state & QStyle::State_Active) ? QPalette::Normal
+                                                                               : QPalette::Inactive;
+    painter->save();
+    painter->setFont(option.font);
+    painter->setPen(option.palette.color(group, selected ? QPalette::HighlightedText : QPalette::Text));
+    painter->setClipRect(textRect);
+    painter->drawStaticText(QPointF(x, y), entry->layout);
+    painter->restore();
+
+    if (option.state & QStyle::State_HasFocus) {
+        style->drawPrimitive(QStyle::PE_FrameFocusRect, &background, painter, widget);
+    }
+}
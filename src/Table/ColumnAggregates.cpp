@@ -0,0 +1,296 @@
+#include "ColumnAggregates.h"
+#include "ColumnStorage.h"
+#include <QtAlgorithms>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TABLE_AGGREGATES_SSE2
+#endif
+
+namespace {
+    constexpr int BlockRows = 64;  // строк на слово битовой карты
+    constexpr quint64 FullBlock = ~quint64(0);
+
+    bool isNumeric(const QVariant &value, double &number)
+    {
+        const TableColumn::Type type = TableColumn::typeForValue(value);
+        if (type != TableColumn::Type::Int64 && type != TableColumn::Type::Double) return false;
+        number = value.toDouble();
+        return true;
+    }
+
+    void addNumber(ColumnAggregates &out, double number)
+    {
+        ++out.numericCount;
+        out.sum += number;
+        out.min = std::fmin(out.min, number);  // fmin/fmax пропускают начальный NaN
+        out.max = std::fmax(out.max, number);
+    }
+
+    void sumBlock(const double *data, double &sum, double &low, double &high)
+    {
+#ifdef TABLE_AGGREGATES_SSE2
+        __m128d sums = _mm_setzero_pd();
+        __m128d lows = _mm_set1_pd(low);
+        __m128d highs = _mm_set1_pd(high);
+        for (int i = 0; i < BlockRows; i += 2) {
+            const __m128d values = _mm_loadu_pd(data + i);
+            sums = _mm_add_pd(sums, values);
+            lows = _mm_min_pd(lows, values);
+            highs = _mm_max_pd(highs, values);
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, sums);
+        sum += lanes[0] + lanes[1];
+        _mm_storeu_pd(lanes, lows);
+        low = std::fmin(lanes[0], lanes[1]);
+        _mm_storeu_pd(lanes, highs);
+        high = std::fmax(lanes[0], lanes[1]);
+#else
+        for (int i = 0; i < BlockRows; ++i) {
+            sum += data[i];
+            low = std::fmin(low, data[i]);
+            high = std::fmax(high, data[i]);
+        }
+#endif
+    }
+
+    void sumBlock(const qint64 *data, qint64 &sum, qint64 &low, qint64 &high)
+    {
+#ifdef TABLE_AGGREGATES_SSE2
+        // В SSE2 нет сравнения 64-битных целых - векторно только сумма
+        __m128i sums = _mm_setzero_si128();
+        for (int i = 0; i < BlockRows; i += 2) {
+            sums = _mm_add_epi64(sums, _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+        }
+        qint64 lanes[2];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), sums);
+        sum += lanes[0] + lanes[1];
+        for (int i = 0; i < BlockRows; ++i) {
+            low = qMin(low, data[i]);
+            high = qMax(high, data[i]);
+        }
+#else
+        for (int i = 0; i < BlockRows; ++i) {
+            sum += data[i];
+            low = qMin(low, data[i]);
+            high = qMax(high, data[i]);
+        }
+#endif
+    }
+}
+
+void AggregateKernels::accumulate(const double *data, const quint64 *valid, int rowCount, ColumnAggregates &out)
+{
+    if (!data || !valid) return;
+
+    double sum = 0.0;
+    double low = std::numeric_limits<double>::infinity();
+    double high = -std::numeric_limits<double>::infinity();
+    qint64 count = 0;
+
+    const int words = (rowCount + BlockRows - 1) / BlockRows;
+    for (int word = 0; word < words; ++word) {
+        const double *block = data + word * BlockRows;
+        quint64 bits = valid[word];
+        if (bits == FullBlock && rowCount - word * BlockRows >= BlockRows) {
+            sumBlock(block, sum, low, high);
+            count += BlockRows;
+            continue;
+        }
+        while (bits) {
+            const int i = qCountTrailingZeroBits(bits);
+            bits &= bits - 1;
+            sum += block[i];
+            low = std::fmin(low, block[i]);
+            high = std::fmax(high, block[i]);
+            ++count;
+        }
+    }
+
+    if (count == 0) return;
+    out.numericCount += count;
+    out.sum += sum;
+    out.min = std::fmin(out.min, low);
+    out.max = std::fmax(out.max, high);
+}
+
+void AggregateKernels::accumulate(const qint64 *data, const quint64 *valid, int rowCount, ColumnAggregates &out)
+{
+    if (!data || !valid) return;
+
+    // Сумма целых копится точно и переводится в double один раз
+    qint64 sum = 0;
+    qint64 low = std::numeric_limits<qint64>::max();
+    qint64 high = std::numeric_limits<qint64>::min();
+    qint64 count = 0;
+
+    const int words = (rowCount + BlockRows - 1) / BlockRows;
+    for (int word = 0; word < words; ++word) {
+        const qint64 *block = data + word * BlockRows;
+        quint64 bits = valid[word];
+        if (bits == FullBlock && rowCount - word * BlockRows >= BlockRows) {
+            sumBlock(block, sum, low, high);
+            count += BlockRows;
+            continue;
+        }
+        while (bits) {
+            const int i = qCountTrailingZeroBits(bits);
+            bits &= bits - 1;
+            sum += block[i];
+            low = qMin(low, block[i]);
+            high = qMax(high, block[i]);
+            ++count;
+        }
+    }
+
+    if (count == 0) return;
+    out.numericCount += count;
+    out.sum += double(sum);
+    out.min = std::fmin(out.min, double(low));
+    out.max = std::fmax(out.max, double(high));
+}
+
+ColumnAggregates ColumnAggregates::compute(const CellStorage &storage, int column)
+{
+    ColumnAggregates result;
+    const int rowCount = storage.rowCount();
+
+    if (storage.kind() == CellStorage::Kind::Columnar) {
+        const TableColumn &source = static_cast<const ColumnStorage &>(storage).column(column);
+        result.count = source.nonNullCount();
+        result.nullCount = rowCount - result.count;
+        if (result.count == 0) return result;
+
+        // Ядра идут по блокам колонки: блок кратен 64 строкам, слова битовой карты не делятся
+        switch (source.type()) {
+        case TableColumn::Type::Int64:
+            for (int chunk = 0; chunk < source.chunkCount(); ++chunk) {
+                AggregateKernels::accumulate(source.int64Data(chunk), source.validityBits(chunk), source.chunkRowCount(chunk), result);
+            }
+            break;
+        case TableColumn::Type::Double:
+            for (int chunk = 0; chunk < source.chunkCount(); ++chunk) {
+                AggregateKernels::accumulate(source.doubleData(chunk), source.validityBits(chunk), source.chunkRowCount(chunk), result);
+            }
+            break;
+        case TableColumn::Type::String:
+            break;
+        case TableColumn::Type::Variant:
+            for (int row = 0; row < rowCount; ++row) {
+                double number;
+                if (!source.isNull(row) && isNumeric(source.value(row), number)) addNumber(result, number);
+            }
+            break;
+        }
+        return result;
+    }
+
+    // Разреженное хранилище: скалярный обход
+    for (int row = 0; row < rowCount; ++row) {
+        const QVariant value = storage.value(row, column);
+        if (!value.isValid()) continue;
+        ++result.count;
+        double number;
+        if (isNumeric(value, number)) addNumber(result, number);
+    }
+    result.nullCount = rowCount - result.count;
+    return result;
+}
+
+void AggregateCache::clear()
+{
+    for (Entry &entry : m_entries) touch(entry);
+}
+
+void AggregateCache::invalidate(int column)
+{
+    if (column >= 0 && column < m_entries.size()) touch(m_entries[column]);
+}
+
+void AggregateCache::insertColumns(int column, int count)
+{
+    if (column > m_entries.size()) return;
+    // Столбцы правее сдвигаются - их фоновые итоги относятся к другим индексам
+    for (int i = column; i < m_entries.size(); ++i) m_entries[i].version = ++m_version;
+    for (int i = 0; i < count; ++i) m_entries.insert(column + i, freshEntry());
+}
+
+void AggregateCache::removeColumns(int column, int count)
+{
+    if (column >= m_entries.size()) return;
+    m_entries.remove(column, qMin(count, int(m_entries.size()) - column));
+    for (int i = column; i < m_entries.size(); ++i) m_entries[i].version = ++m_version;
+}
+
+void AggregateCache::insertRows(int count)
+{
+    // Новые строки пустые
+    for (Entry &entry : m_entries) {
+        entry.version = ++m_version;
+        if (entry.valid) entry.value.nullCount += count;
+    }
+}
+
+void AggregateCache::cellChanged(int column, const QVariant &oldValue, const QVariant &newValue)
+{
+    if (column < 0 || column >= m_entries.size()) return;
+    m_entries[column].version = ++m_version;
+    if (!m_entries[column].valid) return;
+    ColumnAggregates &value = m_entries[column].value;
+
+    double oldNumber = 0.0;
+    const bool oldNumeric = oldValue.isValid() && isNumeric(oldValue, oldNumber);
+    if (oldNumeric && (oldNumber == value.min || oldNumber == value.max)) {
+        // Крайнее значение ушло - новый min/max без полного прохода не узнать
+        m_entries[column].valid = false;
+        return;
+    }
+
+    if (oldValue.isValid()) {
+        --value.count;
+        ++value.nullCount;
+    }
+    if (oldNumeric) {
+        --value.numericCount;
+        value.sum -= oldNumber;
+    }
+    if (newValue.isValid()) {
+        ++value.count;
+        --value.nullCount;
+        double number;
+        if (isNumeric(newValue, number)) addNumber(value, number);
+    }
+}
+
+const ColumnAggregates &AggregateCache::get(const CellStorage &storage, int column)
+{
+    version(column, storage.columnCount());
+
+    Entry &entry = m_entries[column];
+    if (!entry.valid) {
+        entry.value = ColumnAggregates::compute(storage, column);
+        entry.valid = true;
+    }
+    return entry.value;
+}
+
+const ColumnAggregates *AggregateCache::find(int column) const
+{
+    if (column < 0 || column >= m_entries.size() || !m_entries[column].valid) return nullptr;
+    return &m_entries[column].value;
+}
+
+quint64 AggregateCache::version(int column, int columnCount)
+{
+    while (m_entries.size() < columnCount) m_entries.append(freshEntry());
+    return m_entries[column].version;
+}
+
+void AggregateCache::store(int column, quint64 version, const ColumnAggregates &value)
+{
+    if (column < 0 || column >= m_entries.size() || m_entries[column].version != version) return;
+    m_entries[column].value = value;
+    m_entries[column].valid = true;
+}
@@ -0,0 +1,304 @@
+#include "ColumnFormula.h"
+#include <QVarLengthArray>
+#include <cmath>
+#include <limits>
+
+namespace {
+    constexpr double NaN = std::numeric_limits<double>::quiet_NaN();
+    // Глубина вложенности скобок/функций - защита стека парсера
+    constexpr int MaxNesting = 64;
+}
+
+class ColumnFormula::Parser
+{
+public:
+    Parser(ColumnFormula &formula, const QString &text, const std::function<qint64(const QString &)> &resolveName)
+        : m_formula(formula), m_text(text), m_resolveName(resolveName)
+    {
+    }
+
+    bool parse()
+    {
+        if (!parseExpression(0)) return false;
+        skipSpaces();
+        if (m_pos < m_text.size()) return fail(QStringLiteral("лишний символ '%1'").arg(m_text.at(m_pos)));
+        if (m_literalStart < m_text.size()) {
+            m_formula.m_parts.append({m_text.mid(m_literalStart), -1});
+        }
+        return true;
+    }
+
+private:
+    ColumnFormula &m_formula;
+    const QString &m_text;
+    const std::function<qint64(const QString &)> &m_resolveName;
+    int m_pos = 0;
+    int m_literalStart = 0;
+    int m_depth = 0;
+
+    bool fail(const QString &message)
+    {
+        m_formula.m_lastError = QStringLiteral("%1 (позиция %2)").arg(message).arg(m_pos + 1);
+        return false;
+    }
+
+    void skipSpaces()
+    {
+        while (m_pos < m_text.size() && m_text.at(m_pos).isSpace()) ++m_pos;
+    }
+
+    bool accept(QChar symbol)
+    {
+        skipSpaces();
+        if (m_pos < m_text.size() && m_text.at(m_pos) == symbol) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    void emitOp(Op op, int slot = 0, double number = 0.0)
+    {
+        m_formula.m_program.append({op, slot, number});
+        switch (op) {
+        case Op::Number:
+        case Op::Input:
+            ++m_depth;
+            break;
+        case Op::Add:
+        case Op::Sub:
+        case Op::Mul:
+        case Op::Div:
+            --m_depth;
+            break;
+        case Op::Neg:
+        case Op::CumSum:
+            break;
+        }
+        m_formula.m_stackDepth = qMax(m_formula.m_stackDepth, m_depth);
+    }
+
+    bool parseExpression(int nesting)
+    {
+        if (nesting > MaxNesting) return fail(QStringLiteral("слишком глубокая вложенность"));
+        if (!parseTerm(nesting)) return false;
+        for (;;) {
+            if (accept('+')) {
+                if (!parseTerm(nesting)) return false;
+                emitOp(Op::Add);
+            } else if (accept('-')) {
+                if (!parseTerm(nesting)) return false;
+                emitOp(Op::Sub);
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool parseTerm(int nesting)
+    {
+        if (!parseFactor(nesting)) return false;
+        for (;;) {
+            if (accept('*')) {
+                if (!parseFactor(nesting)) return false;
+                emitOp(Op::Mul);
+            } else if (accept('/')) {
+                if (!parseFactor(nesting)) return false;
+                emitOp(Op::Div);
+            } else {
+                return true;
+            }
+        }
+    }
+
+    bool parseFactor(int nesting)
+    {
+        if (accept('-')) {
+            if (!parseFactor(nesting + 1)) return false;
+            emitOp(Op::Neg);
+            return true;
+        }
+        if (accept('(')) {
+            if (!parseExpression(nesting + 1)) return false;
+            return accept(')') || fail(QStringLiteral("ожидается ')'"));
+        }
+        skipSpaces();
+        if (m_pos >= m_text.size()) return fail(QStringLiteral("неожиданный конец формулы"));
+
+        const QChar symbol = m_text.at(m_pos);
+        if (symbol == '[') return parseReference();
+        if (symbol.isDigit() || symbol == '.') return parseNumber();
+        if (symbol.isLetter()) return parseFunction(nesting);
+        return fail(QStringLiteral("неожиданный символ '%1'").arg(symbol));
+    }
+
+    bool parseNumber()
+    {
+        const int start = m_pos;
+        while (m_pos < m_text.size() && (m_text.at(m_pos).isDigit() || m_text.at(m_pos) == '.')) ++m_pos;
+        bool ok = false;
+        const double number = QStringView(m_text).mid(start, m_pos - start).toDouble(&ok);
+        if (!ok) return fail(QStringLiteral("неверное число"));
+        emitOp(Op::Number, 0, number);
+        return true;
+    }
+
+    bool parseFunction(int nesting)
+    {
+        const int start = m_pos;
+        while (m_pos < m_text.size() && m_text.at(m_pos).isLetterOrNumber()) ++m_pos;
+        const QStringView name = QStringView(m_text).mid(start, m_pos - start);
+        if (name.compare(u"cumsum", Qt::CaseInsensitive) != 0) {
+            m_pos = start;
+            return fail(QStringLiteral("неизвестная функция '%1'").arg(name));
+        }
+        if (!accept('(')) return fail(QStringLiteral("ожидается '('"));
+        if (!parseExpression(nesting + 1)) return false;
+        if (!accept(')')) return fail(QStringLiteral("ожидается ')'"));
+        emitOp(Op::CumSum, m_formula.m_cumulativeCount++);
+        return true;
+    }
+
+    bool parseReference()
+    {
+        const int start = m_pos;
+        const int end = m_text.indexOf(']', start + 1);
+        if (end < 0) return fail(QStringLiteral("ожидается ']'"));
+        const QString name = m_text.mid(start + 1, end - start - 1).trimmed();
+
+        qint64 id = -1;
+        if (name.startsWith('#')) {
+            bool ok = false;
+            id = name.mid(1).toLongLong(&ok);
+            if (!ok) id = -1;
+        } else if (m_resolveName) {
+            id = m_resolveName(name);
+        }
+        if (id < 0) return fail(QStringLiteral("нет столбца '%1'").arg(name));
+
+        int slot = m_formula.m_inputs.indexOf(id);
+        if (slot < 0) {
+            slot = m_formula.m_inputs.size();
+            m_formula.m_inputs.append(id);
+        }
+        if (start > m_literalStart) {
+            m_formula.m_parts.append({m_text.mid(m_literalStart, start - m_literalStart), -1});
+        }
+        m_formula.m_parts.append({QString(), id});
+        m_pos = end + 1;
+        m_literalStart = m_pos;
+        emitOp(Op::Input, slot);
+        return true;
+    }
+};
+
+bool ColumnFormula::compile(const QString &text, const std::function<qint64(const QString &name)> &resolveName)
+{
+    m_program.clear();
+    m_inputs.clear();
+    m_parts.clear();
+    m_cumulativeCount = 0;
+    m_stackDepth = 0;
+    m_lastError.clear();
+
+    Parser parser(*this, text, resolveName);
+    if (!parser.parse()) {
+        m_program.clear();
+        return false;
+    }
+    return true;
+}
+
+QString ColumnFormula::displayText(const std::function<QString(qint64 id)> &columnName) const
+{
+    QString text;
+    for (const auto &part : m_parts) {
+        if (part.second < 0) {
+            text += part.first;
+        } else {
+            text += '[' + columnName(part.second) + ']';
+        }
+    }
+    return text;
+}
+
+QString ColumnFormula::storedText() const
+{
+    return displayText([](qint64 id) { return QStringLiteral("#%1").arg(id); });
+}
+
+double ColumnFormula::evaluate(const double *inputs, double *sums) const
+{
+    QVarLengthArray<double, 16> stack(qMax(m_stackDepth, 1));
+    int top = -1;
+    for (const Instruction &instruction : m_program) {
+        switch (instruction.op) {
+        case Op::Number:
+            stack[++top] = instruction.number;
+            break;
+        case Op::Input:
+            stack[++top] = inputs[instruction.slot];
+            break;
+        case Op::Add:
+            stack[top - 1] += stack[top];
+            --top;
+            break;
+        case Op::Sub:
+            stack[top - 1] -= stack[top];
+            --top;
+            break;
+        case Op::Mul:
+            stack[top - 1] *= stack[top];
+            --top;
+            break;
+        case Op::Div:
+            stack[top - 1] = stack[top] == 0.0 ? NaN : stack[top - 1] / stack[top];
+            --top;
+            break;
+        case Op::Neg:
+            stack[top] = -stack[top];
+            break;
+        case Op::CumSum:
+            if (!std::isnan(stack[top])) sums[instruction.slot] += stack[top];
+            stack[top] = sums[instruction.slot];
+            break;
+        }
+    }
+    return top == 0 ? stack[0] : NaN;
+}
+
+void ColumnFormula::remapInputs(const QHash<qint64, qint64> &ids)
+{
+    for (qint64 &id : m_inputs) {
+        id = ids.value(id, id);
+    }
+    for (auto &part : m_parts) {
+        if (part.second >= 0) part.second = ids.value(part.second, part.second);
+    }
+}
+
+double ColumnFormula::toNumber(const QVariant &value)
+{
+    switch (value.typeId()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+    case QMetaType::Double:
+    case QMetaType::Float:
+        return value.toDouble();
+    case QMetaType::Bool:
+        return value.toBool() ? 1.0 : 0.0;
+    case QMetaType::QString: {
+        const QString text = value.toString().trimmed();
+        bool ok = false;
+        double number = text.toDouble(&ok);
+        if (!ok && text.contains(',')) number = QString(text).replace(',', '.').toDouble(&ok);
+        return ok ? number : NaN;
+    }
+    default:
+        return NaN;
+    }
+}
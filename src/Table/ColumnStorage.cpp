@@ -0,0 +1,413 @@
+#include "ColumnStorage.h"
+#include <iterator>
+
+namespace {
+    constexpr int BitsPerWord = 64;
+    // Пул строк уплотняется, когда мусора больше половины и он заметного размера
+    constexpr qsizetype MinGarbageToCompact = 4096;
+
+    int wordCount(int bits)
+    {
+        return (bits + BitsPerWord - 1) / BitsPerWord;
+    }
+
+    bool testBit(const std::vector<quint64> &bits, int index)
+    {
+        return (bits[index / BitsPerWord] >> (index % BitsPerWord)) & 1u;
+    }
+
+    void assignBit(std::vector<quint64> &bits, int index, bool value)
+    {
+        const quint64 mask = quint64(1) << (index % BitsPerWord);
+        if (value) {
+            bits[index / BitsPerWord] |= mask;
+        } else {
+            bits[index / BitsPerWord] &= ~mask;
+        }
+    }
+}
+
+TableColumn::TableColumn(int rowCount)
+    : m_rowCount(rowCount)
+{
+}
+
+TableColumn::Type TableColumn::typeForValue(const QVariant &value)
+{
+    switch (value.typeId()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+        return Type::Int64;
+    case QMetaType::Double:
+    case QMetaType::Float:
+        return Type::Double;
+    case QMetaType::QString:
+        return Type::String;
+    default:
+        return Type::Variant;
+    }
+}
+
+bool TableColumn::isNull(int row) const
+{
+    return !m_allocated || !testBit(chunkAt(row).valid, row % ChunkRows);
+}
+
+QVariant TableColumn::value(int row) const
+{
+    if (isNull(row)) {
+        return QVariant();
+    }
+    const Chunk &chunk = chunkAt(row);
+    const int index = row % ChunkRows;
+    switch (m_type) {
+    case Type::Int64:
+        return QVariant::fromValue<qint64>(chunk.ints[index]);
+    case Type::Double:
+        return chunk.doubles[index];
+    case Type::String:
+        return stringAt(row).toString();
+    case Type::Variant:
+        return chunk.variants[index];
+    }
+    return QVariant();
+}
+
+QStringView TableColumn::stringAt(int row) const
+{
+    if (m_type != Type::String || isNull(row)) {
+        return QStringView();
+    }
+    const Chunk &chunk = chunkAt(row);
+    const StringRef &ref = chunk.strings[row % ChunkRows];
+    return QStringView(chunk.stringPool).mid(ref.offset, ref.length);
+}
+
+const qint64 *TableColumn::int64Data(int chunk) const
+{
+    const std::vector<qint64> &ints = m_chunks[chunk]->ints;
+    return ints.empty() ? nullptr : ints.data();
+}
+
+const double *TableColumn::doubleData(int chunk) const
+{
+    const std::vector<double> &doubles = m_chunks[chunk]->doubles;
+    return doubles.empty() ? nullptr : doubles.data();
+}
+
+const quint64 *TableColumn::validityBits(int chunk) const
+{
+    const std::vector<quint64> &valid = m_chunks[chunk]->valid;
+    return valid.empty() ? nullptr : valid.data();
+}
+
+void TableColumn::setValue(int row, const QVariant &value)
+{
+    const bool wasNull = isNull(row);
+    const int index = row % ChunkRows;
+
+    if (!value.isValid()) {
+        if (wasNull) return;
+        Chunk &chunk = detachChunk(row / ChunkRows);
+        if (m_type == Type::String) releaseString(chunk, index);
+        if (m_type == Type::Variant) chunk.variants[index] = QVariant();
+        assignBit(chunk.valid, index, false);
+        --m_nonNullCount;
+        return;
+    }
+
+    const Type valueType = typeForValue(value);
+    if (valueType != m_type) {
+        // Единственное значение колонки перезаписывается - тип можно сменить без конвертации
+        if (m_nonNullCount == 0 || (m_nonNullCount == 1 && !wasNull)) {
+            reset(valueType);
+        } else if (m_type != Type::Variant) {
+            convertToVariant();
+        }
+    }
+    if (!m_allocated) allocate();
+
+    const bool nowNull = isNull(row);
+    Chunk &chunk = detachChunk(row / ChunkRows);
+    switch (m_type) {
+    case Type::Int64:
+        chunk.ints[index] = value.toLongLong();
+        break;
+    case Type::Double:
+        chunk.doubles[index] = value.toDouble();
+        break;
+    case Type::String: {
+        if (!nowNull) releaseString(chunk, index);
+        const QString text = value.toString();
+        chunk.strings[index] = {static_cast<quint32>(chunk.stringPool.size()), static_cast<quint32>(text.size())};
+        chunk.stringPool.append(text);
+        compactStrings(chunk);
+        break;
+    }
+    case Type::Variant:
+        chunk.variants[index] = value;
+        break;
+    }
+
+    if (nowNull) {
+        assignBit(chunk.valid, index, true);
+        ++m_nonNullCount;
+    }
+}
+
+void TableColumn::insertRows(int row, int count)
+{
+    if (count <= 0) return;
+
+    if (m_allocated) rebuildTail(row, count, 0);
+    m_rowCount += count;
+}
+
+void TableColumn::removeRows(int row, int count)
+{
+    if (count <= 0) return;
+
+    if (m_allocated) {
+        for (int i = row; i < row + count; ++i) {
+            if (!isNull(i)) --m_nonNullCount;
+        }
+        rebuildTail(row, 0, count);
+    }
+    m_rowCount -= count;
+}
+
+qint64 TableColumn::memoryUsage() const
+{
+    qint64 total = static_cast<qint64>(sizeof(TableColumn))
+                   + static_cast<qint64>(m_chunks.capacity() * sizeof(std::shared_ptr<Chunk>));
+    for (const auto &chunk : m_chunks) {
+        total += static_cast<qint64>(sizeof(Chunk))
+                 + static_cast<qint64>(chunk->valid.capacity() * sizeof(quint64))
+                 + static_cast<qint64>(chunk->ints.capacity() * sizeof(qint64))
+                 + static_cast<qint64>(chunk->doubles.capacity() * sizeof(double))
+                 + static_cast<qint64>(chunk->strings.capacity() * sizeof(StringRef))
+                 + static_cast<qint64>(chunk->stringPool.capacity()) * static_cast<qint64>(sizeof(QChar))
+                 + static_cast<qint64>(chunk->variants.capacity() * sizeof(QVariant));
+    }
+    return total;
+}
+
+TableColumn::Chunk &TableColumn::detachChunk(int chunk)
+{
+    std::shared_ptr<Chunk> &target = m_chunks[chunk];
+    if (target.use_count() > 1) target = std::make_shared<Chunk>(*target);
+    return *target;
+}
+
+std::shared_ptr<TableColumn::Chunk> TableColumn::makeChunk(int rows) const
+{
+    auto chunk = std::make_shared<Chunk>();
+    chunk->valid.assign(wordCount(rows), 0);
+    switch (m_type) {
+    case Type::Int64: chunk->ints.assign(rows, 0); break;
+    case Type::Double: chunk->doubles.assign(rows, 0.0); break;
+    case Type::String: chunk->strings.assign(rows, StringRef{0, 0}); break;
+    case Type::Variant: chunk->variants.assign(rows, QVariant()); break;
+    }
+    return chunk;
+}
+
+void TableColumn::allocate()
+{
+    m_chunks.clear();
+    for (int first = 0; first < m_rowCount; first += ChunkRows) {
+        m_chunks.push_back(makeChunk(qMin(ChunkRows, m_rowCount - first)));
+    }
+    m_allocated = true;
+}
+
+void TableColumn::reset(Type type)
+{
+    std::vector<std::shared_ptr<Chunk>>().swap(m_chunks);
+    m_nonNullCount = 0;
+    m_allocated = false;
+    m_type = type;
+}
+
+void TableColumn::convertToVariant()
+{
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    chunks.reserve(m_chunks.size());
+    for (int chunk = 0; chunk < chunkCount(); ++chunk) {
+        const int first = chunk * ChunkRows;
+        auto converted = std::make_shared<Chunk>();
+        converted->valid = m_chunks[chunk]->valid;
+        converted->variants.resize(chunkRowCount(chunk));
+        for (int index = 0; index < chunkRowCount(chunk); ++index) {
+            if (!isNull(first + index)) converted->variants[index] = value(first + index);
+        }
+        chunks.push_back(std::move(converted));
+    }
+
+    m_chunks = std::move(chunks);
+    m_type = Type::Variant;
+}
+
+void TableColumn::rebuildTail(int row, int inserted, int removed)
+{
+    // Блоки выше row не меняются (и остаются общими с копиями колонки); блоки от row
+    // до конца собираются заново со сдвигом. Пул строк новых блоков сразу плотный
+    const int newRowCount = m_rowCount + inserted - removed;
+    const int firstChunk = row / ChunkRows;
+
+    std::vector<std::shared_ptr<Chunk>> tail;
+    for (int first = firstChunk * ChunkRows; first < newRowCount; first += ChunkRows) {
+        std::shared_ptr<Chunk> chunk = makeChunk(qMin(ChunkRows, newRowCount - first));
+        for (int index = 0; index < qMin(ChunkRows, newRowCount - first); ++index) {
+            const int target = first + index;
+            if (target >= row && target < row + inserted) continue;  // вставленные строки пустые
+            const int source = target < row ? target : target - inserted + removed;
+            if (!isNull(source)) copyCell(source, *chunk, index);
+        }
+        tail.push_back(std::move(chunk));
+    }
+
+    m_chunks.erase(m_chunks.begin() + qMin(firstChunk, chunkCount()), m_chunks.end());
+    m_chunks.insert(m_chunks.end(), std::make_move_iterator(tail.begin()), std::make_move_iterator(tail.end()));
+}
+
+void TableColumn::copyCell(int row, Chunk &target, int index) const
+{
+    const Chunk &source = chunkAt(row);
+    const int sourceIndex = row % ChunkRows;
+    switch (m_type) {
+    case Type::Int64:
+        target.ints[index] = source.ints[sourceIndex];
+        break;
+    case Type::Double:
+        target.doubles[index] = source.doubles[sourceIndex];
+        break;
+    case Type::String: {
+        const StringRef &ref = source.strings[sourceIndex];
+        target.strings[index] = {static_cast<quint32>(target.stringPool.size()), ref.length};
+        target.stringPool.append(QStringView(source.stringPool).mid(ref.offset, ref.length));
+        break;
+    }
+    case Type::Variant:
+        target.variants[index] = source.variants[sourceIndex];
+        break;
+    }
+    assignBit(target.valid, index, true);
+}
+
+void TableColumn::releaseString(Chunk &chunk, int index)
+{
+    chunk.stringGarbage += chunk.strings[index].length;
+    chunk.strings[index] = StringRef{0, 0};
+}
+
+void TableColumn::compactStrings(Chunk &chunk)
+{
+    if (chunk.stringGarbage < MinGarbageToCompact || chunk.stringGarbage * 2 < chunk.stringPool.size()) {
+        return;
+    }
+
+    QString pool;
+    pool.reserve(chunk.stringPool.size() - chunk.stringGarbage);
+    for (int index = 0; index < static_cast<int>(chunk.strings.size()); ++index) {
+        if (!testBit(chunk.valid, index)) continue;
+        StringRef &ref = chunk.strings[index];
+        const quint32 offset = static_cast<quint32>(pool.size());
+        pool.append(QStringView(chunk.stringPool).mid(ref.offset, ref.length));
+        ref.offset = offset;
+    }
+    chunk.stringPool = std::move(pool);
+    chunk.stringGarbage = 0;
+}
+
+QVariant ColumnStorage::value(int row, int column) const
+{
+    return m_columns[column]->value(row);
+}
+
+void ColumnStorage::setValue(int row, int column, const QVariant &value)
+{
+    detach(column).setValue(row, value);
+}
+
+void ColumnStorage::insertRows(int row, int count)
+{
+    for (int column = 0; column < columnCount(); ++column) {
+        detach(column).insertRows(row, count);
+    }
+    m_rowCount += count;
+}
+
+void ColumnStorage::removeRows(int row, int count)
+{
+    for (int column = 0; column < columnCount(); ++column) {
+        detach(column).removeRows(row, count);
+    }
+    m_rowCount -= count;
+}
+
+void ColumnStorage::insertColumns(int column, int count)
+{
+    // Новые колонки пустые: буферы выделятся при первой записи
+    // Весь диапазон вставляется одним сдвигом хвоста
+    std::vector<std::shared_ptr<TableColumn>> added;
+    added.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        added.push_back(std::make_shared<TableColumn>(m_rowCount));
+    }
+    m_columns.insert(m_columns.begin() + column, std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+}
+
+void ColumnStorage::removeColumns(int column, int count)
+{
+    m_columns.erase(m_columns.begin() + column, m_columns.begin() + column + count);
+}
+
+qint64 ColumnStorage::filledCellCount() const
+{
+    qint64 total = 0;
+    for (const auto &column : m_columns) {
+        total += column->nonNullCount();
+    }
+    return total;
+}
+
+void ColumnStorage::forEachValue(const std::function<void(int row, int column, const QVariant &value)> &visitor) const
+{
+    for (int column = 0; column < columnCount(); ++column) {
+        const TableColumn &source = *m_columns[column];
+        if (source.nonNullCount() == 0) continue;
+        for (int row = 0; row < m_rowCount; ++row) {
+            if (!source.isNull(row)) visitor(row, column, source.value(row));
+        }
+    }
+}
+
+qint64 ColumnStorage::memoryUsage() const
+{
+    qint64 total = static_cast<qint64>(m_columns.capacity() * sizeof(std::shared_ptr<TableColumn>));
+    for (const auto &column : m_columns) {
+        total += column->memoryUsage();
+    }
+    return total;
+}
+
+std::shared_ptr<const CellStorage> ColumnStorage::snapshot() const
+{
+    auto copy = std::make_shared<ColumnStorage>();
+    copy->m_columns = m_columns;
+    copy->m_rowCount = m_rowCount;
+    return copy;
+}
+
+TableColumn &ColumnStorage::detach(int column)
+{
+    // Снимки создаются и пишутся только из потока модели: use_count() == 1 значит,
+    // что новых владельцев у колонки появиться не может
+    std::shared_ptr<TableColumn> &target = m_columns[column];
+    if (target.use_count() > 1) target = std::make_shared<TableColumn>(*target);
+    return *target;
+}
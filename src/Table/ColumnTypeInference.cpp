@@ -0,0 +1,217 @@
+#include "ColumnTypeInference.h"
+#include "ColumnStorage.h"
+#include "TableDataModel.h"
+#include <QDate>
+#include <QtMath>
+#include <QLocale>
+#include <QReadLocker>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <numeric>
+
+namespace {
+    // Меньше - быстрее посчитать на месте, чем раздавать задачи
+    constexpr qint64 MinCellsForParallel = 200000;
+
+    const QStringList DateFormats = {"yyyy-MM-dd", "dd.MM.yyyy", "d.M.yyyy"};
+
+    bool parseBool(QStringView text, bool &value)
+    {
+        if (text.compare(u"true", Qt::CaseInsensitive) == 0 || text.compare(u"да", Qt::CaseInsensitive) == 0) {
+            value = true;
+            return true;
+        }
+        if (text.compare(u"false", Qt::CaseInsensitive) == 0 || text.compare(u"нет", Qt::CaseInsensitive) == 0) {
+            value = false;
+            return true;
+        }
+        return false;
+    }
+
+    bool parseDouble(QStringView text, double &value)
+    {
+        bool ok = false;
+        value = text.toDouble(&ok);
+        if (ok) return true;
+        // Русская запись с запятой
+        value = QLocale(QLocale::Russian).toDouble(text, &ok);
+        return ok;
+    }
+
+    QDate parseDate(QStringView text)
+    {
+        // Быстрый отсев: даты начинаются с цифры и содержат разделитель
+        if (text.size() < 8 || text.size() > 10 || !text.front().isDigit()) return QDate();
+        for (const QString &format : DateFormats) {
+            const QDate date = QDate::fromString(text.toString(), format);
+            if (date.isValid()) return date;
+        }
+        return QDate();
+    }
+
+    // Доля ячеек выборки, которая должна подходить под тип: единичные выбросы
+    // (например, строка-подпись в числовом столбце) не делают столбец текстовым
+    constexpr double MinMatchRatio = 0.95;
+}
+
+ColumnType ColumnTypeInference::classifyText(QStringView text)
+{
+    const QStringView trimmed = text.trimmed();
+    if (trimmed.isEmpty()) return ColumnType::Text;
+
+    bool ok = false;
+    trimmed.toLongLong(&ok);
+    if (ok) return ColumnType::Int;
+    double number;
+    if (parseDouble(trimmed, number)) return ColumnType::Double;
+    bool flag;
+    if (parseBool(trimmed, flag)) return ColumnType::Bool;
+    if (parseDate(trimmed).isValid()) return ColumnType::Date;
+    return ColumnType::Text;
+}
+
+ColumnType ColumnTypeInference::classify(const QVariant &value)
+{
+    switch (value.typeId()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+    case QMetaType::Short:
+    case QMetaType::UShort:
+        return ColumnType::Int;
+    case QMetaType::Double:
+    case QMetaType::Float:
+        return ColumnType::Double;
+    case QMetaType::Bool:
+        return ColumnType::Bool;
+    case QMetaType::QDate:
+    case QMetaType::QDateTime:
+        return ColumnType::Date;
+    case QMetaType::QString:
+        return classifyText(value.toString());
+    default:
+        return ColumnType::Text;
+    }
+}
+
+ColumnTypeGuess ColumnTypeInference::inferColumn(const CellStorage &storage, int column)
+{
+    ColumnTypeGuess guess;
+    const int rowCount = storage.rowCount();
+    if (rowCount == 0) return guess;
+
+    int nonNull = rowCount;
+    if (storage.kind() == CellStorage::Kind::Columnar) {
+        const TableColumn &source = static_cast<const ColumnStorage &>(storage).column(column);
+        nonNull = source.nonNullCount();
+        if (nonNull == 0) return guess;
+        // Числовой буфер уже однороден
+        if (source.type() == TableColumn::Type::Int64 || source.type() == TableColumn::Type::Double) {
+            guess.type = source.type() == TableColumn::Type::Int64 ? ColumnType::Int : ColumnType::Double;
+            guess.sampled = guess.matched = qMin(nonNull, SampleSize);
+            return guess;
+        }
+    }
+
+    // Шаг по строкам, чтобы выборка покрывала весь лист, а не только его начало
+    const int step = qMax(1, rowCount / SampleSize);
+    int counts[6] = {};
+    for (int row = 0; row < rowCount && guess.sampled < SampleSize; row += step) {
+        const QVariant value = storage.value(row, column);
+        if (!value.isValid()) continue;
+        ++counts[static_cast<int>(classify(value))];
+        ++guess.sampled;
+    }
+    if (guess.sampled == 0) return guess;
+
+    const int ints = counts[static_cast<int>(ColumnType::Int)];
+    const int numbers = ints + counts[static_cast<int>(ColumnType::Double)];
+    const int required = qCeil(guess.sampled * MinMatchRatio);
+    if (numbers >= required) {
+        guess.type = numbers == ints ? ColumnType::Int : ColumnType::Double;
+        guess.matched = numbers;
+    } else if (counts[static_cast<int>(ColumnType::Bool)] >= required) {
+        guess.type = ColumnType::Bool;
+        guess.matched = counts[static_cast<int>(ColumnType::Bool)];
+    } else if (counts[static_cast<int>(ColumnType::Date)] >= required) {
+        guess.type = ColumnType::Date;
+        guess.matched = counts[static_cast<int>(ColumnType::Date)];
+    } else {
+        guess.type = ColumnType::Text;
+        guess.matched = guess.sampled;
+    }
+    return guess;
+}
+
+QFuture<QVector<ColumnTypeGuess>> ColumnTypeInference::inferColumnsAsync(const TableDataModel *model)
+{
+    // Снимок берется в потоке модели; без снимка (плиточное хранилище) - чтение под storageLock
+    const std::shared_ptr<const CellStorage> snapshot = model->snapshot().cells;
+    return QtConcurrent::run([model, snapshot]() {
+        QReadLocker locker(snapshot ? nullptr : &model->storageLock());
+        const CellStorage &storage = snapshot ? *snapshot : model->cellStorage();
+
+        QVector<int> columns(storage.columnCount());
+        std::iota(columns.begin(), columns.end(), 0);
+
+        // Столбцы независимы - на большом листе каждый разбирается в своем потоке.
+        // Снимок и storageLock на чтение допускают несколько читателей одновременно
+        if (qint64(storage.rowCount()) * storage.columnCount() < MinCellsForParallel) {
+            QVector<ColumnTypeGuess> guesses;
+            for (int column : columns) guesses.append(inferColumn(storage, column));
+            return guesses;
+        }
+        return QtConcurrent::blockingMapped<QVector<ColumnTypeGuess>>(columns, [&storage](int column) {
+            return inferColumn(storage, column);
+        });
+    });
+}
+
+QVariant ColumnTypeInference::coerce(const QVariant &value, ColumnType type, bool *ok)
+{
+    if (ok) *ok = true;
+    if (!value.isValid() || type == ColumnType::Auto) return value;
+
+    const QString text = value.toString().trimmed();
+    bool converted = false;
+    QVariant result;
+    switch (type) {
+    case ColumnType::Int: {
+        if (classify(value) == ColumnType::Int) return QVariant::fromValue<qint64>(value.toLongLong());
+        const qint64 number = text.toLongLong(&converted);
+        if (converted) result = QVariant::fromValue(number);
+        break;
+    }
+    case ColumnType::Double: {
+        double number;
+        converted = parseDouble(text, number);
+        if (converted) result = number;
+        break;
+    }
+    case ColumnType::Date: {
+        if (value.typeId() == QMetaType::QDate) return value;
+        const QDate date = parseDate(text);
+        converted = date.isValid();
+        if (converted) result = date;
+        break;
+    }
+    case ColumnType::Bool: {
+        if (value.typeId() == QMetaType::Bool) return value;
+        bool flag;
+        converted = parseBool(text, flag);
+        if (converted) result = flag;
+        break;
+    }
+    case ColumnType::Text:
+        return value.toString();
+    case ColumnType::Auto:
+        return value;
+    }
+
+    if (!converted) {
+        if (ok) *ok = false;
+        return value;
+    }
+    return result;
+}
@@ -0,0 +1,207 @@
+#include "ColumnWidthEstimator.h"
+#include "TableDataModel.h"
+#include <QFontMetrics>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QReadLocker>
+#include <QLocale>
+#include <QDate>
+#include <numeric>
+
+namespace {
+    // Строки выборки по возрастанию: края листа и по строке из каждой полосы
+    QVector<int> sampleRows(int rowCount)
+    {
+        QVector<int> rows;
+        const int strata = ColumnWidthEstimator::SampleStrata;
+        const int edge = ColumnWidthEstimator::EdgeRows;
+        if (rowCount <= strata + 2 * edge) {
+            rows.resize(rowCount);
+            std::iota(rows.begin(), rows.end(), 0);
+            return rows;
+        }
+
+        rows.reserve(strata + 2 * edge);
+        for (int row = 0; row < edge; ++row) rows.append(row);
+        const int inner = rowCount - 2 * edge;
+        for (int stratum = 0; stratum < strata; ++stratum) {
+            const int first = edge + int(qint64(inner) * stratum / strata);
+            const int next = edge + int(qint64(inner) * (stratum + 1) / strata);
+            // Смещение внутри полосы - хеш номера полосы: выборка стабильна между запусками
+            const quint32 hash = quint32(stratum + 1) * 2654435761u;
+            rows.append(first + int(hash % quint32(qMax(next - first, 1))));
+        }
+        for (int row = rowCount - edge; row < rowCount; ++row) rows.append(row);
+        return rows;
+    }
+
+    // Текст как у делегата представления: числа и даты в локали пользователя
+    QString displayText(const QVariant &value, const QLocale &locale)
+    {
+        switch (value.typeId()) {
+        case QMetaType::Double:
+        case QMetaType::Float:
+            return locale.toString(value.toDouble());
+        case QMetaType::QDate:
+            return locale.toString(value.toDate(), QLocale::ShortFormat);
+        default:
+            return value.toString();
+        }
+    }
+
+    QHash<int, int> measureColumns(const TableDataModel *model, const QList<int> &columns, const QVector<QString> &headers,
+                                   const QFont &font, const QFont &headerFont, int padding, int headerPadding)
+    {
+        const QFontMetrics metrics(font);
+        const QFontMetrics headerMetrics(headerFont);
+        const QLocale locale;
+        QHash<int, int> widths;
+        QVector<QVariant> values;
+
+        for (int i = 0; i < columns.size(); ++i) {
+            const int column = columns[i];
+
+            // Под блокировкой только копируются значения выборки одного столбца: правка
+            // из интерфейса ждет не дольше одного столбца, шрифт измеряется без блокировки
+            values.clear();
+            {
+                QReadLocker locker(&model->storageLock());
+                const CellStorage &storage = model->cellStorage();
+                if (column >= storage.columnCount()) continue;
+                const QVector<int> rows = sampleRows(storage.rowCount());
+                values.reserve(rows.size());
+                for (int row : rows) {
+                    const QVariant value = storage.value(row, column);
+                    if (value.isValid()) values.append(value);
+                }
+            }
+
+            int width = headerMetrics.horizontalAdvance(headers[i]) + headerPadding;
+            for (const QVariant &value : std::as_const(values)) {
+                width = qMax(width, metrics.horizontalAdvance(displayText(value, locale)) + padding);
+            }
+            widths.insert(column, qMin(width, ColumnWidthEstimator::MaxWidth));
+        }
+        return widths;
+    }
+}
+
+ColumnWidthEstimator::ColumnWidthEstimator(TableDataModel *model, QObject *parent)
+    : QObject(parent), m_model(model)
+{
+    m_watcher = new QFutureWatcher<QHash<int, int>>(this);
+    connect(m_watcher, &QFutureWatcher<QHash<int, int>>::finished, this, &ColumnWidthEstimator::onFinished);
+
+    if (!model) return;
+    connect(model, &QAbstractItemModel::dataChanged, this,
+            [this](const QModelIndex &topLeft, const QModelIndex &bottomRight) {
+        invalidateColumns(topLeft.column(), bottomRight.column());
+    });
+    connect(model, &QAbstractItemModel::headerDataChanged, this, [this](Qt::Orientation orientation, int first, int last) {
+        if (orientation == Qt::Horizontal) invalidateColumns(first, last);
+    });
+    connect(model, &QAbstractItemModel::columnsInserted, this, &ColumnWidthEstimator::invalidateAll);
+    connect(model, &QAbstractItemModel::columnsRemoved, this, &ColumnWidthEstimator::invalidateAll);
+    connect(model, &QAbstractItemModel::rowsRemoved, this, &ColumnWidthEstimator::invalidateAll);
+    connect(model, &QAbstractItemModel::modelReset, this, &ColumnWidthEstimator::invalidateAll);
+}
+
+ColumnWidthEstimator::~ColumnWidthEstimator()
+{
+    // Фоновая задача читает хранилище модели
+    m_watcher->waitForFinished();
+}
+
+bool ColumnWidthEstimator::isBusy() const
+{
+    return m_watcher->isRunning();
+}
+
+void ColumnWidthEstimator::estimate(const QList<int> &columns, const QFont &font, const QFont &headerFont,
+                                    int padding, int headerPadding)
+{
+    if (!m_model || m_model->isTableBound()) return;
+
+    if (isBusy()) {
+        // Ждет конца текущего измерения; столбцы копятся, шрифт - последний переданный
+        const QList<int> queuedColumns = m_queued ? m_queued->columns + columns : columns;
+        m_queued = Request{queuedColumns, font, headerFont, padding, headerPadding};
+        return;
+    }
+    if (font != m_font || headerFont != m_headerFont || padding != m_padding || headerPadding != m_headerPadding) {
+        m_cache.clear();
+        m_font = font;
+        m_headerFont = headerFont;
+        m_padding = padding;
+        m_headerPadding = headerPadding;
+    }
+
+    QHash<int, int> cached;
+    QList<int> missing;
+    for (int column : columns) {
+        if (column < 0 || column >= m_model->columnCount()) continue;
+        const auto it = m_cache.constFind(column);
+        if (it != m_cache.constEnd()) {
+            cached.insert(column, it.value());
+        } else if (!missing.contains(column)) {
+            missing.append(column);
+        }
+    }
+
+    if (missing.isEmpty()) {
+        if (!cached.isEmpty()) emit widthsReady(cached);
+        return;
+    }
+    m_pendingCached = cached;
+    start(missing);
+}
+
+void ColumnWidthEstimator::start(const QList<int> &columns)
+{
+    // Заголовки читаются здесь: headerData модели - только из потока интерфейса
+    QVector<QString> headers;
+    headers.reserve(columns.size());
+    for (int column : columns) {
+        headers.append(m_model->headerData(column, Qt::Horizontal).toString());
+    }
+
+    m_changedWhileRunning.clear();
+    m_structureChanged = false;
+    const TableDataModel *model = m_model;
+    m_watcher->setFuture(QtConcurrent::run(measureColumns, model, columns, headers, m_font, m_headerFont,
+                                           m_padding, m_headerPadding));
+}
+
+void ColumnWidthEstimator::onFinished()
+{
+    QHash<int, int> widths = m_watcher->result();
+    if (!m_structureChanged) {
+        for (auto it = widths.cbegin(); it != widths.cend(); ++it) {
+            if (!m_changedWhileRunning.contains(it.key())) m_cache.insert(it.key(), it.value());
+        }
+        widths.insert(m_pendingCached);
+        emit widthsReady(widths);
+    }
+    m_pendingCached.clear();
+    m_changedWhileRunning.clear();
+
+    if (m_queued) {
+        const Request queued = *m_queued;
+        m_queued.reset();
+        estimate(queued.columns, queued.font, queued.headerFont, queued.padding, queued.headerPadding);
+    }
+}
+
+void ColumnWidthEstimator::invalidateColumns(int first, int last)
+{
+    for (int column = first; column <= last; ++column) {
+        m_cache.remove(column);
+        if (isBusy()) m_changedWhileRunning.insert(column);
+    }
+}
+
+void ColumnWidthEstimator::invalidateAll()
+{
+    m_cache.clear();
+    if (isBusy()) m_structureChanged = true;
+}
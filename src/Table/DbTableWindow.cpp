@@ -0,0 +1,117 @@
+#include "DbTableWindow.h"
+#include "DataReader.h"
+#include <QSqlRecord>
+
+DbTableWindow::DbTableWindow(DataReader *reader, const QString &tableName, const QString &keyColumn,
+                             int blockSize, int maxBlocks)
+    : m_reader(reader), m_tableName(tableName), m_keyColumn(keyColumn),
+      m_blockSize(qMax(1, blockSize)), m_maxBlocks(qMax(2, maxBlocks))
+{
+}
+
+bool DbTableWindow::open()
+{
+    m_columns = m_reader->getColumnNames(m_tableName);
+    m_keyIndex = m_columns.indexOf(m_keyColumn);
+    if (m_keyIndex < 0) {
+        m_lastError = m_reader->getLastError().isEmpty()
+                          ? QString("Key column '%1' not found in '%2'").arg(m_keyColumn, m_tableName)
+                          : m_reader->getLastError();
+        return false;
+    }
+
+    // Число строк читается один раз; фактический конец таблицы уточняется при чтении блоков
+    m_totalRows = m_reader->countRecords(m_tableName);
+    if (m_totalRows < 0) {
+        m_lastError = m_reader->getLastError();
+        return false;
+    }
+
+    m_loadedRows = 0;
+    m_atEnd = m_totalRows == 0;
+    m_blockAfterKeys = {QVariant()};
+    m_blocks.clear();
+    return true;
+}
+
+int DbTableWindow::loadNextBlock()
+{
+    if (m_atEnd) return 0;
+
+    const int blockIndex = m_loadedRows / m_blockSize;
+    Block *block = fetchBlock(blockIndex);
+    // Ошибка запроса - не конец данных: число строк не урезаем, блок можно запросить снова
+    if (!block) return -1;
+    const int newRows = block->rows;
+    m_loadedRows += newRows;
+
+    if (newRows < m_blockSize) {
+        // Строк оказалось меньше, чем показал COUNT(*) - таблица изменилась
+        m_atEnd = true;
+        m_totalRows = m_loadedRows;
+    } else if (m_loadedRows >= m_totalRows) {
+        m_atEnd = true;
+    }
+    return newRows;
+}
+
+QVariant DbTableWindow::value(int row, int column)
+{
+    if (row < 0 || row >= m_loadedRows || column < 0 || column >= m_columns.size()) {
+        return QVariant();
+    }
+    Block *block = fetchBlock(row / m_blockSize);
+    const int rowInBlock = row % m_blockSize;
+    if (!block || rowInBlock >= block->rows) {
+        return QVariant();
+    }
+    return block->cells.at(rowInBlock * m_columns.size() + column);
+}
+
+DbTableWindow::Block *DbTableWindow::fetchBlock(int blockIndex)
+{
+    auto it = m_blocks.find(blockIndex);
+    if (it != m_blocks.end()) {
+        it->lastUse = ++m_useCounter;
+        return &it.value();
+    }
+    if (blockIndex >= m_blockAfterKeys.size()) {
+        return nullptr;  // блоки читаются по порядку, ключ начала еще неизвестен
+    }
+
+    m_lastError.clear();
+    const QList<QSqlRecord> records = m_reader->selectKeysetPage(
+        m_tableName, m_keyColumn, m_blockAfterKeys.at(blockIndex), m_blockSize, m_columns);
+    if (!m_reader->getLastError().isEmpty()) {
+        m_lastError = m_reader->getLastError();
+        return nullptr;
+    }
+
+    Block block;
+    block.rows = records.size();
+    block.cells.reserve(block.rows * m_columns.size());
+    for (const QSqlRecord &record : records) {
+        for (int column = 0; column < m_columns.size(); ++column) {
+            block.cells.append(record.value(column));
+        }
+    }
+    block.lastUse = ++m_useCounter;
+    if (block.rows > 0 && blockIndex + 1 == m_blockAfterKeys.size()) {
+        m_blockAfterKeys.append(records.last().value(m_keyIndex));
+    }
+
+    evictIfNeeded();
+    return &m_blocks.insert(blockIndex, std::move(block)).value();
+}
+
+void DbTableWindow::evictIfNeeded()
+{
+    // Линейный поиск по не более чем maxBlocks элементам дешевле поддержки списка
+    while (m_blocks.size() >= m_maxBlocks) {
+        auto oldest = m_blocks.begin();
+        for (auto it = m_blocks.begin(); it != m_blocks.end(); ++it) {
+            if (it->lastUse < oldest->lastUse) oldest = it;
+        }
+        m_blocks.erase(oldest);
+    }
+}
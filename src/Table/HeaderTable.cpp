@@ -1,12 +1,34 @@
 // src/Table/HeaderTable.cpp
 #include "HeaderTable.h"
 #include <QDebug>
+#include <QItemSelectionModel>
+#include <QPair>
+
+namespace {
+    // Секции, к которым относится команда меню: все выделенные, если меню вызвано
+    // на выделенной секции, иначе только она сама
+    QList<int> targetSections(const QHeaderView *header, int logicalIndex)
+    {
+        QItemSelectionModel *selection = header->selectionModel();
+        if (!selection) return {logicalIndex};
+
+        QList<int> sections;
+        if (header->orientation() == Qt::Horizontal) {
+            if (!selection->isColumnSelected(logicalIndex, QModelIndex())) return {logicalIndex};
+            for (const QModelIndex &index : selection->selectedColumns()) sections.append(index.column());
+        } else {
+            if (!selection->isRowSelected(logicalIndex, QModelIndex())) return {logicalIndex};
+            for (const QModelIndex &index : selection->selectedRows()) sections.append(index.row());
+        }
+        return sections.isEmpty() ? QList<int>{logicalIndex} : sections;
+    }
+}
 
 CustomHeaderView::CustomHeaderView(Qt::Orientation orientation, QWidget *parent)
     : QHeaderView(orientation, parent), m_contextMenuIndex(-1), m_addToRight(false)
 {
     // Можно настроить поведение заголовка
-    setSectionsClickable(false);  // Разрешить клики
+    setSectionsClickable(true);   // Клик выделяет столбец (нужно для групповых команд меню)
     setSectionsMovable(false);    // Запретить перемещение столбцов
     setStretchLastSection(true);  // Растянуть последний столбец
 
@@ -17,6 +39,51 @@ CustomHeaderView::CustomHeaderView(Qt::Orientation orientation, QWidget *parent)
     m_deleteAction = m_contextMenu->addAction("Удалить");
     m_renameAction = m_contextMenu->addAction("Переименовать");
 
+    // Сортировка: основной ключ заменяет текущую сортировку, дополнительный добавляется к ней
+    m_sortMenu = m_contextMenu->addMenu("Сортировка");
+    QAction *sortAscending = m_sortMenu->addAction("По возрастанию");
+    QAction *sortDescending = m_sortMenu->addAction("По убыванию");
+    m_sortMenu->addSeparator();
+    QAction *addAscending = m_sortMenu->addAction("Добавить ключ по возрастанию");
+    QAction *addDescending = m_sortMenu->addAction("Добавить ключ по убыванию");
+    m_sortMenu->addSeparator();
+    QAction *sortReset = m_sortMenu->addAction("Сбросить сортировку и фильтры");
+    m_filterAction = m_contextMenu->addAction("Фильтр...");
+
+    connect(sortAscending, &QAction::triggered, this, [this]() { emit sortRequested(m_contextMenuIndex, Qt::AscendingOrder, false); });
+    connect(sortDescending, &QAction::triggered, this, [this]() { emit sortRequested(m_contextMenuIndex, Qt::DescendingOrder, false); });
+    connect(addAscending, &QAction::triggered, this, [this]() { emit sortRequested(m_contextMenuIndex, Qt::AscendingOrder, true); });
+    connect(addDescending, &QAction::triggered, this, [this]() { emit sortRequested(m_contextMenuIndex, Qt::DescendingOrder, true); });
+    connect(sortReset, &QAction::triggered, this, &CustomHeaderView::sortResetRequested);
+    connect(m_filterAction, &QAction::triggered, this, &CustomHeaderView::onFilter);
+
+    QMenu *widthMenu = m_contextMenu->addMenu("Ширина по содержимому");
+    QAction *fitSelected = widthMenu->addAction("Выбранные столбцы");
+    QAction *fitAll = widthMenu->addAction("Все столбцы");
+    connect(fitSelected, &QAction::triggered, this, [this]() {
+        emit fitWidthRequested(targetSections(this, m_contextMenuIndex));
+    });
+    connect(fitAll, &QAction::triggered, this, [this]() { emit fitWidthRequested({}); });
+
+    QAction *formulaAction = m_contextMenu->addAction("Формула...");
+    connect(formulaAction, &QAction::triggered, this, [this]() { emit formulaEditRequested(m_contextMenuIndex); });
+
+    m_typeMenu = m_contextMenu->addMenu("Тип данных");
+    QAction *inferType = m_typeMenu->addAction("Определить по содержимому");
+    QAction *inferAllTypes = m_typeMenu->addAction("Определить для всех столбцов");
+    connect(inferType, &QAction::triggered, this, [this]() { emit columnTypeInferenceRequested(m_contextMenuIndex); });
+    connect(inferAllTypes, &QAction::triggered, this, [this]() { emit columnTypeInferenceRequested(-1); });
+    m_typeMenu->addSeparator();
+    const QList<QPair<QString, ColumnType>> types = {
+        {"Без типа", ColumnType::Auto}, {"Целое число", ColumnType::Int}, {"Дробное число", ColumnType::Double},
+        {"Дата", ColumnType::Date}, {"Да/нет", ColumnType::Bool}, {"Текст", ColumnType::Text}
+    };
+    for (const auto &type : types) {
+        QAction *action = m_typeMenu->addAction(type.first);
+        const ColumnType value = type.second;
+        connect(action, &QAction::triggered, this, [this, value]() { emit columnTypeRequested(m_contextMenuIndex, value); });
+    }
+
     // Подключаем слоты
     connect(m_addAction, &QAction::triggered, this, &CustomHeaderView::onAdd);
     connect(m_deleteAction, &QAction::triggered, this, &CustomHeaderView::onDelete);
@@ -27,6 +94,16 @@ CustomHeaderView::~CustomHeaderView()
 {
 }
 
+void CustomHeaderView::setWideMode(bool enabled)
+{
+    if (m_wideMode == enabled) return;
+    m_wideMode = enabled;
+
+    setStretchLastSection(!enabled);
+    // Размер по содержимому пересчитывал бы все секции
+    if (enabled) setSectionResizeMode(QHeaderView::Interactive);
+}
+
 void CustomHeaderView::mousePressEvent(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
@@ -72,14 +149,24 @@ void CustomHeaderView::contextMenuEvent(QContextMenuEvent *event)
 void CustomHeaderView::onAdd()
 {
     if (m_contextMenuIndex >= 0) {
-        emit headerAddRequested(m_contextMenuIndex, m_addToRight);
+        const QList<int> sections = targetSections(this, m_contextMenuIndex);
+        if (sections.size() > 1) {
+            emit headersAddRequested(sections, m_addToRight);
+        } else {
+            emit headerAddRequested(m_contextMenuIndex, m_addToRight);
+        }
     }
 }
 
 void CustomHeaderView::onDelete()
 {
     if (m_contextMenuIndex >= 0) {
-        emit headerDeleteRequested(m_contextMenuIndex);
+        const QList<int> sections = targetSections(this, m_contextMenuIndex);
+        if (sections.size() > 1) {
+            emit headersDeleteRequested(sections);
+        } else {
+            emit headerDeleteRequested(m_contextMenuIndex);
+        }
     }
 }
 
@@ -112,6 +199,25 @@ void CustomHeaderView::onRename()
     }
 }
 
+void CustomHeaderView::onFilter()
+{
+    if (m_contextMenuIndex < 0) return;
+
+    bool ok;
+    const QString text = QInputDialog::getText(
+        this,
+        "Фильтр",
+        "Показывать строки, содержащие (пусто - без фильтра):",
+        QLineEdit::Normal,
+        QString(),
+        &ok
+    );
+
+    if (ok) {
+        emit filterRequested(m_contextMenuIndex, text);
+    }
+}
+
 // RowHeaderView (вертикальный заголовок строк)
 RowHeaderView::RowHeaderView(Qt::Orientation orientation, QWidget *parent)
     : QHeaderView(orientation, parent), m_contextMenuIndex(-1)
@@ -162,13 +268,23 @@ void RowHeaderView::contextMenuEvent(QContextMenuEvent *event)
 void RowHeaderView::onAdd()
 {
     if (m_contextMenuIndex >= 0) {
-        emit rowAddRequested(m_contextMenuIndex);
+        const QList<int> sections = targetSections(this, m_contextMenuIndex);
+        if (sections.size() > 1) {
+            emit rowsAddRequested(sections);
+        } else {
+            emit rowAddRequested(m_contextMenuIndex);
+        }
     }
 }
 
 void RowHeaderView::onDelete()
 {
     if (m_contextMenuIndex >= 0) {
-        emit rowDeleteRequested(m_contextMenuIndex);
+        const QList<int> sections = targetSections(this, m_contextMenuIndex);
+        if (sections.size() > 1) {
+            emit rowsDeleteRequested(sections);
+        } else {
+            emit rowDeleteRequested(m_contextMenuIndex);
+        }
     }
 }
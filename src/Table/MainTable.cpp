@@ -2,6 +2,12 @@
 #include <QMenu>
 #include <QContextMenuEvent>
 #include <QItemSelectionModel>
+#include <QScrollBar>
+#include <QStyle>
+#include <QStyledItemDelegate>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <functional>
 
 MainTable::MainTable(QWidget *parent) : QTableView(parent)
 {
@@ -15,6 +21,13 @@ MainTable::MainTable(QWidget *parent) : QTableView(parent)
     setHorizontalScrollMode(QAbstractItemView::ScrollPerPixel);
 
     setSelectionBehavior(QAbstractItemView::SelectItems);
+
+    m_delegate = new CachedCellDelegate(this);
+    setItemDelegate(m_delegate);
+
+    // Строка итогов занимает нижнее поле области прокрутки, как заголовки - верхнее и левое
+    m_footer = new AggregateFooter(m_customHeader, this);
+    connect(horizontalScrollBar(), &QScrollBar::valueChanged, m_footer, qOverload<>(&QWidget::update));
 }
 
 MainTable::~MainTable()
@@ -22,6 +35,146 @@ MainTable::~MainTable()
 
 }
 
+void MainTable::setModel(QAbstractItemModel *model)
+{
+    for (const QMetaObject::Connection &connection : std::as_const(m_modelConnections)) disconnect(connection);
+    m_modelConnections.clear();
+    QTableView::setModel(model);
+    m_delegate->setModel(model);
+    if (!model) return;
+
+    m_modelConnections = {
+        connect(model, &QAbstractItemModel::columnsInserted, this, &MainTable::updateWideTableMode),
+        connect(model, &QAbstractItemModel::columnsRemoved, this, &MainTable::updateWideTableMode),
+        connect(model, &QAbstractItemModel::modelReset, this, &MainTable::updateWideTableMode)
+    };
+    updateWideTableMode();
+}
+
+void MainTable::setWidthEstimator(ColumnWidthEstimator *estimator)
+{
+    if (m_widthEstimator) m_widthEstimator->disconnect(this);
+    m_widthEstimator = estimator;
+    if (!estimator) return;
+
+    connect(estimator, &ColumnWidthEstimator::widthsReady, this, [this](const QHash<int, int> &widths) {
+        for (auto it = widths.cbegin(); it != widths.cend(); ++it) {
+            if (it.key() < m_customHeader->count()) m_customHeader->resizeSection(it.key(), it.value());
+        }
+    });
+}
+
+void MainTable::fitColumnsToContents(const QList<int> &columns)
+{
+    if (!model()) return;
+    if (!m_widthEstimator) {
+        for (int column : columns) resizeColumnToContents(column);
+        if (columns.isEmpty()) resizeColumnsToContents();
+        return;
+    }
+
+    QList<int> targets = columns;
+    if (targets.isEmpty()) {
+        targets.reserve(model()->columnCount());
+        for (int column = 0; column < model()->columnCount(); ++column) targets.append(column);
+    }
+    // Поля как у стандартного делегата; у заголовка - еще место под индикатор сортировки
+    const int margin = style()->pixelMetric(QStyle::PM_FocusFrameHMargin, nullptr, this) + 1;
+    const int padding = 2 * margin + 2;
+    const int headerPadding = 2 * style()->pixelMetric(QStyle::PM_HeaderMargin, nullptr, m_customHeader)
+                              + style()->pixelMetric(QStyle::PM_HeaderMarkSize, nullptr, m_customHeader);
+    m_widthEstimator->estimate(targets, font(), m_customHeader->font(), padding, headerPadding);
+}
+
+int MainTable::sizeHintForColumn(int column) const
+{
+    const int cached = m_widthEstimator ? m_widthEstimator->cachedWidth(column) : -1;
+    return cached >= 0 ? cached : QTableView::sizeHintForColumn(column);
+}
+
+#ifdef QT_DEBUG
+MainTable::PaintBenchmark MainTable::benchmarkPaint(int frames)
+{
+    PaintBenchmark result;
+    result.frames = qMax(frames, 1);
+    if (!model() || !isVisible()) return result;
+
+    const int firstRow = qMax(rowAt(0), 0);
+    const int lastRow = rowAt(viewport()->height() - 1) < 0 ? model()->rowCount() - 1 : rowAt(viewport()->height() - 1);
+    const int firstColumn = qMax(columnAt(0), 0);
+    const int lastColumn = columnAt(viewport()->width() - 1) < 0 ? model()->columnCount() - 1
+                                                                 : columnAt(viewport()->width() - 1);
+    result.visibleCells = qMax(lastRow - firstRow + 1, 0) * qMax(lastColumn - firstColumn + 1, 0);
+
+    auto measure = [this, &result](const std::function<void()> &beforeFrame) {
+        PaintTiming timing;
+        QElapsedTimer timer;
+        qint64 total = 0;
+        for (int frame = 0; frame < result.frames; ++frame) {
+            beforeFrame();
+            timer.start();
+            viewport()->repaint();
+            const qint64 elapsed = timer.nsecsElapsed();
+            total += elapsed;
+            timing.maxMs = qMax(timing.maxMs, elapsed / 1e6);
+        }
+        timing.averageMs = total / 1e6 / result.frames;
+        return timing;
+    };
+
+    QStyledItemDelegate standard;
+    setItemDelegate(&standard);
+    result.standardDelegate = measure([] {});
+    setItemDelegate(m_delegate);
+    result.coldCache = measure([this] { m_delegate->clear(); });
+    result.warmCache = measure([] {});
+
+    qDebug() << "paint benchmark:" << result.visibleCells << "cells," << result.frames << "frames;"
+             << "standard" << result.standardDelegate.averageMs << "ms (max" << result.standardDelegate.maxMs << "),"
+             << "cold cache" << result.coldCache.averageMs << "ms (max" << result.coldCache.maxMs << "),"
+             << "warm cache" << result.warmCache.averageMs << "ms (max" << result.warmCache.maxMs << ")";
+    return result;
+}
+#endif
+
+void MainTable::updateWideTableMode()
+{
+    const bool wide = model() && model()->columnCount() >= WideTableColumns;
+    if (wide == m_customHeader->isWideMode()) return;
+
+    m_customHeader->setWideMode(wide);
+    // Колесо и стрелки сдвигают на столбец: при ScrollPerPixel шаг иначе слишком мелкий
+    if (wide) {
+        m_narrowSingleStep = horizontalScrollBar()->singleStep();
+        horizontalScrollBar()->setSingleStep(m_customHeader->defaultSectionSize());
+    } else {
+        horizontalScrollBar()->setSingleStep(m_narrowSingleStep);
+    }
+}
+
+void MainTable::updateGeometries()
+{
+    // QTableView::updateGeometries() сбрасывает поля, поэтому нижнее выставляется после него
+    if (m_updatingGeometries) return;
+    m_updatingGeometries = true;
+
+    QTableView::updateGeometries();
+    if (!m_footer) {
+        m_updatingGeometries = false;
+        return;
+    }
+
+    const int footerHeight = m_footer->sizeHint().height();
+    const QMargins margins = viewportMargins();
+    if (margins.bottom() != footerHeight) {
+        setViewportMargins(margins.left(), margins.top(), margins.right(), footerHeight);
+    }
+    const QRect area = viewport()->geometry();
+    m_footer->setGeometry(area.left(), area.bottom() + 1, area.width(), footerHeight);
+
+    m_updatingGeometries = false;
+}
+
 void MainTable::contextMenuEvent(QContextMenuEvent *event)
 {
     const QModelIndex index = indexAt(event->pos());
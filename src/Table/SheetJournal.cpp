@@ -0,0 +1,394 @@
+#include "SheetJournal.h"
+#include <QDataStream>
+#include <QSaveFile>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QDebug>
+#include <algorithm>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr quint32 JournalMagic = 0x53484A52;  // "SHJR"
+    constexpr quint32 JournalVersion = 1;
+    constexpr qint64 RecordHeaderSize = 6;         // длина (4) и CRC-16 (2)
+    constexpr qsizetype MaxBufferedBytes = 1 << 20;
+    constexpr quint32 MaxRecordSize = 64 << 20;
+    // Формат QVariant в записях не должен зависеть от версии Qt, открывшей журнал
+    constexpr QDataStream::Version StreamVersion = QDataStream::Qt_6_0;
+
+    bool flushToDisk(QFile &file)
+    {
+        if (!file.flush()) return false;
+#ifdef Q_OS_WIN
+        return _commit(file.handle()) == 0;
+#else
+        return ::fsync(file.handle()) == 0;
+#endif
+    }
+
+    QDataStream &operator<<(QDataStream &out, const SheetChanges::Line &line)
+    {
+        return out << line.id << line.orderKey << line.name << qint32(line.valueType) << line.formula;
+    }
+
+    QDataStream &operator>>(QDataStream &in, SheetChanges::Line &line)
+    {
+        qint32 valueType = 0;
+        in >> line.id >> line.orderKey >> line.name >> valueType >> line.formula;
+        line.valueType = valueType;
+        return in;
+    }
+}
+
+SheetJournal::SheetJournal(const QString &filePath, qint64 sheetId, QObject *parent)
+    : QObject(parent), m_file(filePath), m_sheetId(sheetId)
+{
+    m_syncTimer = new QTimer(this);
+    m_syncTimer->setSingleShot(true);
+    connect(m_syncTimer, &QTimer::timeout, this, &SheetJournal::startFlush);
+    m_flushWatcher = new QFutureWatcher<QString>(this);
+    connect(m_flushWatcher, &QFutureWatcher<QString>::finished, this, &SheetJournal::finishFlush);
+}
+
+SheetJournal::~SheetJournal()
+{
+    if (isOpen()) sync();
+}
+
+bool SheetJournal::open()
+{
+    m_lastError.clear();
+    if (isOpen()) return true;
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        m_lastError = m_file.errorString();
+        return false;
+    }
+
+    // Заголовок: чужой или испорченный журнал не проигрывается
+    QDataStream in(&m_file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint64 sheetId = 0;
+    in >> magic >> version >> sheetId;
+    const bool valid = in.status() == QDataStream::Ok && magic == JournalMagic
+                       && version == JournalVersion && sheetId == m_sheetId;
+    if (!valid) {
+        if (m_file.size() > 0) qWarning() << "sheet journal reset:" << m_file.fileName();
+        if (!m_file.resize(0) || !m_file.seek(0) || !writeHeader(m_file) || !flushToDisk(m_file)) {
+            m_lastError = m_file.errorString();
+            m_file.close();
+            return false;
+        }
+    }
+    m_fileSize = m_file.size();
+    m_base = 0;
+    m_buffer.clear();
+    return true;
+}
+
+bool SheetJournal::writeHeader(QIODevice &device) const
+{
+    QDataStream out(&device);
+    out << JournalMagic << JournalVersion << m_sheetId;
+    return out.status() == QDataStream::Ok;
+}
+
+void SheetJournal::append(RecordKind kind, const std::function<void(QDataStream &out)> &writeFields)
+{
+    if (!isOpen()) return;
+
+    QByteArray payload;
+    {
+        QDataStream out(&payload, QIODevice::WriteOnly);
+        out.setVersion(StreamVersion);
+        out << quint8(kind);
+        writeFields(out);
+    }
+    QDataStream header(&m_buffer, QIODevice::WriteOnly | QIODevice::Append);
+    header << quint32(payload.size()) << qChecksum(payload);
+    m_buffer += payload;
+
+    // Большой пакет правок уходит на диск, не дожидаясь таймера
+    if (m_buffer.size() >= MaxBufferedBytes) {
+        startFlush();
+    } else if (!m_syncTimer->isActive()) {
+        m_syncTimer->start(m_syncIntervalMs);
+    }
+}
+
+void SheetJournal::appendCell(qint64 rowId, qint64 columnId, const QVariant &value)
+{
+    append(CellRecord, [&](QDataStream &out) { out << rowId << columnId << value; });
+}
+
+void SheetJournal::appendRow(const SheetChanges::Line &row)
+{
+    append(RowRecord, [&](QDataStream &out) { out << row; });
+}
+
+void SheetJournal::appendColumn(const SheetChanges::Line &column)
+{
+    append(ColumnRecord, [&](QDataStream &out) { out << column; });
+}
+
+void SheetJournal::appendRemovedRow(qint64 id)
+{
+    append(RemovedRowRecord, [&](QDataStream &out) { out << id; });
+}
+
+void SheetJournal::appendRemovedColumn(qint64 id)
+{
+    append(RemovedColumnRecord, [&](QDataStream &out) { out << id; });
+}
+
+bool SheetJournal::writeBuffer()
+{
+    if (m_buffer.isEmpty()) return true;
+    if (!m_file.seek(m_fileSize) || m_file.write(m_buffer) != m_buffer.size()) {
+        m_lastError = m_file.errorString();
+        // Частично записанный хвост отрезается - иначе следующие записи встанут за мусором
+        m_file.resize(m_fileSize);
+        return false;
+    }
+    m_fileSize += m_buffer.size();
+    m_buffer.clear();
+    return true;
+}
+
+void SheetJournal::startFlush()
+{
+    // Следующий пакет уйдет по окончании текущего (finishFlush)
+    if (!isOpen() || m_buffer.isEmpty() || !m_flushing.isEmpty()) return;
+    m_syncTimer->stop();
+
+    m_flushing.swap(m_buffer);
+    const qint64 offset = m_fileSize;
+    m_fileSize += m_flushing.size();
+    m_flushWatcher->setFuture(QtConcurrent::run([file = &m_file, batch = m_flushing, offset]() {
+        if (!file->seek(offset) || file->write(batch) != batch.size() || !flushToDisk(*file)) {
+            return file->errorString();
+        }
+        return QString();
+    }));
+}
+
+void SheetJournal::finishFlush()
+{
+    if (m_flushing.isEmpty() || !m_flushWatcher->isFinished()) return;
+
+    const QString error = m_flushWatcher->result();
+    if (!error.isEmpty()) {
+        // Пакет возвращается в буфер, частично записанный хвост отрезается
+        qWarning() << "sheet journal sync failed:" << error;
+        m_lastError = error;
+        m_fileSize -= m_flushing.size();
+        m_file.resize(m_fileSize);
+        m_buffer.prepend(m_flushing);
+    }
+    m_flushing.clear();
+    if (!m_buffer.isEmpty() && !m_syncTimer->isActive()) m_syncTimer->start(m_syncIntervalMs);
+}
+
+void SheetJournal::waitForFlush()
+{
+    m_flushWatcher->waitForFinished();
+    finishFlush();
+}
+
+bool SheetJournal::sync()
+{
+    m_lastError.clear();
+    m_syncTimer->stop();
+    if (!isOpen()) return false;
+    // Неудачный фоновый пакет вернулся в буфер - повторяем запись здесь
+    waitForFlush();
+    m_lastError.clear();
+    if (!writeBuffer()) return false;
+    if (!flushToDisk(m_file)) {
+        m_lastError = m_file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool SheetJournal::replay(SheetChanges &outChanges)
+{
+    m_lastError.clear();
+    outChanges = SheetChanges();
+    if (!isOpen()) {
+        m_lastError = "Журнал не открыт";
+        return false;
+    }
+    if (!sync()) return false;
+
+    // Номер записи нужен, чтобы удаление отбрасывало только более ранние значения ячеек
+    struct CellValue
+    {
+        quint64 sequence = 0;
+        QVariant value;
+    };
+    QHash<qint64, SheetChanges::Line> rows;
+    QHash<qint64, SheetChanges::Line> columns;
+    QSet<qint64> removedRows;
+    QSet<qint64> removedColumns;
+    QHash<qint64, quint64> rowRemovals;     // id -> номер последней записи удаления
+    QHash<qint64, quint64> columnRemovals;
+    QHash<QPair<qint64, qint64>, CellValue> cells;
+    quint64 sequence = 0;
+
+    qint64 offset = HeaderSize;
+    while (offset + RecordHeaderSize <= m_fileSize) {
+        if (!m_file.seek(offset)) break;
+        QDataStream header(&m_file);
+        quint32 size = 0;
+        quint16 checksum = 0;
+        header >> size >> checksum;
+        if (size == 0 || size > MaxRecordSize || offset + RecordHeaderSize + size > m_fileSize) break;
+        const QByteArray payload = m_file.read(size);
+        if (payload.size() != qsizetype(size) || qChecksum(payload) != checksum) break;
+
+        QDataStream in(payload);
+        in.setVersion(StreamVersion);
+        quint8 kind = 0;
+        in >> kind;
+        ++sequence;
+        switch (kind) {
+        case CellRecord: {
+            qint64 rowId = 0;
+            qint64 columnId = 0;
+            QVariant value;
+            in >> rowId >> columnId >> value;
+            cells.insert({rowId, columnId}, {sequence, value});
+            break;
+        }
+        case RowRecord:
+        case ColumnRecord: {
+            // id, удаленный раньше, мог быть выдан снова (журнал до исправления nextId)
+            SheetChanges::Line line;
+            in >> line;
+            (kind == RowRecord ? rows : columns).insert(line.id, line);
+            (kind == RowRecord ? removedRows : removedColumns).remove(line.id);
+            break;
+        }
+        case RemovedRowRecord:
+        case RemovedColumnRecord: {
+            qint64 id = 0;
+            in >> id;
+            (kind == RemovedRowRecord ? rows : columns).remove(id);
+            (kind == RemovedRowRecord ? removedRows : removedColumns).insert(id);
+            (kind == RemovedRowRecord ? rowRemovals : columnRemovals).insert(id, sequence);
+            break;
+        }
+        default:
+            in.setStatus(QDataStream::ReadCorruptData);
+        }
+        if (in.status() != QDataStream::Ok) break;
+        offset += RecordHeaderSize + size;
+    }
+
+    // Хвост, оборванный сбоем, отрезается: новые записи продолжат целую часть
+    if (offset < m_fileSize) {
+        qWarning() << "sheet journal: dropped" << m_fileSize - offset << "bytes of a torn record";
+        if (!m_file.resize(offset)) {
+            m_lastError = m_file.errorString();
+            return false;
+        }
+        m_fileSize = offset;
+    }
+
+    outChanges.rows = rows.values();
+    outChanges.columns = columns.values();
+    outChanges.removedRows = QList<qint64>(removedRows.cbegin(), removedRows.cend());
+    outChanges.removedColumns = QList<qint64>(removedColumns.cbegin(), removedColumns.cend());
+    outChanges.cells.reserve(cells.size());
+    for (auto it = cells.cbegin(); it != cells.cend(); ++it) {
+        // Значение, записанное до удаления строки/столбца, удалено вместе с ними
+        if (rowRemovals.value(it.key().first) > it->sequence || columnRemovals.value(it.key().second) > it->sequence) continue;
+        outChanges.cells.append({it.key().first, it.key().second, it->value});
+    }
+    return true;
+}
+
+void SheetJournal::apply(SheetData &data, const SheetChanges &changes)
+{
+    auto applyLines = [](QList<SheetChanges::Line> &lines, const QList<SheetChanges::Line> &changed,
+                         const QList<qint64> &removed) {
+        QHash<qint64, int> positions;
+        positions.reserve(lines.size());
+        for (int i = 0; i < lines.size(); ++i) positions.insert(lines[i].id, i);
+        for (const auto &line : changed) {
+            const auto it = positions.constFind(line.id);
+            if (it != positions.constEnd()) {
+                lines[it.value()] = line;
+            } else {
+                positions.insert(line.id, lines.size());
+                lines.append(line);
+            }
+        }
+        const QSet<qint64> removedIds(removed.cbegin(), removed.cend());
+        lines.removeIf([&removedIds](const SheetChanges::Line &line) { return removedIds.contains(line.id); });
+        std::stable_sort(lines.begin(), lines.end(), [](const SheetChanges::Line &a, const SheetChanges::Line &b) {
+            return a.orderKey < b.orderKey;
+        });
+    };
+    applyLines(data.rows, changes.rows, changes.removedRows);
+    applyLines(data.columns, changes.columns, changes.removedColumns);
+
+    QHash<QPair<qint64, qint64>, int> positions;
+    positions.reserve(data.cells.size());
+    for (int i = 0; i < data.cells.size(); ++i) positions.insert({data.cells[i].rowId, data.cells[i].columnId}, i);
+    for (const auto &cell : changes.cells) {
+        const auto it = positions.constFind({cell.rowId, cell.columnId});
+        if (it != positions.constEnd()) {
+            data.cells[it.value()].value = cell.value;
+        } else {
+            positions.insert({cell.rowId, cell.columnId}, data.cells.size());
+            data.cells.append(cell);
+        }
+    }
+    const QSet<qint64> removedRows(changes.removedRows.cbegin(), changes.removedRows.cend());
+    const QSet<qint64> removedColumns(changes.removedColumns.cbegin(), changes.removedColumns.cend());
+    data.cells.removeIf([&](const SheetChanges::Cell &cell) {
+        return !cell.value.isValid() || removedRows.contains(cell.rowId) || removedColumns.contains(cell.columnId);
+    });
+}
+
+bool SheetJournal::discardBefore(qint64 checkpoint)
+{
+    m_lastError.clear();
+    if (!isOpen() || checkpoint <= m_base) return true;
+    if (!sync()) return false;
+
+    // Записи после checkpoint (правки во время сохранения) остаются
+    const qint64 cut = qMin(HeaderSize + (checkpoint - m_base), m_fileSize);
+    if (!m_file.seek(cut)) {
+        m_lastError = m_file.errorString();
+        return false;
+    }
+    const QByteArray tail = m_file.read(m_fileSize - cut);
+    // Windows не заменяет открытый файл
+    m_file.close();
+
+    // Файл заменяется целиком: сбой посреди перезаписи оставит старый журнал
+    QSaveFile compacted(m_file.fileName());
+    const bool written = compacted.open(QIODevice::WriteOnly) && writeHeader(compacted)
+                         && compacted.write(tail) == tail.size() && compacted.commit();
+    if (!written) m_lastError = compacted.errorString();
+
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        m_lastError = m_file.errorString();
+        return false;
+    }
+    if (!written) return false;
+    m_fileSize = m_file.size();
+    m_base += cut - HeaderSize;
+    return true;
+}
@@ -0,0 +1,75 @@
+#include "SheetSnapshot.h"
+#include <QIODevice>
+#include <QByteArray>
+#include <QDate>
+#include <QDateTime>
+
+namespace {
+    constexpr qsizetype WriteChunkBytes = 1 << 20;
+
+    QString fieldText(const QVariant &value)
+    {
+        switch (value.typeId()) {
+        case QMetaType::QDate:
+            return value.toDate().toString(Qt::ISODate);
+        case QMetaType::QDateTime:
+            return value.toDateTime().toString(Qt::ISODate);
+        default:
+            return value.toString();
+        }
+    }
+
+    void appendField(QByteArray &line, const QString &text)
+    {
+        const bool quoted = text.contains(',') || text.contains('"') || text.contains('\n') || text.contains('\r')
+                            || (!text.isEmpty() && (text.front().isSpace() || text.back().isSpace()));
+        if (!quoted) {
+            line += text.toUtf8();
+            return;
+        }
+        QString escaped = text;
+        escaped.replace('"', "\"\"");
+        line += '"';
+        line += escaped.toUtf8();
+        line += '"';
+    }
+}
+
+bool SheetCsvWriter::write(const SheetSnapshot &snapshot, QIODevice &device)
+{
+    m_lastError.clear();
+    if (!snapshot.isValid()) {
+        m_lastError = "Снимок листа недоступен";
+        return false;
+    }
+
+    const CellStorage &cells = *snapshot.cells;
+    QByteArray buffer;
+    buffer.reserve(WriteChunkBytes + 4096);
+    auto flush = [&buffer, &device, this]() {
+        if (buffer.isEmpty()) return true;
+        if (device.write(buffer) != buffer.size()) {
+            m_lastError = device.errorString();
+            return false;
+        }
+        buffer.clear();
+        return true;
+    };
+
+    for (int column = 0; column < cells.columnCount(); ++column) {
+        if (column > 0) buffer += ',';
+        appendField(buffer, snapshot.headers.value(column));
+    }
+    buffer += "\r\n";
+
+    for (int row = 0; row < cells.rowCount(); ++row) {
+        for (int column = 0; column < cells.columnCount(); ++column) {
+            if (column > 0) buffer += ',';
+            const QVariant value = cells.value(row, column);
+            if (value.isValid()) appendField(buffer, fieldText(value));
+        }
+        buffer += "\r\n";
+        if (buffer.size() >= WriteChunkBytes && !flush()) return false;
+    }
+    return flush();
+}
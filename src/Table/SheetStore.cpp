@@ -0,0 +1,156 @@
+#include "SheetStore.h"
+#include "DataModifier.h"
+#include "DataReader.h"
+#include <QSqlDatabase>
+#include <QSqlRecord>
+#include <QSqlError>
+#include <QUuid>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QDebug>
+
+SheetStore::SheetStore(const QString &connectionName, qint64 sheetId)
+    : m_connectionName(connectionName), m_sheetId(sheetId)
+{
+}
+
+bool SheetStore::writeChanges(DataModifier &modifier, qint64 sheetId, const SheetChanges &changes)
+{
+    QList<QVariantList> removedRows;
+    for (qint64 rowId : changes.removedRows) removedRows.append({sheetId, rowId});
+    QList<QVariantList> removedColumns;
+    for (qint64 columnId : changes.removedColumns) removedColumns.append({sheetId, columnId});
+
+    QList<QVariantList> rows;
+    for (const auto &row : changes.rows) rows.append({sheetId, row.id, row.orderKey});
+    QList<QVariantList> columns;
+    for (const auto &column : changes.columns) columns.append({sheetId, column.id, column.orderKey, column.name, column.valueType,
+                                                                  column.formula.isEmpty() ? QVariant() : QVariant(column.formula)});
+
+    QList<QVariantList> cells;
+    QList<QVariantList> clearedCells;
+    for (const auto &cell : changes.cells) {
+        if (cell.value.isValid()) {
+            cells.append({sheetId, cell.rowId, cell.columnId, cell.value});
+        } else {
+            clearedCells.append({sheetId, cell.rowId, cell.columnId});
+        }
+    }
+
+    return modifier.executeInTransaction([&] {
+        return modifier.batchExecute("DELETE FROM sheet_cells WHERE sheet_id = ? AND row_id = ?", removedRows) >= 0
+            && modifier.batchExecute("DELETE FROM sheet_rows WHERE sheet_id = ? AND row_id = ?", removedRows) >= 0
+            && modifier.batchExecute("DELETE FROM sheet_cells WHERE sheet_id = ? AND column_id = ?", removedColumns) >= 0
+            && modifier.batchExecute("DELETE FROM sheet_columns WHERE sheet_id = ? AND column_id = ?", removedColumns) >= 0
+            && modifier.batchExecute("INSERT OR REPLACE INTO sheet_rows (sheet_id, row_id, order_key) "
+                                     "VALUES (?, ?, ?)", rows) >= 0
+            && modifier.batchExecute("INSERT OR REPLACE INTO sheet_columns (sheet_id, column_id, order_key, name, value_type, formula) "
+                                     "VALUES (?, ?, ?, ?, ?, ?)", columns) >= 0
+            && modifier.batchExecute("DELETE FROM sheet_cells WHERE sheet_id = ? AND row_id = ? AND column_id = ?",
+                                     clearedCells) >= 0
+            && modifier.batchExecute("INSERT OR REPLACE INTO sheet_cells (sheet_id, row_id, column_id, value) "
+                                     "VALUES (?, ?, ?, ?)", cells) >= 0;
+    });
+}
+
+bool SheetStore::save(const SheetChanges &changes)
+{
+    m_lastError.clear();
+    if (changes.isEmpty()) return true;
+
+    DataModifier modifier(m_connectionName);
+    if (!writeChanges(modifier, m_sheetId, changes)) {
+        m_lastError = modifier.getLastError();
+        return false;
+    }
+    return true;
+}
+
+QFuture<bool> SheetStore::saveAsync(const SheetChanges &changes) const
+{
+    const QString sourceConnection = m_connectionName;
+    const qint64 sheetId = m_sheetId;
+    return QtConcurrent::run([sourceConnection, sheetId, changes]() {
+        if (changes.isEmpty()) return true;
+
+        // Соединение QSqlDatabase нельзя использовать из другого потока - открываем копию
+        const QString connectionName = QString("sheet_save_%1").arg(QUuid::createUuid().toString(QUuid::Id128));
+        bool ok = false;
+        {
+            QSqlDatabase db = QSqlDatabase::cloneDatabase(sourceConnection, connectionName);
+            if (db.open()) {
+                DataModifier modifier(connectionName);
+                ok = writeChanges(modifier, sheetId, changes);
+                if (!ok) qWarning() << "sheet background save failed:" << modifier.getLastError();
+                db.close();
+            } else {
+                qWarning() << "sheet background save: cannot open connection" << db.lastError().text();
+            }
+        }
+        QSqlDatabase::removeDatabase(connectionName);
+        return ok;
+    });
+}
+
+bool SheetStore::load(SheetData &outData)
+{
+    if (!loadLayout(outData)) return false;
+    return forEachCell([&outData](const SheetChanges::Cell &cell) {
+        outData.cells.append(cell);
+        return true;
+    });
+}
+
+bool SheetStore::loadLayout(SheetData &outData, qint64 *cellCount)
+{
+    m_lastError.clear();
+    outData = SheetData();
+
+    DataReader reader(m_connectionName);
+    auto fail = [&]() {
+        m_lastError = reader.getLastError();
+        return false;
+    };
+
+    if (reader.forEachRecord("SELECT column_id, order_key, name, value_type, formula FROM sheet_columns WHERE sheet_id = ? "
+                             "ORDER BY order_key, column_id", {m_sheetId}, [&](const QSqlRecord &record) {
+            outData.columns.append({record.value(0).toLongLong(), record.value(1).toString(), record.value(2).toString(),
+                                    record.value(3).toInt(), record.value(4).toString()});
+            return true;
+        }) < 0) {
+        return fail();
+    }
+
+    if (reader.forEachRecord("SELECT row_id, order_key FROM sheet_rows WHERE sheet_id = ? "
+                             "ORDER BY order_key, row_id", {m_sheetId}, [&](const QSqlRecord &record) {
+            outData.rows.append({record.value(0).toLongLong(), record.value(1).toString(), QString()});
+            return true;
+        }) < 0) {
+        return fail();
+    }
+
+    if (cellCount) {
+        *cellCount = 0;
+        if (reader.forEachRecord("SELECT COUNT(*) FROM sheet_cells WHERE sheet_id = ?",
+                                 {m_sheetId}, [&](const QSqlRecord &record) {
+                *cellCount = record.value(0).toLongLong();
+                return true;
+            }) < 0) {
+            return fail();
+        }
+    }
+    return true;
+}
+
+bool SheetStore::forEachCell(const std::function<bool(const SheetChanges::Cell &cell)> &visitor)
+{
+    m_lastError.clear();
+    DataReader reader(m_connectionName);
+    if (reader.forEachRecord("SELECT row_id, column_id, value FROM sheet_cells WHERE sheet_id = ?",
+                             {m_sheetId}, [&](const QSqlRecord &record) {
+            return visitor({record.value(0).toLongLong(), record.value(1).toLongLong(), record.value(2)});
+        }) < 0) {
+        m_lastError = reader.getLastError();
+        return false;
+    }
+    return true;
+}
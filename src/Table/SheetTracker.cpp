@@ -0,0 +1,234 @@
+#include "SheetTracker.h"
+#include "CellStorage.h"
+#include "OrderKey.h"
+#include <QHash>
+
+void SheetTracker::Axis::insert(int position, int count)
+{
+    const QString before = position > 0 ? keys.at(position - 1) : QString();
+    const QString after = position < keys.size() ? keys.at(position) : QString();
+    const QStringList newKeys = OrderKey::sequence(before, after, count);
+
+    ids.insert(position, count, 0);
+    keys.insert(position, count, QString());
+    for (int i = 0; i < count; ++i) {
+        const qint64 id = nextId++;
+        ids[position + i] = id;
+        keys[position + i] = newKeys.value(i);
+        dirty.insert(id);
+        added.insert(id);
+    }
+}
+
+QVector<qint64> SheetTracker::Axis::remove(int position, int count)
+{
+    const QVector<qint64> removedIds = ids.mid(position, count);
+    ids.remove(position, count);
+    keys.remove(position, count);
+    for (qint64 id : removedIds) {
+        dirty.remove(id);
+        // Строка, созданная после сохранения, в БД еще не попала
+        if (!added.remove(id)) removed.insert(id);
+    }
+    return removedIds;
+}
+
+QHash<qint64, int> SheetTracker::Axis::positionsOf(const QSet<qint64> &wanted) const
+{
+    QHash<qint64, int> positions;
+    positions.reserve(wanted.size());
+    for (int i = 0; i < ids.size() && positions.size() < wanted.size(); ++i) {
+        if (wanted.contains(ids.at(i))) positions.insert(ids.at(i), i);
+    }
+    return positions;
+}
+
+void SheetTracker::clear()
+{
+    m_rows = Axis();
+    m_columns = Axis();
+    m_dirtyCells.clear();
+}
+
+void SheetTracker::load(const SheetData &data)
+{
+    clear();
+    for (const auto &row : data.rows) {
+        m_rows.ids.append(row.id);
+        m_rows.keys.append(row.orderKey);
+        m_rows.nextId = qMax(m_rows.nextId, row.id + 1);
+    }
+    for (const auto &column : data.columns) {
+        m_columns.ids.append(column.id);
+        m_columns.keys.append(column.orderKey);
+        m_columns.nextId = qMax(m_columns.nextId, column.id + 1);
+    }
+}
+
+void SheetTracker::insertRows(int row, int count)
+{
+    m_rows.insert(row, count);
+}
+
+void SheetTracker::removeRows(int row, int count)
+{
+    dropCells(m_rows.remove(row, count), true);
+}
+
+void SheetTracker::insertColumns(int column, int count)
+{
+    m_columns.insert(column, count);
+}
+
+void SheetTracker::removeColumns(int column, int count)
+{
+    dropCells(m_columns.remove(column, count), false);
+}
+
+void SheetTracker::dropCells(const QVector<qint64> &ids, bool byRow)
+{
+    if (m_dirtyCells.isEmpty()) return;
+
+    // Ячейки удаленных строк/столбцов сотрет само удаление
+    const QSet<qint64> removedIds(ids.cbegin(), ids.cend());
+    for (auto it = m_dirtyCells.begin(); it != m_dirtyCells.end();) {
+        if (removedIds.contains(byRow ? it->first : it->second)) {
+            it = m_dirtyCells.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SheetTracker::markCell(int row, int column)
+{
+    m_dirtyCells.insert({m_rows.ids.at(row), m_columns.ids.at(column)});
+}
+
+void SheetTracker::markColumn(int column)
+{
+    m_columns.dirty.insert(m_columns.ids.at(column));
+}
+
+bool SheetTracker::isModified() const
+{
+    return !m_dirtyCells.isEmpty() || !m_rows.dirty.isEmpty() || !m_rows.removed.isEmpty()
+           || !m_columns.dirty.isEmpty() || !m_columns.removed.isEmpty();
+}
+
+SheetChanges SheetTracker::takeChanges(const CellStorage &storage,
+                                       const std::function<void(int column, SheetChanges::Line &line)> &describeColumn)
+{
+    SheetChanges changes;
+
+    // Позиции нужны только для измененных id: один проход по id без построения полного индекса
+    QSet<qint64> wantedRows = m_rows.dirty;
+    QSet<qint64> wantedColumns = m_columns.dirty;
+    for (const auto &cell : m_dirtyCells) {
+        wantedRows.insert(cell.first);
+        wantedColumns.insert(cell.second);
+    }
+    const QHash<qint64, int> rowPositions = m_rows.positionsOf(wantedRows);
+    const QHash<qint64, int> columnPositions = m_columns.positionsOf(wantedColumns);
+
+    for (qint64 id : m_rows.dirty) {
+        const auto it = rowPositions.constFind(id);
+        if (it == rowPositions.constEnd()) continue;
+        SheetChanges::Line line;
+        line.id = id;
+        line.orderKey = m_rows.keys.at(it.value());
+        line.added = m_rows.added.contains(id);
+        changes.rows.append(line);
+    }
+    for (qint64 id : m_columns.dirty) {
+        const auto it = columnPositions.constFind(id);
+        if (it == columnPositions.constEnd()) continue;
+        SheetChanges::Line line;
+        line.id = id;
+        line.orderKey = m_columns.keys.at(it.value());
+        line.added = m_columns.added.contains(id);
+        describeColumn(it.value(), line);
+        changes.columns.append(line);
+    }
+    for (const auto &cell : m_dirtyCells) {
+        const auto row = rowPositions.constFind(cell.first);
+        const auto column = columnPositions.constFind(cell.second);
+        if (row == rowPositions.constEnd() || column == columnPositions.constEnd()) continue;
+        changes.cells.append({cell.first, cell.second, storage.value(row.value(), column.value())});
+    }
+    changes.removedRows = QList<qint64>(m_rows.removed.cbegin(), m_rows.removed.cend());
+    changes.removedColumns = QList<qint64>(m_columns.removed.cbegin(), m_columns.removed.cend());
+
+    m_rows.dirty.clear();
+    m_rows.added.clear();
+    m_rows.removed.clear();
+    m_columns.dirty.clear();
+    m_columns.added.clear();
+    m_columns.removed.clear();
+    m_dirtyCells.clear();
+    return changes;
+}
+
+void SheetTracker::requeue(const SheetChanges &changes)
+{
+    // Актуальные значения перечитаются при следующем takeChanges()
+    for (const auto &row : changes.rows) {
+        if (m_rows.ids.contains(row.id)) {
+            m_rows.dirty.insert(row.id);
+            // Строка из БД остается в ней: ее удаление нужно будет записать
+            if (row.added) m_rows.added.insert(row.id);
+        }
+    }
+    for (const auto &column : changes.columns) {
+        if (m_columns.ids.contains(column.id)) {
+            m_columns.dirty.insert(column.id);
+            if (column.added) m_columns.added.insert(column.id);
+        }
+    }
+    for (qint64 id : changes.removedRows) m_rows.removed.insert(id);
+    for (qint64 id : changes.removedColumns) m_columns.removed.insert(id);
+    for (const auto &cell : changes.cells) {
+        if (m_rows.ids.contains(cell.rowId) && m_columns.ids.contains(cell.columnId)) {
+            m_dirtyCells.insert({cell.rowId, cell.columnId});
+        }
+    }
+}
+
+void SheetTracker::restoreChanges(const SheetChanges &changes, const QSet<qint64> &savedRows,
+                                  const QSet<qint64> &savedColumns)
+{
+    // Новые id - выше всех id журнала: id удаленной несохраненной строки нет ни в БД, ни
+    // в листе, но его записи остались в журнале и при повторном сбое легли бы на новую строку
+    for (const auto &row : changes.rows) m_rows.nextId = qMax(m_rows.nextId, row.id + 1);
+    for (qint64 id : changes.removedRows) m_rows.nextId = qMax(m_rows.nextId, id + 1);
+    for (const auto &column : changes.columns) m_columns.nextId = qMax(m_columns.nextId, column.id + 1);
+    for (qint64 id : changes.removedColumns) m_columns.nextId = qMax(m_columns.nextId, id + 1);
+    for (const auto &cell : changes.cells) {
+        m_rows.nextId = qMax(m_rows.nextId, cell.rowId + 1);
+        m_columns.nextId = qMax(m_columns.nextId, cell.columnId + 1);
+    }
+
+    const QSet<qint64> rowIds(m_rows.ids.cbegin(), m_rows.ids.cend());
+    const QSet<qint64> columnIds(m_columns.ids.cbegin(), m_columns.ids.cend());
+    for (const auto &row : changes.rows) {
+        if (!rowIds.contains(row.id)) continue;
+        m_rows.dirty.insert(row.id);
+        if (!savedRows.contains(row.id)) m_rows.added.insert(row.id);
+    }
+    for (const auto &column : changes.columns) {
+        if (!columnIds.contains(column.id)) continue;
+        m_columns.dirty.insert(column.id);
+        if (!savedColumns.contains(column.id)) m_columns.added.insert(column.id);
+    }
+    for (qint64 id : changes.removedRows) {
+        if (savedRows.contains(id)) m_rows.removed.insert(id);
+    }
+    for (qint64 id : changes.removedColumns) {
+        if (savedColumns.contains(id)) m_columns.removed.insert(id);
+    }
+    for (const auto &cell : changes.cells) {
+        if (rowIds.contains(cell.rowId) && columnIds.contains(cell.columnId)) {
+            m_dirtyCells.insert({cell.rowId, cell.columnId});
+        }
+    }
+}
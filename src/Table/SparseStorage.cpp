@@ -0,0 +1,131 @@
+#include "SparseStorage.h"
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+SparseStorage::Column::iterator SparseStorage::lowerBound(Column &cells, int row)
+{
+    return std::lower_bound(cells.begin(), cells.end(), row,
+                            [](const Cell &cell, int value) { return cell.row < value; });
+}
+
+SparseStorage::Column::const_iterator SparseStorage::lowerBound(const Column &cells, int row)
+{
+    return std::lower_bound(cells.begin(), cells.end(), row,
+                            [](const Cell &cell, int value) { return cell.row < value; });
+}
+
+QVariant SparseStorage::value(int row, int column) const
+{
+    const Column &cells = *m_columns[column];
+    const auto it = lowerBound(cells, row);
+    if (it == cells.end() || it->row != row) {
+        return QVariant();
+    }
+    return it->value;
+}
+
+void SparseStorage::setValue(int row, int column, const QVariant &value)
+{
+    const Column &current = *m_columns[column];
+    const auto found = lowerBound(current, row);
+    const bool exists = found != current.end() && found->row == row;
+    // Очистка пустой ячейки не меняет колонку - копировать ее ради этого не нужно
+    if (!exists && !value.isValid()) return;
+
+    Column &cells = detach(column);
+    auto it = lowerBound(cells, row);
+
+    if (!value.isValid()) {
+        cells.erase(it);
+        --m_filledCells;
+        return;
+    }
+    if (exists) {
+        it->value = value;
+        return;
+    }
+    cells.insert(it, Cell{row, value});
+    ++m_filledCells;
+}
+
+void SparseStorage::insertRows(int row, int count)
+{
+    for (int i = 0; i < columnCount(); ++i) {
+        // Колонки без ячеек ниже позиции не меняются
+        if (lowerBound(std::as_const(*m_columns[i]), row) == m_columns[i]->cend()) continue;
+        Column &column = detach(i);
+        for (auto it = lowerBound(column, row); it != column.end(); ++it) {
+            it->row += count;
+        }
+    }
+    m_rowCount += count;
+}
+
+void SparseStorage::removeRows(int row, int count)
+{
+    for (int i = 0; i < columnCount(); ++i) {
+        if (lowerBound(std::as_const(*m_columns[i]), row) == m_columns[i]->cend()) continue;
+        Column &column = detach(i);
+        auto first = lowerBound(column, row);
+        auto last = lowerBound(column, row + count);
+        m_filledCells -= last - first;
+        for (auto it = last; it != column.end(); ++it) {
+            it->row -= count;
+        }
+        column.erase(first, last);
+    }
+    m_rowCount -= count;
+}
+
+void SparseStorage::insertColumns(int column, int count)
+{
+    std::vector<std::shared_ptr<Column>> added;
+    added.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        added.push_back(std::make_shared<Column>());
+    }
+    m_columns.insert(m_columns.begin() + column, std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+}
+
+void SparseStorage::removeColumns(int column, int count)
+{
+    for (int i = column; i < column + count; ++i) {
+        m_filledCells -= static_cast<qint64>(m_columns[i]->size());
+    }
+    m_columns.erase(m_columns.begin() + column, m_columns.begin() + column + count);
+}
+
+void SparseStorage::forEachValue(const std::function<void(int row, int column, const QVariant &value)> &visitor) const
+{
+    for (int column = 0; column < columnCount(); ++column) {
+        for (const Cell &cell : *m_columns[column]) {
+            visitor(cell.row, column, cell.value);
+        }
+    }
+}
+
+qint64 SparseStorage::memoryUsage() const
+{
+    qint64 total = static_cast<qint64>(m_columns.capacity() * sizeof(std::shared_ptr<Column>));
+    for (const auto &column : m_columns) {
+        total += static_cast<qint64>(sizeof(Column) + column->capacity() * sizeof(Cell));
+    }
+    return total;
+}
+
+std::shared_ptr<const CellStorage> SparseStorage::snapshot() const
+{
+    auto copy = std::make_shared<SparseStorage>();
+    copy->m_columns = m_columns;
+    copy->m_rowCount = m_rowCount;
+    copy->m_filledCells = m_filledCells;
+    return copy;
+}
+
+SparseStorage::Column &SparseStorage::detach(int column)
+{
+    std::shared_ptr<Column> &target = m_columns[column];
+    if (target.use_count() > 1) target = std::make_shared<Column>(*target);
+    return *target;
+}
@@ -1,74 +1,1266 @@
 #include "TableDataModel.h"
+#include "DataReader.h"
+#include <QDebug>
+#include "SparseStorage.h"
+#include "SheetStore.h"
+#include "SheetJournal.h"
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QVarLengthArray>
+#include <QFile>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+    // Автовыбор хранилища: разреженное ниже SparseFillRatio, обратно в колоночное
+    // выше DenseFillRatio (зазор не дает переключаться туда-обратно на границе)
+    constexpr double SparseFillRatio = 0.05;
+    constexpr double DenseFillRatio = 0.15;
+    constexpr qint64 MinCellsForSparse = 65536;
+    // Обратно из плиточного, когда ячейки заведомо помещаются в четверть бюджета
+    constexpr qint64 TiledCellBytes = 48;
+    constexpr int StorageCheckInterval = 1024;  // проверка заполненности раз в N setData
+    constexpr qint64 UndoMergeIntervalMs = 1000;
+    // Пересчет формулы без cumsum от стольких строк идет блоками в пуле потоков
+    constexpr int ParallelRecalcRows = 65536;
+    constexpr int RecalcBlockRows = 16384;
+
+    // Отсортированные без повторов индексы -> непрерывные блоки (начало, длина) по возрастанию
+    QList<QPair<int, int>> contiguousBlocks(QList<int> indexes, int limit)
+    {
+        std::sort(indexes.begin(), indexes.end());
+        indexes.erase(std::unique(indexes.begin(), indexes.end()), indexes.end());
+
+        QList<QPair<int, int>> blocks;
+        for (int index : indexes) {
+            if (index < 0 || index >= limit) continue;
+            if (!blocks.isEmpty() && blocks.last().first + blocks.last().second == index) {
+                ++blocks.last().second;
+            } else {
+                blocks.append({index, 1});
+            }
+        }
+        return blocks;
+    }
+
+    // Значение формулы в строке; sums - состояние cumsum (nullptr для формул без него)
+    QVariant evaluateFormulaRow(const CellStorage &storage, const ColumnFormula &formula, const QVector<int> &inputColumns,
+                                int row, double *inputs, double *sums)
+    {
+        for (int i = 0; i < inputColumns.size(); ++i) {
+            inputs[i] = inputColumns[i] < 0 ? std::nan("") : ColumnFormula::toNumber(storage.value(row, inputColumns[i]));
+        }
+        const double value = formula.evaluate(inputs, sums);
+        return std::isnan(value) ? QVariant() : QVariant(value);
+    }
+
+    std::unique_ptr<CellStorage> createStorage(CellStorage::Kind kind, qint64 tiledMemoryBudget)
+    {
+        if (kind == CellStorage::Kind::Sparse) {
+            return std::make_unique<SparseStorage>();
+        }
+        if (kind == CellStorage::Kind::Tiled) {
+            return std::make_unique<TiledStorage>(tiledMemoryBudget);
+        }
+        return std::make_unique<ColumnStorage>();
+    }
+
+    const char *storageName(CellStorage::Kind kind)
+    {
+        switch (kind) {
+        case CellStorage::Kind::Sparse: return "sparse";
+        case CellStorage::Kind::Tiled: return "tiled";
+        default: return "columnar";
+        }
+    }
+}
 
 TableDataModel::TableDataModel(QObject *parent)
-    : QAbstractTableModel(parent)
+    : QAbstractTableModel(parent), m_storage(std::make_unique<ColumnStorage>())
 {
     m_columnHeaders.clear();
-    m_columnCount = 0;
-    m_rowCount = 0;
     //загрузка данных из db
     //if(Дата есть в db)
     //    загружаем данные из db
     //else
     //    создаем новый столбец
     onHeaderAddRequested(0, false);
+    m_undoLog.clear();
 }
 
 TableDataModel::~TableDataModel()
 {
+    // Подгрузка плиток, фоновый пересчет формулы и итоги читают хранилище
+    m_prefetch.waitForFinished();
+    if (m_recalcWatcher) m_recalcWatcher->waitForFinished();
+    if (m_aggregateWatcher) m_aggregateWatcher->waitForFinished();
+}
+
+
+
+
+bool TableDataModel::bindToTable(DataReader *reader, const QString &tableName, const QString &keyColumn)
+{
+    if (!reader) return false;
+
+    auto window = std::make_unique<DbTableWindow>(reader, tableName, keyColumn);
+    if (!window->open()) {
+        qWarning() << "table bind failed:" << window->getLastError();
+        return false;
+    }
+
+    beginResetModel();
+    m_dbWindow = std::move(window);
+    m_fetchedRows = 0;
+    endResetModel();
+    return true;
+}
+
+void TableDataModel::unbindTable()
+{
+    if (!m_dbWindow) return;
+
+    beginResetModel();
+    m_dbWindow.reset();
+    m_fetchedRows = 0;
+    endResetModel();
+}
+
+bool TableDataModel::saveSheet(SheetStore &store)
+{
+    // Иначе более старый фоновый пакет может записаться позже и затереть новые значения
+    if (m_dbWindow || (m_saveWatcher && m_saveWatcher->isRunning())) return false;
+    if (!m_tracker.isModified()) return true;
+
+    const qint64 journalCheckpoint = m_journal ? m_journal->checkpoint() : 0;
+    const SheetChanges changes = m_tracker.takeChanges(*m_storage, [this](int column, SheetChanges::Line &line) {
+        describeColumn(column, line);
+    });
+    if (!store.save(changes)) {
+        qWarning() << "sheet save failed:" << store.getLastError();
+        m_tracker.requeue(changes);
+        return false;
+    }
+    if (m_journal && !m_journal->discardBefore(journalCheckpoint)) {
+        qWarning() << "sheet journal compaction failed:" << m_journal->getLastError();
+    }
+    return true;
+}
+
+bool TableDataModel::saveSheetInBackground(SheetStore *store)
+{
+    // Следующее сохранение начинается после завершения предыдущего
+    if (!store || m_dbWindow || (m_saveWatcher && m_saveWatcher->isRunning())) return false;
+    if (!m_tracker.isModified()) {
+        emit sheetSaved(true);
+        return true;
+    }
+
+    if (!m_saveWatcher) {
+        m_saveWatcher = new QFutureWatcher<bool>(this);
+    }
+    m_saveWatcher->disconnect(this);
+
+    // Значения копируются сейчас: правки во время записи попадут в следующее сохранение
+    const qint64 journalCheckpoint = m_journal ? m_journal->checkpoint() : 0;
+    const SheetChanges changes = m_tracker.takeChanges(*m_storage, [this](int column, SheetChanges::Line &line) {
+        describeColumn(column, line);
+    });
+    connect(m_saveWatcher, &QFutureWatcher<bool>::finished, this, [this, changes, journalCheckpoint]() {
+        const bool success = m_saveWatcher->result();
+        if (!success) {
+            qWarning() << "background sheet save failed";
+            m_tracker.requeue(changes);
+        } else if (m_journal && !m_journal->discardBefore(journalCheckpoint)) {
+            qWarning() << "sheet journal compaction failed:" << m_journal->getLastError();
+        }
+        emit sheetSaved(success);
+    });
+    m_saveWatcher->setFuture(store->saveAsync(changes));
+    return true;
+}
+
+SheetSnapshot TableDataModel::snapshot() const
+{
+    SheetSnapshot result;
+    if (m_dbWindow) return result;
+    result.cells = m_storage->snapshot();
+    if (!result.cells) return result;
+    result.headers = m_columnHeaders;
+    result.columnTypes = m_columnTypes;
+    return result;
+}
+
+bool TableDataModel::exportCsvInBackground(const QString &filePath)
+{
+    if (m_exportWatcher && m_exportWatcher->isRunning()) return false;
+    const SheetSnapshot sheet = snapshot();
+    if (!sheet.isValid()) {
+        qWarning() << "csv export: sheet snapshot is not available for" << storageName(m_storage->kind()) << "storage";
+        return false;
+    }
+
+    if (!m_exportWatcher) {
+        m_exportWatcher = new QFutureWatcher<QString>(this);
+    }
+    m_exportWatcher->disconnect(this);
+    connect(m_exportWatcher, &QFutureWatcher<QString>::finished, this, [this, filePath]() {
+        const QString error = m_exportWatcher->result();
+        if (!error.isEmpty()) qWarning() << "csv export failed:" << error;
+        emit csvExported(error.isEmpty(), filePath);
+    });
+    m_exportWatcher->setFuture(QtConcurrent::run([sheet, filePath]() {
+        QFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return file.errorString();
+        SheetCsvWriter writer;
+        if (!writer.write(sheet, file)) return writer.getLastError();
+        return QString();
+    }));
+    return true;
+}
+
+bool TableDataModel::loadSheet(SheetStore &store)
+{
+    if (m_dbWindow || (m_saveWatcher && m_saveWatcher->isRunning())) return false;
+
+    // Ячейки читаются потоком прямо в хранилище: SheetData держит только строки и столбцы
+    SheetData data;
+    qint64 storedCells = 0;
+    if (!store.loadLayout(data, &storedCells)) {
+        qWarning() << "sheet load failed:" << store.getLastError();
+        return false;
+    }
+
+    // Несохраненные правки прошлого сеанса (например, до сбоя) поверх состояния БД
+    SheetChanges recovered;
+    QSet<qint64> savedRows;
+    QSet<qint64> savedColumns;
+    if (m_journal) {
+        if (!m_journal->replay(recovered)) {
+            qWarning() << "sheet journal replay failed:" << m_journal->getLastError();
+        }
+        if (!recovered.isEmpty()) {
+            for (const auto &row : data.rows) savedRows.insert(row.id);
+            for (const auto &column : data.columns) savedColumns.insert(column.id);
+            SheetJournal::apply(data, recovered);  // ячейки журнала пишутся после ячеек БД
+            qDebug() << "sheet journal replayed:" << recovered.cells.size() << "cells,"
+                     << recovered.rows.size() + recovered.removedRows.size() << "rows,"
+                     << recovered.columns.size() + recovered.removedColumns.size() << "columns";
+        }
+    }
+
+    QHash<qint64, int> rowPositions;
+    QHash<qint64, int> columnPositions;
+    rowPositions.reserve(data.rows.size());
+    columnPositions.reserve(data.columns.size());
+    for (int i = 0; i < data.rows.size(); ++i) rowPositions.insert(data.rows[i].id, i);
+    for (int i = 0; i < data.columns.size(); ++i) columnPositions.insert(data.columns[i].id, i);
+
+    QVector<ColumnType> columnTypes;
+    columnTypes.reserve(data.columns.size());
+    for (const auto &column : data.columns) {
+        const bool known = column.valueType >= int(ColumnType::Auto) && column.valueType <= int(ColumnType::Text);
+        columnTypes.append(known ? ColumnType(column.valueType) : ColumnType::Auto);
+    }
+
+    // В режиме Auto хранилище выбирается до загрузки по числу ячеек, как в updateStorageKind():
+    // лист больше бюджета памяти сразу пишется в плиточное, а не собирается в памяти целиком
+    CellStorage::Kind kind = CellStorage::Kind::Columnar;
+    if (m_storageMode == StorageMode::Sparse) kind = CellStorage::Kind::Sparse;
+    if (m_storageMode == StorageMode::Tiled) kind = CellStorage::Kind::Tiled;
+    if (m_storageMode == StorageMode::Auto) {
+        const qint64 filledCells = storedCells + recovered.cells.size();
+        const qint64 totalCells = qint64(data.rows.size()) * data.columns.size();
+        if (filledCells * TiledCellBytes > m_tiledMemoryBudget) {
+            kind = CellStorage::Kind::Tiled;
+        } else if (totalCells >= MinCellsForSparse && filledCells < totalCells * SparseFillRatio) {
+            kind = CellStorage::Kind::Sparse;
+        }
+    }
+    std::unique_ptr<CellStorage> storage = createStorage(kind, m_tiledMemoryBudget);
+    storage->insertColumns(0, data.columns.size());
+    storage->insertRows(0, data.rows.size());
+    auto storeCell = [&](const SheetChanges::Cell &cell) {
+        const auto row = rowPositions.constFind(cell.rowId);
+        const auto column = columnPositions.constFind(cell.columnId);
+        if (row == rowPositions.constEnd() || column == columnPositions.constEnd()) return true;
+        // SQLite возвращает даты и логические значения текстом/числом - восстанавливаем тип столбца
+        storage->setValue(row.value(), column.value(), ColumnTypeInference::coerce(cell.value, columnTypes[column.value()]));
+        return true;
+    };
+    if (!store.forEachCell(storeCell)) {
+        qWarning() << "sheet load failed:" << store.getLastError();
+        return false;
+    }
+    // Правки из журнала, в том числе очищенные ячейки
+    for (const auto &cell : recovered.cells) storeCell(cell);
+
+    beginResetModel();
+    m_recalcGeneration.ref();
+    {
+        QWriteLocker locker(&m_storageLock);
+        m_storage = std::move(storage);
+    }
+    m_columnHeaders.clear();
+    for (const auto &column : data.columns) {
+        m_columnHeaders.append(column.name);
+    }
+    m_columnTypes = std::move(columnTypes);
+    m_tracker.load(data);
+    if (!recovered.isEmpty()) m_tracker.restoreChanges(recovered, savedRows, savedColumns);
+
+    // Значения вычисляемых столбцов сохранены вместе с листом - пересчет не нужен
+    m_computed.clear();
+    m_formulaDirty.clear();
+    for (const auto &column : data.columns) {
+        if (column.formula.isEmpty()) continue;
+        auto formula = std::make_shared<ColumnFormula>();
+        if (formula->compile(column.formula)) {
+            m_computed.insert(column.id, {formula, {}});
+        } else {
+            qWarning() << "sheet formula ignored:" << column.formula << formula->getLastError();
+        }
+    }
+    if (!updateFormulaOrder()) {
+        qWarning() << "sheet formulas ignored: circular reference";
+        m_computed.clear();
+        m_formulaOrder.clear();
+    }
+    m_undoLog.clear();
+    m_aggregates.clear();
+    updateStorageKind();
+    endResetModel();
+    return true;
+}
+
+void TableDataModel::clearUndo()
+{
+    m_undoLog.clear();
+    m_canMergeCellEdit = false;
+}
+
+void TableDataModel::beginUndoMacro()
+{
+    if (m_undoMacroDepth++ == 0) {
+        m_undoMacroRecorded = false;
+    }
+}
+
+void TableDataModel::endUndoMacro()
+{
+    if (m_undoMacroDepth > 0 && --m_undoMacroDepth == 0) {
+        m_canMergeCellEdit = false;
+    }
+}
+
+void TableDataModel::recordUndo(const TableUndoOperation &operation, bool cellEdit)
+{
+    if (m_applyingUndo) return;
+
+    if (m_undoMacroDepth > 0) {
+        if (m_undoMacroRecorded) {
+            m_undoLog.appendToLast(operation);
+        } else {
+            m_undoLog.record(operation);
+            m_undoMacroRecorded = true;
+        }
+        return;
+    }
+
+    if (cellEdit && m_canMergeCellEdit && m_lastCellEdit.isValid() && m_lastCellEdit.elapsed() < UndoMergeIntervalMs) {
+        m_undoLog.appendToLast(operation);
+    } else {
+        m_undoLog.record(operation);
+    }
+    m_canMergeCellEdit = cellEdit;
+    if (cellEdit) m_lastCellEdit.restart();
+}
+
+bool TableDataModel::undo()
+{
+    if (m_dbWindow || m_undoMacroDepth > 0 || !m_undoLog.canUndo()) return false;
+
+    TableUndoStep step = m_undoLog.takeUndo();
+    applyUndoStep(step);
+    m_undoLog.pushRedo(std::move(step));
+    return true;
+}
+
+bool TableDataModel::redo()
+{
+    if (m_dbWindow || m_undoMacroDepth > 0 || !m_undoLog.canRedo()) return false;
+
+    TableUndoStep step = m_undoLog.takeRedo();
+    applyUndoStep(step);
+    m_undoLog.pushUndo(std::move(step));
+    return true;
+}
+
+void TableDataModel::applyUndoStep(TableUndoStep &step)
+{
+    // Операции откатываются с конца; после отката шаг описывает обратное действие
+    // в обратном порядке, поэтому повтор проходит его тем же способом
+    m_applyingUndo = true;
+    m_canMergeCellEdit = false;
+    for (int i = step.operations.size() - 1; i >= 0; --i) {
+        applyUndoOperation(step.operations[i]);
+    }
+    std::reverse(step.operations.begin(), step.operations.end());
+    m_applyingUndo = false;
+    recalculateFormulas();
+    updateStorageKind();
+}
+
+void TableDataModel::applyUndoOperation(TableUndoOperation &operation)
+{
+    using Kind = TableUndoOperation::Kind;
+
+    switch (operation.kind) {
+    case Kind::Cells: {
+        QVector<QPair<int, QVariant>> current = captureCells(operation.row, operation.column, operation.rowCount, operation.columnCount);
+        restoreCells(operation.row, operation.column, operation.rowCount, operation.columnCount, operation.values);
+        operation.values = std::move(current);
+        emit dataChanged(index(operation.row, operation.column),
+                         index(operation.row + operation.rowCount - 1, operation.column + operation.columnCount - 1),
+                         {Qt::DisplayRole, Qt::EditRole});
+        break;
+    }
+    case Kind::CellList: {
+        QVector<QPair<int, QVariant>> current = captureCellList(operation.cells);
+        restoreCellList(operation.cells, operation.values);
+        operation.values = std::move(current);
+        QRect changed;
+        for (const QPoint &cell : operation.cells) changed = changed.united(QRect(cell, QSize(1, 1)));
+        notifyCellsChanged(changed);
+        break;
+    }
+    case Kind::InsertRows:
+        operation.column = 0;
+        operation.columnCount = m_storage->columnCount();
+        operation.values = captureCells(operation.row, 0, operation.rowCount, operation.columnCount);
+        removeRows(operation.row, operation.rowCount);
+        operation.kind = Kind::RemoveRows;
+        break;
+    case Kind::RemoveRows:
+        insertRows(operation.row, operation.rowCount);
+        restoreCells(operation.row, 0, operation.rowCount, operation.columnCount, operation.values);
+        // Вставленные строки считаются пустыми (ключи сортировки, агрегаты) - сообщаем о значениях
+        notifyCellsChanged(QRect(0, operation.row, operation.columnCount, operation.rowCount));
+        operation.values.clear();
+        operation.values.squeeze();
+        operation.kind = Kind::InsertRows;
+        break;
+    case Kind::InsertColumns:
+        operation.row = 0;
+        operation.rowCount = m_storage->rowCount();
+        operation.values = captureCells(0, operation.column, operation.rowCount, operation.columnCount);
+        operation.headers = m_columnHeaders.mid(operation.column, operation.columnCount);
+        captureColumnFormulas(operation);
+        operation.columnTypes.clear();
+        for (int i = 0; i < operation.columnCount; ++i) {
+            operation.columnTypes.append(int(columnType(operation.column + i)));
+        }
+        removeColumns(operation.column, operation.columnCount);
+        operation.kind = Kind::RemoveColumns;
+        break;
+    case Kind::RemoveColumns:
+        insertColumns(operation.column, operation.columnCount);
+        restoreCells(0, operation.column, operation.rowCount, operation.columnCount, operation.values);
+        for (int i = 0; i < operation.headers.size() && operation.column + i < m_columnHeaders.size(); ++i) {
+            m_columnHeaders[operation.column + i] = operation.headers[i];
+        }
+        for (int i = 0; i < operation.columnTypes.size() && operation.column + i < m_columnTypes.size(); ++i) {
+            m_columnTypes[operation.column + i] = ColumnType(operation.columnTypes[i]);
+        }
+        restoreColumnFormulas(operation);
+        // После типов и формул: журнал записывает описание столбца целиком
+        for (int i = 0; i < operation.headers.size() && operation.column + i < m_columnHeaders.size(); ++i) {
+            markColumn(operation.column + i);
+        }
+        emit headerDataChanged(Qt::Horizontal, operation.column, operation.column + operation.columnCount - 1);
+        operation.values.clear();
+        operation.values.squeeze();
+        operation.headers.clear();
+        operation.columnTypes.clear();
+        operation.formulas.clear();
+        operation.columnIds.clear();
+        operation.kind = Kind::InsertColumns;
+        break;
+    case Kind::RenameColumn:
+        std::swap(m_columnHeaders[operation.column], operation.headers[0]);
+        markColumn(operation.column);
+        emit headerDataChanged(Qt::Horizontal, operation.column, operation.column);
+        break;
+    case Kind::SetColumnType: {
+        const ColumnType previous = m_columnTypes[operation.column];
+        m_columnTypes[operation.column] = ColumnType(operation.columnTypes[0]);
+        operation.columnTypes[0] = int(previous);
+        markColumn(operation.column);
+        emit headerDataChanged(Qt::Horizontal, operation.column, operation.column);
+        break;
+    }
+    case Kind::SetColumnFormula: {
+        const qint64 id = m_tracker.columnId(operation.column);
+        const auto current = m_computed.constFind(id);
+        const QString currentText = current != m_computed.constEnd() ? current->formula->storedText() : QString();
+        m_computed.remove(id);
+        if (!operation.formulas[0].isEmpty()) {
+            auto formula = std::make_shared<ColumnFormula>();
+            if (formula->compile(operation.formulas[0])) m_computed.insert(id, {formula, {}});
+        }
+        updateFormulaOrder();
+        operation.formulas[0] = currentText;
+        markColumn(operation.column);
+        emit headerDataChanged(Qt::Horizontal, operation.column, operation.column);
+        break;
+    }
+    }
+}
+
+QVector<QPair<int, QVariant>> TableDataModel::captureCells(int row, int column, int rowCount, int columnCount) const
+{
+    QVector<QPair<int, QVariant>> values;
+    for (int r = 0; r < rowCount; ++r) {
+        for (int c = 0; c < columnCount; ++c) {
+            QVariant value = m_storage->value(row + r, column + c);
+            if (value.isValid()) values.append({r * columnCount + c, std::move(value)});
+        }
+    }
+    values.squeeze();
+    return values;
+}
+
+void TableDataModel::restoreCells(int row, int column, int rowCount, int columnCount, const QVector<QPair<int, QVariant>> &values)
+{
+    // values отсортированы по смещению: ячейки между ними очищаются
+    for (int c = column; c < column + columnCount; ++c) {
+        m_aggregates.invalidate(c);
+        markFormulaInputs(c, row, row + rowCount - 1);
+    }
+    QWriteLocker locker(&m_storageLock);
+    int next = 0;
+    for (int r = 0; r < rowCount; ++r) {
+        for (int c = 0; c < columnCount; ++c) {
+            const int offset = r * columnCount + c;
+            if (next < values.size() && values[next].first == offset) {
+                m_storage->setValue(row + r, column + c, values[next++].second);
+            } else {
+                m_storage->setValue(row + r, column + c, QVariant());
+            }
+            markCell(row + r, column + c);
+        }
+    }
+}
+
+QVector<QPair<int, QVariant>> TableDataModel::captureCellList(const QVector<QPoint> &cells) const
+{
+    QVector<QPair<int, QVariant>> values;
+    for (int i = 0; i < cells.size(); ++i) {
+        QVariant value = m_storage->value(cells[i].y(), cells[i].x());
+        if (value.isValid()) values.append({i, std::move(value)});
+    }
+    values.squeeze();
+    return values;
+}
+
+void TableDataModel::restoreCellList(const QVector<QPoint> &cells, const QVector<QPair<int, QVariant>> &values)
+{
+    QWriteLocker locker(&m_storageLock);
+    int next = 0;
+    for (int i = 0; i < cells.size(); ++i) {
+        const QPoint &cell = cells[i];
+        if (next < values.size() && values[next].first == i) {
+            m_storage->setValue(cell.y(), cell.x(), values[next++].second);
+        } else {
+            m_storage->setValue(cell.y(), cell.x(), QVariant());
+        }
+        markCell(cell.y(), cell.x());
+        m_aggregates.invalidate(cell.x());
+        markFormulaInputs(cell.x(), cell.y(), cell.y());
+    }
+}
+
+void TableDataModel::notifyCellsChanged(const QRect &changed)
+{
+    if (changed.isEmpty()) return;
+    if (m_batchDepth > 0) {
+        m_pendingChange = m_pendingChange.united(changed);
+    } else {
+        emit dataChanged(index(changed.top(), changed.left()), index(changed.bottom(), changed.right()),
+                         {Qt::DisplayRole, Qt::EditRole});
+    }
+}
+
+bool TableDataModel::canFetchMore(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !m_dbWindow) return false;
+    return !m_dbWindow->atEnd() || m_fetchedRows < m_dbWindow->loadedRows();
 }
 
+void TableDataModel::fetchMore(const QModelIndex &parent)
+{
+    if (parent.isValid() || !m_dbWindow) return;
 
+    // Блок читается до beginInsertRows, чтобы знать точное число новых строк
+    if (m_fetchedRows >= m_dbWindow->loadedRows() && m_dbWindow->loadNextBlock() < 0) {
+        qWarning() << "table block read failed:" << m_dbWindow->getLastError();
+        return;
+    }
+    const int available = m_dbWindow->loadedRows() - m_fetchedRows;
+    if (available <= 0) return;
+
+    beginInsertRows(QModelIndex(), m_fetchedRows, m_fetchedRows + available - 1);
+    m_fetchedRows += available;
+    endInsertRows();
+}
 
+void TableDataModel::setStorageMode(StorageMode mode)
+{
+    m_storageMode = mode;
+    switch (mode) {
+    case StorageMode::Columnar: switchStorage(CellStorage::Kind::Columnar); break;
+    case StorageMode::Sparse: switchStorage(CellStorage::Kind::Sparse); break;
+    case StorageMode::Tiled: switchStorage(CellStorage::Kind::Tiled); break;
+    case StorageMode::Auto: updateStorageKind(); break;
+    }
+}
+
+void TableDataModel::setTiledMemoryBudget(qint64 bytes)
+{
+    m_tiledMemoryBudget = qMax<qint64>(bytes, 0);
+    if (m_storage->kind() == CellStorage::Kind::Tiled) {
+        QWriteLocker locker(&m_storageLock);
+        static_cast<TiledStorage &>(*m_storage).setMemoryBudget(m_tiledMemoryBudget);
+    }
+    updateStorageKind();
+}
+
+TiledStorage::Metrics TableDataModel::tiledStorageMetrics() const
+{
+    if (m_storage->kind() != CellStorage::Kind::Tiled) return TiledStorage::Metrics();
+    return static_cast<const TiledStorage &>(*m_storage).metrics();
+}
+
+void TableDataModel::prefetchCells(const QRect &visible, int rowDirection, int columnDirection)
+{
+    if (m_storage->kind() != CellStorage::Kind::Tiled || visible.isEmpty()) return;
+    if (rowDirection == 0 && columnDirection == 0) return;
+    // Пока идет прошлая подгрузка, новая не ставится: прокрутка обгонит ее
+    if (m_prefetch.isRunning()) return;
+
+    const QRect ahead = visible.translated(columnDirection * visible.width(), rowDirection * visible.height());
+    m_prefetch = QtConcurrent::run([this, ahead]() {
+        QReadLocker locker(&m_storageLock);
+        if (m_storage->kind() != CellStorage::Kind::Tiled) return;
+        static_cast<const TiledStorage &>(*m_storage).prefetch(ahead.top(), ahead.bottom(), ahead.left(), ahead.right());
+    });
+}
+
+bool TableDataModel::columnAggregates(int column, ColumnAggregates &out)
+{
+    if (m_dbWindow || column < 0 || column >= m_storage->columnCount()) return false;
+    if (const ColumnAggregates *cached = m_aggregates.find(column)) {
+        out = *cached;
+        return true;
+    }
+    // Типизированные буферы считаются векторно; остальные хранилища обходят столбец по ячейкам
+    if (m_storage->kind() == CellStorage::Kind::Columnar) {
+        out = m_aggregates.get(*m_storage, column);
+        return true;
+    }
+    if (!m_aggregateRequests.contains(column)) m_aggregateRequests.append(column);
+    if (!m_aggregatesRunning) startAggregates();
+    return false;
+}
+
+void TableDataModel::startAggregates()
+{
+    QVector<QPair<int, quint64>> columns;
+    for (int column : std::as_const(m_aggregateRequests)) {
+        columns.append({column, m_aggregates.version(column, m_storage->columnCount())});
+    }
+    m_aggregateRequests.clear();
+
+    if (!m_aggregateWatcher) {
+        m_aggregateWatcher = new QFutureWatcher<QVector<AggregateResult>>(this);
+        connect(m_aggregateWatcher, &QFutureWatcher<QVector<AggregateResult>>::finished,
+                this, &TableDataModel::finishAggregates);
+    }
+    m_aggregatesRunning = true;
+    m_aggregateWatcher->setFuture(QtConcurrent::run([this, columns]() {
+        // Блокировка на каждый столбец: запись из потока UI ждет не дольше одного столбца
+        QVector<AggregateResult> results;
+        for (const auto &column : columns) {
+            QReadLocker locker(&m_storageLock);
+            if (column.first >= m_storage->columnCount()) continue;
+            results.append({column.first, column.second, ColumnAggregates::compute(*m_storage, column.first)});
+        }
+        return results;
+    }));
+}
+
+void TableDataModel::finishAggregates()
+{
+    m_aggregatesRunning = false;
+    // Итог столбца, измененного во время подсчета, не сохранится (версия) - его запросят снова
+    for (const AggregateResult &result : m_aggregateWatcher->result()) {
+        m_aggregates.store(result.column, result.version, result.value);
+    }
+    emit columnAggregatesReady();
+    if (!m_aggregateRequests.isEmpty()) startAggregates();
+}
+
+bool TableDataModel::setColumnType(int column, ColumnType type)
+{
+    if (m_dbWindow || column < 0 || column >= m_storage->columnCount()) return false;
+    if (m_columnTypes[column] == type) return true;
+
+    // Тип и конвертация ячеек - один шаг отмены
+    beginUndoMacro();
+    TableUndoOperation operation;
+    operation.kind = TableUndoOperation::Kind::SetColumnType;
+    operation.column = column;
+    operation.columnTypes.append(int(m_columnTypes[column]));
+    recordUndo(operation);
+
+    m_columnTypes[column] = type;
+    markColumn(column);
+    emit headerDataChanged(Qt::Horizontal, column, column);
+
+    // Приводятся только заполненные ячейки, записываются только изменившиеся:
+    // пустые ячейки не попадают ни в сохранение, ни в журнал
+    if (type != ColumnType::Auto && !isComputedColumn(column)) {
+        QVector<CellUpdate> updates;
+        int failed = 0;
+        const int rows = m_storage->rowCount();
+        for (int r = 0; r < rows; ++r) {
+            const QVariant value = m_storage->value(r, column);
+            if (!value.isValid()) continue;
+            bool ok = true;
+            const QVariant coerced = ColumnTypeInference::coerce(value, type, &ok);
+            if (!ok) ++failed;
+            if (coerced.typeId() != value.typeId() || coerced != value) updates.append({r, column, coerced});
+        }
+        if (!updates.isEmpty()) writeCells(updates, false);
+        if (failed > 0) {
+            qDebug() << "column" << column << "type changed," << failed << "cells kept as entered";
+        }
+    }
+    endUndoMacro();
+    return true;
+}
+
+void TableDataModel::describeColumn(int column, SheetChanges::Line &line) const
+{
+    line.name = m_columnHeaders.value(column);
+    line.valueType = int(columnType(column));
+    const auto computed = m_computed.constFind(m_tracker.columnId(column));
+    if (computed != m_computed.constEnd()) line.formula = computed->formula->storedText();
+}
+
+void TableDataModel::markCell(int row, int column)
+{
+    m_tracker.markCell(row, column);
+    if (m_journal) m_journal->appendCell(m_tracker.rowId(row), m_tracker.columnId(column), m_storage->value(row, column));
+}
+
+void TableDataModel::markColumn(int column)
+{
+    m_tracker.markColumn(column);
+    if (!m_journal) return;
+    SheetChanges::Line line;
+    line.id = m_tracker.columnId(column);
+    line.orderKey = m_tracker.columnKey(column);
+    describeColumn(column, line);
+    m_journal->appendColumn(line);
+}
+
+QVariant TableDataModel::coerceToColumn(int column, const QVariant &value) const
+{
+    const ColumnType type = columnType(column);
+    return type == ColumnType::Auto ? value : ColumnTypeInference::coerce(value, type);
+}
+
+bool TableDataModel::setColumnFormula(int column, const QString &formula)
+{
+    if (m_dbWindow || column < 0 || column >= m_storage->columnCount()) return false;
+
+    const qint64 id = m_tracker.columnId(column);
+    std::shared_ptr<ColumnFormula> compiled;
+    if (!formula.trimmed().isEmpty()) {
+        compiled = std::make_shared<ColumnFormula>();
+        if (!compiled->compile(formula, [this](const QString &name) { return resolveColumnName(name); })) {
+            qWarning() << "formula error:" << compiled->getLastError();
+            return false;
+        }
+    }
+
+    // Проверка цикла до записи в журнал: формула, ссылающаяся на себя через другие, отклоняется
+    const auto previous = m_computed.constFind(id);
+    const std::shared_ptr<ColumnFormula> previousFormula = previous != m_computed.constEnd() ? previous->formula : nullptr;
+    if (compiled) {
+        m_computed[id] = {compiled, {}};
+    } else {
+        m_computed.remove(id);
+    }
+    if (!updateFormulaOrder()) {
+        qWarning() << "formula error: circular reference in column" << column;
+        if (previousFormula) {
+            m_computed[id] = {previousFormula, {}};
+        } else {
+            m_computed.remove(id);
+        }
+        updateFormulaOrder();
+        return false;
+    }
+
+    // Прежние значения столбца и формула - один шаг отмены
+    beginUndoMacro();
+    if (m_storage->rowCount() > 0) {
+        TableUndoOperation values;
+        values.column = column;
+        values.columnCount = 1;
+        values.rowCount = m_storage->rowCount();
+        values.values = captureCells(0, column, values.rowCount, 1);
+        recordUndo(values);
+    }
+    TableUndoOperation operation;
+    operation.kind = TableUndoOperation::Kind::SetColumnFormula;
+    operation.column = column;
+    operation.formulas.append(previousFormula ? previousFormula->storedText() : QString());
+    recordUndo(operation);
+    endUndoMacro();
+
+    markColumn(column);
+    emit headerDataChanged(Qt::Horizontal, column, column);
+    if (compiled) {
+        markFormulaDirty(id, 0, m_storage->rowCount() - 1);
+        recalculateFormulas();
+    }
+    return true;
+}
+
+QString TableDataModel::columnFormula(int column) const
+{
+    if (column < 0 || column >= m_storage->columnCount()) return QString();
+    const auto computed = m_computed.constFind(m_tracker.columnId(column));
+    if (computed == m_computed.constEnd()) return QString();
+
+    return computed->formula->displayText([this](qint64 id) {
+        const int index = m_tracker.columnIndex(id);
+        return index < 0 ? QStringLiteral("#%1").arg(id) : headerData(index, Qt::Horizontal).toString();
+    });
+}
+
+bool TableDataModel::isComputedColumn(int column) const
+{
+    return !m_computed.isEmpty() && column >= 0 && column < m_storage->columnCount()
+           && m_computed.contains(m_tracker.columnId(column));
+}
+
+qint64 TableDataModel::resolveColumnName(const QString &name) const
+{
+    // Имя столбца как в заголовке (в том числе автоматическое для безымянных)
+    for (int column = 0; column < m_storage->columnCount(); ++column) {
+        if (headerData(column, Qt::Horizontal).toString() == name) return m_tracker.columnId(column);
+    }
+    return -1;
+}
+
+bool TableDataModel::updateFormulaOrder()
+{
+    // Обход в глубину по аргументам-формулам; повторный вход в столбец на стеке - цикл
+    enum class Mark { None, Active, Done };
+    QHash<qint64, Mark> marks;
+    QVector<qint64> order;
+    order.reserve(m_computed.size());
+
+    std::function<bool(qint64)> visit = [&](qint64 id) {
+        const Mark mark = marks.value(id, Mark::None);
+        if (mark == Mark::Done) return true;
+        if (mark == Mark::Active) return false;
+        marks.insert(id, Mark::Active);
+        for (qint64 input : m_computed[id].formula->inputs()) {
+            if (m_computed.contains(input) && !visit(input)) return false;
+        }
+        marks.insert(id, Mark::Done);
+        order.append(id);
+        return true;
+    };
+    for (auto it = m_computed.cbegin(); it != m_computed.cend(); ++it) {
+        if (!visit(it.key())) return false;
+    }
+    m_formulaOrder = std::move(order);
+    return true;
+}
+
+void TableDataModel::markFormulaInputs(int column, int firstRow, int lastRow)
+{
+    if (m_computed.isEmpty()) return;
+
+    const qint64 id = m_tracker.columnId(column);
+    for (auto it = m_computed.cbegin(); it != m_computed.cend(); ++it) {
+        if (it->formula->inputs().contains(id)) markFormulaDirty(it.key(), firstRow, lastRow);
+    }
+}
+
+void TableDataModel::markFormulaDirty(qint64 columnId, int firstRow, int lastRow)
+{
+    if (firstRow > lastRow) return;
+    auto it = m_formulaDirty.find(columnId);
+    if (it == m_formulaDirty.end()) {
+        m_formulaDirty.insert(columnId, {firstRow, lastRow});
+    } else {
+        it->first = qMin(it->first, firstRow);
+        it->second = qMax(it->second, lastRow);
+    }
+}
+
+void TableDataModel::recalculateFormulas()
+{
+    // В пакете и при откате пересчет откладывается до конца - один проход на все правки.
+    // Во время фонового пересчета правки копятся и считаются по его окончании
+    if (m_formulaDirty.isEmpty() || m_batchDepth > 0 || m_applyingUndo || m_recalcJob.results) return;
+
+    // Столбец идет после своих аргументов: пересчитанный диапазон помечает зависимые,
+    // и каждый столбец считается за проход один раз
+    const int rowCount = m_storage->rowCount();
+    for (qint64 id : std::as_const(m_formulaOrder)) {
+        const auto dirty = m_formulaDirty.constFind(id);
+        if (dirty == m_formulaDirty.constEnd()) continue;
+        const int column = m_tracker.columnIndex(id);
+        ComputedColumn &computed = m_computed[id];
+
+        const int firstRow = qMax(dirty->first, 0);
+        // Нарастающий итог меняется во всех строках ниже
+        const int lastRow = computed.formula->isCumulative() ? rowCount - 1 : qMin(dirty->second, rowCount - 1);
+        m_formulaDirty.erase(dirty);
+        if (column < 0 || firstRow > lastRow) continue;
+
+        // Столбец ушел в пул потоков: зависимые от него досчитает finishRecalculation
+        if (!recalculateColumn(column, computed, firstRow, lastRow)) return;
+        markFormulaInputs(column, firstRow, lastRow);
+    }
+    m_formulaDirty.clear();
+
+    if (m_writesSinceStorageCheck >= StorageCheckInterval) {
+        updateStorageKind();
+    }
+}
+
+bool TableDataModel::recalculateColumn(int column, ComputedColumn &computed, int firstRow, int lastRow)
+{
+    const ColumnFormula &formula = *computed.formula;
+    QVector<int> inputColumns;
+    for (qint64 id : formula.inputs()) {
+        inputColumns.append(m_tracker.columnIndex(id));  // -1 - столбец удален, значение пустое
+    }
+
+    const int count = lastRow - firstRow + 1;
+    if (!formula.isCumulative() && count >= ParallelRecalcRows) {
+        startRecalculation(column, computed.formula, inputColumns, firstRow, lastRow);
+        return false;
+    }
+
+    std::vector<QVariant> results(count);
+    QVarLengthArray<double, 8> inputs(inputColumns.size());
+    if (formula.isCumulative()) {
+        // Итоги идут сверху вниз: продолжаем с сохраненного состояния строки выше
+        const int slots = formula.cumulativeCount();
+        const size_t needed = size_t(m_storage->rowCount()) * slots;
+        if (computed.sums.size() != needed) {
+            computed.sums.assign(needed, 0.0);
+            if (firstRow > 0) {
+                // Состояние выше неизвестно - считаем столбец целиком
+                return recalculateColumn(column, computed, 0, lastRow);
+            }
+        }
+        std::vector<double> sums(slots, 0.0);
+        if (firstRow > 0) {
+            std::copy_n(computed.sums.begin() + qsizetype(firstRow - 1) * slots, slots, sums.begin());
+        }
+        for (int row = firstRow; row <= lastRow; ++row) {
+            results[row - firstRow] = evaluateFormulaRow(*m_storage, formula, inputColumns, row, inputs.data(), sums.data());
+            std::copy(sums.begin(), sums.end(), computed.sums.begin() + qsizetype(row) * slots);
+        }
+    } else {
+        for (int row = firstRow; row <= lastRow; ++row) {
+            results[row - firstRow] = evaluateFormulaRow(*m_storage, formula, inputColumns, row, inputs.data(), nullptr);
+        }
+    }
+    storeRecalculated(column, firstRow, results);
+    return true;
+}
+
+void TableDataModel::startRecalculation(int column, const std::shared_ptr<ColumnFormula> &formula,
+                                        const QVector<int> &inputColumns, int firstRow, int lastRow)
+{
+    // Строки независимы: блоки считаются в пуле потоков, каждый под блокировкой на чтение.
+    // Вставка или удаление строк/столбцов меняет поколение - оставшиеся блоки пропускаются,
+    // результат отбрасывается, и столбец пересчитывается заново
+    m_recalcJob.columnId = m_tracker.columnId(column);
+    m_recalcJob.formula = formula;
+    m_recalcJob.firstRow = firstRow;
+    m_recalcJob.lastRow = lastRow;
+    m_recalcJob.generation = m_recalcGeneration.loadRelaxed();
+    m_recalcJob.results = std::make_shared<std::vector<QVariant>>(lastRow - firstRow + 1);
+    m_recalcJob.blocks.clear();
+    for (int from = firstRow; from <= lastRow; from += RecalcBlockRows) m_recalcJob.blocks.append(from);
+
+    if (!m_recalcWatcher) {
+        m_recalcWatcher = new QFutureWatcher<void>(this);
+        connect(m_recalcWatcher, &QFutureWatcher<void>::finished, this, &TableDataModel::finishRecalculation);
+    }
+    m_recalcWatcher->setFuture(QtConcurrent::map(m_recalcJob.blocks,
+        [this, formula, inputColumns, firstRow, lastRow, results = m_recalcJob.results,
+         generation = m_recalcJob.generation](int from) {
+            QReadLocker locker(&m_storageLock);
+            if (m_recalcGeneration.loadRelaxed() != generation) return;
+            QVarLengthArray<double, 8> inputs(inputColumns.size());
+            const int to = qMin(from + RecalcBlockRows - 1, lastRow);
+            for (int row = from; row <= to; ++row) {
+                (*results)[row - firstRow] = evaluateFormulaRow(*m_storage, *formula, inputColumns, row, inputs.data(), nullptr);
+            }
+        }));
+}
+
+void TableDataModel::finishRecalculation()
+{
+    const RecalcJob job = m_recalcJob;
+    m_recalcJob.results.reset();
+    if (!job.results) return;
+
+    // Правки ячеек во время пересчета уже помечены в m_formulaDirty и будут досчитаны
+    const auto computed = m_computed.constFind(job.columnId);
+    const int column = m_tracker.columnIndex(job.columnId);
+    if (computed == m_computed.constEnd() || computed->formula != job.formula) {
+        // Формула снята или заменена - ее пересчет уже запрошен заново
+    } else if (job.generation != m_recalcGeneration.loadRelaxed() || column < 0) {
+        markFormulaDirty(job.columnId, 0, m_storage->rowCount() - 1);
+    } else {
+        storeRecalculated(column, job.firstRow, *job.results);
+        markFormulaInputs(column, job.firstRow, job.lastRow);
+    }
+    recalculateFormulas();
+}
+
+void TableDataModel::storeRecalculated(int column, int firstRow, const std::vector<QVariant> &results)
+{
+    // Пишутся только изменившиеся значения - остальные не попадают в сохранение
+    QVector<int> changedRows;
+    {
+        QWriteLocker locker(&m_storageLock);
+        for (size_t i = 0; i < results.size(); ++i) {
+            const int row = firstRow + int(i);
+            if (m_storage->value(row, column) == results[i]) continue;
+            m_storage->setValue(row, column, results[i]);
+            changedRows.append(row);
+        }
+    }
+    for (int row : std::as_const(changedRows)) markCell(row, column);
+    m_aggregates.invalidate(column);
+    m_writesSinceStorageCheck += int(results.size());
+    notifyCellsChanged(QRect(column, firstRow, 1, int(results.size())));
+}
+
+void TableDataModel::captureColumnFormulas(TableUndoOperation &operation) const
+{
+    operation.formulas.clear();
+    operation.columnIds.clear();
+    if (m_computed.isEmpty()) return;
+    for (int i = 0; i < operation.columnCount; ++i) {
+        const qint64 id = m_tracker.columnId(operation.column + i);
+        const auto computed = m_computed.constFind(id);
+        operation.formulas.append(computed != m_computed.constEnd() ? computed->formula->storedText() : QString());
+        operation.columnIds.append(id);
+    }
+}
+
+void TableDataModel::restoreColumnFormulas(const TableUndoOperation &operation)
+{
+    if (operation.columnIds.isEmpty()) return;
+
+    // Вставленные заново столбцы получили новые id - переводим на них ссылки формул
+    QHash<qint64, qint64> ids;
+    QSet<qint64> newIds;
+    for (int i = 0; i < operation.columnIds.size(); ++i) {
+        const qint64 id = m_tracker.columnId(operation.column + i);
+        ids.insert(operation.columnIds[i], id);
+        newIds.insert(id);
+    }
+    for (auto it = m_computed.begin(); it != m_computed.end(); ++it) {
+        it->formula->remapInputs(ids);
+    }
+    QSet<qint64> restored;
+    for (int i = 0; i < operation.formulas.size(); ++i) {
+        if (operation.formulas[i].isEmpty()) continue;
+        auto formula = std::make_shared<ColumnFormula>();
+        if (!formula->compile(operation.formulas[i])) continue;
+        formula->remapInputs(ids);
+        const qint64 id = m_tracker.columnId(operation.column + i);
+        m_computed.insert(id, {formula, {}});
+        restored.insert(id);
+    }
+    updateFormulaOrder();
+
+    // Пересчитываются восстановленные столбцы и те, чьи аргументы вернулись
+    const int lastRow = m_storage->rowCount() - 1;
+    for (auto it = m_computed.cbegin(); it != m_computed.cend(); ++it) {
+        const QVector<qint64> &inputs = it->formula->inputs();
+        const bool affected = restored.contains(it.key())
+                              || std::any_of(inputs.cbegin(), inputs.cend(), [&newIds](qint64 id) { return newIds.contains(id); });
+        if (affected) markFormulaDirty(it.key(), 0, lastRow);
+    }
+}
+
+qint64 TableDataModel::memoryUsage() const
+{
+    qint64 total = m_storage->memoryUsage();
+    for (const QString &header : m_columnHeaders) {
+        total += static_cast<qint64>(sizeof(QString)) + header.capacity() * static_cast<qint64>(sizeof(QChar));
+    }
+    return total;
+}
+
+void TableDataModel::updateStorageKind()
+{
+    m_writesSinceStorageCheck = 0;
+    if (m_storageMode != StorageMode::Auto) return;
+
+    const qint64 totalCells = qint64(m_storage->rowCount()) * m_storage->columnCount();
+    const double fillRatio = totalCells > 0 ? double(m_storage->filledCellCount()) / double(totalCells) : 1.0;
+
+    if (m_storage->kind() == CellStorage::Kind::Tiled) {
+        if (m_storage->filledCellCount() * TiledCellBytes >= m_tiledMemoryBudget / 4) return;
+        switchStorage(totalCells >= MinCellsForSparse && fillRatio < SparseFillRatio ? CellStorage::Kind::Sparse
+                                                                                      : CellStorage::Kind::Columnar);
+        return;
+    }
+    if (m_storage->memoryUsage() > m_tiledMemoryBudget) {
+        switchStorage(CellStorage::Kind::Tiled);
+        return;
+    }
+
+    if (m_storage->kind() == CellStorage::Kind::Columnar) {
+        if (totalCells >= MinCellsForSparse && fillRatio < SparseFillRatio) {
+            switchStorage(CellStorage::Kind::Sparse);
+        }
+    } else if (totalCells < MinCellsForSparse || fillRatio > DenseFillRatio) {
+        switchStorage(CellStorage::Kind::Columnar);
+    }
+}
+
+void TableDataModel::switchStorage(CellStorage::Kind kind)
+{
+    if (m_storage->kind() == kind) return;
+
+    // Содержимое не меняется, поэтому представление уведомлять не нужно
+    std::unique_ptr<CellStorage> target = createStorage(kind, m_tiledMemoryBudget);
+    target->insertColumns(0, m_storage->columnCount());
+    target->insertRows(0, m_storage->rowCount());
+    m_storage->forEachValue([&target](int row, int column, const QVariant &value) {
+        target->setValue(row, column, value);
+    });
+
+    const qint64 memoryBefore = m_storage->memoryUsage();
+    {
+        QWriteLocker locker(&m_storageLock);
+        m_storage = std::move(target);
+    }
+    qDebug() << "table storage switched to" << storageName(kind)
+             << "memory" << memoryBefore << "->" << m_storage->memoryUsage();
+}
 
 bool TableDataModel::removeRows(int row, int count, const QModelIndex &parent)
 {
     Q_UNUSED(parent);
-    if (row < 0 || row > m_rowCount || count <= 0) return false;
+    if (m_dbWindow) return false;
+    if (row < 0 || row + count > m_storage->rowCount() || count <= 0) return false;
+
+    if (!m_applyingUndo) {
+        TableUndoOperation operation;
+        operation.kind = TableUndoOperation::Kind::RemoveRows;
+        operation.row = row;
+        operation.rowCount = count;
+        operation.columnCount = m_storage->columnCount();
+        operation.values = captureCells(row, 0, count, operation.columnCount);
+        recordUndo(operation);
+    }
 
+    // Накопленные в пакете изменения относятся к старым индексам
+    flushPendingChange();
+    m_recalcGeneration.ref();
     beginRemoveRows(QModelIndex(), row, row + count - 1);
 
-    // Удаляем строки из массива
-    for (int i = 0; i < count; ++i) {
-        m_data.removeAt(row);
+    // Удаляем строки во всех колонках
+    {
+        QWriteLocker locker(&m_storageLock);
+        m_storage->removeRows(row, count);
     }
-
-    m_rowCount -= count;
+    if (m_journal) {
+        for (int r = 0; r < count; ++r) m_journal->appendRemovedRow(m_tracker.rowId(row + r));
+    }
+    m_tracker.removeRows(row, count);
+    m_aggregates.clear();
+    updateStorageKind();
 
     endRemoveRows();
 
+    // Нарастающие итоги ниже удаленных строк меняются
+    if (row < m_storage->rowCount()) {
+        for (auto it = m_computed.cbegin(); it != m_computed.cend(); ++it) {
+            if (it->formula->isCumulative()) markFormulaDirty(it.key(), row, row);
+        }
+        recalculateFormulas();
+    }
+
     return true;
 }
 
 bool TableDataModel::insertColumns(int column, int count, const QModelIndex &parent)
 {
     Q_UNUSED(parent);
-    if (column < 0 || column > m_columnCount || count <= 0) return false;
+    if (m_dbWindow) return false;
+    if (column < 0 || column > m_storage->columnCount() || count <= 0) return false;
 
     if(m_columnHeaders.size() > 0){
-        bool hadPlaceholder = (m_columnCount == 1 && m_columnHeaders[0] == "Столбец");
+        bool hadPlaceholder = (!m_applyingUndo && m_storage->columnCount() == 1 && m_columnHeaders[0] == "Столбец");
         if (hadPlaceholder) {
             onHeaderRenameRequested(0,"имя ячейки");
             return true;
         }
     }
 
+    TableUndoOperation operation;
+    operation.kind = TableUndoOperation::Kind::InsertColumns;
+    operation.column = column;
+    operation.columnCount = count;
+    recordUndo(operation);
+
+    // Накопленные в пакете изменения относятся к старым индексам
+    flushPendingChange();
+    m_recalcGeneration.ref();
     beginInsertColumns(QModelIndex(), column, column + count - 1);
 
-    // Убираем плейсхолдер, если он существует (m_columnCount == 1 и заголовок "Столбец")
-    // Добавляем столбцы во все строки
-    for (int i = 0; i < m_rowCount; ++i) {
-        for (int j = 0; j < count; ++j) {
-            m_data[i].insert(column + j, QVariant());
-        }
+    // Убираем плейсхолдер, если он существует (m_storage->columnCount() == 1 и заголовок "Столбец")
+    // Новые колонки не трогают данные остальных столбцов
+    {
+        QWriteLocker locker(&m_storageLock);
+        m_storage->insertColumns(column, count);
     }
+    m_tracker.insertColumns(column, count);
+    m_aggregates.insertColumns(column, count);
+    updateStorageKind();
     // Вставляем пустые заголовки для новых столбцов
 
     for (int j = 0; j < count; ++j) {
         m_columnHeaders.insert(column + j, QString());
     }
-
-    m_columnCount += count;
+    m_columnTypes.insert(column, count, ColumnType::Auto);
+    if (m_journal) {
+        for (int j = 0; j < count; ++j) markColumn(column + j);
+    }
 
     endInsertColumns();
 
@@ -77,39 +1269,86 @@ bool TableDataModel::insertColumns(int column, int count, const QModelIndex &par
 
 bool TableDataModel::insertRows(int row, int count, const QModelIndex &parent){
     Q_UNUSED(parent);
-    if (row < 0 || row > m_rowCount || count <= 0) return false;
+    if (m_dbWindow) return false;
+    if (row < 0 || row > m_storage->rowCount() || count <= 0) return false;
+
 
+    TableUndoOperation operation;
+    operation.kind = TableUndoOperation::Kind::InsertRows;
+    operation.row = row;
+    operation.rowCount = count;
+    recordUndo(operation);
 
     // Уведомляем представление о начале вставки
+    // Накопленные в пакете изменения относятся к старым индексам
+    flushPendingChange();
+    m_recalcGeneration.ref();
     beginInsertRows(QModelIndex(), row, row + count - 1);
 
-    // Создаем новые строки с пустыми ячейками
-    for (int i = 0; i < count; ++i) {
-        QVector<QVariant> newRow(m_columnCount); // Строка с m_columnCount пустыми ячейками
-        m_data.insert(row + i, newRow); // Вставляем строку в позицию row + i
+    // Пустые ячейки в колонках (пустая колонка не выделяет буферов)
+    {
+        QWriteLocker locker(&m_storageLock);
+        m_storage->insertRows(row, count);
     }
-
-    m_rowCount += count; // Увеличиваем счетчик строк
+    m_tracker.insertRows(row, count);
+    if (m_journal) {
+        for (int r = row; r < row + count; ++r) m_journal->appendRow({m_tracker.rowId(r), m_tracker.rowKey(r)});
+    }
+    m_aggregates.insertRows(count);
+    updateStorageKind();
 
     // Уведомляем представление об окончании вставки
     endInsertRows();
 
+    // Новые строки вычисляемых столбцов (формула может не зависеть от пустых аргументов)
+    for (auto it = m_computed.cbegin(); it != m_computed.cend(); ++it) {
+        markFormulaDirty(it.key(), row, row + count - 1);
+    }
+    recalculateFormulas();
+
     return true;
 }
 
 bool TableDataModel::removeColumns(int column, int count, const QModelIndex &parent)
 {
     Q_UNUSED(parent);
-    if (column < 0 || column > m_columnCount || count <= 0) return false;
+    if (m_dbWindow) return false;
+    if (column < 0 || column + count > m_storage->columnCount() || count <= 0) return false;
+
+    if (!m_applyingUndo) {
+        TableUndoOperation operation;
+        operation.kind = TableUndoOperation::Kind::RemoveColumns;
+        operation.column = column;
+        operation.columnCount = count;
+        operation.rowCount = m_storage->rowCount();
+        operation.values = captureCells(0, column, operation.rowCount, count);
+        operation.headers = m_columnHeaders.mid(column, count);
+        for (int j = 0; j < count; ++j) {
+            operation.columnTypes.append(int(columnType(column + j)));
+        }
+        captureColumnFormulas(operation);
+        recordUndo(operation);
+    }
 
+    QSet<qint64> removedIds;
+    for (int j = 0; j < count; ++j) {
+        removedIds.insert(m_tracker.columnId(column + j));
+        if (m_journal) m_journal->appendRemovedColumn(m_tracker.columnId(column + j));
+    }
+
+    // Накопленные в пакете изменения относятся к старым индексам
+    flushPendingChange();
+    m_recalcGeneration.ref();
     beginRemoveColumns(QModelIndex(), column, column + count - 1);
 
-    // Удаляем столбцы из всех строк
-    for (int i = 0; i < m_rowCount; ++i) {
-        for (int j = 0; j < count; ++j) {
-            m_data[i].removeAt(column);
-        }
+    // Удаляем колонки целиком
+    {
+        QWriteLocker locker(&m_storageLock);
+        m_storage->removeColumns(column, count);
     }
+    m_tracker.removeColumns(column, count);
+    m_aggregates.removeColumns(column, count);
+    updateStorageKind();
 
     // Удаляем заголовки
     for (int j = 0; j < count; ++j) {
@@ -117,47 +1356,235 @@ bool TableDataModel::removeColumns(int column, int count, const QModelIndex &par
             m_columnHeaders.removeAt(column);
         }
     }
-
-    m_columnCount -= count;
+    m_columnTypes.remove(column, count);
 
     endRemoveColumns();
 
+    // Формулы удаленных столбцов уходят, ссылавшиеся на них столбцы становятся пустыми
+    if (!m_computed.isEmpty()) {
+        for (qint64 id : std::as_const(removedIds)) {
+            m_computed.remove(id);
+            m_formulaDirty.remove(id);
+        }
+        for (auto it = m_computed.cbegin(); it != m_computed.cend(); ++it) {
+            const QVector<qint64> &inputs = it->formula->inputs();
+            const bool broken = std::any_of(inputs.cbegin(), inputs.cend(),
+                                            [&removedIds](qint64 id) { return removedIds.contains(id); });
+            if (broken) markFormulaDirty(it.key(), 0, m_storage->rowCount() - 1);
+        }
+        updateFormulaOrder();
+        recalculateFormulas();
+    }
+
     return true;
 }
 
 bool TableDataModel::setData(const QModelIndex &index, const QVariant &value, int role)
 {
-    if (!index.isValid() || role != Qt::EditRole) {
+    if (!index.isValid() || role != Qt::EditRole || m_dbWindow) {
         return false;
     }
 
     int row = index.row();
     int column = index.column();
 
-    if (row < 0 || row >= m_rowCount ||
-        column < 0 || column >= m_columnCount) {
+    if (row < 0 || row >= m_storage->rowCount() ||
+        column < 0 || column >= m_storage->columnCount() || isComputedColumn(column)) {
         return false;
     }
 
-    // Устанавливаем новое значение
-    m_data[row][column] = value;
+    TableUndoOperation operation;
+    operation.row = row;
+    operation.column = column;
+    operation.rowCount = 1;
+    operation.columnCount = 1;
+    const QVariant oldValue = m_storage->value(row, column);
+    if (oldValue.isValid()) operation.values.append({0, oldValue});
+    recordUndo(operation, true);
+
+    // Устанавливаем новое значение (в типе столбца, если он объявлен)
+    const QVariant newValue = coerceToColumn(column, value);
+    {
+        QWriteLocker locker(&m_storageLock);
+        m_storage->setValue(row, column, newValue);
+    }
+    markCell(row, column);
+    m_aggregates.cellChanged(column, oldValue, newValue);
+    if (++m_writesSinceStorageCheck >= StorageCheckInterval) {
+        updateStorageKind();
+    }
+
+    // Уведомляем представление об изменении данных (в пакете - одним сигналом в конце)
+    if (m_batchDepth > 0) {
+        m_pendingChange = m_pendingChange.united(QRect(column, row, 1, 1));
+    } else {
+        emit dataChanged(index, index, {role});
+    }
+    markFormulaInputs(column, row, row);
+    recalculateFormulas();
+
+    return true;
+}
+
+bool TableDataModel::setRange(int row, int column, const QVector<QVector<QVariant>> &values)
+{
+    int columnCount = 0;
+    for (const auto &line : values) {
+        columnCount = qMax(columnCount, static_cast<int>(line.size()));
+    }
+    return fillRange(row, column, values.size(), columnCount, [&values, row, column](int r, int c) {
+        return values[r - row].value(c - column);
+    });
+}
+
+bool TableDataModel::fillRange(int row, int column, int rowCount, int columnCount,
+                               const std::function<QVariant(int row, int column)> &generator)
+{
+    if (m_dbWindow || rowCount <= 0 || columnCount <= 0 || row < 0 || column < 0
+        || row + rowCount > m_storage->rowCount() || column + columnCount > m_storage->columnCount()) {
+        return false;
+    }
+
+    TableUndoOperation operation;
+    operation.row = row;
+    operation.column = column;
+    operation.rowCount = rowCount;
+    operation.columnCount = columnCount;
+    operation.values = captureCells(row, column, rowCount, columnCount);
+    recordUndo(operation);
+
+    // Значения считаются до блокировки: медленный генератор не задерживает читателей
+    // в пуле потоков, а генератор, читающий модель, не ждет собственной блокировки
+    QVector<QVariant> values;
+    values.reserve(qsizetype(rowCount) * columnCount);
+    for (int c = column; c < column + columnCount; ++c) {
+        if (isComputedColumn(c)) continue;  // значения задает формула
+        for (int r = row; r < row + rowCount; ++r) {
+            values.append(coerceToColumn(c, generator(r, c)));
+        }
+    }
+
+    // По колонкам: запись идет подряд в буфер одной колонки
+    {
+        QWriteLocker locker(&m_storageLock);
+        qsizetype next = 0;
+        for (int c = column; c < column + columnCount; ++c) {
+            if (isComputedColumn(c)) continue;
+            for (int r = row; r < row + rowCount; ++r) {
+                m_storage->setValue(r, c, values[next++]);
+            }
+        }
+    }
+    for (int c = column; c < column + columnCount; ++c) {
+        if (isComputedColumn(c)) continue;
+        for (int r = row; r < row + rowCount; ++r) {
+            markCell(r, c);
+        }
+    }
+    for (int c = column; c < column + columnCount; ++c) {
+        m_aggregates.invalidate(c);
+        markFormulaInputs(c, row, row + rowCount - 1);
+    }
+    m_writesSinceStorageCheck += rowCount * columnCount;
+    if (m_writesSinceStorageCheck >= StorageCheckInterval) {
+        updateStorageKind();
+    }
+
+    const QRect changed(column, row, columnCount, rowCount);
+    if (m_batchDepth > 0) {
+        m_pendingChange = m_pendingChange.united(changed);
+    } else {
+        emit dataChanged(index(row, column), index(row + rowCount - 1, column + columnCount - 1),
+                         {Qt::DisplayRole, Qt::EditRole});
+    }
+    recalculateFormulas();
+    return true;
+}
+
+bool TableDataModel::setCells(const QVector<CellUpdate> &updates)
+{
+    return writeCells(updates, true);
+}
+
+bool TableDataModel::writeCells(const QVector<CellUpdate> &updates, bool coerce)
+{
+    if (m_dbWindow || updates.isEmpty()) return false;
+
+    TableUndoOperation operation;
+    operation.kind = TableUndoOperation::Kind::CellList;
+    operation.cells.reserve(updates.size());
+    QVector<QPair<int, QVariant>> newValues;
+    QRect changed;
+    for (int i = 0; i < updates.size(); ++i) {
+        const CellUpdate &update = updates[i];
+        if (update.row < 0 || update.row >= m_storage->rowCount()
+            || update.column < 0 || update.column >= m_storage->columnCount()) {
+            return false;
+        }
+        if (isComputedColumn(update.column)) continue;  // значения задает формула
+        const QPoint cell(update.column, update.row);
+        const QVariant value = coerce ? coerceToColumn(update.column, update.value) : update.value;
+        if (value.isValid()) newValues.append({int(operation.cells.size()), value});
+        operation.cells.append(cell);
+        changed = changed.united(QRect(cell, QSize(1, 1)));
+    }
+    if (operation.cells.isEmpty()) return false;
 
-    // Уведомляем представление об изменении данных
-    emit dataChanged(index, index, {role});
+    operation.values = captureCellList(operation.cells);
+    recordUndo(operation);
+    restoreCellList(operation.cells, newValues);
 
+    m_writesSinceStorageCheck += updates.size();
+    if (m_writesSinceStorageCheck >= StorageCheckInterval) {
+        updateStorageKind();
+    }
+    notifyCellsChanged(changed);
+    recalculateFormulas();
     return true;
 }
 
+void TableDataModel::beginBatchUpdate()
+{
+    if (m_batchDepth++ == 0) {
+        m_pendingChange = QRect();
+    }
+    beginUndoMacro();
+}
+
+void TableDataModel::endBatchUpdate()
+{
+    if (m_batchDepth == 0) return;
+
+    endUndoMacro();
+    if (--m_batchDepth == 0) {
+        recalculateFormulas();
+        flushPendingChange();
+    }
+}
+
+void TableDataModel::flushPendingChange()
+{
+    if (m_pendingChange.isEmpty()) return;
+
+    // Один сигнал на охватывающий прямоугольник: представление перерисует только видимую часть
+    const QRect changed = m_pendingChange;
+    m_pendingChange = QRect();
+    emit dataChanged(index(changed.top(), changed.left()), index(changed.bottom(), changed.right()),
+                     {Qt::DisplayRole, Qt::EditRole});
+}
+
 int TableDataModel::rowCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    return m_rowCount;  // Возвращаем количество строк из m_data
+    if (m_dbWindow) return m_fetchedRows;
+    return m_storage->rowCount();
 }
 
 int TableDataModel::columnCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    return m_columnCount;  // Возвращаем количество столбцов из m_data
+    if (m_dbWindow) return m_dbWindow->columnCount();
+    return m_storage->columnCount();
 }
 
 QVariant TableDataModel::data(const QModelIndex &index, int role) const
@@ -165,20 +1592,35 @@ QVariant TableDataModel::data(const QModelIndex &index, int role) const
     if (!index.isValid() || role != Qt::DisplayRole)
         return QVariant();
 
-    if (index.row() >= m_rowCount || index.column() >= m_columnCount)
+    if (m_dbWindow) {
+        if (index.row() >= m_fetchedRows) return QVariant();
+        return m_dbWindow->value(index.row(), index.column());
+    }
+
+    if (index.row() >= m_storage->rowCount() || index.column() >= m_storage->columnCount())
         return QVariant();
 
-    return m_data[index.row()][index.column()];  // Возвращаем данные из m_data
+    return m_storage->value(index.row(), index.column());
 }
 
 QVariant TableDataModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
+    // Подсказка вычисляемого столбца - его формула
+    if (role == Qt::ToolTipRole && orientation == Qt::Horizontal && !m_dbWindow) {
+        const QString formula = columnFormula(section);
+        return formula.isEmpty() ? QVariant() : QVariant("= " + formula);
+    }
+
     if (role != Qt::DisplayRole && role != Qt::EditRole)
         return QVariant();
 
     if (orientation == Qt::Horizontal) {
+        if (m_dbWindow) {
+            return m_dbWindow->columnNames().value(section);
+        }
+
         // Проверяем границы
-        if (section < 0 || section >= m_columnCount)
+        if (section < 0 || section >= m_storage->columnCount())
             return QVariant();
 
         // Если есть сохраненный заголовок, возвращаем его
@@ -203,7 +1645,7 @@ bool TableDataModel::setHeaderData(int section, Qt::Orientation orientation, con
         return false;
 
     if (orientation == Qt::Horizontal) {
-        if (section < 0 || section >= m_columnCount)
+        if (m_dbWindow || section < 0 || section >= m_storage->columnCount())
             return false;
 
         QString newName = value.toString();
@@ -221,7 +1663,14 @@ bool TableDataModel::setHeaderData(int section, Qt::Orientation orientation, con
             m_columnHeaders.append(QString());
         }
 
+        TableUndoOperation operation;
+        operation.kind = TableUndoOperation::Kind::RenameColumn;
+        operation.column = section;
+        operation.headers.append(m_columnHeaders[section]);
+        recordUndo(operation);
+
         m_columnHeaders[section] = newName;
+        markColumn(section);
 
         // Уведомляем представление об изменении заголовка
         emit headerDataChanged(orientation, section, section);
@@ -234,28 +1683,39 @@ bool TableDataModel::setHeaderData(int section, Qt::Orientation orientation, con
 
 bool TableDataModel::onHeaderAddRequested(int logicalIndex, bool addToRight)
 {
-    if (logicalIndex < 0 || logicalIndex > m_columnCount) {
+    if (logicalIndex < 0 || logicalIndex > m_storage->columnCount()) {
         return false;
     }
 
     // Определяем позицию вставки
     int insertPosition = addToRight ? logicalIndex + 1 : logicalIndex;
 
+    // Вставка и имя столбца отменяются одним шагом
+    beginUndoMacro();
+
     // Вставляем один столбец
     if (!insertColumns(insertPosition, 1)) {
+        endUndoMacro();
         return false; // Проверяем успешность вставки
     }
 
+    const bool named = assignNewColumnName(insertPosition);
+    endUndoMacro();
+    return named;
+}
+
+bool TableDataModel::assignNewColumnName(int column)
+{
     // Определяем базовое имя для нового заголовка
     QString baseName;
-    if (m_columnHeaders.size() > 0 && m_columnCount == 1 && m_columnHeaders[0] == QString()) {
+    if (m_columnHeaders.size() > 0 && m_storage->columnCount() == 1 && m_columnHeaders[0] == QString()) {
         baseName = "Столбец";
     } else {
-        baseName = QString("Новое имя %1").arg(insertPosition);
+        baseName = QString("Новое имя %1").arg(column);
     }
 
     if (baseName.isEmpty()) {
-        baseName = QString("Столбец %1").arg(insertPosition + 1);
+        baseName = QString("Столбец %1").arg(column + 1);
     }
 
     // Устанавливаем уникальное имя заголовка
@@ -264,7 +1724,7 @@ bool TableDataModel::onHeaderAddRequested(int logicalIndex, bool addToRight)
         QString candidate = (suffix == 0)
                                 ? baseName
                                 : QString("%1 (%2)").arg(baseName).arg(suffix);
-        if (setHeaderData(insertPosition, Qt::Horizontal, candidate)) {
+        if (setHeaderData(column, Qt::Horizontal, candidate)) {
             return true;
         }
     }
@@ -274,23 +1734,27 @@ bool TableDataModel::onHeaderAddRequested(int logicalIndex, bool addToRight)
 
 bool TableDataModel::onHeaderDeleteRequested(int logicalIndex)
 {
-    if (logicalIndex < 0 || logicalIndex >= m_columnCount) {
+    if (logicalIndex < 0 || logicalIndex >= m_storage->columnCount()) {
         return false;
     }
 
+    beginUndoMacro();
+
     // Удаляем один столбец
     removeColumns(logicalIndex, 1);
 
     // Если после удаления не осталось столбцов, создаем плейсхолдер
-    if (m_columnCount == 0) {
+    if (m_storage->columnCount() == 0) {
         onHeaderAddRequested(0, false);
     }
+
+    endUndoMacro();
     return true;
 }
 
 bool TableDataModel::onHeaderRenameRequested(int logicalIndex, const QString &newName)
 {
-    if (logicalIndex < 0 || logicalIndex >= m_columnCount) {
+    if (logicalIndex < 0 || logicalIndex >= m_storage->columnCount()) {
         return false;
     }
 
@@ -307,8 +1771,8 @@ bool TableDataModel::onRowAddRequested(int logicalIndex)
         insertPosition = 0;
     }
 
-    if (insertPosition > m_rowCount) {
-        insertPosition = m_rowCount;
+    if (insertPosition > m_storage->rowCount()) {
+        insertPosition = m_storage->rowCount();
     }
 
     return insertRows(insertPosition, 1, QModelIndex());
@@ -316,15 +1780,91 @@ bool TableDataModel::onRowAddRequested(int logicalIndex)
 
 bool TableDataModel::onRowDeleteRequested(int logicalIndex)
 {
-    if (logicalIndex < 0 || logicalIndex >= m_rowCount) {
+    if (logicalIndex < 0 || logicalIndex >= m_storage->rowCount()) {
         return false;
     }
 
+    beginUndoMacro();
+
     bool removed = removeRows(logicalIndex, 1, QModelIndex());
 
-    if (removed && m_rowCount == 0) {
+    if (removed && m_storage->rowCount() == 0) {
         insertRows(0, 1, QModelIndex());
     }
 
+    endUndoMacro();
+    return removed;
+}
+
+bool TableDataModel::onRowsAddRequested(const QList<int> &logicalIndexes)
+{
+    const QList<QPair<int, int>> blocks = contiguousBlocks(logicalIndexes, m_storage->rowCount());
+    if (blocks.isEmpty()) return false;
+
+    // Под каждым блоком столько же новых строк; с конца, чтобы индексы блоков не сдвигались
+    beginUndoMacro();
+    bool inserted = true;
+    for (int i = blocks.size() - 1; i >= 0; --i) {
+        inserted &= insertRows(blocks[i].first + blocks[i].second, blocks[i].second);
+    }
+    endUndoMacro();
+    return inserted;
+}
+
+bool TableDataModel::onRowsDeleteRequested(const QList<int> &logicalIndexes)
+{
+    const QList<QPair<int, int>> blocks = contiguousBlocks(logicalIndexes, m_storage->rowCount());
+    if (blocks.isEmpty()) return false;
+
+    beginUndoMacro();
+    bool removed = true;
+    for (int i = blocks.size() - 1; i >= 0; --i) {
+        removed &= removeRows(blocks[i].first, blocks[i].second);
+    }
+    if (m_storage->rowCount() == 0) {
+        insertRows(0, 1);
+    }
+    endUndoMacro();
+    return removed;
+}
+
+bool TableDataModel::onHeadersAddRequested(const QList<int> &logicalIndexes, bool addToRight)
+{
+    const QList<QPair<int, int>> blocks = contiguousBlocks(logicalIndexes, m_storage->columnCount());
+    if (blocks.isEmpty()) return false;
+
+    beginUndoMacro();
+    bool inserted = true;
+    for (int i = blocks.size() - 1; i >= 0; --i) {
+        const int position = addToRight ? blocks[i].first + blocks[i].second : blocks[i].first;
+        const int countBefore = m_storage->columnCount();
+        if (!insertColumns(position, blocks[i].second)) {
+            inserted = false;
+            continue;
+        }
+        // Плейсхолдер переименовывается вместо вставки - тогда новых столбцов нет
+        const int added = m_storage->columnCount() - countBefore;
+        for (int j = 0; j < added; ++j) {
+            inserted &= assignNewColumnName(position + j);
+        }
+    }
+    endUndoMacro();
+    return inserted;
+}
+
+bool TableDataModel::onHeadersDeleteRequested(const QList<int> &logicalIndexes)
+{
+    const QList<QPair<int, int>> blocks = contiguousBlocks(logicalIndexes, m_storage->columnCount());
+    if (blocks.isEmpty()) return false;
+
+    beginUndoMacro();
+    bool removed = true;
+    for (int i = blocks.size() - 1; i >= 0; --i) {
+        removed &= removeColumns(blocks[i].first, blocks[i].second);
+    }
+    if (m_storage->columnCount() == 0) {
+        onHeaderAddRequested(0, false);
+    }
+    endUndoMacro();
     return removed;
 }
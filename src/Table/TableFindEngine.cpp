@@ -0,0 +1,266 @@
+#include "TableFindEngine.h"
+#include "TableDataModel.h"
+#include "ColumnStorage.h"
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QReadLocker>
+#include <QDebug>
+#include <algorithm>
+#include <charconv>
+
+namespace {
+    constexpr int RowsPerBlock = 16384;
+
+    struct RowBlock
+    {
+        int first;
+        int last;  // не включительно
+    };
+
+    struct Matcher
+    {
+        FindOptions options;
+        QRegularExpression regex;
+        bool numericPattern = false;  // образец может встретиться в записи числа
+
+        bool matches(QStringView text) const
+        {
+            if (options.regularExpression) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+                return regex.matchView(text).hasMatch();
+#else
+                return regex.match(text).hasMatch();
+#endif
+            }
+            if (options.wholeCell) return text.compare(options.pattern, options.caseSensitivity) == 0;
+            return text.contains(options.pattern, options.caseSensitivity);
+        }
+    };
+
+    // Запись числа в UTF-16 буфер на стеке (формат совпадает с QVariant::toString)
+    template <typename T>
+    QStringView formatNumber(T value, char16_t (&buffer)[64])
+    {
+        char text[64];
+        const auto result = std::to_chars(text, text + sizeof(text), value);
+        const int length = static_cast<int>(result.ptr - text);
+        for (int i = 0; i < length; ++i) buffer[i] = char16_t(text[i]);
+        return QStringView(buffer, length);
+    }
+
+    QVector<FindMatch> searchBlock(const TableDataModel *model, const Matcher &matcher, const RowBlock &block)
+    {
+        QVector<FindMatch> found;
+        QReadLocker locker(&model->storageLock());
+        const CellStorage &storage = model->cellStorage();
+        const int last = qMin(block.last, storage.rowCount());
+        char16_t buffer[64];
+
+        for (int column = 0; column < storage.columnCount(); ++column) {
+            if (storage.kind() != CellStorage::Kind::Columnar) {
+                for (int row = block.first; row < last; ++row) {
+                    const QVariant value = storage.value(row, column);
+                    if (value.isValid() && matcher.matches(value.toString())) found.append({row, column});
+                }
+                continue;
+            }
+
+            const TableColumn &source = static_cast<const ColumnStorage &>(storage).column(column);
+            if (source.nonNullCount() == 0) continue;
+            switch (source.type()) {
+            case TableColumn::Type::String:
+                for (int row = block.first; row < last; ++row) {
+                    if (!source.isNull(row) && matcher.matches(source.stringAt(row))) found.append({row, column});
+                }
+                break;
+            case TableColumn::Type::Int64:
+                if (!matcher.numericPattern) break;
+                for (int row = block.first; row < last; ++row) {
+                    if (!source.isNull(row) && matcher.matches(formatNumber(source.int64At(row), buffer))) found.append({row, column});
+                }
+                break;
+            case TableColumn::Type::Double:
+                if (!matcher.numericPattern) break;
+                for (int row = block.first; row < last; ++row) {
+                    if (!source.isNull(row) && matcher.matches(formatNumber(source.doubleAt(row), buffer))) found.append({row, column});
+                }
+                break;
+            case TableColumn::Type::Variant:
+                for (int row = block.first; row < last; ++row) {
+                    if (!source.isNull(row) && matcher.matches(source.value(row).toString())) found.append({row, column});
+                }
+                break;
+            }
+        }
+
+        // Внутри блока обход шел по столбцам - выдаем в порядке строк
+        std::sort(found.begin(), found.end(), [](const FindMatch &a, const FindMatch &b) {
+            return a.row != b.row ? a.row < b.row : a.column < b.column;
+        });
+        return found;
+    }
+
+    bool isNumericPattern(const FindOptions &options)
+    {
+        if (options.regularExpression) return true;
+        for (QChar ch : options.pattern) {
+            if (!ch.isDigit() && !QStringLiteral("+-.eE").contains(ch)) return false;
+        }
+        return true;
+    }
+}
+
+TableFindEngine::TableFindEngine(TableDataModel *model, QObject *parent)
+    : QObject(parent), m_model(model), m_watcher(new QFutureWatcher<QVector<FindMatch>>(this))
+{
+    connect(m_watcher, &QFutureWatcher<QVector<FindMatch>>::resultsReadyAt, this, [this](int begin, int end) {
+        QVector<FindMatch> batch;
+        for (int i = begin; i < end; ++i) batch += m_watcher->resultAt(i);
+        if (batch.isEmpty()) return;
+        m_matches += batch;
+        emit matchesFound(batch);
+    });
+    connect(m_watcher, &QFutureWatcher<QVector<FindMatch>>::finished, this, [this]() {
+        if (m_watcher->isCanceled()) return;
+        std::sort(m_matches.begin(), m_matches.end(), [](const FindMatch &a, const FindMatch &b) {
+            return a.row != b.row ? a.row < b.row : a.column < b.column;
+        });
+        m_valid = true;
+        emit finished(m_matches.size());
+    });
+
+    if (m_model) {
+        connect(m_model, &QAbstractItemModel::dataChanged, this, &TableFindEngine::onModelChanged);
+        connect(m_model, &QAbstractItemModel::rowsInserted, this, &TableFindEngine::onModelChanged);
+        connect(m_model, &QAbstractItemModel::rowsRemoved, this, &TableFindEngine::onModelChanged);
+        connect(m_model, &QAbstractItemModel::columnsInserted, this, &TableFindEngine::onModelChanged);
+        connect(m_model, &QAbstractItemModel::columnsRemoved, this, &TableFindEngine::onModelChanged);
+        connect(m_model, &QAbstractItemModel::modelReset, this, &TableFindEngine::onModelChanged);
+    }
+}
+
+TableFindEngine::~TableFindEngine()
+{
+    cancel();
+}
+
+bool TableFindEngine::find(const FindOptions &options)
+{
+    m_lastError.clear();
+    cancel();
+    m_matches.clear();
+    m_valid = false;
+
+    if (!m_model || m_model->isTableBound()) {
+        m_lastError = "Поиск доступен только для листа в памяти";
+        return false;
+    }
+    if (options.pattern.isEmpty()) {
+        m_lastError = "Пустой образец поиска";
+        return false;
+    }
+
+    m_options = options;
+    m_regex = QRegularExpression();
+    if (options.regularExpression) {
+        const QString pattern = options.wholeCell ? QRegularExpression::anchoredPattern(options.pattern) : options.pattern;
+        m_regex = QRegularExpression(pattern, options.caseSensitivity == Qt::CaseInsensitive
+                                                  ? QRegularExpression::CaseInsensitiveOption
+                                                  : QRegularExpression::NoPatternOption);
+        if (!m_regex.isValid()) {
+            m_lastError = m_regex.errorString();
+            return false;
+        }
+        m_regex.optimize();
+    }
+
+    Matcher matcher;
+    matcher.options = options;
+    matcher.regex = m_regex;
+    matcher.numericPattern = isNumericPattern(options);
+
+    QVector<RowBlock> blocks;
+    const int rowCount = m_model->rowCount();
+    for (int first = 0; first < rowCount; first += RowsPerBlock) {
+        blocks.append({first, qMin(first + RowsPerBlock, rowCount)});
+    }
+
+    const TableDataModel *model = m_model;
+    m_watcher->setFuture(QtConcurrent::mapped(blocks, [model, matcher](const RowBlock &block) {
+        return searchBlock(model, matcher, block);
+    }));
+    return true;
+}
+
+void TableFindEngine::cancel()
+{
+    if (!m_watcher->isRunning()) return;
+    m_watcher->cancel();
+    m_watcher->waitForFinished();
+}
+
+bool TableFindEngine::isRunning() const
+{
+    return m_watcher->isRunning();
+}
+
+int TableFindEngine::replaceAll(const QString &replacement)
+{
+    m_lastError.clear();
+    if (!m_model || isRunning() || !m_valid) {
+        m_lastError = "Нет завершенного поиска для замены";
+        return -1;
+    }
+    if (m_matches.isEmpty()) return 0;
+
+    QVector<TableDataModel::CellUpdate> updates;
+    updates.reserve(m_matches.size());
+    for (const FindMatch &match : m_matches) {
+        const QVariant original = m_model->data(m_model->index(match.row, match.column));
+        QString text = original.toString();
+        if (m_options.regularExpression) {
+            text.replace(m_regex, replacement);
+        } else if (m_options.wholeCell) {
+            text = replacement;
+        } else {
+            text.replace(m_options.pattern, replacement, m_options.caseSensitivity);
+        }
+
+        // Число остается числом, если результат по-прежнему им читается
+        QVariant value = text;
+        const TableColumn::Type type = TableColumn::typeForValue(original);
+        bool ok = false;
+        if (type == TableColumn::Type::Int64) {
+            const qint64 number = text.toLongLong(&ok);
+            if (ok) value = QVariant::fromValue(number);
+        } else if (type == TableColumn::Type::Double) {
+            const double number = text.toDouble(&ok);
+            if (ok) value = number;
+        }
+        if (value != original) updates.append({match.row, match.column, value});
+    }
+    if (updates.isEmpty()) return 0;
+
+    // dataChanged от собственной замены не должен выглядеть как чужая правка
+    m_replacing = true;
+    const bool ok = m_model->setCells(updates);
+    m_replacing = false;
+    m_valid = false;
+    m_matches.clear();
+    if (!ok) {
+        m_lastError = "Не удалось записать замену";
+        return -1;
+    }
+    return updates.size();
+}
+
+void TableFindEngine::onModelChanged()
+{
+    if (m_replacing) return;
+    if (!isRunning() && !m_valid) return;
+
+    cancel();
+    m_valid = false;
+    m_matches.clear();
+    emit invalidated();
+}
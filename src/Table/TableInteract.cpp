@@ -1,12 +1,46 @@
 #include "TableInteract.h"
+#include "DBManager.h"
+#include <QShortcut>
+#include <QKeySequence>
+#include <QInputDialog>
+#include <QFileDialog>
+#include <QScrollBar>
+#include <QRect>
+#include <QSqlDatabase>
+#include <QFileInfo>
+#include <QDir>
 
 
 TableInteract::TableInteract(MainTable *tableView,QObject *parent)
     : QObject(parent), tableView(tableView)
 {
     tableModel = new TableDataModel();
+    sortModel = new TableSortFilterModel(this);
+    sortModel->setSourceModel(tableModel);
 
-    tableView->setModel(tableModel);
+    tableView->setModel(sortModel);
+    tableView->getFooter()->setSourceModel(tableModel);
+    widthEstimator = new ColumnWidthEstimator(tableModel, this);
+    tableView->setWidthEstimator(widthEstimator);
+
+    findEngine = new TableFindEngine(tableModel, this);
+    // Первое совпадение выделяется сразу, остальные продолжают приходить порциями
+    connect(findEngine, &TableFindEngine::matchesFound, this, [this](const QVector<FindMatch> &matches) {
+        if (findEngine->matches().size() != matches.size()) return;
+        const QModelIndex index = sortModel->mapFromSource(tableModel->index(matches.first().row, matches.first().column));
+        if (index.isValid()) this->tableView->setCurrentIndex(index);
+    });
+    connect(findEngine, &TableFindEngine::finished, this, [this](int total) {
+        qDebug() << "Найдено ячеек:" << total;
+        if (!replaceAfterFind) return;
+
+        // Замена после завершения поиска - одним шагом отмены
+        replaceAfterFind = false;
+        const int replaced = findEngine->replaceAll(pendingReplacement);
+        if (replaced < 0) qWarning() << "replace failed:" << findEngine->getLastError();
+        else qDebug() << "Заменено ячеек:" << replaced;
+    });
+    connect(findEngine, &TableFindEngine::invalidated, this, [this]() { replaceAfterFind = false; });
 
     // Подключаем сигналы от CustomHeaderView к слотам TableDataModel
     CustomHeaderView *header = tableView->getCustomHeader();
@@ -17,27 +51,156 @@ TableInteract::TableInteract(MainTable *tableView,QObject *parent)
                 tableModel, &TableDataModel::onHeaderDeleteRequested);
         connect(header, &CustomHeaderView::headerRenameRequested,
                 tableModel, &TableDataModel::onHeaderRenameRequested);
+        connect(header, &CustomHeaderView::headersAddRequested,
+                tableModel, &TableDataModel::onHeadersAddRequested);
+        connect(header, &CustomHeaderView::headersDeleteRequested,
+                tableModel, &TableDataModel::onHeadersDeleteRequested);
+
+        connect(header, &CustomHeaderView::sortRequested, this,
+                [this, header](int logicalIndex, Qt::SortOrder order, bool addKey) {
+            if (addKey) {
+                sortModel->addSortKey(logicalIndex, order);
+            } else {
+                sortModel->sort(logicalIndex, order);
+            }
+            // Индикатор показывает главный ключ
+            const auto keys = sortModel->sortKeys();
+            header->setSortIndicatorShown(true);
+            header->setSortIndicator(keys.first().column, keys.first().order);
+        });
+        connect(header, &CustomHeaderView::sortResetRequested, this, [this, header]() {
+            sortModel->clearSortAndFilters();
+            header->setSortIndicatorShown(false);
+        });
+        connect(header, &CustomHeaderView::filterRequested,
+                sortModel, &TableSortFilterModel::setFilter);
+        connect(header, &CustomHeaderView::columnTypeRequested,
+                tableModel, &TableDataModel::setColumnType);
+        connect(header, &CustomHeaderView::columnTypeInferenceRequested,
+                this, &TableInteract::inferColumnTypes);
+        connect(header, &CustomHeaderView::formulaEditRequested,
+                this, &TableInteract::editColumnFormula);
+        connect(header, &CustomHeaderView::fitWidthRequested,
+                tableView, &MainTable::fitColumnsToContents);
     }
 
     RowHeaderView *rowHeader = tableView->getRowHeader();
     if (rowHeader) {
-        connect(rowHeader, &RowHeaderView::rowAddRequested,
-                tableModel, &TableDataModel::onRowAddRequested);
-        connect(rowHeader, &RowHeaderView::rowDeleteRequested,
-                tableModel, &TableDataModel::onRowDeleteRequested);
+        // Заголовок строк работает с позициями представления - переводим их в строки модели
+        connect(rowHeader, &RowHeaderView::rowAddRequested, this, [this](int logicalIndex) {
+            tableModel->onRowAddRequested(sortModel->mapRowToSource(logicalIndex));
+        });
+        connect(rowHeader, &RowHeaderView::rowDeleteRequested, this, [this](int logicalIndex) {
+            tableModel->onRowDeleteRequested(sortModel->mapRowToSource(logicalIndex));
+        });
+        connect(rowHeader, &RowHeaderView::rowsAddRequested, this, [this](const QList<int> &logicalIndexes) {
+            tableModel->onRowsAddRequested(sourceRows(logicalIndexes));
+        });
+        connect(rowHeader, &RowHeaderView::rowsDeleteRequested, this, [this](const QList<int> &logicalIndexes) {
+            tableModel->onRowsDeleteRequested(sourceRows(logicalIndexes));
+        });
     }
 
     if (tableView) {
         connect(tableView, &MainTable::editCellRequested,
                 this, &TableInteract::determineCellType);
+
+        // Ctrl+Z / Ctrl+Y (Ctrl+Shift+Z) в пределах таблицы
+        auto *undoShortcut = new QShortcut(QKeySequence::Undo, tableView);
+        undoShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(undoShortcut, &QShortcut::activated, tableModel, &TableDataModel::undo);
+        auto *redoShortcut = new QShortcut(QKeySequence::Redo, tableView);
+        redoShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(redoShortcut, &QShortcut::activated, tableModel, &TableDataModel::redo);
+
+        auto *findShortcut = new QShortcut(QKeySequence::Find, tableView);
+        findShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(findShortcut, &QShortcut::activated, this, &TableInteract::findInTable);
+        auto *replaceShortcut = new QShortcut(QKeySequence::Replace, tableView);
+        replaceShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(replaceShortcut, &QShortcut::activated, this, &TableInteract::replaceInTable);
+
+        // Сохранение листа в БД: пишутся только изменения, редактирование не блокируется
+        auto *saveShortcut = new QShortcut(QKeySequence::Save, tableView);
+        saveShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(saveShortcut, &QShortcut::activated, this, &TableInteract::saveSheet);
+
+        // Экспорт в CSV идет в фоне по снимку листа - редактирование не блокируется
+        auto *exportShortcut = new QShortcut(QKeySequence("Ctrl+Shift+E"), tableView);
+        exportShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(exportShortcut, &QShortcut::activated, this, &TableInteract::exportToCsv);
+        connect(tableModel, &TableDataModel::csvExported, this, [](bool success, const QString &filePath) {
+            qDebug() << (success ? "Лист выгружен:" : "Ошибка выгрузки листа:") << filePath;
+        });
+
+#ifdef QT_DEBUG
+        // Замер скорости отрисовки таблицы и счетчики кеша плиток (результат в лог)
+        auto *benchmarkShortcut = new QShortcut(QKeySequence("Ctrl+Alt+P"), tableView);
+        benchmarkShortcut->setContext(Qt::WidgetWithChildrenShortcut);
+        connect(benchmarkShortcut, &QShortcut::activated, this, [this]() {
+            this->tableView->benchmarkPaint();
+            if (tableModel->storageKind() != CellStorage::Kind::Tiled) return;
+            const TiledStorage::Metrics metrics = tableModel->tiledStorageMetrics();
+            qDebug() << "tiles: hits" << metrics.hits << "misses" << metrics.misses << "prefetched" << metrics.prefetched
+                     << "evictions" << metrics.evictions << "spills" << metrics.spills
+                     << "resident" << metrics.residentTiles << "(" << metrics.residentBytes << "bytes )"
+                     << "spilled" << metrics.spilledTiles << "file" << metrics.spillFileBytes;
+        });
+#endif
+
+        // Плиточное хранилище: следующий экран подгружается с диска по ходу прокрутки
+        connect(tableView->verticalScrollBar(), &QScrollBar::valueChanged, this, [this, previous = 0](int value) mutable {
+            prefetchAhead(value > previous ? 1 : -1, 0);
+            previous = value;
+        });
+        connect(tableView->horizontalScrollBar(), &QScrollBar::valueChanged, this, [this, previous = 0](int value) mutable {
+            prefetchAhead(0, value > previous ? 1 : -1);
+            previous = value;
+        });
     }
 
-    ForTestCommand();
+    connect(tableModel, &TableDataModel::sheetSaved, this, [this](bool success) {
+        qDebug() << (success ? "Лист сохранен:" : "Ошибка сохранения листа:") << sheetId();
+        emit sheetSaved(success);
+    });
+}
+
+void TableInteract::prefetchAhead(int rowDirection, int columnDirection)
+{
+    if (tableModel->storageKind() != CellStorage::Kind::Tiled) return;
+    // После сортировки видимые строки разбросаны по листу - направление прокрутки ничего не говорит
+    if (!sortModel->sortKeys().isEmpty()) return;
+
+    const QWidget *viewport = tableView->viewport();
+    const int firstRow = qMax(tableView->rowAt(0), 0);
+    int lastRow = tableView->rowAt(viewport->height() - 1);
+    if (lastRow < 0) lastRow = sortModel->rowCount() - 1;
+    const int firstColumn = qMax(tableView->columnAt(0), 0);
+    int lastColumn = tableView->columnAt(viewport->width() - 1);
+    if (lastColumn < 0) lastColumn = sortModel->columnCount() - 1;
+    if (lastRow < firstRow || lastColumn < firstColumn) return;
 
+    // Фильтр сохраняет порядок строк: видимый экран лежит между первой и последней строкой источника
+    // (если отфильтровано почти все, этот охват слишком велик для подгрузки)
+    const int sourceFirst = sortModel->mapRowToSource(firstRow);
+    const int sourceLast = sortModel->mapRowToSource(lastRow);
+    if (sourceFirst < 0 || sourceLast < sourceFirst) return;
+    if (sourceLast - sourceFirst > 4 * (lastRow - firstRow + 1)) return;
+    tableModel->prefetchCells(QRect(QPoint(firstColumn, sourceFirst), QPoint(lastColumn, sourceLast)),
+                              rowDirection, columnDirection);
 }
 
 TableInteract::~TableInteract()
 {
+    // Поиск, оценка ширины и определение типов читают модель в пуле потоков и ждут
+    // свои задачи только в деструкторе - удаляем их раньше модели, а не вместе с детьми
+    delete findEngine;
+    delete widthEstimator;
+    if (typeWatcher) {
+        typeWatcher->waitForFinished();
+        delete typeWatcher;
+    }
+    delete sortModel;
     delete tableModel;
 }
 
@@ -72,13 +235,174 @@ void TableInteract::ForTestCommand()
 
 }
 
+qint64 TableInteract::createSheet(DatabaseManager *db, const QString &name)
+{
+    if (!db) return -1;
+    const qint64 id = db->getModifier()->insertRecordAndReturnId("sheets", {{"name", name}}, "id");
+    if (id < 0) qWarning() << "sheet create failed:" << db->getModifier()->getLastError();
+    return id;
+}
+
+bool TableInteract::openSheet(DatabaseManager *db, qint64 sheetId)
+{
+    if (!db || sheetId < 0) return false;
+
+    const QString connectionName = db->getReader()->getConnectionName();
+    auto store = std::make_unique<SheetStore>(connectionName, sheetId);
+
+    // Журнал подключается до загрузки: loadSheet проигрывает правки, не дошедшие до БД.
+    // Без журнала лист все равно открывается - теряется только восстановление после сбоя
+    std::unique_ptr<SheetJournal> journal;
+    const QString dbPath = QSqlDatabase::database(connectionName, false).databaseName();
+    if (!dbPath.isEmpty() && dbPath != ":memory:") {
+        const QString journalPath = QFileInfo(dbPath).absoluteDir().filePath(QString("sheet_%1.journal").arg(sheetId));
+        journal = std::make_unique<SheetJournal>(journalPath, sheetId);
+        if (!journal->open()) {
+            qWarning() << "sheet journal unavailable:" << journal->getLastError();
+            journal.reset();
+        }
+    }
+
+    tableModel->setJournal(journal.get());
+    if (!tableModel->loadSheet(*store)) {
+        tableModel->setJournal(sheetJournal.get());
+        return false;
+    }
+    sheetStore = std::move(store);
+    sheetJournal = std::move(journal);
+
+    // Новый лист начинается так же, как лист без БД; эти правки уйдут в первое сохранение
+    if (tableModel->columnCount() == 0) {
+        tableModel->onHeaderAddRequested(0, false);
+        ForTestCommand();
+        tableModel->clearUndo();
+    }
+    return true;
+}
+
+bool TableInteract::saveSheet()
+{
+    if (!sheetStore) return false;
+    if (!tableModel->saveSheetInBackground(sheetStore.get())) {
+        qDebug() << "Сохранение недоступно (идет предыдущее сохранение или открыта таблица БД)";
+        return false;
+    }
+    return true;
+}
+
+bool TableInteract::showDatabaseTable(DataReader *reader, const QString &tableName, const QString &keyColumn)
+{
+    if (!tableModel) return false;
+    return tableModel->bindToTable(reader, tableName, keyColumn);
+}
+
+void TableInteract::findInTable()
+{
+    bool ok;
+    const QString pattern = QInputDialog::getText(tableView, "Найти", "Текст:", QLineEdit::Normal, QString(), &ok);
+    if (!ok || pattern.isEmpty()) return;
+
+    FindOptions options;
+    options.pattern = pattern;
+    replaceAfterFind = false;
+    if (!findEngine->find(options)) {
+        qWarning() << "find failed:" << findEngine->getLastError();
+    }
+}
+
+void TableInteract::replaceInTable()
+{
+    bool ok;
+    const QString pattern = QInputDialog::getText(tableView, "Заменить", "Найти:", QLineEdit::Normal, QString(), &ok);
+    if (!ok || pattern.isEmpty()) return;
+    const QString replacement = QInputDialog::getText(tableView, "Заменить", "Заменить на:", QLineEdit::Normal, QString(), &ok);
+    if (!ok) return;
+
+    FindOptions options;
+    options.pattern = pattern;
+    pendingReplacement = replacement;
+    replaceAfterFind = findEngine->find(options);
+    if (!replaceAfterFind) {
+        qWarning() << "replace failed:" << findEngine->getLastError();
+    }
+}
+
+QList<int> TableInteract::sourceRows(const QList<int> &viewRows) const
+{
+    QList<int> rows;
+    rows.reserve(viewRows.size());
+    for (int row : viewRows) rows.append(sortModel->mapRowToSource(row));
+    return rows;
+}
+
+void TableInteract::inferColumnTypes(int column)
+{
+    if (tableModel->isTableBound()) return;
+
+    // Один столбец: выборка не больше SampleSize ячеек - определяем сразу
+    if (column >= 0) {
+        ColumnTypeGuess guess;
+        {
+            QReadLocker locker(&tableModel->storageLock());
+            if (column >= tableModel->cellStorage().columnCount()) return;
+            guess = ColumnTypeInference::inferColumn(tableModel->cellStorage(), column);
+        }
+        qDebug() << "Тип столбца" << column << ":" << int(guess.type)
+                 << QStringLiteral("(%1 из %2)").arg(guess.matched).arg(guess.sampled);
+        if (guess.type != ColumnType::Auto) tableModel->setColumnType(column, guess.type);
+        return;
+    }
+
+    // Все столбцы - в пуле потоков; тип назначается только столбцам без типа
+    if (typeWatcher && typeWatcher->isRunning()) return;
+    if (!typeWatcher) {
+        typeWatcher = new QFutureWatcher<QVector<ColumnTypeGuess>>(this);
+        connect(typeWatcher, &QFutureWatcher<QVector<ColumnTypeGuess>>::finished, this, [this]() {
+            const QVector<ColumnTypeGuess> guesses = typeWatcher->result();
+            // Столбцы могли измениться, пока шел разбор
+            if (guesses.size() != tableModel->columnCount()) return;
+
+            TableDataModel::BatchUpdate batch(tableModel);
+            for (int i = 0; i < guesses.size(); ++i) {
+                if (guesses[i].type != ColumnType::Auto && tableModel->columnType(i) == ColumnType::Auto) {
+                    tableModel->setColumnType(i, guesses[i].type);
+                }
+            }
+        });
+    }
+    typeWatcher->setFuture(ColumnTypeInference::inferColumnsAsync(tableModel));
+}
+
+void TableInteract::exportToCsv()
+{
+    const QString filePath = QFileDialog::getSaveFileName(tableView, "Экспорт листа", QString(), "CSV (*.csv)");
+    if (filePath.isEmpty()) return;
+    if (!tableModel->exportCsvInBackground(filePath)) {
+        qDebug() << "Экспорт недоступен (идет предыдущий экспорт или лист не поддерживает снимки)";
+    }
+}
+
+void TableInteract::editColumnFormula(int column)
+{
+    if (tableModel->isTableBound()) return;
+
+    bool ok = false;
+    const QString formula = QInputDialog::getText(tableView, "Формула столбца",
+                                                  "Например: [Цена] * [Количество] или cumsum([Сумма])\n"
+                                                  "Пустая формула делает столбец обычным:",
+                                                  QLineEdit::Normal, tableModel->columnFormula(column), &ok);
+    if (ok && !tableModel->setColumnFormula(column, formula)) {
+        qWarning() << "formula not applied to column" << column;
+    }
+}
+
 void TableInteract::determineCellType(const QModelIndex &index)
 {
     if (!tableModel || !index.isValid()) {
         return;
     }
 
-    const QVariant cellValue = tableModel->data(index, Qt::DisplayRole);
+    const QVariant cellValue = sortModel->data(index, Qt::DisplayRole);
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     const char *typeName = cellValue.isValid() ? cellValue.metaType().name() : "Invalid";
 #else
@@ -87,5 +411,6 @@ void TableInteract::determineCellType(const QModelIndex &index)
 
     qDebug() << "Тип данных ячейки"
              << QStringLiteral("[%1, %2]").arg(index.row()).arg(index.column())
-             << ":" << (cellValue.isNull() ? "Null" : typeName);
+             << ":" << (cellValue.isNull() ? "Null" : typeName)
+             << "тип столбца:" << int(tableModel->columnType(index.column()));
 }
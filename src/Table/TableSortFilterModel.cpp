@@ -0,0 +1,842 @@
+#include "TableSortFilterModel.h"
+#include "TableDataModel.h"
+#include "ColumnStorage.h"
+#include <QFutureWatcher>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    using ColumnKeys = TableSortFilterModel::ColumnKeys;
+    using Bitmap = TableSortFilterModel::Bitmap;
+
+    using RowEdit = TableSortFilterModel::RowEdit;
+
+    // Меньше этого сортируем одним потоком: накладные расходы на задачи больше выигрыша
+    constexpr int MinRowsForParallelSort = 65536;
+
+    // Ключи столбца для задачи: из кеша (со сдвигами строк) или построить заново
+    struct KeyColumn
+    {
+        int column;
+        std::shared_ptr<const ColumnKeys> cached;
+        QVector<RowEdit> rowEdits;
+    };
+
+    struct SortColumn
+    {
+        int column;
+        Qt::SortOrder order;
+        std::shared_ptr<const ColumnKeys> keys;  // заполняется в задаче
+    };
+
+    struct FilterColumn
+    {
+        int column;
+        QString needle;  // уже в нижнем регистре
+        std::shared_ptr<const ColumnKeys> keys;  // заполняется в задаче
+        std::shared_ptr<const Bitmap> cached;
+    };
+
+    struct Job
+    {
+        quint64 generation = 0;
+        quint64 keyVersion = 0;
+        const TableDataModel *source = nullptr;
+        QVector<KeyColumn> keyColumns;
+        QVector<SortColumn> sortColumns;
+        QVector<FilterColumn> filters;
+    };
+
+    void setKey(ColumnKeys &keys, int row, double number)
+    {
+        if (keys.numbers.empty()) keys.numbers.assign(keys.kinds.size(), 0.0);
+        keys.kinds[row] = ColumnKeys::Number;
+        keys.numbers[row] = number;
+    }
+
+    void setKey(ColumnKeys &keys, int row, const QString &text)
+    {
+        if (keys.texts.isEmpty()) keys.texts.resize(static_cast<int>(keys.kinds.size()));
+        keys.kinds[row] = ColumnKeys::Text;
+        keys.texts[row] = text.toCaseFolded();
+    }
+
+    void setKey(ColumnKeys &keys, int row, const QVariant &value)
+    {
+        if (!value.isValid()) return;
+        switch (TableColumn::typeForValue(value)) {
+        case TableColumn::Type::Int64:
+        case TableColumn::Type::Double:
+            setKey(keys, row, value.toDouble());
+            break;
+        default:
+            setKey(keys, row, value.toString());
+            break;
+        }
+    }
+
+    std::shared_ptr<const ColumnKeys> buildKeys(const CellStorage &storage, int column)
+    {
+        auto keys = std::make_shared<ColumnKeys>();
+        const int rowCount = storage.rowCount();
+        keys->kinds.assign(rowCount, ColumnKeys::Null);
+
+        if (storage.kind() != CellStorage::Kind::Columnar) {
+            for (int row = 0; row < rowCount; ++row) {
+                setKey(*keys, row, storage.value(row, column));
+            }
+            return keys;
+        }
+
+        // Колоночное хранилище: числа читаются прямо из типизированных буферов
+        const TableColumn &source = static_cast<const ColumnStorage &>(storage).column(column);
+        if (source.nonNullCount() == 0) return keys;
+        switch (source.type()) {
+        case TableColumn::Type::Int64:
+            for (int row = 0; row < rowCount; ++row) {
+                if (!source.isNull(row)) setKey(*keys, row, static_cast<double>(source.int64At(row)));
+            }
+            break;
+        case TableColumn::Type::Double:
+            for (int row = 0; row < rowCount; ++row) {
+                if (!source.isNull(row)) setKey(*keys, row, source.doubleAt(row));
+            }
+            break;
+        case TableColumn::Type::String:
+            for (int row = 0; row < rowCount; ++row) {
+                if (!source.isNull(row)) setKey(*keys, row, source.stringAt(row).toString());
+            }
+            break;
+        case TableColumn::Type::Variant:
+            for (int row = 0; row < rowCount; ++row) {
+                setKey(*keys, row, source.value(row));
+            }
+            break;
+        }
+        return keys;
+    }
+
+    // Ключи после вставок/удалений строк (count < 0 - удаление); новые строки пустые.
+    // nullptr - сдвиг не сходится с ключами, столбец строится заново
+    std::shared_ptr<const ColumnKeys> shiftKeys(const ColumnKeys &keys, const QVector<RowEdit> &edits)
+    {
+        auto shifted = std::make_shared<ColumnKeys>(keys);
+        for (const RowEdit &edit : edits) {
+            const qsizetype size = qsizetype(shifted->kinds.size());
+            if (edit.first < 0 || edit.first > size || (edit.count < 0 && edit.first - edit.count > size)) return nullptr;
+            if (edit.count > 0) {
+                shifted->kinds.insert(shifted->kinds.begin() + edit.first, edit.count, ColumnKeys::Null);
+                if (!shifted->numbers.empty()) shifted->numbers.insert(shifted->numbers.begin() + edit.first, edit.count, 0.0);
+                if (!shifted->texts.isEmpty()) shifted->texts.insert(edit.first, edit.count, QString());
+            } else {
+                shifted->kinds.erase(shifted->kinds.begin() + edit.first, shifted->kinds.begin() + edit.first - edit.count);
+                if (!shifted->numbers.empty()) {
+                    shifted->numbers.erase(shifted->numbers.begin() + edit.first, shifted->numbers.begin() + edit.first - edit.count);
+                }
+                if (!shifted->texts.isEmpty()) shifted->texts.remove(edit.first, -edit.count);
+            }
+        }
+        return shifted;
+    }
+
+    // Сравнение по одному ключу: числа < текст < пустые
+    int compareKeys(const ColumnKeys &keys, int a, int b)
+    {
+        const quint8 kindA = keys.kinds[a];
+        const quint8 kindB = keys.kinds[b];
+        if (kindA != kindB) return kindA < kindB ? -1 : 1;
+        if (kindA == ColumnKeys::Number) {
+            const double x = keys.numbers[a];
+            const double y = keys.numbers[b];
+            return x < y ? -1 : (y < x ? 1 : 0);
+        }
+        if (kindA == ColumnKeys::Text) {
+            return keys.texts[a].compare(keys.texts[b]);
+        }
+        return 0;
+    }
+
+    QString keyText(const ColumnKeys &keys, int row)
+    {
+        switch (keys.kinds[row]) {
+        case ColumnKeys::Number: {
+            const double number = keys.numbers[row];
+            // Целые печатаются без экспоненты, как их показывает таблица
+            if (std::floor(number) == number && std::fabs(number) < 1e15) {
+                return QString::number(static_cast<qint64>(number));
+            }
+            return QString::number(number);
+        }
+        case ColumnKeys::Text:
+            return keys.texts[row];
+        default:
+            return QString();
+        }
+    }
+
+    std::shared_ptr<const Bitmap> buildBitmap(const ColumnKeys &keys, const QString &needle, int rowCount)
+    {
+        auto bitmap = std::make_shared<Bitmap>((rowCount + 63) / 64, 0);
+        for (int row = 0; row < rowCount; ++row) {
+            if (keyText(keys, row).contains(needle)) {
+                (*bitmap)[row / 64] |= quint64(1) << (row % 64);
+            }
+        }
+        return bitmap;
+    }
+
+    // Параллельная сортировка: куски по числу ядер сортируются одновременно,
+    // затем соседние куски сливаются попарно, каждый уровень слияния тоже параллельно
+    template <typename Less>
+    void parallelSort(QVector<int> &rows, Less less)
+    {
+        const int threads = qMax(1, QThread::idealThreadCount());
+        if (rows.size() < MinRowsForParallelSort || threads == 1) {
+            std::sort(rows.begin(), rows.end(), less);
+            return;
+        }
+
+        struct Range
+        {
+            int begin;
+            int end;
+        };
+        QVector<Range> ranges;
+        const int chunk = (rows.size() + threads - 1) / threads;
+        for (int begin = 0; begin < rows.size(); begin += chunk) {
+            ranges.append({begin, qMin(begin + chunk, static_cast<int>(rows.size()))});
+        }
+
+        int *data = rows.data();
+        QtConcurrent::blockingMap(ranges, [data, &less](const Range &range) {
+            std::sort(data + range.begin, data + range.end, less);
+        });
+
+        while (ranges.size() > 1) {
+            QVector<Range> merged;
+            QVector<QPair<Range, Range>> pairs;
+            for (int i = 0; i + 1 < ranges.size(); i += 2) {
+                pairs.append({ranges[i], ranges[i + 1]});
+                merged.append({ranges[i].begin, ranges[i + 1].end});
+            }
+            if (ranges.size() % 2) merged.append(ranges.last());
+
+            QtConcurrent::blockingMap(pairs, [data, &less](const QPair<Range, Range> &pair) {
+                std::inplace_merge(data + pair.first.begin, data + pair.second.begin, data + pair.second.end, less);
+            });
+            ranges = merged;
+        }
+    }
+
+    TableSortFilterModel::Result computeResult(Job job)
+    {
+        TableSortFilterModel::Result result;
+        result.generation = job.generation;
+        result.keyVersion = job.keyVersion;
+        result.identity = job.sortColumns.isEmpty() && job.filters.isEmpty();
+        if (result.identity) return result;
+
+        // Ключи строятся здесь под блокировкой хранилища на чтение: поток UI занят только
+        // на время записи. Закешированные ключи лишь сдвигаются по вставкам/удалениям строк
+        int rowCount = 0;
+        {
+            QReadLocker locker(&job.source->storageLock());
+            const CellStorage &storage = job.source->cellStorage();
+            rowCount = storage.rowCount();
+            for (const KeyColumn &column : job.keyColumns) {
+                // Столбцы сдвинулись после постановки задачи - результат все равно устарел
+                if (column.column >= storage.columnCount()) return result;
+                std::shared_ptr<const ColumnKeys> keys = column.cached;
+                if (keys && !column.rowEdits.isEmpty()) keys = shiftKeys(*keys, column.rowEdits);
+                if (!keys || keys->kinds.size() != size_t(rowCount)) keys = buildKeys(storage, column.column);
+                result.keys.insert(column.column, keys);
+            }
+        }
+        for (SortColumn &column : job.sortColumns) column.keys = result.keys.value(column.column);
+        for (FilterColumn &filter : job.filters) filter.keys = result.keys.value(filter.column);
+
+        // Фильтры: битовые карты столбцов (из кеша или новые) объединяются по AND
+        Bitmap combined;
+        for (const FilterColumn &filter : job.filters) {
+            std::shared_ptr<const Bitmap> bitmap = filter.cached;
+            if (bitmap && bitmap->size() != size_t(rowCount + 63) / 64) bitmap.reset();
+            if (!bitmap) {
+                bitmap = buildBitmap(*filter.keys, filter.needle, rowCount);
+                result.bitmaps.insert(filter.column, bitmap);
+                result.bitmapKeys.insert(filter.column, filter.keys);
+            }
+            if (combined.empty()) {
+                combined = *bitmap;
+            } else {
+                for (size_t i = 0; i < combined.size(); ++i) combined[i] &= (*bitmap)[i];
+            }
+        }
+
+        result.rows.reserve(job.filters.isEmpty() ? rowCount : 0);
+        for (int row = 0; row < rowCount; ++row) {
+            if (combined.empty() || ((combined[row / 64] >> (row % 64)) & 1u)) result.rows.append(row);
+        }
+
+        if (!job.sortColumns.isEmpty()) {
+            const QVector<SortColumn> &columns = job.sortColumns;
+            parallelSort(result.rows, [&columns](int a, int b) {
+                for (const SortColumn &column : columns) {
+                    const int order = compareKeys(*column.keys, a, b);
+                    if (order == 0) continue;
+                    // Пустые ячейки в конце при любом направлении
+                    if (column.keys->kinds[a] == ColumnKeys::Null || column.keys->kinds[b] == ColumnKeys::Null) {
+                        return order < 0;
+                    }
+                    return column.order == Qt::AscendingOrder ? order < 0 : order > 0;
+                }
+                return a < b;  // равные ключи - исходный порядок
+            });
+        }
+        return result;
+    }
+}
+
+TableSortFilterModel::TableSortFilterModel(QObject *parent)
+    : QAbstractProxyModel(parent), m_watcher(new QFutureWatcher<Result>(this))
+{
+    connect(m_watcher, &QFutureWatcher<Result>::finished, this, [this]() {
+        applyResult(m_watcher->result());
+        if (m_pending) startJob();
+    });
+}
+
+TableSortFilterModel::~TableSortFilterModel()
+{
+    m_watcher->waitForFinished();
+}
+
+void TableSortFilterModel::setSourceModel(QAbstractItemModel *sourceModel)
+{
+    // Задача читает хранилище прежнего источника
+    m_watcher->waitForFinished();
+    beginResetModel();
+
+    if (m_source) disconnect(m_source, nullptr, this, nullptr);
+    m_source = qobject_cast<TableDataModel *>(sourceModel);
+    if (sourceModel && !m_source) {
+        qWarning() << "TableSortFilterModel: source model must be TableDataModel";
+    }
+    QAbstractProxyModel::setSourceModel(m_source);
+
+    m_sortKeys.clear();
+    m_filters.clear();
+    invalidateCaches();
+    setIdentity();
+    ++m_generation;
+
+    if (m_source) {
+        connect(m_source, &QAbstractItemModel::dataChanged, this, &TableSortFilterModel::onSourceDataChanged);
+        connect(m_source, &QAbstractItemModel::headerDataChanged, this, &TableSortFilterModel::onSourceHeaderDataChanged);
+        connect(m_source, &QAbstractItemModel::rowsAboutToBeInserted, this, &TableSortFilterModel::onSourceRowsAboutToBeInserted);
+        connect(m_source, &QAbstractItemModel::rowsInserted, this, &TableSortFilterModel::onSourceRowsInserted);
+        connect(m_source, &QAbstractItemModel::rowsAboutToBeRemoved, this, &TableSortFilterModel::onSourceRowsAboutToBeRemoved);
+        connect(m_source, &QAbstractItemModel::rowsRemoved, this, &TableSortFilterModel::onSourceRowsRemoved);
+        connect(m_source, &QAbstractItemModel::columnsAboutToBeInserted, this, &TableSortFilterModel::onSourceColumnsAboutToBeInserted);
+        connect(m_source, &QAbstractItemModel::columnsInserted, this, &TableSortFilterModel::onSourceColumnsInserted);
+        connect(m_source, &QAbstractItemModel::columnsAboutToBeRemoved, this, &TableSortFilterModel::onSourceColumnsAboutToBeRemoved);
+        connect(m_source, &QAbstractItemModel::columnsRemoved, this, &TableSortFilterModel::onSourceColumnsRemoved);
+        connect(m_source, &QAbstractItemModel::modelAboutToBeReset, this, &TableSortFilterModel::onSourceAboutToBeReset);
+        connect(m_source, &QAbstractItemModel::modelReset, this, &TableSortFilterModel::onSourceReset);
+        connect(m_source, &QAbstractItemModel::layoutAboutToBeChanged, this, &TableSortFilterModel::onSourceAboutToBeReset);
+        connect(m_source, &QAbstractItemModel::layoutChanged, this, &TableSortFilterModel::onSourceReset);
+    }
+
+    endResetModel();
+}
+
+void TableSortFilterModel::setSortKeys(const QVector<SortKey> &keys)
+{
+    m_sortKeys = keys;
+    requestUpdate();
+}
+
+void TableSortFilterModel::addSortKey(int column, Qt::SortOrder order)
+{
+    for (SortKey &key : m_sortKeys) {
+        if (key.column == column) {
+            key.order = order;
+            requestUpdate();
+            return;
+        }
+    }
+    m_sortKeys.append({column, order});
+    requestUpdate();
+}
+
+void TableSortFilterModel::sort(int column, Qt::SortOrder order)
+{
+    if (column < 0) {
+        setSortKeys({});
+    } else {
+        setSortKeys({{column, order}});
+    }
+}
+
+void TableSortFilterModel::setFilter(int column, const QString &text)
+{
+    if (text.isEmpty()) {
+        if (m_filters.remove(column) == 0) return;
+    } else {
+        m_filters.insert(column, text);
+    }
+    m_bitmapCache.remove(column);
+    requestUpdate();
+}
+
+void TableSortFilterModel::clearSortAndFilters()
+{
+    m_sortKeys.clear();
+    m_filters.clear();
+    m_bitmapCache.clear();
+    requestUpdate();
+}
+
+bool TableSortFilterModel::isBusy() const
+{
+    return m_watcher->isRunning();
+}
+
+void TableSortFilterModel::requestUpdate()
+{
+    ++m_generation;
+    m_pending = true;
+    if (!m_watcher->isRunning()) startJob();
+}
+
+void TableSortFilterModel::startJob()
+{
+    m_pending = false;
+    if (!m_source) return;
+    if (m_source->isTableBound()) {
+        // Окно БД держит только часть строк: сортировать нужно запросом к БД
+        qWarning() << "TableSortFilterModel: sorting and filtering are not available for a bound database table";
+        return;
+    }
+
+    Job job;
+    job.generation = m_generation;
+    job.keyVersion = m_keyVersion;
+    job.source = m_source;
+    const int columnCount = m_source->columnCount();
+
+    // Ключи (новые или сдвинутые по строкам) готовит задача; здесь только список столбцов
+    auto addKeyColumn = [this, &job](int column) {
+        for (const KeyColumn &added : std::as_const(job.keyColumns)) {
+            if (added.column == column) return;
+        }
+        const CachedKeys cached = m_keyCache.value(column);
+        job.keyColumns.append({column, cached.keys, cached.rowEdits});
+    };
+    for (const SortKey &key : m_sortKeys) {
+        if (key.column < 0 || key.column >= columnCount) continue;
+        addKeyColumn(key.column);
+        job.sortColumns.append({key.column, key.order, nullptr});
+    }
+    for (auto it = m_filters.cbegin(); it != m_filters.cend(); ++it) {
+        if (it.key() < 0 || it.key() >= columnCount) continue;
+        addKeyColumn(it.key());
+        job.filters.append({it.key(), it.value().toCaseFolded(), nullptr, m_bitmapCache.value(it.key())});
+    }
+
+    m_watcher->setFuture(QtConcurrent::run([job]() { return computeResult(job); }));
+}
+
+void TableSortFilterModel::applyResult(const Result &result)
+{
+    // Ключи годятся и для устаревшего запроса, если кеш с начала задачи не менялся
+    if (result.keyVersion == m_keyVersion) {
+        for (auto it = result.keys.cbegin(); it != result.keys.cend(); ++it) {
+            m_keyCache.insert(it.key(), {it.value(), {}});
+        }
+    }
+
+    // Данные или запрос изменились, пока шла задача: результат устарел
+    if (result.generation != m_generation) return;
+
+    for (auto it = result.bitmaps.cbegin(); it != result.bitmaps.cend(); ++it) {
+        if (m_keyCache.value(it.key()).keys == result.bitmapKeys.value(it.key())) {
+            m_bitmapCache.insert(it.key(), it.value());
+        }
+    }
+
+    const int sourceRows = m_source ? m_source->rowCount() : 0;
+    bool sameRows = false;
+    if (result.identity) {
+        sameRows = m_identity || m_proxyToSource.size() == sourceRows;
+    } else if (result.rows.size() == rowCount()) {
+        sameRows = true;
+        for (int row : result.rows) {
+            if (mapFromSource(m_source->index(row, 0)).row() < 0) {
+                sameRows = false;
+                break;
+            }
+        }
+    }
+
+    if (!sameRows) {
+        beginResetModel();
+        if (result.identity) {
+            setIdentity();
+        } else {
+            m_identity = false;
+            m_proxyToSource = result.rows;
+            rebuildSourceToProxy();
+        }
+        endResetModel();
+        emit sortFilterFinished();
+        return;
+    }
+
+    // Набор строк тот же - меняется только порядок, выделение и текущая ячейка сохраняются
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    const QModelIndexList persistent = persistentIndexList();
+    QModelIndexList sourcePersistent;
+    sourcePersistent.reserve(persistent.size());
+    for (const QModelIndex &index : persistent) sourcePersistent.append(mapToSource(index));
+
+    if (result.identity) {
+        setIdentity();
+    } else {
+        m_identity = false;
+        m_proxyToSource = result.rows;
+        rebuildSourceToProxy();
+    }
+
+    QModelIndexList updated;
+    updated.reserve(persistent.size());
+    for (const QModelIndex &index : sourcePersistent) updated.append(mapFromSource(index));
+    changePersistentIndexList(persistent, updated);
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+    emit sortFilterFinished();
+}
+
+void TableSortFilterModel::setIdentity()
+{
+    m_identity = true;
+    m_proxyToSource.clear();
+    m_proxyToSource.squeeze();
+    m_sourceToProxy.clear();
+    m_sourceToProxy.squeeze();
+}
+
+void TableSortFilterModel::rebuildSourceToProxy()
+{
+    m_sourceToProxy.fill(-1, m_source ? m_source->rowCount() : 0);
+    for (int row = 0; row < m_proxyToSource.size(); ++row) {
+        const int source = m_proxyToSource[row];
+        if (source >= 0 && source < m_sourceToProxy.size()) m_sourceToProxy[source] = row;
+    }
+}
+
+void TableSortFilterModel::invalidateCaches()
+{
+    ++m_keyVersion;
+    m_keyCache.clear();
+    m_bitmapCache.clear();
+}
+
+void TableSortFilterModel::shiftRows(int first, int count)
+{
+    // Ключи не перестраиваются: сдвиг запоминается и применяется в задаче.
+    // Карты фильтров дешевле построить заново по сдвинутым ключам
+    ++m_keyVersion;
+    m_bitmapCache.clear();
+    for (auto it = m_keyCache.begin(); it != m_keyCache.end();) {
+        if (it->rowEdits.size() >= MaxRowEdits) {
+            it = m_keyCache.erase(it);
+            continue;
+        }
+        it->rowEdits.append({first, count});
+        ++it;
+    }
+}
+
+void TableSortFilterModel::shiftColumns(int first, int count)
+{
+    // count < 0 - удаление столбцов [first, first - count)
+    auto shift = [first, count](int column) {
+        if (column < first) return column;
+        if (count < 0 && column < first - count) return -1;
+        return column + count;
+    };
+
+    QVector<SortKey> keys;
+    for (SortKey key : m_sortKeys) {
+        key.column = shift(key.column);
+        if (key.column >= 0) keys.append(key);
+    }
+    m_sortKeys = keys;
+
+    QHash<int, QString> filters;
+    for (auto it = m_filters.cbegin(); it != m_filters.cend(); ++it) {
+        const int column = shift(it.key());
+        if (column >= 0) filters.insert(column, it.value());
+    }
+    m_filters = filters;
+
+    ++m_keyVersion;
+    QHash<int, CachedKeys> keyCache;
+    for (auto it = m_keyCache.cbegin(); it != m_keyCache.cend(); ++it) {
+        const int column = shift(it.key());
+        if (column >= 0) keyCache.insert(column, it.value());
+    }
+    m_keyCache = keyCache;
+
+    QHash<int, std::shared_ptr<const Bitmap>> bitmapCache;
+    for (auto it = m_bitmapCache.cbegin(); it != m_bitmapCache.cend(); ++it) {
+        const int column = shift(it.key());
+        if (column >= 0) bitmapCache.insert(column, it.value());
+    }
+    m_bitmapCache = bitmapCache;
+}
+
+int TableSortFilterModel::mapRowToSource(int row) const
+{
+    if (m_identity) return row;
+    return row >= 0 && row < m_proxyToSource.size() ? m_proxyToSource[row] : -1;
+}
+
+QModelIndex TableSortFilterModel::mapToSource(const QModelIndex &proxyIndex) const
+{
+    if (!m_source || !proxyIndex.isValid()) return QModelIndex();
+    const int row = mapRowToSource(proxyIndex.row());
+    if (row < 0) return QModelIndex();
+    return m_source->index(row, proxyIndex.column());
+}
+
+QModelIndex TableSortFilterModel::mapFromSource(const QModelIndex &sourceIndex) const
+{
+    if (!m_source || !sourceIndex.isValid()) return QModelIndex();
+    const int sourceRow = sourceIndex.row();
+    int row = sourceRow;
+    if (!m_identity) {
+        row = sourceRow < m_sourceToProxy.size() ? m_sourceToProxy[sourceRow] : -1;
+    }
+    if (row < 0) return QModelIndex();
+    return index(row, sourceIndex.column());
+}
+
+QModelIndex TableSortFilterModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (parent.isValid() || row < 0 || column < 0 || row >= rowCount() || column >= columnCount()) {
+        return QModelIndex();
+    }
+    return createIndex(row, column);
+}
+
+QModelIndex TableSortFilterModel::parent(const QModelIndex &child) const
+{
+    Q_UNUSED(child);
+    return QModelIndex();
+}
+
+int TableSortFilterModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !m_source) return 0;
+    return m_identity ? m_source->rowCount() : m_proxyToSource.size();
+}
+
+int TableSortFilterModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid() || !m_source) return 0;
+    return m_source->columnCount();
+}
+
+QVariant TableSortFilterModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (!m_source) return QVariant();
+    // Номер строки показывает исходную позицию
+    if (orientation == Qt::Vertical) {
+        const int row = mapRowToSource(section);
+        return row < 0 ? QVariant() : m_source->headerData(row, orientation, role);
+    }
+    return m_source->headerData(section, orientation, role);
+}
+
+void TableSortFilterModel::onSourceDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QList<int> &roles)
+{
+    ++m_keyVersion;
+    for (int column = topLeft.column(); column <= bottomRight.column(); ++column) {
+        m_keyCache.remove(column);
+        m_bitmapCache.remove(column);
+    }
+
+    if (m_identity) {
+        emit dataChanged(index(topLeft.row(), topLeft.column()), index(bottomRight.row(), bottomRight.column()), roles);
+        return;
+    }
+    if (topLeft.row() == bottomRight.row()) {
+        const QModelIndex row = mapFromSource(topLeft);
+        if (row.isValid()) {
+            emit dataChanged(index(row.row(), topLeft.column()), index(row.row(), bottomRight.column()), roles);
+        }
+        return;
+    }
+    // Строки диапазона разбросаны по представлению - обновляем столбцы целиком
+    if (rowCount() > 0) {
+        emit dataChanged(index(0, topLeft.column()), index(rowCount() - 1, bottomRight.column()), roles);
+    }
+}
+
+void TableSortFilterModel::onSourceHeaderDataChanged(Qt::Orientation orientation, int first, int last)
+{
+    if (orientation == Qt::Horizontal || m_identity) {
+        emit headerDataChanged(orientation, first, last);
+    } else if (rowCount() > 0) {
+        emit headerDataChanged(orientation, 0, rowCount() - 1);
+    }
+}
+
+void TableSortFilterModel::onSourceRowsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) return;
+    ++m_generation;
+    if (m_identity) beginInsertRows(QModelIndex(), first, last);
+}
+
+void TableSortFilterModel::onSourceRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) return;
+    shiftRows(first, last - first + 1);
+    if (m_identity) {
+        endInsertRows();
+    } else {
+        // Новые строки показываются в конце, пока не закончится пересортировка
+        const int count = last - first + 1;
+        const int position = m_proxyToSource.size();
+        beginInsertRows(QModelIndex(), position, position + count - 1);
+        for (int &row : m_proxyToSource) {
+            if (row >= first) row += count;
+        }
+        for (int row = first; row <= last; ++row) m_proxyToSource.append(row);
+        rebuildSourceToProxy();
+        endInsertRows();
+    }
+    updateAfterStructureChange();
+}
+
+void TableSortFilterModel::onSourceRowsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) return;
+    ++m_generation;
+    m_removingRows = false;
+    m_resetOnRemove = false;
+    if (m_identity) {
+        beginRemoveRows(QModelIndex(), first, last);
+        return;
+    }
+
+    // В отсортированном виде удаляемые строки могут быть разбросаны: один блок
+    // удаляется обычным образом, несколько - сбросом модели. Отображение меняется
+    // в onSourceRowsRemoved, когда строк нет и в источнике
+    int low = -1;
+    int high = -1;
+    int visible = 0;
+    for (int row = first; row <= last && row < m_sourceToProxy.size(); ++row) {
+        const int proxyRow = m_sourceToProxy[row];
+        if (proxyRow < 0) continue;
+        low = low < 0 ? proxyRow : qMin(low, proxyRow);
+        high = qMax(high, proxyRow);
+        ++visible;
+    }
+    if (visible == 0) return;
+    if (high - low + 1 == visible) {
+        m_removingRows = true;
+        beginRemoveRows(QModelIndex(), low, high);
+    } else {
+        m_resetOnRemove = true;
+        beginResetModel();
+    }
+}
+
+void TableSortFilterModel::onSourceRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) return;
+    shiftRows(first, -(last - first + 1));
+    if (m_identity) {
+        endRemoveRows();
+        updateAfterStructureChange();
+        return;
+    }
+
+    const int count = last - first + 1;
+    QVector<int> rows;
+    rows.reserve(m_proxyToSource.size());
+    for (int row : m_proxyToSource) {
+        if (row >= first && row <= last) continue;
+        rows.append(row > last ? row - count : row);
+    }
+    m_proxyToSource = rows;
+    rebuildSourceToProxy();
+
+    if (m_removingRows) {
+        m_removingRows = false;
+        endRemoveRows();
+    } else if (m_resetOnRemove) {
+        m_resetOnRemove = false;
+        endResetModel();
+    }
+    updateAfterStructureChange();
+}
+
+void TableSortFilterModel::onSourceColumnsAboutToBeInserted(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) return;
+    ++m_generation;
+    beginInsertColumns(QModelIndex(), first, last);
+}
+
+void TableSortFilterModel::onSourceColumnsInserted(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) return;
+    shiftColumns(first, last - first + 1);
+    endInsertColumns();
+    updateAfterStructureChange();
+}
+
+void TableSortFilterModel::onSourceColumnsAboutToBeRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) return;
+    ++m_generation;
+    beginRemoveColumns(QModelIndex(), first, last);
+}
+
+void TableSortFilterModel::onSourceColumnsRemoved(const QModelIndex &parent, int first, int last)
+{
+    if (parent.isValid()) return;
+    shiftColumns(first, -(last - first + 1));
+    endRemoveColumns();
+    updateAfterStructureChange();
+}
+
+void TableSortFilterModel::onSourceAboutToBeReset()
+{
+    ++m_generation;
+    beginResetModel();
+}
+
+void TableSortFilterModel::onSourceReset()
+{
+    invalidateCaches();
+    setIdentity();
+    endResetModel();
+
+    // Новое содержимое сортируется и фильтруется по прежним правилам
+    updateAfterStructureChange();
+}
+
+void TableSortFilterModel::updateAfterStructureChange()
+{
+    // Изменение строк/столбцов отбрасывает результат идущей задачи (m_generation),
+    // поэтому сортировка и фильтр запрашиваются заново
+    if (!m_sortKeys.isEmpty() || !m_filters.isEmpty()) requestUpdate();
+}
@@ -0,0 +1,157 @@
+#include "TableUndoLog.h"
+
+namespace {
+    qint64 variantMemory(const QVariant &value)
+    {
+        qint64 total = static_cast<qint64>(sizeof(QVariant));
+        if (value.typeId() == QMetaType::QString) {
+            total += static_cast<qint64>(value.toString().size()) * static_cast<qint64>(sizeof(QChar));
+        }
+        return total;
+    }
+}
+
+qint64 TableUndoOperation::memoryUsage() const
+{
+    qint64 total = static_cast<qint64>(sizeof(TableUndoOperation));
+    total += static_cast<qint64>(values.capacity()) * static_cast<qint64>(sizeof(int));
+    total += static_cast<qint64>(cells.capacity()) * static_cast<qint64>(sizeof(QPoint));
+    total += static_cast<qint64>(columnTypes.capacity()) * static_cast<qint64>(sizeof(int));
+    total += static_cast<qint64>(columnIds.capacity()) * static_cast<qint64>(sizeof(qint64));
+    for (const auto &value : values) {
+        total += variantMemory(value.second);
+    }
+    for (const QString &header : headers) {
+        total += static_cast<qint64>(sizeof(QString)) + header.size() * static_cast<qint64>(sizeof(QChar));
+    }
+    for (const QString &formula : formulas) {
+        total += static_cast<qint64>(sizeof(QString)) + formula.size() * static_cast<qint64>(sizeof(QChar));
+    }
+    return total;
+}
+
+qint64 TableUndoStep::memoryUsage() const
+{
+    qint64 total = static_cast<qint64>(sizeof(TableUndoStep));
+    for (const auto &operation : operations) {
+        total += operation.memoryUsage();
+    }
+    return total;
+}
+
+void TableUndoLog::setMemoryLimit(qint64 bytes)
+{
+    m_memoryLimit = qMax<qint64>(0, bytes);
+    trim();
+}
+
+void TableUndoLog::clear()
+{
+    m_undo.clear();
+    m_redo.clear();
+    m_memoryUsage = 0;
+}
+
+void TableUndoLog::record(const TableUndoOperation &operation)
+{
+    for (const auto &step : m_redo) {
+        m_memoryUsage -= step.memoryUsage();
+    }
+    m_redo.clear();
+
+    TableUndoStep step;
+    step.operations.append(operation);
+    m_memoryUsage += step.memoryUsage();
+    m_undo.push(step);
+    trim();
+}
+
+void TableUndoLog::appendToLast(const TableUndoOperation &operation)
+{
+    if (m_undo.isEmpty()) {
+        record(operation);
+        return;
+    }
+
+    TableUndoStep &step = m_undo.top();
+    if (!step.operations.isEmpty() && step.operations.last().kind == TableUndoOperation::Kind::Cells
+        && operation.kind == TableUndoOperation::Kind::Cells) {
+        TableUndoOperation &last = step.operations.last();
+        const qint64 before = last.memoryUsage();
+        if (mergeCells(last, operation)) {
+            m_memoryUsage += last.memoryUsage() - before;
+            trim();
+            return;
+        }
+    }
+    step.operations.append(operation);
+    m_memoryUsage += operation.memoryUsage();
+    trim();
+}
+
+bool TableUndoLog::mergeCells(TableUndoOperation &target, const TableUndoOperation &operation)
+{
+    if (operation.rowCount != 1 || operation.columnCount != 1) return false;
+
+    // Повторная правка той же ячейки: исходное значение уже сохранено
+    if (operation.row >= target.row && operation.row < target.row + target.rowCount
+        && operation.column >= target.column && operation.column < target.column + target.columnCount) {
+        return true;
+    }
+
+    // Продолжение полосы вправо (Tab) или вниз (Enter): смещения прежних значений не меняются
+    int offset = -1;
+    if (target.rowCount == 1 && operation.row == target.row && operation.column == target.column + target.columnCount) {
+        offset = target.columnCount++;
+    } else if (target.columnCount == 1 && operation.column == target.column && operation.row == target.row + target.rowCount) {
+        offset = target.rowCount++;
+    }
+    if (offset < 0) return false;
+
+    if (!operation.values.isEmpty()) {
+        target.values.append({offset, operation.values.first().second});
+    }
+    return true;
+}
+
+TableUndoStep TableUndoLog::takeUndo()
+{
+    TableUndoStep step = m_undo.pop();
+    m_memoryUsage -= step.memoryUsage();
+    return step;
+}
+
+void TableUndoLog::pushUndo(TableUndoStep step)
+{
+    m_memoryUsage += step.memoryUsage();
+    m_undo.push(std::move(step));
+    trim();
+}
+
+TableUndoStep TableUndoLog::takeRedo()
+{
+    TableUndoStep step = m_redo.pop();
+    m_memoryUsage -= step.memoryUsage();
+    return step;
+}
+
+void TableUndoLog::pushRedo(TableUndoStep step)
+{
+    m_memoryUsage += step.memoryUsage();
+    m_redo.push(std::move(step));
+    trim();
+}
+
+void TableUndoLog::trim()
+{
+    // Сначала самые старые шаги отмены, затем самые дальние шаги повтора.
+    // Ближайший шаг (последний undo или верхний redo) не отбрасывается
+    while (m_memoryUsage > m_memoryLimit && m_undo.size() > (m_redo.isEmpty() ? 1 : 0)) {
+        m_memoryUsage -= m_undo.first().memoryUsage();
+        m_undo.removeFirst();
+    }
+    while (m_memoryUsage > m_memoryLimit && m_redo.size() > 1) {
+        m_memoryUsage -= m_redo.first().memoryUsage();
+        m_redo.removeFirst();
+    }
+}
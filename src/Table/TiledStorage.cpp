@@ -0,0 +1,417 @@
+#include "TiledStorage.h"
+#include <QTemporaryFile>
+#include <QDataStream>
+#include <QByteArray>
+#include <QDir>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+    constexpr int TileCells = TiledStorage::TileRows * TiledStorage::TileColumns;
+    // Файл переписывается, когда мусор (старые версии плиток) больше половины и больше порога
+    constexpr qint64 CompactGarbageBytes = 64ll * 1024 * 1024;
+
+    std::unique_ptr<QTemporaryFile> openSpillFile()
+    {
+        auto file = std::make_unique<QTemporaryFile>(QDir::tempPath() + "/sheet-tiles-XXXXXX");
+        if (!file->open()) {
+            qWarning() << "tile spill file open failed:" << file->errorString();
+            return nullptr;
+        }
+        return file;
+    }
+}
+
+TiledStorage::TiledStorage(qint64 memoryBudget)
+    : m_memoryBudget(qMax<qint64>(memoryBudget, 0))
+{
+}
+
+TiledStorage::~TiledStorage() = default;
+
+qint64 TiledStorage::valueBytes(const QVariant &value)
+{
+    if (value.metaType().id() != QMetaType::QString) return 0;
+    return static_cast<const QString *>(value.constData())->capacity() * qint64(sizeof(QChar));
+}
+
+QVariant TiledStorage::value(int row, int column) const
+{
+    const int rowSlot = m_rowSlots[row];
+    const int columnSlot = m_columnSlots[column];
+    QMutexLocker locker(&m_mutex);
+    const Tile *tile = findTile(tileKey(rowSlot, columnSlot));
+    return tile ? tile->cells[cellIndex(rowSlot, columnSlot)] : QVariant();
+}
+
+void TiledStorage::setValue(int row, int column, const QVariant &value)
+{
+    const int rowSlot = m_rowSlots[row];
+    const int columnSlot = m_columnSlots[column];
+    const quint64 key = tileKey(rowSlot, columnSlot);
+    QMutexLocker locker(&m_mutex);
+
+    Tile *tile = findTile(key);
+    if (!tile) {
+        if (!value.isValid()) return;
+        tile = createTile(key);
+    }
+    QVariant &cell = tile->cells[cellIndex(rowSlot, columnSlot)];
+    if (!cell.isValid() && !value.isValid()) return;
+
+    const qint64 delta = valueBytes(value) - valueBytes(cell);
+    const int filledDelta = int(value.isValid()) - int(cell.isValid());
+    cell = value;
+    tile->bytes += delta;
+    m_residentBytes += delta;
+    tile->filled += filledDelta;
+    m_filledCells += filledDelta;
+    tile->dirty = true;
+
+    if (tile->filled == 0) {
+        dropTile(key);
+    } else if (delta > 0) {
+        evictOverBudget(tile);
+    }
+}
+
+void TiledStorage::insertRows(int row, int count)
+{
+    QMutexLocker locker(&m_mutex);
+    std::vector<int> slots;
+    slots.reserve(count);
+    for (int i = 0; i < count; ++i) slots.push_back(takeSlot(true));
+    m_rowSlots.insert(m_rowSlots.begin() + row, slots.begin(), slots.end());
+}
+
+void TiledStorage::removeRows(int row, int count)
+{
+    QMutexLocker locker(&m_mutex);
+    std::vector<int> slots(m_rowSlots.begin() + row, m_rowSlots.begin() + row + count);
+    m_rowSlots.erase(m_rowSlots.begin() + row, m_rowSlots.begin() + row + count);
+    clearSlots(slots, true);
+    m_freeRowSlots.insert(m_freeRowSlots.end(), slots.begin(), slots.end());
+}
+
+void TiledStorage::insertColumns(int column, int count)
+{
+    QMutexLocker locker(&m_mutex);
+    std::vector<int> slots;
+    slots.reserve(count);
+    for (int i = 0; i < count; ++i) slots.push_back(takeSlot(false));
+    m_columnSlots.insert(m_columnSlots.begin() + column, slots.begin(), slots.end());
+}
+
+void TiledStorage::removeColumns(int column, int count)
+{
+    QMutexLocker locker(&m_mutex);
+    std::vector<int> slots(m_columnSlots.begin() + column, m_columnSlots.begin() + column + count);
+    m_columnSlots.erase(m_columnSlots.begin() + column, m_columnSlots.begin() + column + count);
+    clearSlots(slots, false);
+    m_freeColumnSlots.insert(m_freeColumnSlots.end(), slots.begin(), slots.end());
+}
+
+void TiledStorage::forEachValue(const std::function<void(int row, int column, const QVariant &value)> &visitor) const
+{
+    QMutexLocker locker(&m_mutex);
+    // Полоса столбцов обходится по строкам: плитки полосы читаются с диска по одному разу
+    for (int first = 0; first < columnCount(); first += TileColumns) {
+        const int last = qMin(first + TileColumns, columnCount());
+        for (int row = 0; row < rowCount(); ++row) {
+            const int rowSlot = m_rowSlots[row];
+            quint64 currentKey = ~quint64(0);
+            const Tile *tile = nullptr;
+            for (int column = first; column < last; ++column) {
+                const int columnSlot = m_columnSlots[column];
+                const quint64 key = tileKey(rowSlot, columnSlot);
+                if (key != currentKey) {
+                    tile = findTile(key);
+                    currentKey = key;
+                }
+                if (!tile) continue;
+                const QVariant &value = tile->cells[cellIndex(rowSlot, columnSlot)];
+                if (value.isValid()) visitor(row, column, value);
+            }
+        }
+    }
+}
+
+qint64 TiledStorage::memoryUsage() const
+{
+    QMutexLocker locker(&m_mutex);
+    const qint64 slots = qint64(m_rowSlots.capacity() + m_columnSlots.capacity()
+                                + m_freeRowSlots.capacity() + m_freeColumnSlots.capacity()) * qint64(sizeof(int));
+    const qint64 index = qint64(m_tiles.size() + m_spilled.size()) * 4 * qint64(sizeof(void *));
+    return m_residentBytes + slots + index;
+}
+
+void TiledStorage::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_memoryBudget = qMax<qint64>(bytes, 0);
+    evictOverBudget(nullptr);
+}
+
+void TiledStorage::prefetch(int firstRow, int lastRow, int firstColumn, int lastColumn) const
+{
+    firstRow = qMax(firstRow, 0);
+    firstColumn = qMax(firstColumn, 0);
+    lastRow = qMin(lastRow, rowCount() - 1);
+    lastColumn = qMin(lastColumn, columnCount() - 1);
+    if (firstRow > lastRow || firstColumn > lastColumn) return;
+
+    std::vector<quint64> keys;
+    for (int row = firstRow; row <= lastRow; ++row) {
+        for (int column = firstColumn; column <= lastColumn; ++column) {
+            keys.push_back(tileKey(m_rowSlots[row], m_columnSlots[column]));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    // Мьютекс берется на каждую плитку: чтение ячеек из интерфейса ждет не дольше одной плитки
+    for (quint64 key : keys) {
+        QMutexLocker locker(&m_mutex);
+        if (m_tiles.count(key) || !m_spilled.count(key)) continue;
+        findTile(key, true);
+    }
+}
+
+TiledStorage::Metrics TiledStorage::metrics() const
+{
+    QMutexLocker locker(&m_mutex);
+    Metrics result = m_metrics;
+    result.residentTiles = qint64(m_tiles.size());
+    result.spilledTiles = qint64(m_spilled.size());
+    result.residentBytes = m_residentBytes;
+    result.spillFileBytes = m_file ? m_file->size() : 0;
+    return result;
+}
+
+TiledStorage::Tile *TiledStorage::findTile(quint64 key, bool prefetching) const
+{
+    const auto it = m_tiles.find(key);
+    if (it != m_tiles.end()) {
+        ++m_metrics.hits;
+        touch(it->second.get());
+        return it->second.get();
+    }
+
+    const auto spilled = m_spilled.find(key);
+    if (spilled == m_spilled.end()) return nullptr;
+
+    auto tile = std::make_unique<Tile>();
+    if (!readTile(spilled->second, *tile)) {
+        qWarning() << "tile read failed at offset" << spilled->second.offset;
+        return nullptr;
+    }
+    tile->dirty = false;
+    if (prefetching) {
+        ++m_metrics.prefetched;
+    } else {
+        ++m_metrics.misses;
+    }
+
+    Tile *loaded = tile.get();
+    m_lru.push_front(key);
+    loaded->lru = m_lru.begin();
+    m_residentBytes += loaded->bytes;
+    m_tiles.emplace(key, std::move(tile));
+    evictOverBudget(loaded);
+    return loaded;
+}
+
+TiledStorage::Tile *TiledStorage::createTile(quint64 key)
+{
+    auto tile = std::make_unique<Tile>();
+    tile->cells.resize(TileCells);
+    tile->bytes = qint64(sizeof(Tile)) + TileCells * qint64(sizeof(QVariant));
+
+    Tile *created = tile.get();
+    m_lru.push_front(key);
+    created->lru = m_lru.begin();
+    m_residentBytes += created->bytes;
+    m_tiles.emplace(key, std::move(tile));
+    evictOverBudget(created);
+    return created;
+}
+
+void TiledStorage::dropTile(quint64 key)
+{
+    const auto it = m_tiles.find(key);
+    if (it != m_tiles.end()) {
+        m_residentBytes -= it->second->bytes;
+        m_lru.erase(it->second->lru);
+        m_tiles.erase(it);
+    }
+    const auto spilled = m_spilled.find(key);
+    if (spilled != m_spilled.end()) {
+        m_fileGarbage += spilled->second.size;
+        m_spilled.erase(spilled);
+    }
+}
+
+void TiledStorage::touch(Tile *tile) const
+{
+    m_lru.splice(m_lru.begin(), m_lru, tile->lru);
+}
+
+void TiledStorage::evictOverBudget(const Tile *keep) const
+{
+    while (m_residentBytes > m_memoryBudget && !m_lru.empty()) {
+        const quint64 key = m_lru.back();
+        Tile &tile = *m_tiles.at(key);
+        if (&tile == keep) break;
+        // Без файла плитки остаются в памяти сверх бюджета
+        if (tile.dirty && !spill(key, tile)) break;
+
+        m_residentBytes -= tile.bytes;
+        m_lru.pop_back();
+        m_tiles.erase(key);
+        ++m_metrics.evictions;
+    }
+}
+
+bool TiledStorage::spill(quint64 key, Tile &tile) const
+{
+    if (m_spillFailed) return false;
+    if (!m_file) {
+        m_file = openSpillFile();
+        if (!m_file) {
+            m_spillFailed = true;
+            return false;
+        }
+    }
+
+    // На диск пишутся только непустые ячейки: номер в плитке и значение
+    QByteArray buffer;
+    {
+        QDataStream out(&buffer, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_6_0);
+        out << qint32(tile.filled);
+        for (int i = 0; i < TileCells; ++i) {
+            if (tile.cells[i].isValid()) out << quint16(i) << tile.cells[i];
+        }
+    }
+
+    const qint64 offset = m_file->size();
+    if (!m_file->seek(offset) || m_file->write(buffer) != buffer.size()) {
+        qWarning() << "tile spill failed:" << m_file->errorString();
+        m_spillFailed = true;
+        return false;
+    }
+
+    const auto previous = m_spilled.find(key);
+    if (previous != m_spilled.end()) m_fileGarbage += previous->second.size;
+    m_spilled[key] = SpillRecord{offset, buffer.size()};
+    tile.dirty = false;
+    ++m_metrics.spills;
+
+    if (m_fileGarbage > CompactGarbageBytes && m_fileGarbage * 2 > m_file->size()) compactFile();
+    return true;
+}
+
+bool TiledStorage::readTile(const SpillRecord &record, Tile &tile) const
+{
+    if (!m_file || !m_file->seek(record.offset)) return false;
+    const QByteArray buffer = m_file->read(record.size);
+    if (buffer.size() != record.size) return false;
+
+    QDataStream in(buffer);
+    in.setVersion(QDataStream::Qt_6_0);
+    qint32 filled = 0;
+    in >> filled;
+    if (filled < 0 || filled > TileCells) return false;
+
+    tile.cells.assign(TileCells, QVariant());
+    tile.bytes = qint64(sizeof(Tile)) + TileCells * qint64(sizeof(QVariant));
+    for (qint32 i = 0; i < filled; ++i) {
+        quint16 index = 0;
+        QVariant value;
+        in >> index >> value;
+        if (in.status() != QDataStream::Ok || index >= TileCells) return false;
+        tile.bytes += valueBytes(value);
+        tile.cells[index] = std::move(value);
+    }
+    tile.filled = filled;
+    return true;
+}
+
+void TiledStorage::compactFile() const
+{
+    std::unique_ptr<QTemporaryFile> compacted = openSpillFile();
+    if (!compacted) return;
+
+    std::unordered_map<quint64, SpillRecord> records;
+    records.reserve(m_spilled.size());
+    for (const auto &[key, record] : m_spilled) {
+        if (!m_file->seek(record.offset)) return;
+        const QByteArray buffer = m_file->read(record.size);
+        const qint64 offset = compacted->pos();
+        if (buffer.size() != record.size || compacted->write(buffer) != buffer.size()) {
+            qWarning() << "tile spill compaction failed:" << compacted->errorString();
+            return;
+        }
+        records.emplace(key, SpillRecord{offset, record.size});
+    }
+
+    m_file = std::move(compacted);
+    m_spilled = std::move(records);
+    m_fileGarbage = 0;
+}
+
+void TiledStorage::clearSlots(std::vector<int> slots, bool rows)
+{
+    if (slots.empty()) return;
+    std::sort(slots.begin(), slots.end());
+
+    // Плитки (в памяти и на диске), которые пересекают удаленные слоты
+    auto tileIndex = [rows](quint64 key) { return rows ? int(key >> 32) : int(key & 0xffffffffu); };
+    auto touchesSlots = [&slots, rows](int index) {
+        const int size = rows ? TileRows : TileColumns;
+        const auto it = std::lower_bound(slots.begin(), slots.end(), index * size);
+        return it != slots.end() && *it < (index + 1) * size;
+    };
+    std::vector<quint64> keys;
+    for (const auto &entry : m_tiles) {
+        if (touchesSlots(tileIndex(entry.first))) keys.push_back(entry.first);
+    }
+    for (const auto &entry : m_spilled) {
+        if (!m_tiles.count(entry.first) && touchesSlots(tileIndex(entry.first))) keys.push_back(entry.first);
+    }
+
+    for (quint64 key : keys) {
+        Tile *tile = findTile(key);
+        if (!tile) continue;
+        const int index = tileIndex(key);
+        const int size = rows ? TileRows : TileColumns;
+        for (auto it = std::lower_bound(slots.begin(), slots.end(), index * size);
+             it != slots.end() && *it < (index + 1) * size; ++it) {
+            for (int other = 0; other < (rows ? TileColumns : TileRows); ++other) {
+                QVariant &cell = rows ? tile->cells[(*it % TileRows) * TileColumns + other]
+                                      : tile->cells[other * TileColumns + *it % TileColumns];
+                if (!cell.isValid()) continue;
+                const qint64 bytes = valueBytes(cell);
+                tile->bytes -= bytes;
+                m_residentBytes -= bytes;
+                cell = QVariant();
+                --tile->filled;
+                --m_filledCells;
+                tile->dirty = true;
+            }
+        }
+        if (tile->filled == 0) dropTile(key);
+    }
+}
+
+int TiledStorage::takeSlot(bool rows)
+{
+    std::vector<int> &freeSlots = rows ? m_freeRowSlots : m_freeColumnSlots;
+    if (!freeSlots.empty()) {
+        const int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    return rows ? m_physicalRows++ : m_physicalColumns++;
+}
@@ -1,16 +1,41 @@
 #include "LTreeWidget.h"
 #include <qcontainerfwd.h>
 #include <QMessageBox>
+#include <QHeaderView>
+#include "TreeSnapshot.h"
+#include "OrderKey.h"
+#include "TreeTransfer.h"
+#include <QFile>
+#include <QFileDialog>
 
 struct TreeStruct
 {
     QString name;
     QString parent_id;
     QString id;
+    qint64 version = 0;
+    QString order_key;
 };
+
+namespace {
+    bool isRootParentId(const QString &parentId)
+    {
+        return parentId.isEmpty() || parentId == "0" || parentId == "NULL";
+    }
+
+    // Порядок братьев: ключ order_key, при равных ключах - id
+    bool siblingOrderLess(const QTreeWidgetItem *a, const QTreeWidgetItem *b)
+    {
+        const QString keyA = a->data(0, LTreeWidget::OrderKeyRole).toString();
+        const QString keyB = b->data(0, LTreeWidget::OrderKeyRole).toString();
+        if (keyA != keyB) return keyA < keyB;
+        return a->data(0, LTreeWidget::NodeIdRole).toLongLong() < b->data(0, LTreeWidget::NodeIdRole).toLongLong();
+    }
+}
 LTreeWidget::LTreeWidget(QWidget *parent) : QTreeWidget(parent), dbInit(nullptr)
 {
     setupContextMenu();
+    setupSearch();
     // Не инициализируем дерево, так как нет имени таблицы и менеджера БД
 }
 
@@ -18,9 +43,24 @@ LTreeWidget::LTreeWidget(QString tableName,QWidget *parent, DatabaseManager *dbI
 {
     m_tableName = tableName;
     setupContextMenu();
+    setupSearch();
+
+    snapshotTimer = new QTimer(this);
+    snapshotTimer->setSingleShot(true);
+    snapshotTimer->setInterval(SnapshotDelayMs);
+    connect(snapshotTimer, &QTimer::timeout, this, &LTreeWidget::saveSnapshot);
+
+    // Колонка 0 - имя узла, колонка 1 - число потомков
+    setColumnCount(2);
+    header()->setStretchLastSection(false);
+    header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    header()->setSectionResizeMode(1, QHeaderView::Fixed);
+    header()->resizeSection(1, 56);
+
     iniTree(tableName);
 
     setHeaderHidden(true);
+    setDragDropMode(QAbstractItemView::InternalMove);
     // Подключаем сигналы
     connect(this, &QTreeWidget::itemClicked, this, &LTreeWidget::onItemClicked);
     connect(this, &QTreeWidget::itemDoubleClicked, this, &LTreeWidget::onItemDoubleClicked);
@@ -32,6 +72,7 @@ LTreeWidget::LTreeWidget(QString tableName,QWidget *parent, DatabaseManager *dbI
 
 LTreeWidget::~LTreeWidget()
 {
+    saveSnapshot();
 }
 
 void LTreeWidget::setupContextMenu()
@@ -42,34 +83,67 @@ void LTreeWidget::setupContextMenu()
     deleteAction = contextMenu->addAction("Удалить");
     renameAction = contextMenu->addAction("Переименовать");
     addRootAction = contextMenu->addAction("Добавить корневой элемент");
+    contextMenu->addSeparator();
+    importAction = contextMenu->addAction("Импорт...");
+    exportAction = contextMenu->addAction("Экспорт...");
 
     connect(addChildAction, &QAction::triggered, this, &LTreeWidget::onAddChild);
     connect(deleteAction, &QAction::triggered, this, &LTreeWidget::onDeleteNode);
     connect(renameAction, &QAction::triggered, this, &LTreeWidget::onRenameNode);
     connect(addRootAction, &QAction::triggered, this, &LTreeWidget::addNodeToRoot);
+    connect(importAction, &QAction::triggered, this, &LTreeWidget::onImportTree);
+    connect(exportAction, &QAction::triggered, this, &LTreeWidget::onExportTree);
 }
 
 void LTreeWidget::iniTree(QString tableName)
 {
-    QList<QSqlRecord> records = dbInit->getReader()->selectAll(tableName);
+    // Счетчик читаем до данных: изменение между чтениями сделает снимок устаревшим, но не неверным
+    const qint64 changeCounter = readChangeCounter();
     std::vector<TreeStruct> treeNodes;
-    for(const auto &record : records) {
-        TreeStruct tmp;
-        tmp.name = record.value("name").toString();
-        tmp.parent_id = record.value("parent_id").toString();
-        tmp.id = record.value("id").toString();
-        treeNodes.push_back(tmp);
+
+    QList<TreeSnapshot::Node> snapshotNodes;
+    if (changeCounter >= 0 && TreeSnapshot::read(snapshotPath(), changeCounter, snapshotNodes)) {
+        treeNodes.reserve(snapshotNodes.size());
+        for (const auto &node : snapshotNodes) {
+            TreeStruct tmp;
+            tmp.name = node.name;
+            tmp.parent_id = QString::number(node.parentId);
+            tmp.id = QString::number(node.id);
+            tmp.version = node.version;
+            tmp.order_key = node.orderKey;
+            treeNodes.push_back(tmp);
+        }
+    } else {
+        QList<QSqlRecord> records = dbInit->getReader()->selectAll(tableName);
+        for(const auto &record : records) {
+            TreeStruct tmp;
+            tmp.name = record.value("name").toString();
+            tmp.parent_id = record.value("parent_id").toString();
+            tmp.id = record.value("id").toString();
+            tmp.version = record.value("version").toLongLong();
+            tmp.order_key = record.value("order_key").toString();
+            treeNodes.push_back(tmp);
+        }
+        // Следующий запуск сможет обойтись без чтения таблицы
+        if (changeCounter >= 0) snapshotTimer->start();
     }
+    syncedChangeCounter = changeCounter;
 
+    // Внутри родителя - по ключу порядка, чтобы addChild() сразу строил нужный порядок братьев
     std::sort(treeNodes.begin(), treeNodes.end(), [](const TreeStruct &a, const TreeStruct &b) {
-        return a.parent_id < b.parent_id;
+        if (a.parent_id != b.parent_id) return a.parent_id < b.parent_id;
+        if (a.order_key != b.order_key) return a.order_key < b.order_key;
+        return a.id.toLongLong() < b.id.toLongLong();
     });
         // Сначала создаем все элементы
         for(const auto &node : treeNodes) {
             std::shared_ptr<QTreeWidgetItem> item = std::make_shared<QTreeWidgetItem>();
             item->setText(0, node.name);
             item->setData(0, Qt::UserRole, node.parent_id); // Сохраняем ID в данных элемента
+            item->setData(0, NodeIdRole, node.id);
+            item->setData(0, OrderKeyRole, node.order_key);
             itemMap[node.id] = item;
+            nodeVersions[node.id] = node.version;
         }
 
         // Затем строим иерархию
@@ -87,6 +161,11 @@ void LTreeWidget::iniTree(QString tableName)
             }
         }
 
+        // Один проход в глубину вместо подсчета поддерева для каждого узла
+        for (int i = 0; i < topLevelItemCount(); ++i) {
+            recountSubtree(topLevelItem(i));
+        }
+
         // Включаем стрелочки для разворачивания/сворачивания
         setRootIsDecorated(true);
 }
@@ -183,6 +262,68 @@ void LTreeWidget::onRenameNode()
     }
 }
 
+void LTreeWidget::onImportTree()
+{
+    const QString filePath = QFileDialog::getOpenFileName(this, tr("Импорт"), QString(),
+                                                          tr("JSON Lines (*.jsonl);;Все файлы (*)"));
+    if (filePath.isEmpty()) return;
+
+    const int count = importTree(filePath, currentSelectedNodeId);
+    if (count >= 0) {
+        QMessageBox::information(this, tr("Импорт"), tr("Импортировано узлов: %1").arg(count));
+    }
+}
+
+void LTreeWidget::onExportTree()
+{
+    const QString filePath = QFileDialog::getSaveFileName(this, tr("Экспорт"), QString(),
+                                                          tr("JSON Lines (*.jsonl)"));
+    if (filePath.isEmpty()) return;
+
+    exportTree(filePath, currentSelectedNodeId);
+}
+
+int LTreeWidget::importTree(const QString &filePath, const QString &parentId)
+{
+    if (!dbInit) return -1;
+    if (!isRootParentId(parentId) && !itemMap.contains(parentId)) return -1;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QMessageBox::warning(this, tr("Ошибка"), file.errorString());
+        return -1;
+    }
+
+    TreeTransfer transfer(dbInit->getReader()->getConnectionName(), m_tableName);
+    const int count = transfer.importJsonLines(file, isRootParentId(parentId) ? 0 : parentId.toLongLong());
+
+    // Один проход refreshTree вместо обновления на каждый узел; при ошибке
+    // показывает и уже зафиксированные пакеты
+    refreshTree();
+    if (count < 0) {
+        QMessageBox::warning(this, tr("Ошибка"), transfer.getLastError());
+    }
+    return count;
+}
+
+int LTreeWidget::exportTree(const QString &filePath, const QString &nodeId)
+{
+    if (!dbInit) return -1;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QMessageBox::warning(this, tr("Ошибка"), file.errorString());
+        return -1;
+    }
+
+    TreeTransfer transfer(dbInit->getReader()->getConnectionName(), m_tableName);
+    const int count = transfer.exportJsonLines(file, isRootParentId(nodeId) ? 0 : nodeId.toLongLong());
+    if (count < 0) {
+        QMessageBox::warning(this, tr("Ошибка"), transfer.getLastError());
+    }
+    return count;
+}
+
 void LTreeWidget::addNodeToRoot()
 {
     bool ok = false;
@@ -199,45 +340,190 @@ void LTreeWidget::addNodeToRoot()
         return;
     }
 
+    insertNodeBetween(QString::number(0), QString(), QString(), name);
+}
+
+void LTreeWidget::addNodeToParent(const QString &parentId)
+{
+    if (!itemMap.contains(parentId)) return;
+
+    QString name = QInputDialog::getText(this, tr("Новый узел"), tr("Имя:"));
+    if (name.isEmpty()) return;
+
+    insertNodeBetween(parentId, QString(), QString(), name);
+}
+
+QString LTreeWidget::insertNodeBetween(const QString &parentId, const QString &previousId,
+                                       const QString &nextId, const QString &name)
+{
+    if (!dbInit || name.isEmpty()) return QString();
+    if (!isRootParentId(parentId) && !itemMap.contains(parentId)) return QString();
+
+    const QString orderKey = orderKeyBetween(parentId, previousId, nextId);
+    if (orderKey.isEmpty()) return QString();
+
     QVariantMap values;
     values["name"] = name;
-    values["parent_id"] = 0;
+    values["parent_id"] = isRootParentId(parentId) ? QString::number(0) : parentId;
+    values["order_key"] = orderKey;
 
+    const qint64 counterBefore = readChangeCounter();
     qint64 id = dbInit->getModifier()->insertRecordAndReturnId(m_tableName, values, "id");
     if (id < 0) {
         QMessageBox::warning(this, tr("Ошибка"), dbInit->getModifier()->getLastError());
-        return;
+        return QString();
     }
 
+    const QString nodeId = QString::number(id);
     auto item = std::make_shared<QTreeWidgetItem>();
     item->setText(0, name);
-    item->setData(0, Qt::UserRole, QString::number(0));
-    itemMap[QString::number(id)] = item;
-    addTopLevelItem(item.get());
+    item->setData(0, NodeIdRole, nodeId);
+    item->setData(0, OrderKeyRole, orderKey);
+    itemMap[nodeId] = item;
+    nodeVersions[nodeId] = 0;
+    attachToParent(nodeId, values["parent_id"].toString());
+    noteLocalChange(counterBefore);
+    return nodeId;
 }
 
-void LTreeWidget::addNodeToParent(const QString &parentId)
+bool LTreeWidget::moveNode(const QString &nodeId, const QString &newParentId,
+                           const QString &previousId, const QString &nextId)
 {
-    if (!itemMap.contains(parentId)) return;
+    if (!dbInit || !itemMap.contains(nodeId)) return false;
+    // Узел уже стоит рядом с указанным соседом
+    if (previousId == nodeId || nextId == nodeId) return true;
+
+    QTreeWidgetItem *item = itemMap[nodeId].get();
+    const QString parentId = isRootParentId(newParentId) ? QString::number(0) : newParentId;
+    if (!isRootParentId(parentId)) {
+        if (!itemMap.contains(parentId)) return false;
+        // Тот же запрет, что и в trg_tree_nodes_path_guard, но без обращения к БД
+        for (QTreeWidgetItem *ancestor = itemMap[parentId].get(); ancestor; ancestor = ancestor->parent()) {
+            if (ancestor == item) return false;
+        }
+    }
 
-    QString name = QInputDialog::getText(this, tr("Новый узел"), tr("Имя:"));
-    if (name.isEmpty()) return;
+    const QString orderKey = orderKeyBetween(parentId, previousId, nextId);
+    if (orderKey.isEmpty()) return false;
 
+    // Одна строка: ключ порядка и, при смене родителя, parent_id (пути поддерева правит триггер)
     QVariantMap values;
-    values["name"] = name;
-    values["parent_id"] = parentId;
+    values["order_key"] = orderKey;
+    const QString oldParentId = item->data(0, Qt::UserRole).toString();
+    const bool parentChanged = isRootParentId(oldParentId) != isRootParentId(parentId)
+                               || (!isRootParentId(parentId) && oldParentId != parentId);
+    if (parentChanged) {
+        values["parent_id"] = parentId;
+    }
 
-    qint64 id = dbInit->getModifier()->insertRecordAndReturnId(m_tableName, values, "id");
-    if (id < 0) {
+    const qint64 counterBefore = readChangeCounter();
+    if (!dbInit->getModifier()->updateRecordById(m_tableName, nodeId, values, "id")) {
         QMessageBox::warning(this, tr("Ошибка"), dbInit->getModifier()->getLastError());
+        return false;
+    }
+
+    // Перестановка сбрасывает раскрытие/выделение поддерева в представлении
+    QList<QTreeWidgetItem*> expanded;
+    QList<QTreeWidgetItem*> selected;
+    QTreeWidgetItem *current = currentItem();
+    collectViewState(item, expanded, selected);
+
+    item->setData(0, OrderKeyRole, orderKey);
+    nodeVersions[nodeId] += 1;
+    attachToParent(nodeId, parentChanged ? parentId : oldParentId);
+
+    for (QTreeWidgetItem *expandedItem : expanded) expandedItem->setExpanded(true);
+    for (QTreeWidgetItem *selectedItem : selected) selectedItem->setSelected(true);
+    if (current) setCurrentItem(current, 0, QItemSelectionModel::NoUpdate);
+
+    noteLocalChange(counterBefore);
+    return true;
+}
+
+QString LTreeWidget::orderKeyBetween(const QString &parentId, const QString &previousId, const QString &nextId) const
+{
+    // Соседи должны быть детьми parentId, иначе ключ оказался бы в чужом списке
+    auto siblingKey = [&](const QString &id, QString &key) {
+        if (id.isEmpty()) return true;
+        const auto it = itemMap.constFind(id);
+        if (it == itemMap.constEnd()) return false;
+        const QString siblingParent = it.value()->data(0, Qt::UserRole).toString();
+        if (isRootParentId(siblingParent) != isRootParentId(parentId)
+            || (!isRootParentId(parentId) && siblingParent != parentId)) {
+            return false;
+        }
+        key = it.value()->data(0, OrderKeyRole).toString();
+        return true;
+    };
+
+    QString previousKey;
+    QString nextKey;
+    if (!siblingKey(previousId, previousKey) || !siblingKey(nextId, nextKey)) {
+        return QString();
+    }
+
+    if (previousId.isEmpty() && nextId.isEmpty()) {
+        // Без соседей - в конец списка
+        QTreeWidgetItem *parent = isRootParentId(parentId) ? nullptr : itemMap.value(parentId).get();
+        const int count = parent ? parent->childCount() : topLevelItemCount();
+        if (count > 0) {
+            QTreeWidgetItem *last = parent ? parent->child(count - 1) : topLevelItem(count - 1);
+            previousKey = last->data(0, OrderKeyRole).toString();
+        }
+    }
+    return OrderKey::between(previousKey, nextKey);
+}
+
+void LTreeWidget::dropEvent(QDropEvent *event)
+{
+    QTreeWidgetItem *source = currentItem();
+    if (event->source() != this || !source) {
+        event->ignore();
         return;
     }
 
-    auto item = std::make_shared<QTreeWidgetItem>();
-    item->setText(0, name);
-    item->setData(0, Qt::UserRole, parentId);
-    itemMap[QString::number(id)] = item;
-    itemMap[parentId]->addChild(item.get());
+    const QString sourceId = source->data(0, NodeIdRole).toString();
+    QTreeWidgetItem *target = itemAt(event->position().toPoint());
+    QString parentId = QString::number(0);
+    QString previousId;
+    QString nextId;
+
+    auto siblingId = [this](QTreeWidgetItem *parent, int index) {
+        const int count = parent ? parent->childCount() : topLevelItemCount();
+        if (index < 0 || index >= count) return QString();
+        QTreeWidgetItem *sibling = parent ? parent->child(index) : topLevelItem(index);
+        return sibling->data(0, NodeIdRole).toString();
+    };
+
+    switch (target ? dropIndicatorPosition() : QAbstractItemView::OnViewport) {
+    case QAbstractItemView::OnItem:
+        parentId = target->data(0, NodeIdRole).toString();
+        previousId = siblingId(target, target->childCount() - 1);
+        break;
+    case QAbstractItemView::AboveItem:
+    case QAbstractItemView::BelowItem: {
+        QTreeWidgetItem *parent = target->parent();
+        const int index = parent ? parent->indexOfChild(target) : indexOfTopLevelItem(target);
+        if (parent) parentId = parent->data(0, NodeIdRole).toString();
+        if (dropIndicatorPosition() == QAbstractItemView::AboveItem) {
+            previousId = siblingId(parent, index - 1);
+            nextId = target->data(0, NodeIdRole).toString();
+        } else {
+            previousId = target->data(0, NodeIdRole).toString();
+            nextId = siblingId(parent, index + 1);
+        }
+        break;
+    }
+    case QAbstractItemView::OnViewport:
+        previousId = siblingId(nullptr, topLevelItemCount() - 1);
+        break;
+    }
+
+    moveNode(sourceId, parentId, previousId, nextId);
+
+    // Элемент уже переставлен moveNode(); базовая реализация удалила бы источник
+    event->setDropAction(Qt::IgnoreAction);
+    event->accept();
 }
 
 void LTreeWidget::deleteNode(const QString &nodeId)
@@ -254,6 +540,7 @@ void LTreeWidget::deleteNode(const QString &nodeId)
     QString parentId = itemMap[nodeId]->data(0, Qt::UserRole).toString();
 
     // В транзакции: перепривязываем детей к родителю удаляемого узла, затем удаляем узел
+    const qint64 counterBefore = readChangeCounter();
     bool ok = dbInit->getModifier()->executeInTransaction([&]{
         // Перепривязываем всех детей к родителю удаляемого узла
 
@@ -278,41 +565,27 @@ void LTreeWidget::deleteNode(const QString &nodeId)
     }
 
     // Обновляем UI: перепривязываем детей в дереве
-    QList<QTreeWidgetItem*> childrenToMove;
+    QStringList childrenToMove;
     for (auto it = itemMap.begin(); it != itemMap.end(); ++it) {
         if (it.value()->data(0, Qt::UserRole).toString() == nodeId) {
-            childrenToMove.append(it.value().get());
+            childrenToMove.append(it.key());
+            // Триггер в БД увеличил version перепривязанного ребенка
+            nodeVersions[it.key()] += 1;
         }
     }
 
-    for (QTreeWidgetItem* child : childrenToMove) {
-        // Удаляем из текущего родителя
-        if (child->parent()) {
-            child->parent()->removeChild(child);
-        } else {
-            takeTopLevelItem(indexOfTopLevelItem(child));
-        }
-
-        // Перепривязываем к новому родителю
-        if (parentId == "0") {
-            addTopLevelItem(child);
-        } else if (itemMap.contains(parentId)) {
-            itemMap[parentId]->addChild(child);
-        }
-
-        // Обновляем данные
-        child->setData(0, Qt::UserRole, parentId);
+    // attachToParent пересчитывает счетчики потомков по старой и новой цепочке предков
+    for (const QString &childId : childrenToMove) {
+        attachToParent(childId, parentId);
     }
 
     // Удаляем сам узел из UI
-    if (parentId == "0") {
-        takeTopLevelItem(indexOfTopLevelItem(itemMap[nodeId].get()));
-    } else if (itemMap.contains(parentId)) {
-        itemMap[parentId]->removeChild(itemMap[nodeId].get());
-    }
+    detachItem(itemMap[nodeId].get());
 
     // Удаляем из карты
     itemMap.remove(nodeId);
+    nodeVersions.remove(nodeId);
+    noteLocalChange(counterBefore);
 }
 
 void LTreeWidget::renameNode(const QString &nodeId)
@@ -325,10 +598,419 @@ void LTreeWidget::renameNode(const QString &nodeId)
                                          QLineEdit::Normal, current, &ok);
     if (!ok || name.isEmpty() || name == current) return;
 
+    const qint64 counterBefore = readChangeCounter();
     if (!dbInit->getModifier()->updateRecordById(m_tableName, nodeId, {{"name", name}}, "id")) {
         QMessageBox::warning(this, tr("Ошибка"), dbInit->getModifier()->getLastError());
         return;
     }
 
     itemMap[nodeId]->setText(0, name);
+    nodeVersions[nodeId] += 1;
+    noteLocalChange(counterBefore);
+}
+
+void LTreeWidget::detachItem(QTreeWidgetItem *item)
+{
+    if (!item) return;
+
+    // Поддерево уходит из-под текущих предков
+    adjustAncestorCounts(item, -(item->data(0, DescendantCountRole).toInt() + 1));
+
+    if (item->parent()) {
+        item->parent()->removeChild(item);
+        return;
+    }
+    const int topIndex = indexOfTopLevelItem(item);
+    if (topIndex >= 0) {
+        takeTopLevelItem(topIndex);
+    }
+}
+
+void LTreeWidget::attachToParent(const QString &childId, const QString &parentId)
+{
+    if (!itemMap.contains(childId)) return;
+
+    QTreeWidgetItem *child = itemMap[childId].get();
+    detachItem(child);
+    child->setData(0, Qt::UserRole, parentId);
+
+    if (isRootParentId(parentId)) {
+        insertTopLevelItem(orderedInsertIndex(nullptr, child), child);
+    } else if (itemMap.contains(parentId)) {
+        QTreeWidgetItem *parent = itemMap[parentId].get();
+        parent->insertChild(orderedInsertIndex(parent, child), child);
+        adjustAncestorCounts(child, child->data(0, DescendantCountRole).toInt() + 1);
+    }
+    // Родитель отсутствует - узел остается вне дерева, как и при iniTree()
+}
+
+int LTreeWidget::orderedInsertIndex(QTreeWidgetItem *parent, QTreeWidgetItem *child) const
+{
+    // Братья уже упорядочены - бинарный поиск позиции
+    int low = 0;
+    int high = parent ? parent->childCount() : topLevelItemCount();
+    while (low < high) {
+        const int mid = (low + high) / 2;
+        const QTreeWidgetItem *sibling = parent ? parent->child(mid) : topLevelItem(mid);
+        if (siblingOrderLess(sibling, child)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void LTreeWidget::adjustAncestorCounts(QTreeWidgetItem *item, int delta)
+{
+    if (!item || delta == 0) return;
+
+    for (QTreeWidgetItem *ancestor = item->parent(); ancestor; ancestor = ancestor->parent()) {
+        setItemDescendantCount(ancestor, ancestor->data(0, DescendantCountRole).toInt() + delta);
+    }
+}
+
+void LTreeWidget::setItemDescendantCount(QTreeWidgetItem *item, int count)
+{
+    item->setData(0, DescendantCountRole, count);
+    item->setText(1, count > 0 ? QString::number(count) : QString());
+    item->setTextAlignment(1, Qt::AlignRight | Qt::AlignVCenter);
+}
+
+int LTreeWidget::recountSubtree(QTreeWidgetItem *item)
+{
+    int count = 0;
+    for (int i = 0; i < item->childCount(); ++i) {
+        count += recountSubtree(item->child(i)) + 1;
+    }
+    setItemDescendantCount(item, count);
+    return count;
+}
+
+int LTreeWidget::descendantCount(const QString &nodeId) const
+{
+    const auto it = itemMap.constFind(nodeId);
+    if (it == itemMap.constEnd()) return 0;
+    return it.value()->data(0, DescendantCountRole).toInt();
+}
+
+void LTreeWidget::setShowDescendantCounts(bool show)
+{
+    setColumnHidden(1, !show);
+}
+
+bool LTreeWidget::isRoot(const QString &nodeId)
+{
+    if (!itemMap.contains(nodeId)) return false;
+
+    return isRootParentId(itemMap[nodeId]->data(0, Qt::UserRole).toString());
+}
+
+void LTreeWidget::collectViewState(QTreeWidgetItem *item, QList<QTreeWidgetItem*> &expanded,
+                                   QList<QTreeWidgetItem*> &selected) const
+{
+    if (!item) return;
+
+    if (item->isExpanded()) expanded.append(item);
+    if (item->isSelected()) selected.append(item);
+    for (int i = 0; i < item->childCount(); ++i) {
+        collectViewState(item->child(i), expanded, selected);
+    }
+}
+
+void LTreeWidget::refreshTree()
+{
+    if (!dbInit) return;
+
+    // Компактный снимок без лишних колонок
+    const qint64 changeCounter = readChangeCounter();
+    DataReader *reader = dbInit->getReader();
+    const QList<QSqlRecord> records = reader->selectCustom(
+        QString("SELECT id, parent_id, name, version, order_key FROM %1").arg(m_tableName));
+    if (!reader->getLastError().isEmpty()) {
+        qWarning() << "tree refresh failed:" << reader->getLastError();
+        return;
+    }
+
+    QHash<QString, TreeStruct> snapshot;
+    snapshot.reserve(records.size());
+    for (const auto &record : records) {
+        TreeStruct node;
+        node.id = record.value("id").toString();
+        node.parent_id = record.value("parent_id").toString();
+        node.name = record.value("name").toString();
+        node.version = record.value("version").toLongLong();
+        node.order_key = record.value("order_key").toString();
+        snapshot.insert(node.id, node);
+    }
+
+    QStringList removedIds;
+    for (auto it = itemMap.cbegin(); it != itemMap.cend(); ++it) {
+        if (!snapshot.contains(it.key())) {
+            removedIds.append(it.key());
+        }
+    }
+
+    // Новые узлы и узлы с изменившейся версией (переименование/перенос/перестановка)
+    QStringList attachIds;
+    for (auto it = snapshot.cbegin(); it != snapshot.cend(); ++it) {
+        const TreeStruct &node = it.value();
+        if (!itemMap.contains(node.id)) {
+            auto item = std::make_shared<QTreeWidgetItem>();
+            item->setText(0, node.name);
+            item->setData(0, NodeIdRole, node.id);
+            item->setData(0, OrderKeyRole, node.order_key);
+            itemMap[node.id] = item;
+            nodeVersions[node.id] = node.version;
+            attachIds.append(node.id);
+            continue;
+        }
+        if (nodeVersions.value(node.id, -1) == node.version) {
+            continue;
+        }
+        QTreeWidgetItem *item = itemMap[node.id].get();
+        if (item->text(0) != node.name) {
+            item->setText(0, node.name);
+        }
+        const bool reordered = item->data(0, OrderKeyRole).toString() != node.order_key;
+        if (reordered) {
+            item->setData(0, OrderKeyRole, node.order_key);
+        }
+        if (reordered || item->data(0, Qt::UserRole).toString() != node.parent_id) {
+            attachIds.append(node.id);
+        }
+        nodeVersions[node.id] = node.version;
+    }
+
+    syncedChangeCounter = changeCounter;
+    if (changeCounter >= 0) snapshotTimer->start();
+
+    if (attachIds.isEmpty() && removedIds.isEmpty()) {
+        return;
+    }
+
+    setUpdatesEnabled(false);
+
+    // Перенос элемента сбрасывает его раскрытие/выделение в представлении - запоминаем заранее
+    QList<QTreeWidgetItem*> expanded;
+    QList<QTreeWidgetItem*> selected;
+    QTreeWidgetItem *current = currentItem();
+    for (const QString &id : attachIds) {
+        collectViewState(itemMap[id].get(), expanded, selected);
+    }
+
+    for (const QString &id : attachIds) {
+        attachToParent(id, snapshot[id].parent_id);
+    }
+
+    for (const QString &id : removedIds) {
+        QTreeWidgetItem *item = itemMap[id].get();
+        detachItem(item);
+        // Оставшиеся дети без родителя в снимке не отображаются, как и при iniTree();
+        // отвязываем их, чтобы удаление элемента не удалило их вместе с ним
+        item->takeChildren();
+        if (current == item) current = nullptr;
+        expanded.removeAll(item);
+        selected.removeAll(item);
+        if (currentSelectedNodeId == id) currentSelectedNodeId.clear();
+        itemMap.remove(id);
+        nodeVersions.remove(id);
+    }
+
+    for (QTreeWidgetItem *item : expanded) item->setExpanded(true);
+    for (QTreeWidgetItem *item : selected) item->setSelected(true);
+    if (current) setCurrentItem(current, 0, QItemSelectionModel::NoUpdate);
+
+    setUpdatesEnabled(true);
+}
+
+void LTreeWidget::setupSearch()
+{
+    // Откладываем запрос, пока пользователь продолжает печатать
+    searchTimer = new QTimer(this);
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(SearchDebounceMs);
+    connect(searchTimer, &QTimer::timeout, this, &LTreeWidget::startSearch);
+}
+
+void LTreeWidget::setSearchText(const QString &text)
+{
+    const QString trimmed = text.trimmed();
+    if (trimmed == searchText) return;
+
+    searchText = trimmed;
+    ++searchGeneration; // страницы предыдущего поиска больше не нужны
+    searchTimer->start();
+}
+
+void LTreeWidget::setFilterMode(bool enabled)
+{
+    if (filterMode == enabled) return;
+    filterMode = enabled;
+
+    setUpdatesEnabled(false);
+    if (enabled && !searchText.isEmpty()) {
+        // Скрываем всё один раз, дальше открываем только совпадения и их предков
+        setAllItemsHidden(true);
+        filterHidesAll = true;
+        for (const QString &id : searchMatchIds) {
+            if (itemMap.contains(id)) revealWithAncestors(itemMap[id].get());
+        }
+    } else if (!enabled && filterHidesAll) {
+        setAllItemsHidden(false);
+        filterHidesAll = false;
+        revealedIds.clear();
+    }
+    setUpdatesEnabled(true);
+}
+
+void LTreeWidget::startSearch()
+{
+    clearSearchResults();
+    searchCursor = 0;
+
+    if (searchText.isEmpty()) {
+        if (filterHidesAll) {
+            setAllItemsHidden(false);
+            filterHidesAll = false;
+        }
+        emit searchFinished(0);
+        return;
+    }
+
+    if (filterMode && !filterHidesAll) {
+        setAllItemsHidden(true);
+        filterHidesAll = true;
+    }
+    fetchSearchPage();
+}
+
+void LTreeWidget::fetchSearchPage()
+{
+    if (!dbInit || searchText.isEmpty()) return;
+
+    DataReader *reader = dbInit->getReader();
+    const QList<QSqlRecord> records = reader->searchFullText(
+        m_tableName, m_tableName + "_fts", "name", searchText, searchCursor, SearchPageSize);
+    if (!reader->getLastError().isEmpty()) {
+        qWarning() << "tree search failed:" << reader->getLastError();
+        return;
+    }
+
+    QStringList pageIds;
+    for (const auto &record : records) {
+        searchCursor = record.value("id").toLongLong();
+        const QString id = record.value("id").toString();
+        if (!itemMap.contains(id)) continue;
+
+        QTreeWidgetItem *item = itemMap[id].get();
+        setItemHighlighted(item, true);
+        if (filterHidesAll) revealWithAncestors(item);
+        pageIds.append(id);
+    }
+    searchMatchIds.append(pageIds);
+    if (!pageIds.isEmpty()) emit searchMatchesFound(pageIds);
+
+    if (records.size() < SearchPageSize) {
+        emit searchFinished(searchMatchIds.size());
+        return;
+    }
+
+    // Следующая страница - после обработки накопившихся событий ввода
+    const quint64 generation = searchGeneration;
+    QTimer::singleShot(0, this, [this, generation]() {
+        if (generation == searchGeneration) fetchSearchPage();
+    });
+}
+
+void LTreeWidget::clearSearchResults()
+{
+    for (const QString &id : searchMatchIds) {
+        if (itemMap.contains(id)) setItemHighlighted(itemMap[id].get(), false);
+    }
+    searchMatchIds.clear();
+
+    // Возвращаем дерево к состоянию "всё скрыто" за O(открытых), а не O(всех узлов)
+    if (filterHidesAll) {
+        for (const QString &id : revealedIds) {
+            if (itemMap.contains(id)) itemMap[id]->setHidden(true);
+        }
+    }
+    revealedIds.clear();
+}
+
+void LTreeWidget::setAllItemsHidden(bool hidden)
+{
+    for (auto it = itemMap.cbegin(); it != itemMap.cend(); ++it) {
+        it.value()->setHidden(hidden);
+    }
+}
+
+void LTreeWidget::revealWithAncestors(QTreeWidgetItem *item)
+{
+    // Поднимаемся до первого уже открытого предка - общие ветки не обходятся повторно
+    bool isMatch = true;
+    for (QTreeWidgetItem *current = item; current; current = current->parent()) {
+        const QString id = current->data(0, NodeIdRole).toString();
+        const bool alreadyRevealed = revealedIds.contains(id);
+        current->setHidden(false);
+        if (!isMatch) current->setExpanded(true);
+        revealedIds.insert(id);
+        if (alreadyRevealed) break;
+        isMatch = false;
+    }
+}
+
+void LTreeWidget::setItemHighlighted(QTreeWidgetItem *item, bool highlighted)
+{
+    QFont font = item->font(0);
+    font.setBold(highlighted);
+    item->setFont(0, font);
+}
+
+qint64 LTreeWidget::readChangeCounter() const
+{
+    if (!dbInit) return -1;
+
+    const QList<QSqlRecord> records = dbInit->getReader()->selectCustom(
+        QString("SELECT change_counter FROM %1_state WHERE id = 1").arg(m_tableName));
+    if (records.isEmpty()) return -1;
+    return records.first().value(0).toLongLong();
+}
+
+void LTreeWidget::noteLocalChange(qint64 counterBefore)
+{
+    // Если до нашей операции БД не менялась извне, дерево по-прежнему совпадает с БД
+    if (counterBefore >= 0 && counterBefore == syncedChangeCounter) {
+        syncedChangeCounter = readChangeCounter();
+    } else {
+        syncedChangeCounter = -1;
+    }
+    if (syncedChangeCounter >= 0 && snapshotTimer) snapshotTimer->start();
+}
+
+QString LTreeWidget::snapshotPath() const
+{
+    const QString databasePath = QSqlDatabase::database(dbInit->getReader()->getConnectionName()).databaseName();
+    return databasePath + "." + m_tableName + ".snapshot";
+}
+
+void LTreeWidget::saveSnapshot()
+{
+    if (!dbInit || syncedChangeCounter < 0) return;
+    // Таблицу меняли мимо виджета - такой снимок не соответствовал бы счетчику
+    if (readChangeCounter() != syncedChangeCounter) return;
+
+    QList<TreeSnapshot::Node> nodes;
+    nodes.reserve(itemMap.size());
+    for (auto it = itemMap.cbegin(); it != itemMap.cend(); ++it) {
+        TreeSnapshot::Node node;
+        node.id = it.key().toLongLong();
+        node.parentId = it.value()->data(0, Qt::UserRole).toString().toLongLong();
+        node.version = nodeVersions.value(it.key());
+        node.name = it.value()->text(0);
+        node.orderKey = it.value()->data(0, OrderKeyRole).toString();
+        nodes.append(node);
+    }
+    TreeSnapshot::write(snapshotPath(), syncedChangeCounter, nodes);
 }
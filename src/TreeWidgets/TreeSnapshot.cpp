@@ -0,0 +1,105 @@
+#include "TreeSnapshot.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QDebug>
+#include <cstring>
+#include <vector>
+
+bool TreeSnapshot::write(const QString &filePath, qint64 changeCounter, const QList<Node> &nodes)
+{
+    std::vector<NodeEntry> entries;
+    entries.reserve(nodes.size());
+    QString strings;
+    for (const Node &node : nodes) {
+        NodeEntry entry;
+        entry.id = node.id;
+        entry.parentId = node.parentId;
+        entry.version = node.version;
+        entry.nameOffset = static_cast<quint32>(strings.size());
+        entry.nameLength = static_cast<quint32>(node.name.size());
+        strings.append(node.name);
+        entry.orderKeyOffset = static_cast<quint32>(strings.size());
+        entry.orderKeyLength = static_cast<quint32>(node.orderKey.size());
+        strings.append(node.orderKey);
+        entries.push_back(entry);
+    }
+
+    Header header;
+    header.magic = Magic;
+    header.formatVersion = FormatVersion;
+    header.changeCounter = changeCounter;
+    header.nodeCount = static_cast<quint32>(entries.size());
+    header.stringUnits = static_cast<quint32>(strings.size());
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "tree snapshot: cannot open" << filePath << file.errorString();
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(entries.data()),
+               static_cast<qint64>(entries.size() * sizeof(NodeEntry)));
+    file.write(reinterpret_cast<const char *>(strings.constData()),
+               static_cast<qint64>(strings.size()) * static_cast<qint64>(sizeof(QChar)));
+    if (!file.commit()) {
+        qWarning() << "tree snapshot: cannot write" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool TreeSnapshot::read(const QString &filePath, qint64 expectedChangeCounter, QList<Node> &outNodes)
+{
+    QFile file(filePath);
+    if (!file.exists() || !file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 fileSize = file.size();
+    if (fileSize < static_cast<qint64>(sizeof(Header))) {
+        return false;
+    }
+
+    uchar *base = file.map(0, fileSize);
+    if (!base) {
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, base, sizeof(header));
+    const qint64 expectedSize = static_cast<qint64>(sizeof(Header))
+                                + static_cast<qint64>(header.nodeCount) * static_cast<qint64>(sizeof(NodeEntry))
+                                + static_cast<qint64>(header.stringUnits) * static_cast<qint64>(sizeof(QChar));
+    if (header.magic != Magic || header.formatVersion != FormatVersion
+        || header.changeCounter != expectedChangeCounter || expectedSize != fileSize) {
+        file.unmap(base);
+        return false;
+    }
+
+    // Заголовок кратен 8 байтам, а отображение выровнено по странице
+    const auto *entries = reinterpret_cast<const NodeEntry *>(base + sizeof(Header));
+    const auto *strings = reinterpret_cast<const QChar *>(base + sizeof(Header)
+                                                          + header.nodeCount * sizeof(NodeEntry));
+
+    outNodes.clear();
+    outNodes.reserve(header.nodeCount);
+    for (quint32 i = 0; i < header.nodeCount; ++i) {
+        const NodeEntry &entry = entries[i];
+        if (static_cast<quint64>(entry.nameOffset) + entry.nameLength > header.stringUnits
+            || static_cast<quint64>(entry.orderKeyOffset) + entry.orderKeyLength > header.stringUnits) {
+            outNodes.clear();
+            file.unmap(base);
+            return false;
+        }
+        Node node;
+        node.id = entry.id;
+        node.parentId = entry.parentId;
+        node.version = entry.version;
+        node.name = QString(strings + entry.nameOffset, static_cast<qsizetype>(entry.nameLength));
+        node.orderKey = QString(strings + entry.orderKeyOffset, static_cast<qsizetype>(entry.orderKeyLength));
+        outNodes.append(node);
+    }
+
+    file.unmap(base);
+    return true;
+}
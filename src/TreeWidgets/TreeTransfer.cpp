@@ -0,0 +1,232 @@
+#include "TreeTransfer.h"
+#include "OrderKey.h"
+#include "DataReader.h"
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonValue>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+namespace {
+    // id клиента может быть числом или строкой; пустая строка - отсутствует
+    QString clientId(const QJsonValue &value)
+    {
+        if (value.isString()) return value.toString();
+        if (value.isDouble()) return value.toVariant().toString();
+        return QString();
+    }
+
+    bool readNodeLine(const QByteArray &line, QJsonObject &outObject, QString &outError)
+    {
+        QJsonParseError parseError;
+        const QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+            outError = parseError.error != QJsonParseError::NoError ? parseError.errorString()
+                                                                     : QString("object expected");
+            return false;
+        }
+        outObject = document.object();
+        if (clientId(outObject.value("id")).isEmpty()) {
+            outError = "missing id";
+            return false;
+        }
+        if (outObject.value("name").toString().isEmpty()) {
+            outError = "missing name";
+            return false;
+        }
+        return true;
+    }
+}
+
+TreeTransfer::TreeTransfer(const QString &connectionName, const QString &tableName)
+    : m_connectionName(connectionName), m_tableName(tableName)
+{
+}
+
+QString TreeTransfer::getLastError() const
+{
+    return m_lastError;
+}
+
+QString TreeTransfer::lastChildOrderKey(qint64 parentId)
+{
+    QSqlQuery query(QSqlDatabase::database(m_connectionName));
+    // Читается по индексу (parent_id, order_key)
+    const QString condition = parentId == 0 ? "parent_id IS NULL OR parent_id = 0" : "parent_id = ?";
+    query.prepare(QString("SELECT MAX(order_key) FROM %1 WHERE %2").arg(m_tableName, condition));
+    if (parentId != 0) query.addBindValue(parentId);
+    if (!query.exec() || !query.next()) return QString();
+    return query.value(0).toString();
+}
+
+int TreeTransfer::importJsonLines(QIODevice &device, qint64 targetParentId)
+{
+    m_lastError.clear();
+    QSqlDatabase db = QSqlDatabase::database(m_connectionName);
+    if (!db.isValid() || !db.isOpen()) {
+        m_lastError = QString("Database is not open for connection '%1'").arg(m_connectionName);
+        return -1;
+    }
+    if (device.isSequential() || !device.isReadable()) {
+        m_lastError = "Import source must be a readable file";
+        return -1;
+    }
+
+    // Первый проход: проверка и число детей у каждого родителя ("" - целевой узел)
+    QSet<QString> seenIds;
+    QHash<QString, int> childCounts;
+    int lineNumber = 0;
+    while (!device.atEnd()) {
+        const QByteArray line = device.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty()) continue;
+
+        QJsonObject object;
+        QString error;
+        if (!readNodeLine(line, object, error)) {
+            m_lastError = QString("Line %1: %2").arg(lineNumber).arg(error);
+            return -1;
+        }
+        const QString id = clientId(object.value("id"));
+        if (seenIds.contains(id)) {
+            m_lastError = QString("Line %1: duplicate id %2").arg(lineNumber).arg(id);
+            return -1;
+        }
+        const QString parent = clientId(object.value("parent"));
+        ++childCounts[seenIds.contains(parent) ? parent : QString()];
+        seenIds.insert(id);
+    }
+    seenIds.clear();
+
+    if (!device.seek(0)) {
+        m_lastError = "Cannot rewind import source";
+        return -1;
+    }
+
+    QSqlQuery insert(db);
+    if (!insert.prepare(QString("INSERT INTO %1 (name, parent_id, order_key) VALUES (?, ?, ?)").arg(m_tableName))) {
+        m_lastError = insert.lastError().text();
+        return -1;
+    }
+
+    // Ключи порядка выдаются сразу на всех детей родителя: длина ключа ~log(число детей)
+    const QString targetLastKey = lastChildOrderKey(targetParentId);
+    QHash<QString, QStringList> pendingKeys;
+    QHash<QString, qint64> idMap;  // id клиента -> id в БД
+    idMap.reserve(childCounts.size());
+
+    int inserted = 0;
+    int inChunk = 0;
+    lineNumber = 0;
+    auto fail = [&](const QString &error) {
+        m_lastError = QString("Line %1: %2").arg(lineNumber).arg(error);
+        if (inChunk > 0) db.rollback();
+        return -1;
+    };
+
+    while (!device.atEnd()) {
+        const QByteArray line = device.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty()) continue;
+
+        QJsonObject object;
+        QString error;
+        if (!readNodeLine(line, object, error)) {
+            return fail(error);  // файл изменился между проходами
+        }
+
+        const QString parent = clientId(object.value("parent"));
+        const auto mapped = idMap.constFind(parent);
+        const QString parentKey = mapped != idMap.constEnd() ? parent : QString();
+        const qint64 parentId = mapped != idMap.constEnd() ? mapped.value() : targetParentId;
+
+        auto keys = pendingKeys.find(parentKey);
+        if (keys == pendingKeys.end()) {
+            keys = pendingKeys.insert(parentKey, OrderKey::sequence(
+                parentKey.isEmpty() ? targetLastKey : QString(), QString(), childCounts.value(parentKey)));
+        }
+        if (keys->isEmpty()) {
+            return fail("file changed during import");
+        }
+        const QString orderKey = keys->takeFirst();
+        if (keys->isEmpty()) pendingKeys.erase(keys);
+
+        if (inChunk == 0 && !db.transaction()) {
+            return fail(db.lastError().text());
+        }
+        insert.addBindValue(object.value("name").toString());
+        insert.addBindValue(parentId);
+        insert.addBindValue(orderKey);
+        if (!insert.exec()) {
+            return fail(insert.lastError().text());
+        }
+        idMap.insert(clientId(object.value("id")), insert.lastInsertId().toLongLong());
+        ++inserted;
+
+        if (++inChunk >= ChunkSize) {
+            if (!db.commit()) {
+                return fail(db.lastError().text());
+            }
+            inChunk = 0;
+        }
+    }
+
+    if (inChunk > 0 && !db.commit()) {
+        return fail(db.lastError().text());
+    }
+    return inserted;
+}
+
+int TreeTransfer::exportJsonLines(QIODevice &device, qint64 rootId)
+{
+    m_lastError.clear();
+
+    // Ключ сортировки - цепочка (order_key, id) от корня: разделители char(1)/char(2)
+    // меньше любых символов ключа, поэтому ORDER BY дает обход в глубину в порядке братьев
+    const QString rootCondition = rootId == 0 ? "parent_id IS NULL OR parent_id = 0" : "id = ?";
+    auto step = [](const QString &alias) {
+        return "char(1) || COALESCE(" + alias + "order_key, '') || char(2) || printf('%020d', " + alias + "id)";
+    };
+    const QString queryStr = QString(
+        "WITH RECURSIVE subtree(id, parent_id, name, sort_path) AS ("
+        "SELECT id, parent_id, name, %3 FROM %1 WHERE %2 "
+        "UNION ALL "
+        "SELECT c.id, c.parent_id, c.name, s.sort_path || %4 "
+        "FROM %1 c JOIN subtree s ON c.parent_id = s.id"
+        ") "
+        "SELECT id, parent_id, name FROM subtree ORDER BY sort_path")
+        .arg(m_tableName, rootCondition, step(QString()), step("c."));
+
+    int exported = 0;
+    bool writeFailed = false;
+    const DataReader reader(m_connectionName);
+    const QVariantList bindValues = rootId != 0 ? QVariantList{rootId} : QVariantList();
+    const int processed = reader.forEachRecord(queryStr, bindValues, [&](const QSqlRecord &record) {
+        const qint64 id = record.value(0).toLongLong();
+        QJsonObject object;
+        object.insert("id", id);
+        // Корень выгрузки при импорте прикрепится к целевому узлу
+        object.insert("parent", id == rootId ? 0 : record.value(1).toLongLong());
+        object.insert("name", record.value(2).toString());
+        const QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+        if (device.write(line) != line.size()) {
+            writeFailed = true;
+            return false;
+        }
+        ++exported;
+        return true;
+    });
+    if (processed < 0) {
+        m_lastError = reader.getLastError();
+        return -1;
+    }
+    if (writeFailed) {
+        m_lastError = device.errorString();
+        return -1;
+    }
+    return exported;
+}
@@ -0,0 +1,103 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <QFileInfo>
+#include <memory>
+#include "DBManager.h"
+#include "TableInteract.h"
+
+// Лист проходит весь путь приложения: создание в sheets, открытие в TableInteract,
+// правка через представление, фоновое сохранение (Ctrl+S) и повторное открытие;
+// несохраненные правки восстанавливаются из журнала листа
+class SheetRoundTripTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void savedSheetReopens();
+    void unsavedEditsRecover();
+
+private:
+    QTemporaryDir m_dir;
+    std::unique_ptr<DatabaseManager> m_db;
+};
+
+void SheetRoundTripTest::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+    // Таблицы листов создаются только для соединения по умолчанию
+    m_db = std::make_unique<DatabaseManager>(DEFAULT_CONNECTION_NAME, m_dir.filePath("sheets.db"));
+}
+
+void SheetRoundTripTest::cleanupTestCase()
+{
+    m_db.reset();
+}
+
+void SheetRoundTripTest::savedSheetReopens()
+{
+    const qint64 sheetId = TableInteract::createSheet(m_db.get(), "Тест");
+    QVERIFY(sheetId >= 0);
+
+    {
+        MainTable view;
+        TableInteract interact(&view);
+        QVERIFY(interact.openSheet(m_db.get(), sheetId));
+        QAbstractItemModel *model = view.model();
+        QCOMPARE(model->data(model->index(0, 0)).toString(), QString("Test1"));
+        QVERIFY(model->setData(model->index(2, 0), "saved"));
+
+        QSignalSpy saved(&interact, &TableInteract::sheetSaved);
+        QVERIFY(interact.saveSheet());
+        QTRY_COMPARE_WITH_TIMEOUT(saved.count(), 1, 10000);
+        QVERIFY(saved.first().first().toBool());
+    }
+
+    MainTable view;
+    TableInteract interact(&view);
+    QVERIFY(interact.openSheet(m_db.get(), sheetId));
+    QAbstractItemModel *model = view.model();
+    QCOMPARE(model->columnCount(), 3);
+    QCOMPARE(model->rowCount(), 3);
+    QCOMPARE(model->headerData(0, Qt::Horizontal).toString(), QString("Header1"));
+    QCOMPARE(model->data(model->index(0, 0)).toString(), QString("Test1"));
+    QCOMPARE(model->data(model->index(2, 2)).toString(), QString("Test5"));
+    QCOMPARE(model->data(model->index(2, 0)).toString(), QString("saved"));
+}
+
+void SheetRoundTripTest::unsavedEditsRecover()
+{
+    const qint64 sheetId = TableInteract::createSheet(m_db.get(), "Без сохранения");
+    QVERIFY(sheetId >= 0);
+
+    // Сеанс закрывается без сохранения - в БД лист остается пустым
+    {
+        MainTable view;
+        TableInteract interact(&view);
+        QVERIFY(interact.openSheet(m_db.get(), sheetId));
+        QAbstractItemModel *model = view.model();
+        QVERIFY(model->setData(model->index(1, 2), "unsaved"));
+    }
+    QVERIFY(QFile::exists(m_dir.filePath(QString("sheet_%1.journal").arg(sheetId))));
+
+    MainTable view;
+    TableInteract interact(&view);
+    QVERIFY(interact.openSheet(m_db.get(), sheetId));
+    QAbstractItemModel *model = view.model();
+    QCOMPARE(model->columnCount(), 3);
+    QCOMPARE(model->rowCount(), 3);
+    QCOMPARE(model->data(model->index(0, 0)).toString(), QString("Test1"));
+    QCOMPARE(model->data(model->index(1, 2)).toString(), QString("unsaved"));
+
+    // После сохранения в журнале остается только заголовок (16 байт)
+    QSignalSpy saved(&interact, &TableInteract::sheetSaved);
+    QVERIFY(interact.saveSheet());
+    QTRY_COMPARE_WITH_TIMEOUT(saved.count(), 1, 10000);
+    QVERIFY(saved.first().first().toBool());
+    QCOMPARE(QFileInfo(m_dir.filePath(QString("sheet_%1.journal").arg(sheetId))).size(), qint64(16));
+}
+
+QTEST_MAIN(SheetRoundTripTest)
+#include "SheetRoundTripTest.moc"